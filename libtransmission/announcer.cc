@@ -993,6 +993,7 @@ void tr_announcer_impl::onAnnounceDone(
     tier->lastAnnounceSucceeded = false;
     tier->isAnnouncing = false;
     tier->manualAnnounceAllowedAt = now + tier->announceMinIntervalSec;
+    tier->tor->bump_change_version(tr_torrent::ChangeGroup::Activity);
 
     if (response.external_ip)
     {
@@ -1331,6 +1332,7 @@ void tr_announcer_impl::onScrapeDone(tr_scrape_response const& response)
 
         tier->isScraping = false;
         tier->lastScrapeTime = now;
+        tier->tor->bump_change_version(tr_torrent::ChangeGroup::Activity);
         tier->lastScrapeSucceeded = false;
         tier->lastScrapeTimedOut = response.did_timeout;
 
@@ -1430,6 +1432,7 @@ void multiscrape(tr_announcer_impl* announcer, std::vector<tr_tier*> const& tier
             ++req->info_hash_count;
             tier->isScraping = true;
             tier->lastScrapeStartTime = now;
+            tier->tor->bump_change_version(tr_torrent::ChangeGroup::Activity);
             found = true;
         }
 
@@ -1444,6 +1447,7 @@ void multiscrape(tr_announcer_impl* announcer, std::vector<tr_tier*> const& tier
             ++req->info_hash_count;
             tier->isScraping = true;
             tier->lastScrapeStartTime = now;
+            tier->tor->bump_change_version(tr_torrent::ChangeGroup::Activity);
 
             ++request_count;
         }
@@ -1522,6 +1526,7 @@ void tierAnnounce(tr_announcer_impl* announcer, tr_tier* tier)
 
     tier->isAnnouncing = true;
     tier->lastAnnounceStartTime = now;
+    tor->bump_change_version(tr_torrent::ChangeGroup::Activity);
 
     auto tier_id = tier->id;
     auto is_running_on_success = tor->is_running();
@@ -4,7 +4,9 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <array>
 #include <initializer_list>
+#include <memory>
 #include <utility> // for std::swap()
 #include <vector>
 
@@ -15,7 +17,6 @@
 #include "libtransmission/bandwidth.h"
 #include "libtransmission/crypto-utils.h"
 #include "libtransmission/log.h"
-#include "libtransmission/peer-io.h"
 #include "libtransmission/tr-assert.h"
 #include "libtransmission/utils.h" // tr_time_msec()
 
@@ -104,6 +105,8 @@ void tr_bandwidth::deparent() noexcept
 {
     using namespace deparent_helpers;
 
+    dequeue();
+
     if (parent_ == nullptr)
     {
         return;
@@ -117,6 +120,19 @@ void tr_bandwidth::set_parent(tr_bandwidth* new_parent)
 {
     TR_ASSERT(this != new_parent);
 
+    // deparent() empties our queue if we're a root, and takes us out of
+    // our root's queue if we're waiting, so make a note of who was in line
+    auto in_line = std::array<std::vector<tr_bandwidth*>, 2>{};
+    for (auto const dir : { TR_UP, TR_DOWN })
+    {
+        in_line[dir] = band_[dir].waiting_;
+
+        if (auto* const root = band_[dir].waiting_at_; root != nullptr && root != this)
+        {
+            in_line[dir].push_back(this);
+        }
+    }
+
     deparent();
 
     if (new_parent != nullptr)
@@ -130,68 +146,183 @@ void tr_bandwidth::set_parent(tr_bandwidth* new_parent)
         new_parent->children_.push_back(this);
         this->parent_ = new_parent;
     }
+
+    // get back in line, but in the new tree's queue
+    for (auto const dir : { TR_UP, TR_DOWN })
+    {
+        for (auto* const waiting : in_line[dir])
+        {
+            waiting->enqueue(dir);
+        }
+    }
 }
 
 // ---
 
-void tr_bandwidth::allocate_bandwidth(
-    tr_priority_t parent_priority,
-    unsigned int period_msec,
-    std::vector<std::shared_ptr<tr_peerIo>>& peer_pool)
+void tr_bandwidth::enqueue(tr_direction dir)
+{
+    TR_ASSERT(tr_isDirection(dir));
+    TR_ASSERT(band_[dir].waiting_at_ == nullptr);
+
+    auto* root = this;
+    while (root->parent_ != nullptr)
+    {
+        root = root->parent_;
+    }
+
+    root->band_[dir].waiting_.push_back(this);
+    band_[dir].waiting_at_ = root;
+}
+
+void tr_bandwidth::dequeue() noexcept
 {
-    auto const priority = std::max(parent_priority, this->priority_);
+    using namespace deparent_helpers;
 
-    // set the available bandwidth
     for (auto const dir : { TR_UP, TR_DOWN })
     {
-        if (auto& bandwidth = band_[dir]; bandwidth.is_limited_)
+        auto& band = band_[dir];
+
+        // leave the queue that we're waiting in...
+        if (band.waiting_at_ != nullptr)
         {
-            auto const next_pulse_speed = bandwidth.desired_speed_bps_;
-            bandwidth.bytes_left_ = next_pulse_speed * period_msec / 1000U;
+            remove_child(band.waiting_at_->band_[dir].waiting_, this);
+            band.waiting_at_ = nullptr;
         }
+
+        // ...and if this is a root, empty its queue
+        for (auto* const waiting : band.waiting_)
+        {
+            waiting->band_[dir].waiting_at_ = nullptr;
+        }
+
+        band.waiting_.clear();
     }
+}
+
+// ---
 
-    // add this bandwidth's peer, if any, to the peer pool
-    if (auto shared = this->peer_.lock(); shared)
+void tr_bandwidth::allocate(tr_direction dir, uint64_t now)
+{
+    // Value of 3000 bytes chosen so that when using µTP we'll send a full-size
+    // frame right away and leave enough buffered data for the next frame to go
+    // out in a timely manner.
+    static auto constexpr Increment = size_t{ 3000 };
+
+    // How many `Increment`s a peer gets per round. A busy high priority peer
+    // gets three times the bandwidth of a busy low priority one, but nobody starves.
+    static auto constexpr quantum = [](tr_priority_t priority)
     {
-        shared->set_priority(priority);
-        peer_pool.push_back(std::move(shared));
+        switch (priority)
+        {
+        case TR_PRI_HIGH:
+            return 3U;
+
+        case TR_PRI_NORMAL:
+            return 2U;
+
+        default:
+            return 1U;
+        }
+    };
+
+    auto waiting = std::vector<tr_bandwidth*>{};
+    std::swap(waiting, band_[dir].waiting_);
+
+    // keep these peers alive for the scope of this function
+    auto refs = std::vector<std::pair<tr_bandwidth*, std::shared_ptr<Peer>>>{};
+    refs.reserve(std::size(waiting));
+
+    // the peers to go round-robin, and how many turns they get per round
+    auto peers = std::vector<std::pair<Peer*, unsigned int>>{};
+    peers.reserve(std::size(waiting));
+
+    for (auto* const leaf : waiting)
+    {
+        leaf->band_[dir].waiting_at_ = nullptr;
+
+        // A leaf's priority is the highest one in its path to the root.
+        // Top up the buckets on that path while we're here: nobody else
+        // is waiting for the other ones, so they can wait to be refilled.
+        auto priority = tr_priority_t{ TR_PRI_LOW };
+        auto* root = leaf;
+        for (;;)
+        {
+            priority = std::max(priority, root->priority_);
+
+            if (auto& band = root->band_[dir]; band.is_limited_)
+            {
+                band.refill(now);
+            }
+
+            if (root->parent_ == nullptr)
+            {
+                break;
+            }
+
+            root = root->parent_;
+        }
+
+        // this leaf's subtree was moved to another tree after it got in line
+        if (root != this)
+        {
+            leaf->enqueue(dir);
+            continue;
+        }
+
+        auto shared = leaf->peer_.lock();
+        if (!shared)
+        {
+            continue;
+        }
+
+        peers.emplace_back(shared.get(), quantum(priority));
+        refs.emplace_back(leaf, std::move(shared));
     }
 
-    // traverse & repeat for the subtree
-    for (auto* child : this->children_)
+    tr_logAddTrace(fmt::format(
+        "{} of {} peers to go round-robin for {}",
+        std::size(refs),
+        std::size(waiting),
+        dir == TR_UP ? "upload" : "download"));
+
+    if (dir == TR_UP)
     {
-        child->allocate_bandwidth(priority, period_msec, peer_pool);
+        for (auto const& [leaf, peer] : refs)
+        {
+            peer->flush_outgoing_protocol_msgs();
+        }
     }
-}
 
-void tr_bandwidth::phase_one(std::vector<tr_peerIo*>& peers, tr_direction dir)
-{
     // First phase of IO. Tries to distribute bandwidth fairly to keep faster
-    // peers from starving the others.
-    tr_logAddTrace(fmt::format("{} peers to go round-robin for {}", peers.size(), dir == TR_UP ? "upload" : "download"));
-
-    // Shuffle the peers so they all have equal chance to be first in line.
+    // peers from starving the others. This is deficit round-robin where every
+    // turn costs `Increment`: each round, every peer gets its priority's quantum
+    // of turns and is given `Increment` bytes per turn. A peer that uses less
+    // than that is done for now and leaves the rotation. Keep going until we
+    // run out of bandwidth and/or peers that can use it.
+    //
+    // The priorities share one rotation so that when the bandwidth runs out
+    // partway through a round, it's a matter of luck and not of priority
+    // who missed their turn. Shuffle the peers to give them equal chances.
     thread_local auto urbg = tr_urbg<size_t>{};
     std::shuffle(std::begin(peers), std::end(peers), urbg);
 
-    // Give each peer `Increment` bandwidth bytes to use. Repeat this
-    // process until we run out of bandwidth and/or peers that can use it.
     for (size_t n_unfinished = std::size(peers); n_unfinished > 0U;)
     {
         for (size_t i = 0; i < n_unfinished;)
         {
-            // Value of 3000 bytes chosen so that when using µTP we'll send a full-size
-            // frame right away and leave enough buffered data for the next frame to go
-            // out in a timely manner.
-            static auto constexpr Increment = size_t{ 3000 };
+            auto const [peer, n_turns] = peers[i];
+            auto is_done = false;
 
-            auto const bytes_used = peers[i]->flush(dir, Increment);
-            tr_logAddTrace(fmt::format("peer #{} of {} used {} bytes in this pass", i, n_unfinished, bytes_used));
+            for (unsigned int turn = 0; turn < n_turns && !is_done; ++turn)
+            {
+                auto const bytes_used = peer->flush(dir, Increment);
+                tr_logAddTrace(fmt::format("peer #{} of {} used {} bytes in this pass", i, n_unfinished, bytes_used));
+                is_done = bytes_used != Increment;
+            }
 
-            if (bytes_used != Increment)
+            if (is_done)
             {
-                // peer is done writing for now; move it to the end of the list
+                // peer is done for now; move it to the end of the list
                 std::swap(peers[i], peers[n_unfinished - 1]);
                 --n_unfinished;
             }
@@ -201,61 +332,32 @@ void tr_bandwidth::phase_one(std::vector<tr_peerIo*>& peers, tr_direction dir)
             }
         }
     }
-}
 
-void tr_bandwidth::allocate(unsigned int period_msec)
-{
-    // keep these peers alive for the scope of this function
-    auto refs = std::vector<std::shared_ptr<tr_peerIo>>{};
-
-    auto peer_arrays = std::array<std::vector<tr_peerIo*>, 3>{};
-    auto& high = peer_arrays[0];
-    auto& normal = peer_arrays[1];
-    auto& low = peer_arrays[2];
-
-    // allocateBandwidth () is a helper function with two purposes:
-    // 1. allocate bandwidth to b and its subtree
-    // 2. accumulate an array of all the peerIos from b and its subtree.
-    this->allocate_bandwidth(TR_PRI_LOW, period_msec, refs);
-
-    for (auto const& io : refs)
+    // Second phase of IO. To help us scale in high bandwidth situations,
+    // enable on-demand IO for peers with bandwidth left to burn.
+    // This on-demand IO is enabled until the peer runs out of bandwidth.
+    // The peers that already have get back in line for the next allocate().
+    for (auto const& [leaf, peer] : refs)
     {
-        io->flush_outgoing_protocol_msgs();
+        auto const has_bandwidth_left = peer->has_bandwidth_left(dir);
+        peer->set_enabled(dir, has_bandwidth_left);
 
-        switch (io->priority())
+        if (!has_bandwidth_left)
         {
-        case TR_PRI_HIGH:
-            high.push_back(io.get());
-            [[fallthrough]];
-
-        case TR_PRI_NORMAL:
-            normal.push_back(io.get());
-            [[fallthrough]];
-
-        default:
-            low.push_back(io.get());
+            leaf->notify_bandwidth_wanted(dir);
         }
     }
+}
 
-    // First phase of IO. Tries to distribute bandwidth fairly to keep faster
-    // peers from starving the others. Loop through the peers, giving each a
-    // small chunk of bandwidth. Keep looping until we run out of bandwidth
-    // and/or peers that can use it
-    for (auto& peers : peer_arrays)
+void tr_bandwidth::allocate(uint64_t now)
+{
+    if (now == 0)
     {
-        phase_one(peers, TR_UP);
-        phase_one(peers, TR_DOWN);
+        now = tr_time_msec();
     }
 
-    // Second phase of IO. To help us scale in high bandwidth situations,
-    // enable on-demand IO for peers with bandwidth left to burn.
-    // This on-demand IO is enabled until (1) the peer runs out of bandwidth,
-    // or (2) the next tr_bandwidth::allocate () call, when we start over again.
-    for (auto const& io : refs)
-    {
-        io->set_enabled(TR_UP, io->has_bandwidth_left(TR_UP));
-        io->set_enabled(TR_DOWN, io->has_bandwidth_left(TR_DOWN));
-    }
+    allocate(TR_UP, now);
+    allocate(TR_DOWN, now);
 }
 
 // ---
@@ -264,9 +366,9 @@ size_t tr_bandwidth::clamp(uint64_t now, tr_direction dir, size_t byte_count) co
 {
     TR_ASSERT(tr_isDirection(dir));
 
-    if (this->band_[dir].is_limited_)
+    if (auto const& band = this->band_[dir]; band.is_limited_)
     {
-        byte_count = std::min(byte_count, this->band_[dir].bytes_left_);
+        byte_count = std::min(byte_count, static_cast<size_t>(band.milli_bytes_left_ / 1000U));
 
         /* if we're getting close to exceeding the speed limit,
          * clamp down harder on the bytes available */
@@ -277,8 +379,8 @@ size_t tr_bandwidth::clamp(uint64_t now, tr_direction dir, size_t byte_count) co
                 now = tr_time_msec();
             }
 
-            auto const current = this->get_raw_speed_bytes_per_second(now, TR_DOWN);
-            auto const desired = this->get_desired_speed_bytes_per_second(TR_DOWN);
+            auto const current = this->get_raw_speed_bytes_per_second(now, dir);
+            auto const desired = this->get_desired_speed_bytes_per_second(dir);
             auto const r = desired >= 1 ? static_cast<double>(current) / desired : 0.0;
 
             if (r > 1.0)
@@ -304,6 +406,19 @@ size_t tr_bandwidth::clamp(uint64_t now, tr_direction dir, size_t byte_count) co
     return byte_count;
 }
 
+void tr_bandwidth::Band::refill(uint64_t now) noexcept
+{
+    // Refills are lazy, so make up for all the time since the last one.
+    // This is capped at `BucketMSec` so that an idle band can't save up a burst.
+    // A fresh band has `refilled_at_msec_ == 0`, so it starts out full.
+    // Note that bytes per second times milliseconds is milli-bytes.
+    auto const elapsed_msec = now > refilled_at_msec_ ? now - refilled_at_msec_ : 0U;
+    auto const capacity = uint64_t{ desired_speed_bps_ } * BucketMSec;
+    auto const refill = uint64_t{ desired_speed_bps_ } * std::min(elapsed_msec, BucketMSec);
+    milli_bytes_left_ = std::min(capacity, milli_bytes_left_ + refill);
+    refilled_at_msec_ = std::max(refilled_at_msec_, now);
+}
+
 void tr_bandwidth::notify_bandwidth_consumed(tr_direction dir, size_t byte_count, bool is_piece_data, uint64_t now)
 {
     TR_ASSERT(tr_isDirection(dir));
@@ -312,7 +427,8 @@ void tr_bandwidth::notify_bandwidth_consumed(tr_direction dir, size_t byte_count
 
     if (band->is_limited_ && is_piece_data)
     {
-        band->bytes_left_ -= std::min(size_t{ band->bytes_left_ }, byte_count);
+        auto const milli_bytes = uint64_t{ byte_count } * 1000U;
+        band->milli_bytes_left_ -= std::min(band->milli_bytes_left_, milli_bytes);
     }
 
 #ifdef DEBUG_DIRECTION
@@ -20,8 +20,6 @@
 
 #include "tr-assert.h"
 
-class tr_peerIo;
-
 /**
  * @addtogroup networked_io Networked IO
  * @{
@@ -62,17 +60,21 @@ struct tr_bandwidth_limits
  *
  * CONSTRAINING
  *
- *   Call `tr_bandwidth::allocate()` periodically. `tr_bandwidth` knows its current
- *   speed and will decide how many bytes to make available over the
- *   user-specified period to reach the user-specified desired speed.
- *   If appropriate, it notifies its peer-ios that new bandwidth is available.
- *
- *   `tr_bandwidth::allocate()` operates on the `tr_bandwidth` subtree, so usually
- *   you'll only need to invoke it for the top-level `tr_session` bandwidth.
+ *   Each limited `tr_bandwidth` is a token bucket that fills at the desired
+ *   speed and holds at most `BucketMSec` worth of it. Peer-ios call
+ *   `tr_bandwidth::clamp()` before performing I/O to see how much bandwidth
+ *   they can safely use, which is the least that's left in any bucket between
+ *   them and the top of the tree.
  *
- *   The peer-ios all have a pointer to their associated `tr_bandwidth` object,
- *   and call `tr_bandwidth::clamp()` before performing I/O to see how much
- *   bandwidth they can safely use.
+ *   A peer-io that has data to send, or that has run out of bandwidth, calls
+ *   `tr_bandwidth::notify_bandwidth_wanted()` to wait in the tree's queue.
+ *   Call `tr_bandwidth::allocate()` on the top-level `tr_session` bandwidth
+ *   periodically to top up the buckets above the waiting peers and share
+ *   the bandwidth among those peers with deficit round-robin across
+ *   priorities. Only waiting peers are visited, so a pulse costs time in
+ *   proportion to the number of busy peers, not to the number of connected
+ *   ones. Whatever is left over is spent by the peer-ios' on-demand I/O
+ *   until the next pulse.
  */
 struct tr_bandwidth
 {
@@ -82,7 +84,33 @@ private:
     static constexpr size_t GranularityMSec = 250;
     static constexpr size_t HistorySize = (IntervalMSec / GranularityMSec);
 
+    // How much of its speed limit a limited bandwidth can save up.
+    // This matches the bandwidth pulse, so a peer that waits for one
+    // `allocate()` gets at most one period's worth of bandwidth.
+    static constexpr uint64_t BucketMSec = 500U;
+
 public:
+    /**
+     * The peer-io that a leaf `tr_bandwidth` hands out bandwidth to.
+     * This is `tr_peerIo` in the wild; tests and benchmarks use fakes.
+     */
+    class Peer
+    {
+    public:
+        virtual ~Peer() = default;
+
+        // Transfer up to `byte_limit` bytes. Returns the number of bytes transferred.
+        virtual size_t flush(tr_direction dir, size_t byte_limit) = 0;
+
+        // Send the non-piece-data messages at the front of the outbound queue.
+        virtual size_t flush_outgoing_protocol_msgs() = 0;
+
+        // Enable or disable on-demand I/O until the next `tr_bandwidth::allocate()`.
+        virtual void set_enabled(tr_direction dir, bool is_enabled) = 0;
+
+        [[nodiscard]] virtual bool has_bandwidth_left(tr_direction dir) const noexcept = 0;
+    };
+
     explicit tr_bandwidth(tr_bandwidth* newParent);
 
     tr_bandwidth()
@@ -101,7 +129,7 @@ public:
     tr_bandwidth(tr_bandwidth&) = delete;
 
     // @brief Sets the peer. nullptr is allowed.
-    void set_peer(std::weak_ptr<tr_peerIo> peer) noexcept
+    void set_peer(std::weak_ptr<Peer> peer) noexcept
     {
         this->peer_ = std::move(peer);
     }
@@ -113,9 +141,22 @@ public:
     void notify_bandwidth_consumed(tr_direction dir, size_t byte_count, bool is_piece_data, uint64_t now);
 
     /**
-     * @brief allocate the next `period_msec`'s worth of bandwidth for the peer-ios to consume
+     * @brief Ask to be given bandwidth in the next `allocate()`.
+     * This is invoked by the peer-io when it has data to send,
+     * or when it wanted to transfer more than `clamp()` allowed.
      */
-    void allocate(unsigned int period_msec);
+    void notify_bandwidth_wanted(tr_direction dir)
+    {
+        if (band_[dir].waiting_at_ == nullptr)
+        {
+            enqueue(dir);
+        }
+    }
+
+    /**
+     * @brief Share the bandwidth available at `now` among the peers waiting in this subtree.
+     */
+    void allocate(uint64_t now);
 
     void set_parent(tr_bandwidth* new_parent);
 
@@ -137,6 +178,11 @@ public:
         return this->clamp(0, dir, byte_count);
     }
 
+    /**
+     * @brief clamps `byte_count` down to a number that this bandwidth will allow to be consumed at `now`
+     */
+    [[nodiscard]] size_t clamp(uint64_t now, tr_direction dir, size_t byte_count) const;
+
     /** @brief Get the raw total of bytes read or sent by this bandwidth subtree. */
     [[nodiscard]] auto get_raw_speed_bytes_per_second(uint64_t const now, tr_direction const dir) const
     {
@@ -243,9 +289,22 @@ private:
 
     struct Band
     {
+        // buckets are only refilled in `allocate()`, and only when a peer needs them
+        void refill(uint64_t now) noexcept;
+
         RateControl raw_;
         RateControl piece_;
-        size_t bytes_left_;
+
+        // the leaves that are waiting for `allocate()`. Only used by the root.
+        std::vector<tr_bandwidth*> waiting_;
+
+        // the root whose `waiting_` this leaf is in, if any
+        tr_bandwidth* waiting_at_ = nullptr;
+
+        // the token bucket, in thousandths of a byte so that refills don't lose bytes to rounding
+        uint64_t milli_bytes_left_;
+        uint64_t refilled_at_msec_;
+
         tr_bytes_per_second_t desired_speed_bps_;
         bool is_limited_ = false;
         bool honor_parent_limits_ = true;
@@ -260,21 +319,18 @@ private:
 
     void deparent() noexcept;
 
-    static void notify_bandwidth_consumed_bytes(uint64_t now, RateControl* r, size_t size);
+    void enqueue(tr_direction dir);
 
-    [[nodiscard]] size_t clamp(uint64_t now, tr_direction dir, size_t byte_count) const;
+    void dequeue() noexcept;
 
-    static void phase_one(std::vector<tr_peerIo*>& peers, tr_direction dir);
+    void allocate(tr_direction dir, uint64_t now);
 
-    void allocate_bandwidth(
-        tr_priority_t parent_priority,
-        unsigned int period_msec,
-        std::vector<std::shared_ptr<tr_peerIo>>& peer_pool);
+    static void notify_bandwidth_consumed_bytes(uint64_t now, RateControl* r, size_t size);
 
     mutable std::array<Band, 2> band_ = {};
     std::vector<tr_bandwidth*> children_;
     tr_bandwidth* parent_ = nullptr;
-    std::weak_ptr<tr_peerIo> peer_;
+    std::weak_ptr<Peer> peer_;
     tr_priority_t priority_ = 0;
 };
 
@@ -3,9 +3,18 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
-#include <algorithm> // std::copy, std::fill_n, std::min, std::max
+#include <algorithm> // std::fill_n, std::min, std::max
+#include <cstdint> // uint64_t, SIZE_MAX
 #include <vector> // std::vector
 
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define TR_BITFIELD_X86_KERNELS
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define TR_BITFIELD_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
 #include "libtransmission/bitfield.h"
 #include "libtransmission/tr-assert.h" // TR_ASSERT, TR_ENABLE_ASSERTS
 #include "libtransmission/tr-popcount.h" // tr_popcnt
@@ -15,11 +24,14 @@
 namespace
 {
 
-[[nodiscard]] constexpr size_t getBytesNeeded(size_t bit_count) noexcept
+auto constexpr WordBits = size_t{ 64U };
+auto constexpr AllOnes = ~uint64_t{};
+
+[[nodiscard]] constexpr size_t getWordsNeeded(size_t bit_count) noexcept
 {
-    /* NB: If can guarantee bit_count <= SIZE_MAX - 8 then faster logic
-       is ((bit_count + 7) >> 3). */
-    return (bit_count >> 3) + ((bit_count & 7) != 0 ? 1 : 0);
+    /* NB: If can guarantee bit_count <= SIZE_MAX - 63 then faster logic
+       is ((bit_count + 63) >> 6). */
+    return (bit_count >> 6U) + ((bit_count & 63U) != 0 ? 1 : 0);
 }
 
 /* Used only in cases where it can be guaranteed bit_count <= SIZE_MAX - 8 */
@@ -28,167 +40,527 @@ namespace
     return ((bit_count + 7) >> 3);
 }
 
-void setAllTrue(uint8_t* array, size_t bit_count)
+// the bits [begin, end) of a word, where 0 <= begin < end <= 64
+[[nodiscard]] constexpr uint64_t spanMask(size_t begin, size_t end) noexcept
 {
-    uint8_t constexpr Val = 0xFF;
-    /* Only ever called internally with in-use bit counts. Impossible
-       for bitcount > SIZE_MAX - 8. */
-    size_t const n = getBytesNeededSafe(bit_count);
+    return (AllOnes >> begin) & (AllOnes << (WordBits - end));
+}
+
+void setAllTrue(uint64_t* words, size_t bit_count)
+{
+    /* Only ever called internally with in-use bit counts. */
+    size_t const n = getWordsNeeded(bit_count);
 
     if (n > 0)
     {
-        std::fill_n(array, n, Val);
-        /* -bit_count & 7U. Since bitcount is unsigned do ~bitcount +
-           1 to replace -bitcount as linters warn about negating
-           unsigned types. Any compiler will optimize ~x + 1 to -x in
-           the backend. */
-        uint32_t const shift = ((~bit_count) + 1) & 7U;
-        array[n - 1] = Val << shift;
+        std::fill_n(words, n, AllOnes);
+
+        if (auto const tail = bit_count & (WordBits - 1U); tail != 0U)
+        {
+            words[n - 1] = spanMask(0U, tail);
+        }
     }
 }
 
 /* Switch to std::popcount if project upgrades to c++20 or newer */
-[[nodiscard]] uint32_t doPopcount(uint8_t flags) noexcept
+[[nodiscard]] uint32_t doPopcount(uint64_t word) noexcept
 {
-    /* If flags are ever expanded to use machine words instead of
-       uint8_t popcnt64 is also available */
-    return tr_popcnt<uint8_t>::count(flags);
+    return tr_popcnt<uint64_t>::count(word);
 }
 
-[[nodiscard]] size_t rawCountFlags(uint8_t const* flags, size_t n) noexcept
+/* Switch to std::countl_zero if project upgrades to c++20 or newer */
+[[nodiscard]] size_t countLeadingZeroes(uint64_t word) noexcept
 {
+    TR_ASSERT(word != 0U);
+
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<size_t>(__builtin_clzll(word));
+#else
+    auto n = size_t{};
+    for (auto mask = uint64_t{ 1U } << (WordBits - 1U); (word & mask) == 0U; mask >>= 1U)
+    {
+        ++n;
+    }
+    return n;
+#endif
+}
+
+// --- Kernels
+//
+// Bulk operations on word arrays. `getKernels()` picks the fastest set
+// that the CPU supports the first time it's called.
+
+struct Kernels
+{
+    size_t (*popcount)(uint64_t const* words, size_t n);
+    void (*or_into)(uint64_t* dst, uint64_t const* src, size_t n);
+    void (*and_into)(uint64_t* dst, uint64_t const* src, size_t n);
+    void (*and_not_into)(uint64_t* dst, uint64_t const* src, size_t n);
+    bool (*intersects)(uint64_t const* a, uint64_t const* b, size_t n);
+};
+
+namespace scalar_kernels
+{
+size_t popcount(uint64_t const* words, size_t n)
+{
+    /* Use 2x accumulators to help alleviate high latency of
+       popcnt instruction on many architectures. */
     auto ret = size_t{};
+    auto tmp_accum = size_t{};
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        ret += doPopcount(words[i]);
+        tmp_accum += doPopcount(words[i + 1]);
+    }
+    if (i < n)
+    {
+        ret += doPopcount(words[i]);
+    }
+    return ret + tmp_accum;
+}
+
+void or_into(uint64_t* dst, uint64_t const* src, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        dst[i] |= src[i];
+    }
+}
 
-    for (auto const* const end = flags + n; flags != end; ++flags)
+void and_into(uint64_t* dst, uint64_t const* src, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
     {
-        ret += doPopcount(*flags);
+        dst[i] &= src[i];
+    }
+}
+
+void and_not_into(uint64_t* dst, uint64_t const* src, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        dst[i] &= ~src[i];
+    }
+}
+
+bool intersects(uint64_t const* a, uint64_t const* b, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        if ((a[i] & b[i]) != 0U)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+} // namespace scalar_kernels
+
+#if defined(TR_BITFIELD_X86_KERNELS)
+
+// SSE4.2-era CPUs: hardware POPCNT and SSE4.1's PTEST
+namespace sse42_kernels
+{
+__attribute__((target("popcnt"))) size_t popcount(uint64_t const* words, size_t n)
+{
+    auto ret = size_t{};
+    auto tmp_accum = size_t{};
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        ret += static_cast<size_t>(__builtin_popcountll(words[i]));
+        tmp_accum += static_cast<size_t>(__builtin_popcountll(words[i + 1]));
+    }
+    if (i < n)
+    {
+        ret += static_cast<size_t>(__builtin_popcountll(words[i]));
+    }
+    return ret + tmp_accum;
+}
+
+__attribute__((target("sse4.1"))) bool intersects(uint64_t const* a, uint64_t const* b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        auto const va = _mm_loadu_si128(reinterpret_cast<__m128i const*>(a + i));
+        auto const vb = _mm_loadu_si128(reinterpret_cast<__m128i const*>(b + i));
+        if (_mm_testz_si128(va, vb) == 0)
+        {
+            return true;
+        }
+    }
+
+    return scalar_kernels::intersects(a + i, b + i, n - i);
+}
+
+} // namespace sse42_kernels
+
+namespace avx2_kernels
+{
+auto constexpr WordsPerVector = size_t{ 4U };
+
+// Counts bits with a nibble lookup table and sums the bytes with SAD.
+// See Muła, Kurz, and Lemire, "Faster Population Counts Using AVX2 Instructions"
+__attribute__((target("avx2,popcnt"))) size_t popcount(uint64_t const* words, size_t n)
+{
+    // the number of bits set in each nibble 0x0..0xF, once for each 128-bit lane
+    auto const lookup = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, //
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    auto const low_mask = _mm256_set1_epi8(0x0f);
+    auto acc = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + WordsPerVector <= n; i += WordsPerVector)
+    {
+        auto const vec = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(words + i));
+        auto const lo = _mm256_and_si256(vec, low_mask);
+        auto const hi = _mm256_and_si256(_mm256_srli_epi16(vec, 4), low_mask);
+        auto const counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(counts, _mm256_setzero_si256()));
+    }
+
+    alignas(32) uint64_t lanes[WordsPerVector];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+    auto ret = static_cast<size_t>(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+
+    for (; i < n; ++i)
+    {
+        ret += static_cast<size_t>(__builtin_popcountll(words[i]));
     }
 
     return ret;
 }
 
+__attribute__((target("avx2"))) void or_into(uint64_t* dst, uint64_t const* src, size_t n)
+{
+    size_t i = 0;
+    for (; i + WordsPerVector <= n; i += WordsPerVector)
+    {
+        auto* const out = reinterpret_cast<__m256i*>(dst + i);
+        auto const in = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + i));
+        _mm256_storeu_si256(out, _mm256_or_si256(_mm256_loadu_si256(out), in));
+    }
+
+    scalar_kernels::or_into(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2"))) void and_into(uint64_t* dst, uint64_t const* src, size_t n)
+{
+    size_t i = 0;
+    for (; i + WordsPerVector <= n; i += WordsPerVector)
+    {
+        auto* const out = reinterpret_cast<__m256i*>(dst + i);
+        auto const in = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + i));
+        _mm256_storeu_si256(out, _mm256_and_si256(_mm256_loadu_si256(out), in));
+    }
+
+    scalar_kernels::and_into(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2"))) void and_not_into(uint64_t* dst, uint64_t const* src, size_t n)
+{
+    size_t i = 0;
+    for (; i + WordsPerVector <= n; i += WordsPerVector)
+    {
+        auto* const out = reinterpret_cast<__m256i*>(dst + i);
+        auto const in = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + i));
+        _mm256_storeu_si256(out, _mm256_andnot_si256(in, _mm256_loadu_si256(out)));
+    }
+
+    scalar_kernels::and_not_into(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2"))) bool intersects(uint64_t const* a, uint64_t const* b, size_t n)
+{
+    size_t i = 0;
+    for (; i + WordsPerVector <= n; i += WordsPerVector)
+    {
+        auto const va = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(a + i));
+        auto const vb = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(b + i));
+        if (_mm256_testz_si256(va, vb) == 0)
+        {
+            return true;
+        }
+    }
+
+    return scalar_kernels::intersects(a + i, b + i, n - i);
+}
+
+} // namespace avx2_kernels
+
+#elif defined(TR_BITFIELD_NEON_KERNELS)
+
+namespace neon_kernels
+{
+auto constexpr WordsPerVector = size_t{ 2U };
+
+size_t popcount(uint64_t const* words, size_t n)
+{
+    auto ret = size_t{};
+
+    size_t i = 0;
+    for (; i + WordsPerVector <= n; i += WordsPerVector)
+    {
+        auto const bytes = vreinterpretq_u8_u64(vld1q_u64(words + i));
+        ret += vaddlvq_u8(vcntq_u8(bytes));
+    }
+
+    return ret + scalar_kernels::popcount(words + i, n - i);
+}
+
+void or_into(uint64_t* dst, uint64_t const* src, size_t n)
+{
+    size_t i = 0;
+    for (; i + WordsPerVector <= n; i += WordsPerVector)
+    {
+        vst1q_u64(dst + i, vorrq_u64(vld1q_u64(dst + i), vld1q_u64(src + i)));
+    }
+
+    scalar_kernels::or_into(dst + i, src + i, n - i);
+}
+
+void and_into(uint64_t* dst, uint64_t const* src, size_t n)
+{
+    size_t i = 0;
+    for (; i + WordsPerVector <= n; i += WordsPerVector)
+    {
+        vst1q_u64(dst + i, vandq_u64(vld1q_u64(dst + i), vld1q_u64(src + i)));
+    }
+
+    scalar_kernels::and_into(dst + i, src + i, n - i);
+}
+
+void and_not_into(uint64_t* dst, uint64_t const* src, size_t n)
+{
+    size_t i = 0;
+    for (; i + WordsPerVector <= n; i += WordsPerVector)
+    {
+        vst1q_u64(dst + i, vbicq_u64(vld1q_u64(dst + i), vld1q_u64(src + i)));
+    }
+
+    scalar_kernels::and_not_into(dst + i, src + i, n - i);
+}
+
+bool intersects(uint64_t const* a, uint64_t const* b, size_t n)
+{
+    size_t i = 0;
+    for (; i + WordsPerVector <= n; i += WordsPerVector)
+    {
+        auto const both = vreinterpretq_u32_u64(vandq_u64(vld1q_u64(a + i), vld1q_u64(b + i)));
+        if (vmaxvq_u32(both) != 0U)
+        {
+            return true;
+        }
+    }
+
+    return scalar_kernels::intersects(a + i, b + i, n - i);
+}
+
+} // namespace neon_kernels
+
+#endif
+
+[[nodiscard]] Kernels pickKernels() noexcept
+{
+#if defined(TR_BITFIELD_X86_KERNELS)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+    {
+        return { avx2_kernels::popcount,
+                 avx2_kernels::or_into,
+                 avx2_kernels::and_into,
+                 avx2_kernels::and_not_into,
+                 avx2_kernels::intersects };
+    }
+
+    if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+    {
+        return { sse42_kernels::popcount,
+                 scalar_kernels::or_into,
+                 scalar_kernels::and_into,
+                 scalar_kernels::and_not_into,
+                 sse42_kernels::intersects };
+    }
+#elif defined(TR_BITFIELD_NEON_KERNELS)
+    return { neon_kernels::popcount,
+             neon_kernels::or_into,
+             neon_kernels::and_into,
+             neon_kernels::and_not_into,
+             neon_kernels::intersects };
+#endif
+
+    return { scalar_kernels::popcount,
+             scalar_kernels::or_into,
+             scalar_kernels::and_into,
+             scalar_kernels::and_not_into,
+             scalar_kernels::intersects };
+}
+
+[[nodiscard]] Kernels const& getKernels() noexcept
+{
+    static auto const kernels = pickKernels();
+    return kernels;
+}
+
 } // namespace
 
 // ---
 
 size_t tr_bitfield::count_flags() const noexcept
 {
-    return rawCountFlags(std::data(flags_), std::size(flags_));
+    return getKernels().popcount(std::data(words_), std::size(words_));
 }
 
 size_t tr_bitfield::count_flags(size_t begin, size_t end) const noexcept
 {
-    auto ret = size_t{};
-    size_t const first_byte = begin >> 3U;
-    size_t const last_byte = (end - 1) >> 3U;
-
-    if (bit_count_ == 0)
+    if (bit_count_ == 0 || begin >= end)
     {
         return 0;
     }
 
-    if (first_byte >= std::size(flags_))
+    size_t const first_word = begin / WordBits;
+    size_t const last_word = (end - 1) / WordBits;
+
+    if (first_word >= std::size(words_))
     {
         return 0;
     }
 
-    TR_ASSERT(begin < end);
-    TR_ASSERT(!std::empty(flags_));
+    size_t const first_bit = begin & (WordBits - 1U);
+    size_t const last_bit = ((end - 1) & (WordBits - 1U)) + 1U;
 
-    if (first_byte == last_byte)
+    if (first_word == last_word)
     {
-        uint8_t val = flags_[first_byte];
+        return doPopcount(words_[first_word] & spanMask(first_bit, last_bit));
+    }
+
+    /* first word */
+    auto ret = size_t{ doPopcount(words_[first_word] & spanMask(first_bit, WordBits)) };
 
-        auto i = begin & 7U;
-        val <<= i;
-        i = (begin - end) & 7U;
-        val >>= i;
-        ret = doPopcount(val);
+    /* middle words */
+    if (size_t const walk_end = std::min(std::size(words_), last_word); walk_end > first_word + 1)
+    {
+        ret += getKernels().popcount(std::data(words_) + first_word + 1, walk_end - (first_word + 1));
     }
-    else
+
+    /* last word */
+    if (last_word < std::size(words_))
+    {
+        ret += doPopcount(words_[last_word] & spanMask(0U, last_bit));
+    }
+
+    TR_ASSERT(ret <= (end - begin));
+    return ret;
+}
+
+size_t tr_bitfield::count(size_t begin, size_t end) const
+{
+    if (has_all())
+    {
+        return end - begin;
+    }
+
+    if (has_none())
     {
-        size_t const walk_end = std::min(std::size(flags_), last_byte);
+        return 0;
+    }
+
+    return count_flags(begin, end);
+}
 
-        /* first byte */
-        size_t const first_shift = begin & 7U;
-        uint8_t val = flags_[first_byte];
-        val <<= first_shift;
-        /* No need to shift back val for correct popcount. */
-        ret = doPopcount(val);
+size_t tr_bitfield::find_next_flag(size_t begin, bool value) const noexcept
+{
+    auto const n_words = getWordsNeeded(bit_count_);
+    auto const invert = value ? uint64_t{} : AllOnes;
 
-        /* middle bytes */
+    for (auto idx = begin / WordBits; idx < n_words; ++idx)
+    {
+        // bits that aren't allocated are unset
+        auto word = (idx < std::size(words_) ? words_[idx] : uint64_t{}) ^ invert;
 
-        /* Use 2x accumulators to help alleviate high latency of
-           popcnt instruction on many architectures. */
-        size_t tmp_accum = 0;
-        for (size_t i = first_byte + 1; i < walk_end;)
+        if (idx == begin / WordBits)
         {
-            tmp_accum += doPopcount(flags_[i]);
-            i += 2;
-            if (i > walk_end)
-            {
-                break;
-            }
-            ret += doPopcount(flags_[i - 1]);
+            word &= spanMask(begin & (WordBits - 1U), WordBits);
         }
-        ret += tmp_accum;
 
-        /* last byte */
-        if (last_byte < std::size(flags_))
+        if (word != 0U)
         {
-            /* -end & 7U. Since bitcount is unsigned do ~end + 1 to
-               replace -end as linters warn about negating unsigned
-               types. Any compiler will optimize ~x + 1 to -x in the
-               backend. */
-            uint32_t const last_shift = (~end + 1) & 7U;
-            val = flags_[last_byte];
-            val >>= last_shift;
-            /* No need to shift back val for correct popcount. */
-            ret += doPopcount(val);
+            return std::min(idx * WordBits + countLeadingZeroes(word), bit_count_);
         }
     }
 
-    TR_ASSERT(ret <= (begin - end));
-    return ret;
+    return bit_count_;
 }
 
-size_t tr_bitfield::count(size_t begin, size_t end) const
+size_t tr_bitfield::find_next_set(size_t begin) const noexcept
 {
+    if (begin >= bit_count_ || has_none())
+    {
+        return bit_count_;
+    }
+
     if (has_all())
     {
-        return end - begin;
+        return begin;
+    }
+
+    return find_next_flag(begin, true);
+}
+
+size_t tr_bitfield::find_next_unset(size_t begin) const noexcept
+{
+    if (begin >= bit_count_ || has_all())
+    {
+        return bit_count_;
     }
 
     if (has_none())
     {
-        return 0;
+        return begin;
     }
 
-    return count_flags(begin, end);
+    return find_next_flag(begin, false);
 }
 
 // ---
 
 bool tr_bitfield::is_valid() const
 {
-    return std::empty(flags_) || true_count_ == count_flags();
+    return std::empty(words_) || true_count_ == count_flags();
 }
 
 std::vector<uint8_t> tr_bitfield::raw() const
 {
     /* Impossible for bit_count_ to exceed SIZE_MAX - 8 */
-    auto const n = getBytesNeededSafe(bit_count_);
+    auto const n = bit_count_ != 0 ? getBytesNeededSafe(bit_count_) : std::size(words_) * sizeof(uint64_t);
+    auto raw = std::vector<uint8_t>(n);
 
-    if (!std::empty(flags_))
+    if (!std::empty(words_))
     {
-        return flags_;
+        for (size_t i = 0, n_bytes = std::min(n, std::size(words_) * sizeof(uint64_t)); i < n_bytes; ++i)
+        {
+            raw[i] = static_cast<uint8_t>(words_[i / sizeof(uint64_t)] >> (56U - 8U * (i % sizeof(uint64_t))));
+        }
     }
-
-    auto raw = std::vector<uint8_t>(n);
-
-    if (has_all())
+    else if (has_all())
     {
-        setAllTrue(std::data(raw), bit_count_);
+        std::fill_n(std::data(raw), n, 0xFF);
+
+        /* -bit_count & 7U. Since bitcount is unsigned do ~bitcount +
+           1 to replace -bitcount as linters warn about negating
+           unsigned types. Any compiler will optimize ~x + 1 to -x in
+           the backend. */
+        if (n > 0)
+        {
+            uint32_t const shift = ((~bit_count_) + 1) & 7U;
+            raw[n - 1] = 0xFF << shift;
+        }
     }
 
     return raw;
@@ -198,15 +570,15 @@ void tr_bitfield::ensure_bits_alloced(size_t n)
 {
     bool const has_all = this->has_all();
 
-    /* Can't use getBytesNeededSafe as n can be > SIZE_MAX - 8. */
-    size_t const bytes_needed = has_all ? getBytesNeeded(std::max(n, true_count_)) : getBytesNeeded(n);
+    /* Can't use a Safe variant as n can be > SIZE_MAX - 63. */
+    size_t const words_needed = has_all ? getWordsNeeded(std::max(n, true_count_)) : getWordsNeeded(n);
 
-    if (std::size(flags_) < bytes_needed)
+    if (std::size(words_) < words_needed)
     {
-        flags_.resize(bytes_needed);
+        words_.resize(words_needed);
         if (has_all)
         {
-            setAllTrue(std::data(flags_), true_count_);
+            setAllTrue(std::data(words_), true_count_);
         }
     }
 }
@@ -285,18 +657,21 @@ void tr_bitfield::set_has_all() noexcept
 
 void tr_bitfield::set_raw(uint8_t const* raw, size_t byte_count)
 {
-    flags_.assign(raw, raw + byte_count);
+    words_.assign((byte_count + sizeof(uint64_t) - 1U) / sizeof(uint64_t), uint64_t{});
+
+    for (size_t i = 0; i < byte_count; ++i)
+    {
+        words_[i / sizeof(uint64_t)] |= uint64_t{ raw[i] } << (56U - 8U * (i % sizeof(uint64_t)));
+    }
 
     // ensure any excess bits at the end of the array are set to '0'.
     if (byte_count == getBytesNeededSafe(bit_count_))
     {
-        auto const excess_bit_count = byte_count * 8 - bit_count_;
+        TR_ASSERT(byte_count * 8 - bit_count_ <= 7);
 
-        TR_ASSERT(excess_bit_count <= 7);
-
-        if (excess_bit_count != 0)
+        if (auto const tail = bit_count_ & (WordBits - 1U); tail != 0U)
         {
-            flags_.back() &= 0xff << excess_bit_count;
+            words_.back() &= spanMask(0U, tail);
         }
     }
 
@@ -315,7 +690,7 @@ void tr_bitfield::set_from_bools(bool const* flags, size_t n)
         if (flags[i])
         {
             ++true_count;
-            flags_[i >> 3U] |= (0x80 >> (i & 7U));
+            words_[i / WordBits] |= word_bit(i);
         }
     }
 
@@ -335,24 +710,24 @@ void tr_bitfield::set(size_t nth, bool value)
     }
 
     /* Already tested that val != nth bit so just swap */
-    auto& byte = flags_[nth >> 3U];
+    auto& word = words_[nth / WordBits];
 #ifdef TR_ENABLE_ASSERTS
-    auto const old_byte_pop = doPopcount(byte);
+    auto const old_word_pop = doPopcount(word);
 #endif
-    byte ^= 0x80 >> (nth & 7U);
+    word ^= word_bit(nth);
 #ifdef TR_ENABLE_ASSERTS
-    auto const new_byte_pop = doPopcount(byte);
+    auto const new_word_pop = doPopcount(word);
 #endif
 
     if (value)
     {
         ++true_count_;
-        TR_ASSERT(old_byte_pop + 1 == new_byte_pop);
+        TR_ASSERT(old_word_pop + 1 == new_word_pop);
     }
     else
     {
         --true_count_;
-        TR_ASSERT(new_byte_pop + 1 == old_byte_pop);
+        TR_ASSERT(new_word_pop + 1 == old_word_pop);
     }
     have_all_hint_ = true_count_ == bit_count_;
     have_none_hint_ = true_count_ == 0;
@@ -384,26 +759,26 @@ void tr_bitfield::set_span(size_t begin, size_t end, bool value)
         return;
     }
 
-    auto walk = begin >> 3;
-    auto const last_byte = end >> 3;
+    auto walk = begin / WordBits;
+    auto const last_word = end / WordBits;
 
-    unsigned char first_mask = 0xff >> (begin & 7U);
-    unsigned char last_mask = 0xff << ((~end) & 7U);
+    uint64_t first_mask = spanMask(begin & (WordBits - 1U), WordBits);
+    uint64_t last_mask = spanMask(0U, (end & (WordBits - 1U)) + 1U);
     if (value)
     {
-        if (walk == last_byte)
+        if (walk == last_word)
         {
-            flags_[walk] |= first_mask & last_mask;
+            words_[walk] |= first_mask & last_mask;
         }
         else
         {
-            flags_[walk] |= first_mask;
-            /* last_byte is expected to be hot in cache due to earlier
+            words_[walk] |= first_mask;
+            /* last_word is expected to be hot in cache due to earlier
                count(begin, end) */
-            flags_[last_byte] |= last_mask;
-            if (++walk < last_byte)
+            words_[last_word] |= last_mask;
+            if (++walk < last_word)
             {
-                std::fill_n(std::data(flags_) + walk, last_byte - walk, 0xff);
+                std::fill_n(std::data(words_) + walk, last_word - walk, AllOnes);
             }
         }
 
@@ -413,19 +788,19 @@ void tr_bitfield::set_span(size_t begin, size_t end, bool value)
     {
         first_mask = ~first_mask;
         last_mask = ~last_mask;
-        if (walk == last_byte)
+        if (walk == last_word)
         {
-            flags_[walk] &= first_mask | last_mask;
+            words_[walk] &= first_mask | last_mask;
         }
         else
         {
-            flags_[walk] &= first_mask;
-            /* last_byte is expected to be hot in cache due to earlier
+            words_[walk] &= first_mask;
+            /* last_word is expected to be hot in cache due to earlier
                count(begin, end) */
-            flags_[last_byte] &= last_mask;
-            if (++walk < last_byte)
+            words_[last_word] &= last_mask;
+            if (++walk < last_word)
             {
-                std::fill_n(std::data(flags_) + walk, last_byte - walk, 0);
+                std::fill_n(std::data(words_) + walk, last_word - walk, uint64_t{});
             }
         }
 
@@ -446,12 +821,8 @@ tr_bitfield& tr_bitfield::operator|=(tr_bitfield const& that) noexcept
         return *this;
     }
 
-    flags_.resize(std::max(std::size(flags_), std::size(that.flags_)));
-
-    for (size_t i = 0, n = std::size(that.flags_); i < n; ++i)
-    {
-        flags_[i] |= that.flags_[i];
-    }
+    words_.resize(std::max(std::size(words_), std::size(that.words_)));
+    getKernels().or_into(std::data(words_), std::data(that.words_), std::size(that.words_));
 
     rebuild_true_count();
     return *this;
@@ -470,13 +841,41 @@ tr_bitfield& tr_bitfield::operator&=(tr_bitfield const& that) noexcept
         return *this;
     }
 
-    flags_.resize(std::min(std::size(flags_), std::size(that.flags_)));
+    words_.resize(std::min(std::size(words_), std::size(that.words_)));
+    getKernels().and_into(std::data(words_), std::data(that.words_), std::size(words_));
+
+    rebuild_true_count();
+    return *this;
+}
+
+tr_bitfield& tr_bitfield::and_not(tr_bitfield const& that) noexcept
+{
+    if (has_none() || that.has_none())
+    {
+        return *this;
+    }
+
+    if (that.has_all())
+    {
+        set_has_none();
+        return *this;
+    }
 
-    for (size_t i = 0, n = std::size(flags_); i < n; ++i)
+    if (has_all())
     {
-        flags_[i] &= that.flags_[i];
+        if (bit_count_ == 0)
+        {
+            // magnet link: we can't list the bits without knowing how many there are
+            return *this;
+        }
+
+        // we need the real bits to clear some of them
+        ensure_bits_alloced(bit_count_);
     }
 
+    auto const n = std::min(std::size(words_), std::size(that.words_));
+    getKernels().and_not_into(std::data(words_), std::data(that.words_), n);
+
     rebuild_true_count();
     return *this;
 }
@@ -493,13 +892,6 @@ bool tr_bitfield::intersects(tr_bitfield const& that) const noexcept
         return true;
     }
 
-    for (size_t i = 0, n = std::min(std::size(flags_), std::size(that.flags_)); i < n; ++i)
-    {
-        if ((flags_[i] & that.flags_[i]) != 0U)
-        {
-            return true;
-        }
-    }
-
-    return false;
+    auto const n = std::min(std::size(words_), std::size(that.words_));
+    return getKernels().intersects(std::data(words_), std::data(that.words_), n);
 }
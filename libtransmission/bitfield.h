@@ -10,7 +10,7 @@
 #endif
 
 #include <cstddef> // size_t
-#include <cstdint> // uint8_t
+#include <cstdint> // uint8_t, uint64_t
 #include <vector> // std::vector
 
 #include "tr-macros.h" // TR_CONSTEXPR20
@@ -35,6 +35,11 @@
  *
  * - "Have none" is another special case that has the same advantages
  *   and motivations as "Have all".
+ *
+ * The bits are stored in 64-bit words, highest bit first, so that a word
+ * holds the same bits in the same order as eight bytes of the raw format.
+ * Counting and the bitwise operations work a word at a time and use
+ * SIMD instructions when the CPU has them.
  */
 class tr_bitfield
 {
@@ -112,22 +117,40 @@ public:
         return static_cast<float>(count()) / size();
     }
 
+    // returns the index of the first set (or unset) bit in [begin, size()),
+    // or size() if there isn't one
+    [[nodiscard]] size_t find_next_set(size_t begin) const noexcept;
+    [[nodiscard]] size_t find_next_unset(size_t begin) const noexcept;
+
     tr_bitfield& operator|=(tr_bitfield const& that) noexcept;
     tr_bitfield& operator&=(tr_bitfield const& that) noexcept;
+
+    // unset every bit that is set in `that`
+    tr_bitfield& and_not(tr_bitfield const& that) noexcept;
+
     [[nodiscard]] bool intersects(tr_bitfield const& that) const noexcept;
 
 private:
+    static auto constexpr WordBits = size_t{ 64U };
+
+    [[nodiscard]] static constexpr uint64_t word_bit(size_t n) noexcept
+    {
+        return uint64_t{ 1U } << (WordBits - 1U - (n & (WordBits - 1U)));
+    }
+
     [[nodiscard]] size_t count_flags() const noexcept;
     [[nodiscard]] size_t count_flags(size_t begin, size_t end) const noexcept;
 
+    [[nodiscard]] size_t find_next_flag(size_t begin, bool value) const noexcept;
+
     [[nodiscard]] TR_CONSTEXPR20 bool test_flag(size_t n) const
     {
-        if (n >> 3U >= std::size(flags_))
+        if (n / WordBits >= std::size(words_))
         {
             return false;
         }
 
-        return (flags_[n >> 3U] << (n & 7U) & 0x80) != 0;
+        return (words_[n / WordBits] & word_bit(n)) != 0U;
     }
 
     void ensure_bits_alloced(size_t n);
@@ -136,7 +159,7 @@ private:
     void free_array() noexcept
     {
         // move-assign to ensure the reserve memory is cleared
-        flags_ = std::vector<uint8_t>{};
+        words_ = std::vector<uint64_t>{};
     }
 
     void increment_true_count(size_t inc) noexcept;
@@ -147,7 +170,7 @@ private:
         set_true_count(count_flags());
     }
 
-    std::vector<uint8_t> flags_;
+    std::vector<uint64_t> words_;
 
     size_t bit_count_ = 0;
     size_t true_count_ = 0;
@@ -9,7 +9,11 @@
 #include <cstdint>
 #include <fstream>
 #include <initializer_list>
+#include <memory>
+#include <string>
 #include <string_view>
+#include <tuple> // for std::tuple_size_v
+#include <utility>
 #include <vector>
 
 #ifdef _WIN32
@@ -39,7 +43,11 @@ namespace
 {
 
 // A string at the beginning of .bin files to test & make sure we don't load incompatible files
-auto constexpr BinContentsPrefix = std::string_view{ "-tr-blocklist-file-format-v3-" };
+auto constexpr BinContentsPrefix = std::string_view{ "-tr-blocklist-file-format-v4-" };
+
+// .bin files are mapped straight into memory, so their numbers are in host byte order.
+// This marker lets us notice -- and rebuild -- a file that was written on another host.
+auto constexpr BinByteOrderMark = uint32_t{ 0x01020304U };
 
 // In the blocklists directory, the The plaintext source file can be anything, e.g. "level1".
 // The pre-parsed, fast-to-load binary file will have a ".bin" suffix e.g. "level1.bin".
@@ -47,37 +55,251 @@ auto constexpr BinFileSuffix = std::string_view{ ".bin" };
 
 using address_range_t = std::pair<tr_address, tr_address>;
 
-void save(std::string_view filename, address_range_t const* ranges, size_t n_ranges)
+// An IPv4 range, as host-byte-order integers
+struct Ipv4Range
+{
+    uint32_t first;
+    uint32_t last;
+};
+
+// An IPv6 address as a 128-bit integer
+struct Ipv6Key
 {
-    auto out = std::ofstream{ tr_pathbuf{ filename }, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary };
-    if (!out.is_open())
+    uint64_t hi;
+    uint64_t lo;
+
+    [[nodiscard]] friend constexpr bool operator<(Ipv6Key const& a, Ipv6Key const& b) noexcept
+    {
+        return a.hi != b.hi ? a.hi < b.hi : a.lo < b.lo;
+    }
+};
+
+struct Ipv6Range
+{
+    Ipv6Key first;
+    Ipv6Key last;
+};
+
+// The layout of a .bin file is:
+// - this header
+// - `n_ipv4` Ipv4Ranges in Eytzinger order
+// - `n_ipv6` Ipv6Ranges in Eytzinger order
+struct BinHeader
+{
+    std::array<char, 32> prefix; // BinContentsPrefix, zero-padded
+    uint32_t byte_order;
+    uint32_t n_ipv4;
+    uint32_t n_ipv6;
+    uint32_t reserved;
+};
+
+// keep the tables aligned when the file is mapped
+static_assert(sizeof(Ipv4Range) == 8U);
+static_assert(sizeof(Ipv6Range) == 32U);
+static_assert(sizeof(BinHeader) == 48U);
+static_assert(sizeof(BinHeader) % alignof(Ipv6Range) == 0U);
+static_assert(sizeof(Ipv4Range) % alignof(Ipv6Range) == 0U);
+static_assert(std::size(BinContentsPrefix) < std::tuple_size_v<decltype(BinHeader::prefix)>);
+
+[[nodiscard]] uint32_t toKey4(tr_address const& addr) noexcept
+{
+    return ntohl(addr.addr.addr4.s_addr);
+}
+
+[[nodiscard]] Ipv6Key toKey6(tr_address const& addr) noexcept
+{
+    auto const* const bytes = addr.addr.addr6.s6_addr;
+
+    auto key = Ipv6Key{};
+    for (size_t i = 0; i < 8U; ++i)
+    {
+        key.hi = (key.hi << 8U) | bytes[i];
+        key.lo = (key.lo << 8U) | bytes[i + 8U];
+    }
+    return key;
+}
+
+// Sorted, non-overlapping ranges, split by address family
+struct Ranges
+{
+    [[nodiscard]] bool empty() const noexcept
+    {
+        return std::empty(ipv4) && std::empty(ipv6);
+    }
+
+    [[nodiscard]] size_t size() const noexcept
+    {
+        return std::size(ipv4) + std::size(ipv6);
+    }
+
+    std::vector<Ipv4Range> ipv4;
+    std::vector<Ipv6Range> ipv6;
+};
+
+template<typename Range>
+void sortAndMerge(std::vector<Range>& ranges)
+{
+    if (std::empty(ranges))
     {
-        tr_logAddWarn(fmt::format(
-            _("Couldn't read '{path}': {error} ({error_code})"),
-            fmt::arg("path", filename),
-            fmt::arg("error", tr_strerror(errno)),
-            fmt::arg("error_code", errno)));
         return;
     }
 
-    if (!out.write(std::data(BinContentsPrefix), std::size(BinContentsPrefix)) ||
-        !out.write(reinterpret_cast<char const*>(ranges), n_ranges * sizeof(*ranges)))
+    // sort ranges by start address
+    std::sort(std::begin(ranges), std::end(ranges), [](auto const& a, auto const& b) { return a.first < b.first; });
+
+    // merge overlapping ranges
+    auto keep = size_t{ 0U };
+    for (auto const& range : ranges)
+    {
+        if (ranges[keep].last < range.first)
+        {
+            ranges[++keep] = range;
+        }
+        else if (ranges[keep].last < range.last)
+        {
+            ranges[keep].last = range.last;
+        }
+    }
+
+    TR_ASSERT_MSG(keep + 1 <= std::size(ranges), "Can shrink `ranges` or leave intact, but not grow");
+    ranges.resize(keep + 1);
+
+#ifdef TR_ENABLE_ASSERTS
+    for (auto const& [low, high] : ranges)
+    {
+        TR_ASSERT(!(high < low));
+    }
+    for (size_t i = 1, n = std::size(ranges); i < n; ++i)
+    {
+        TR_ASSERT(ranges[i - 1].last < ranges[i].first);
+    }
+#endif
+}
+
+// --- Eytzinger layout
+//
+// A sorted table of `n` ranges is stored as an implicit binary search tree:
+// table[k - 1] is node `k`, whose children are nodes `2k` and `2k + 1`.
+// The nodes near the root are packed together at the front of the table,
+// so the first probes of every lookup hit the same few cache lines.
+
+// Call `visit(node - 1)` for each node of a tree of size `n`, in sorted order
+template<typename Visitor>
+void visitInOrder(size_t n, Visitor const& visit, size_t node = 1U)
+{
+    if (node <= n)
+    {
+        visitInOrder(n, visit, 2U * node);
+        visit(node - 1U);
+        visitInOrder(n, visit, 2U * node + 1U);
+    }
+}
+
+template<typename Range>
+[[nodiscard]] std::vector<Range> toEytzinger(std::vector<Range> const& sorted)
+{
+    auto table = std::vector<Range>(std::size(sorted));
+    auto iter = std::begin(sorted);
+    visitInOrder(std::size(sorted), [&](size_t idx) { table[idx] = *iter++; });
+    return table;
+}
+
+template<typename Range>
+void appendInOrder(Range const* table, size_t n, std::vector<Range>& out)
+{
+    visitInOrder(n, [&](size_t idx) { out.emplace_back(table[idx]); });
+}
+
+template<typename Range, typename Key>
+[[nodiscard]] bool tableContains(Range const* table, size_t n, Key const& key) noexcept
+{
+    // walk down to a leaf, going right whenever the node's range ends before `key`
+    auto node = size_t{ 1U };
+    while (node <= n)
+    {
+        node = 2U * node + (table[node - 1U].last < key ? 1U : 0U);
+    }
+
+    // the first range that ends at or after `key` is the last node where the
+    // walk went left, so undo the trailing right turns and then that left turn
+    while ((node & 1U) != 0U)
+    {
+        node >>= 1U;
+    }
+    node >>= 1U;
+
+    return node != 0U && !(key < table[node - 1U].first);
+}
+
+// ---
+
+void save(std::string_view filename, Ranges const& ranges)
+{
+    auto const ipv4 = toEytzinger(ranges.ipv4);
+    auto const ipv6 = toEytzinger(ranges.ipv6);
+
+    auto header = BinHeader{};
+    std::copy(std::begin(BinContentsPrefix), std::end(BinContentsPrefix), std::begin(header.prefix));
+    header.byte_order = BinByteOrderMark;
+    header.n_ipv4 = static_cast<uint32_t>(std::size(ipv4));
+    header.n_ipv6 = static_cast<uint32_t>(std::size(ipv6));
+
+    // Never rewrite the old file in place, since a live Blocklist may have it mapped.
+    // Write a temp file and rename it over. That fails on Windows while the old file
+    // is still mapped, so callers drop their Blocklists for `filename` first.
+    auto tmp = tr_pathbuf{ filename, ".tmp.XXXXXX"sv };
+    tr_error* error = nullptr;
+    auto const fd = tr_sys_file_open_temp(std::data(tmp), &error);
+    if (fd == TR_BAD_SYS_FILE)
     {
         tr_logAddWarn(fmt::format(
             _("Couldn't save '{path}': {error} ({error_code})"),
             fmt::arg("path", filename),
-            fmt::arg("error", tr_strerror(errno)),
-            fmt::arg("error_code", errno)));
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+        tr_error_clear(&error);
+        return;
     }
-    else
+
+    auto const write_all = [fd, &error](void const* buf, size_t n_bytes)
     {
-        tr_logAddInfo(fmt::format(
-            tr_ngettext("Blocklist '{path}' has {count} entry", "Blocklist '{path}' has {count} entries", n_ranges),
-            fmt::arg("path", tr_sys_path_basename(filename)),
-            fmt::arg("count", n_ranges)));
+        for (auto const* walk = static_cast<std::byte const*>(buf); n_bytes > 0U;)
+        {
+            auto n_written = uint64_t{};
+            if (!tr_sys_file_write(fd, walk, n_bytes, &n_written, &error))
+            {
+                return false;
+            }
+
+            walk += n_written;
+            n_bytes -= n_written;
+        }
+
+        return true;
+    };
+
+    auto ok = write_all(&header, sizeof(header)) && write_all(std::data(ipv4), std::size(ipv4) * sizeof(Ipv4Range)) &&
+        write_all(std::data(ipv6), std::size(ipv6) * sizeof(Ipv6Range)) && tr_sys_file_flush(fd, &error);
+    ok = tr_sys_file_close(fd, ok ? &error : nullptr) && ok;
+    ok = ok && tr_sys_path_rename(tmp, tr_pathbuf{ filename }, &error);
+
+    if (!ok)
+    {
+        tr_logAddWarn(fmt::format(
+            _("Couldn't save '{path}': {error} ({error_code})"),
+            fmt::arg("path", filename),
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+        tr_error_clear(&error);
+        tr_sys_path_remove(tmp);
+        return;
     }
 
-    out.close();
+    auto const n_ranges = std::size(ranges);
+    tr_logAddInfo(fmt::format(
+        tr_ngettext("Blocklist '{path}' has {count} entry", "Blocklist '{path}' has {count} entries", n_ranges),
+        fmt::arg("path", tr_sys_path_basename(filename)),
+        fmt::arg("count", n_ranges)));
 }
 
 namespace ParseHelpers
@@ -219,7 +441,7 @@ std::optional<address_range_t> parseLine(std::string_view line)
 }
 } // namespace ParseHelpers
 
-auto parseFile(std::string_view filename)
+Ranges parseFile(std::string_view filename)
 {
     using namespace ParseHelpers;
 
@@ -233,7 +455,7 @@ auto parseFile(std::string_view filename)
             fmt::arg("path", filename),
             fmt::arg("error", tr_strerror(errno)),
             fmt::arg("error_code", errno)));
-        return ranges;
+        return {};
     }
 
     auto line = std::string{};
@@ -253,52 +475,28 @@ auto parseFile(std::string_view filename)
     }
     in.close();
 
-    if (std::empty(ranges))
-    {
-        return ranges;
-    }
-
-    // safeguard against some joker swapping the begin & end ranges
-    for (auto& [low, high] : ranges)
+    auto ret = Ranges{};
+    for (auto [low, high] : ranges)
     {
+        // safeguard against some joker swapping the begin & end ranges
         if (low > high)
         {
             std::swap(low, high);
         }
-    }
 
-    // sort ranges by start address
-    std::sort(std::begin(ranges), std::end(ranges), [](auto const& a, auto const& b) { return a.first < b.first; });
-
-    // merge overlapping ranges
-    auto keep = size_t{ 0U };
-    for (auto const& range : ranges)
-    {
-        if (ranges[keep].second < range.first)
+        if (low.is_ipv4())
         {
-            ranges[++keep] = range;
+            ret.ipv4.push_back({ toKey4(low), toKey4(high) });
         }
-        else if (ranges[keep].second < range.second)
+        else
         {
-            ranges[keep].second = range.second;
+            ret.ipv6.push_back({ toKey6(low), toKey6(high) });
         }
     }
 
-    TR_ASSERT_MSG(keep + 1 <= std::size(ranges), "Can shrink `ranges` or leave intact, but not grow");
-    ranges.resize(keep + 1);
-
-#ifdef TR_ENABLE_ASSERTS
-    for (auto const& [low, high] : ranges)
-    {
-        TR_ASSERT(low <= high);
-    }
-    for (size_t i = 1, n = std::size(ranges); i < n; ++i)
-    {
-        TR_ASSERT(ranges[i - 1].second < ranges[i].first);
-    }
-#endif
-
-    return ranges;
+    sortAndMerge(ret.ipv4);
+    sortAndMerge(ret.ipv6);
+    return ret;
 }
 
 auto getFilenamesInDir(std::string_view folder)
@@ -314,13 +512,74 @@ auto getFilenamesInDir(std::string_view folder)
 
 } // namespace
 
+// The Eytzinger-ordered tables of a blocklist. They point either into
+// a memory-mapped .bin file or into this object's own storage.
+struct Blocklist::Rules
+{
+    Rules() = default;
+
+    explicit Rules(Ranges&& sorted)
+        : ipv4_storage{ toEytzinger(sorted.ipv4) }
+        , ipv6_storage{ toEytzinger(sorted.ipv6) }
+    {
+        ipv4 = std::data(ipv4_storage);
+        n_ipv4 = std::size(ipv4_storage);
+        ipv6 = std::data(ipv6_storage);
+        n_ipv6 = std::size(ipv6_storage);
+    }
+
+    ~Rules()
+    {
+        if (view != nullptr)
+        {
+            tr_sys_file_unmap(view, view_size);
+        }
+    }
+
+    Rules(Rules&&) = delete;
+    Rules(Rules const&) = delete;
+    Rules& operator=(Rules&&) = delete;
+    Rules& operator=(Rules const&) = delete;
+
+    [[nodiscard]] size_t size() const noexcept
+    {
+        return n_ipv4 + n_ipv6;
+    }
+
+    [[nodiscard]] bool contains(tr_address const& addr) const noexcept
+    {
+        return addr.is_ipv4() ? tableContains(ipv4, n_ipv4, toKey4(addr)) : tableContains(ipv6, n_ipv6, toKey6(addr));
+    }
+
+    void appendSorted(Ranges& out) const
+    {
+        appendInOrder(ipv4, n_ipv4, out.ipv4);
+        appendInOrder(ipv6, n_ipv6, out.ipv6);
+    }
+
+    Ipv4Range const* ipv4 = nullptr;
+    size_t n_ipv4 = 0U;
+    Ipv6Range const* ipv6 = nullptr;
+    size_t n_ipv6 = 0U;
+
+    void const* view = nullptr;
+    uint64_t view_size = 0U;
+
+    std::vector<Ipv4Range> const ipv4_storage;
+    std::vector<Ipv6Range> const ipv6_storage;
+};
+
 void Blocklist::ensureLoaded() const
 {
-    if (!std::empty(rules_))
+    if (rules_)
     {
         return;
     }
 
+    // if the file can't be loaded, treat it as empty instead of retrying on every lookup
+    auto rules = std::make_shared<Rules>();
+    rules_ = rules;
+
     // get the file's size
     tr_error* error = nullptr;
     auto const file_info = tr_sys_path_get_info(bin_file_, 0, &error);
@@ -339,63 +598,87 @@ void Blocklist::ensureLoaded() const
     }
 
     // open the file
-    auto in = std::ifstream{ bin_file_, std::ios_base::in | std::ios_base::binary };
-    if (!in)
+    auto const fd = tr_sys_file_open(bin_file_.c_str(), TR_SYS_FILE_READ, 0, &error);
+    if (fd == TR_BAD_SYS_FILE)
     {
         tr_logAddWarn(fmt::format(
             _("Couldn't read '{path}': {error} ({error_code})"),
             fmt::arg("path", bin_file_),
-            fmt::arg("error", tr_strerror(errno)),
-            fmt::arg("error_code", errno)));
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+        tr_error_clear(&error);
         return;
     }
 
     // check to see if the file is usable
+    auto header = BinHeader{};
+    auto n_read = uint64_t{};
     bool supported_file = true;
-    if (file_info->size < std::size(BinContentsPrefix)) // too small
+    if (file_info->size < sizeof(header)) // too small
     {
         supported_file = false;
     }
-    else if (((file_info->size - std::size(BinContentsPrefix)) % sizeof(address_range_t)) != 0) // wrong size
+    else if (!tr_sys_file_read(fd, &header, sizeof(header), &n_read) || n_read != sizeof(header))
     {
         supported_file = false;
     }
-    else
+    else if (BinContentsPrefix != std::string_view{ std::data(header.prefix), std::size(BinContentsPrefix) })
+    {
+        supported_file = false;
+    }
+    else if (header.byte_order != BinByteOrderMark) // written on a different host
+    {
+        supported_file = false;
+    }
+    else if (file_info->size != sizeof(header) + header.n_ipv4 * sizeof(Ipv4Range) + header.n_ipv6 * sizeof(Ipv6Range))
     {
-        auto tmp = std::array<char, std::size(BinContentsPrefix)>{};
-        in.read(std::data(tmp), std::size(tmp));
-        supported_file = BinContentsPrefix == std::string_view{ std::data(tmp), std::size(tmp) };
+        supported_file = false; // wrong size
     }
 
     if (!supported_file)
     {
         // bad binary file; try to rebuild it
-        in.close();
+        tr_sys_file_close(fd);
         if (auto const sz_src_file = std::string{ std::data(bin_file_), std::size(bin_file_) - std::size(BinFileSuffix) };
             tr_sys_path_exists(sz_src_file))
         {
-            rules_ = parseFile(sz_src_file);
-            if (!std::empty(rules_))
+            if (auto ranges = parseFile(sz_src_file); !std::empty(ranges))
             {
                 tr_logAddInfo(_("Rewriting old blocklist file format to new format"));
-                tr_sys_path_remove(bin_file_);
-                save(bin_file_, std::data(rules_), std::size(rules_));
+                save(bin_file_, ranges);
+                rules_ = std::make_shared<Rules>(std::move(ranges));
             }
         }
         return;
     }
 
-    auto range = address_range_t{};
-    rules_.reserve((file_info->size - std::size(BinContentsPrefix)) / sizeof(address_range_t));
-    while (in.read(reinterpret_cast<char*>(&range), sizeof(range)))
+    // map the file instead of reading it. Pages that lookups never touch are never read,
+    // and the kernel can drop the rest under memory pressure without writing them anywhere.
+    auto const* const view = tr_sys_file_map_for_reading(fd, 0, file_info->size, &error);
+    tr_sys_file_close(fd);
+    if (view == nullptr)
     {
-        rules_.emplace_back(range);
+        tr_logAddWarn(fmt::format(
+            _("Couldn't read '{path}': {error} ({error_code})"),
+            fmt::arg("path", bin_file_),
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+        tr_error_clear(&error);
+        return;
     }
 
+    auto const* const tables = static_cast<std::byte const*>(view) + sizeof(header);
+    rules->view = view;
+    rules->view_size = file_info->size;
+    rules->ipv4 = reinterpret_cast<Ipv4Range const*>(tables);
+    rules->n_ipv4 = header.n_ipv4;
+    rules->ipv6 = reinterpret_cast<Ipv6Range const*>(tables + header.n_ipv4 * sizeof(Ipv4Range));
+    rules->n_ipv6 = header.n_ipv6;
+
     tr_logAddInfo(fmt::format(
-        tr_ngettext("Blocklist '{path}' has {count} entry", "Blocklist '{path}' has {count} entries", std::size(rules_)),
+        tr_ngettext("Blocklist '{path}' has {count} entry", "Blocklist '{path}' has {count} entries", rules->size()),
         fmt::arg("path", tr_sys_path_basename(bin_file_)),
-        fmt::arg("count", std::size(rules_))));
+        fmt::arg("count", rules->size())));
 }
 
 std::vector<Blocklist> Blocklist::loadBlocklists(std::string_view const blocklist_dir, bool const is_enabled)
@@ -417,7 +700,7 @@ std::vector<Blocklist> Blocklist::loadBlocklists(std::string_view const blocklis
         {
             if (auto const ranges = parseFile(src_file); !std::empty(ranges))
             {
-                save(bin_file, std::data(ranges), std::size(ranges));
+                save(bin_file, ranges);
             }
         }
     }
@@ -433,6 +716,37 @@ std::vector<Blocklist> Blocklist::loadBlocklists(std::string_view const blocklis
     return ret;
 }
 
+Blocklist Blocklist::merge(std::vector<Blocklist> const& blocklists)
+{
+    auto sources = std::vector<Blocklist const*>{};
+    for (auto const& blocklist : blocklists)
+    {
+        if (blocklist.enabled() && blocklist.size() != 0U)
+        {
+            sources.emplace_back(&blocklist);
+        }
+    }
+
+    auto ret = Blocklist{ {}, true };
+
+    if (std::size(sources) == 1U)
+    {
+        ret.rules_ = sources.front()->rules_;
+        return ret;
+    }
+
+    auto ranges = Ranges{};
+    for (auto const* const source : sources)
+    {
+        source->rules_->appendSorted(ranges);
+    }
+
+    sortAndMerge(ranges.ipv4);
+    sortAndMerge(ranges.ipv6);
+    ret.rules_ = std::make_shared<Rules>(std::move(ranges));
+    return ret;
+}
+
 bool Blocklist::contains(tr_address const& addr) const
 {
     TR_ASSERT(addr.is_valid());
@@ -444,38 +758,14 @@ bool Blocklist::contains(tr_address const& addr) const
 
     ensureLoaded();
 
-    struct Compare
-    {
-        [[nodiscard]] static auto compare(tr_address const& a, address_range_t const& b) noexcept // <=>
-        {
-            if (a < b.first)
-            {
-                return -1;
-            }
-            if (b.second < a)
-            {
-                return 1;
-            }
-            return 0;
-        }
-
-        [[nodiscard]] static auto compare(address_range_t const& a, tr_address const& b) noexcept // <=>
-        {
-            return -compare(b, a);
-        }
-
-        [[nodiscard]] auto operator()(address_range_t const& a, tr_address const& b) const noexcept // <
-        {
-            return compare(a, b) < 0;
-        }
+    return rules_->contains(addr);
+}
 
-        [[nodiscard]] auto operator()(tr_address const& a, address_range_t const& b) const noexcept // <
-        {
-            return compare(a, b) < 0;
-        }
-    };
+size_t Blocklist::size() const
+{
+    ensureLoaded();
 
-    return std::binary_search(std::begin(rules_), std::end(rules_), addr, Compare{});
+    return rules_->size();
 }
 
 std::optional<Blocklist> Blocklist::saveNew(std::string_view external_file, std::string_view bin_file, bool is_enabled)
@@ -506,11 +796,11 @@ std::optional<Blocklist> Blocklist::saveNew(std::string_view external_file, std:
         return {};
     }
 
-    save(bin_file, std::data(rules), std::size(rules));
+    save(bin_file, rules);
 
     // return a new Blocklist with these rules
     auto ret = Blocklist{ bin_file, is_enabled };
-    ret.rules_ = std::move(rules);
+    ret.rules_ = std::make_shared<Rules>(std::move(rules));
     return ret;
 }
 
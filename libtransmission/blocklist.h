@@ -9,10 +9,11 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <cstddef> // for size_t
+#include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
-#include <utility> // for std::pair
 #include <vector>
 
 #include "net.h" // for tr_address
@@ -20,6 +21,13 @@
 namespace libtransmission
 {
 
+// A set of blocked address ranges.
+//
+// Each blocklist's rules are kept in a pre-parsed .bin file that is
+// memory-mapped, rather than read, when the blocklist is first used.
+// IPv4 and IPv6 ranges are kept in separate tables of fixed-size keys,
+// each laid out in breadth-first (Eytzinger) order so that a lookup's
+// first few probes share a handful of cache lines.
 class Blocklist
 {
 public:
@@ -27,6 +35,10 @@ public:
 
     static std::optional<Blocklist> saveNew(std::string_view external_file, std::string_view bin_file, bool is_enabled);
 
+    // Combine the rules of the enabled blocklists in `blocklists` into a single
+    // in-memory blocklist, so that checking an address takes one lookup
+    [[nodiscard]] static Blocklist merge(std::vector<Blocklist> const& blocklists);
+
     Blocklist() = default;
 
     Blocklist(std::string_view bin_file, bool is_enabled)
@@ -37,12 +49,7 @@ public:
 
     [[nodiscard]] bool contains(tr_address const& addr) const;
 
-    [[nodiscard]] auto size() const
-    {
-        ensureLoaded();
-
-        return std::size(rules_);
-    }
+    [[nodiscard]] size_t size() const;
 
     [[nodiscard]] constexpr bool enabled() const noexcept
     {
@@ -60,9 +67,12 @@ public:
     }
 
 private:
+    struct Rules;
+
     void ensureLoaded() const;
 
-    mutable std::vector<std::pair<tr_address, tr_address>> rules_;
+    // shared so that copies, and a merge of a single blocklist, don't copy the tables
+    mutable std::shared_ptr<Rules const> rules_;
 
     std::string bin_file_;
     bool is_enabled_ = false;
@@ -6,10 +6,9 @@
 #include <algorithm>
 #include <cerrno>
 #include <cstdint> // uint8_t
-#include <iterator> // std::distance(), std::next(), std::prev()
+#include <iterator> // std::next(), std::prev()
+#include <limits>
 #include <memory>
-#include <numeric> // std::accumulate()
-#include <utility> // std::make_pair()
 #include <vector>
 
 #include <fmt/core.h>
@@ -18,6 +17,7 @@
 #include "libtransmission/transmission.h"
 
 #include "libtransmission/cache.h"
+#include "libtransmission/file.h" // tr_sys_iovec
 #include "libtransmission/inout.h"
 #include "libtransmission/log.h"
 #include "libtransmission/torrent.h"
@@ -25,92 +25,74 @@
 #include "libtransmission/tr-assert.h"
 #include "libtransmission/utils.h" // tr_formatter
 
-Cache::Key Cache::make_key(tr_torrent const* torrent, tr_block_info::Location loc) noexcept
+void Cache::add_run(TorrentBlocks& tb, Run const& run)
 {
-    return std::make_pair(torrent->id(), loc.block);
+    tb.run_ends.try_emplace(run.begin, run.end);
+    tb.run_begins.try_emplace(run.end, run.begin);
+    runs_.insert(run);
 }
 
-Cache::CIter Cache::find_span_end(CIter span_begin, CIter end) noexcept
+void Cache::remove_run(TorrentBlocks& tb, Run const& run)
 {
-    static constexpr auto NotAdjacent = [](CacheBlock const& block1, CacheBlock const& block2)
-    {
-        return block1.key.first != block2.key.first || block1.key.second + 1 != block2.key.second;
-    };
-    auto const span_end = std::adjacent_find(span_begin, end, NotAdjacent);
-    return span_end == end ? end : std::next(span_end);
+    tb.run_ends.erase(run.begin);
+    tb.run_begins.erase(run.end);
+    runs_.erase(run);
 }
 
-std::pair<Cache::CIter, Cache::CIter> Cache::find_biggest_span(CIter const begin, CIter const end) noexcept
+void Cache::add_to_runs(TorrentBlocks& tb, tr_torrent_id_t tor_id, tr_block_index_t block)
 {
-    auto biggest_begin = begin;
-    auto biggest_end = begin;
-    auto biggest_len = std::distance(biggest_begin, biggest_end);
+    auto run = Run{ tor_id, block, block + 1 };
 
-    for (auto span_begin = begin; span_begin < end;)
+    // is there a run that ends right before this block?
+    if (auto const iter = tb.run_begins.find(block); iter != std::end(tb.run_begins))
     {
-        auto span_end = find_span_end(span_begin, end);
-        auto const len = std::distance(span_begin, span_end);
-
-        if (len > biggest_len)
-        {
-            biggest_begin = span_begin;
-            biggest_end = span_end;
-            biggest_len = len;
-        }
+        auto const prev = Run{ tor_id, iter->second, block };
+        remove_run(tb, prev);
+        run.begin = prev.begin;
+    }
 
-        std::advance(span_begin, len);
+    // is there a run that starts right after this block?
+    if (auto const iter = tb.run_ends.find(block + 1); iter != std::end(tb.run_ends))
+    {
+        auto const next = Run{ tor_id, block + 1, iter->second };
+        remove_run(tb, next);
+        run.end = next.end;
     }
 
-    return { biggest_begin, biggest_end };
+    add_run(tb, run);
 }
 
-int Cache::write_contiguous(CIter const begin, CIter const end) const
+int Cache::write_contiguous(TorrentBlocks const& tb, Run const& run) const
 {
-    // The most common case without an extra data copy.
-    auto const* out = std::data(*begin->buf);
-    auto outlen = std::size(*begin->buf);
-
-    // Contiguous area to join more than one block, if any.
-    auto buf = std::vector<uint8_t>{};
-
-    if (end - begin > 1)
-    {
-        // copy blocks into contiguous memory
-        auto const buflen = std::accumulate(
-            begin,
-            end,
-            size_t{},
-            [](size_t sum, auto const& block) { return sum + std::size(*block.buf); });
-        buf.resize(buflen);
-        auto* walk = std::data(buf);
-        for (auto iter = begin; iter != end; ++iter)
-        {
-            TR_ASSERT(begin->key.first == iter->key.first);
-            TR_ASSERT(begin->key.second + std::distance(begin, iter) == iter->key.second);
-            walk = std::copy_n(std::data(*iter->buf), std::size(*iter->buf), walk);
-        }
-        TR_ASSERT(std::data(buf) + std::size(buf) == walk);
-        out = std::data(buf);
-        outlen = std::size(buf);
+    TR_ASSERT(run.size() > 0U);
+
+    // hand the blocks to the disk as-is instead of copying them into one buffer
+    auto bufs = small::vector<tr_sys_iovec, 64U>{};
+    bufs.reserve(run.size());
+    auto outlen = size_t{};
+    for (auto block = run.begin; block < run.end; ++block)
+    {
+        auto const& data = *tb.blocks.at(block);
+        bufs.push_back({ std::data(data), std::size(data) });
+        outlen += std::size(data);
     }
 
     // save it
-    auto const& [torrent_id, block] = begin->key;
-    auto* const tor = torrents_.get(torrent_id);
+    auto* const tor = torrents_.get(run.tor_id);
     if (tor == nullptr)
     {
         return EINVAL;
     }
 
-    auto const loc = tor->block_loc(block);
+    auto const loc = tor->block_loc(run.begin);
 
-    if (auto const err = tr_ioWrite(tor, loc, outlen, out); err != 0)
+    if (auto const err = tr_ioWrite(tor, loc, std::data(bufs), std::size(bufs)); err != 0)
     {
         return err;
     }
 
-    ++disk_writes_;
-    disk_write_bytes_ += outlen;
+    ++stats_.disk_writes;
+    stats_.disk_write_bytes += outlen;
     return {};
 }
 
@@ -128,16 +110,50 @@ int Cache::set_limit(size_t new_limit)
     return cache_trim();
 }
 
+void Cache::set_read_cache_limit(size_t new_limit)
+{
+    max_clean_blocks_ = get_max_blocks(new_limit);
+
+    tr_logAddDebug(
+        fmt::format("Maximum read cache size set to {} ({} blocks)", tr_formatter_mem_B(new_limit), max_clean_blocks_));
+
+    if (std::size(clean_blocks_) > max_clean_blocks_)
+    {
+        auto const begin = std::next(std::begin(clean_blocks_), max_clean_blocks_);
+        std::for_each(begin, std::end(clean_blocks_), [this](auto const& clean) { clean_block_index_.erase(clean.key); });
+        clean_blocks_.erase(begin, std::end(clean_blocks_));
+        clock_hand_ = 0U;
+    }
+}
+
 Cache::Cache(tr_torrents& torrents, size_t max_bytes)
     : torrents_{ torrents }
     , max_blocks_(get_max_blocks(max_bytes))
 {
 }
 
+Cache::~Cache() = default;
+
+void Cache::set_io_pool(std::unique_ptr<tr_io_pool> io_pool)
+{
+    // the old pool finishes its queued I/O when it's destroyed
+    io_pool_.reset();
+    in_flight_.clear();
+    pending_prefetches_.clear();
+
+    io_pool_ = std::move(io_pool);
+}
+
 // ---
 
 int Cache::write_block(tr_torrent_id_t tor_id, tr_block_index_t block, std::unique_ptr<BlockData> writeme)
 {
+    // any older copies of the block are out of date now
+    auto const key = Key{ tor_id, block };
+    remove_clean_block(key);
+    in_flight_.erase(key);
+    pending_prefetches_.erase(key);
+
     if (max_blocks_ == 0U)
     {
         TR_ASSERT(std::empty(blocks_));
@@ -146,121 +162,545 @@ int Cache::write_block(tr_torrent_id_t tor_id, tr_block_index_t block, std::uniq
         // already has a cache layer for the very purpose of this cache
         // https://github.com/transmission/transmission/pull/5668
         auto* const tor = torrents_.get(tor_id);
+        if (io_pool_)
+        {
+            auto blocks = std::vector<std::unique_ptr<BlockData>>{};
+            blocks.emplace_back(std::move(writeme));
+            write_async(tor, block, std::move(blocks));
+            return {};
+        }
+
         return tr_ioWrite(tor, tor->block_loc(block), std::size(*writeme), std::data(*writeme));
     }
 
-    auto const key = Key{ tor_id, block };
-    auto iter = std::lower_bound(std::begin(blocks_), std::end(blocks_), key, CompareCacheBlockByKey);
-    if (iter == std::end(blocks_) || iter->key != key)
+    auto& tb = blocks_[tor_id];
+    auto& buf = tb.blocks[block];
+    auto const is_new_block = !buf;
+    buf = std::move(writeme);
+
+    ++stats_.cache_writes;
+    stats_.cache_write_bytes += std::size(*buf);
+
+    if (is_new_block)
     {
-        iter = blocks_.emplace(iter);
-        iter->key = key;
+        ++n_blocks_;
+        add_to_runs(tb, tor_id, block);
     }
 
-    iter->buf = std::move(writeme);
+    return cache_trim();
+}
 
-    ++cache_writes_;
-    cache_write_bytes_ += std::size(*iter->buf);
+Cache::BlockData const* Cache::get_block(tr_torrent const* torrent, tr_block_info::Location const& loc) const noexcept
+{
+    if (auto const tb_iter = blocks_.find(torrent->id()); tb_iter != std::end(blocks_))
+    {
+        auto const& blocks = tb_iter->second.blocks;
 
-    return cache_trim();
+        if (auto const iter = blocks.find(loc.block); iter != std::end(blocks))
+        {
+            return iter->second.get();
+        }
+    }
+
+    if (auto const iter = in_flight_.find(Key{ torrent->id(), loc.block }); iter != std::end(in_flight_))
+    {
+        return iter->second;
+    }
+
+    return nullptr;
+}
+
+std::shared_ptr<Cache::BlockData> const* Cache::get_clean_block(Key const& key) noexcept
+{
+    if (auto const iter = clean_block_index_.find(key); iter != std::end(clean_block_index_))
+    {
+        auto& clean = clean_blocks_[iter->second];
+        clean.referenced = true;
+        return &clean.buf;
+    }
+
+    return nullptr;
+}
+
+int Cache::read_clean_block(tr_torrent* torrent, tr_block_index_t block, std::shared_ptr<BlockData>& setme)
+{
+    auto const block_size = torrent->block_size(block);
+    auto buf = std::make_shared<BlockData>(block_size);
+    if (auto const err = tr_ioRead(torrent, torrent->block_loc(block), block_size, std::data(*buf)); err != 0)
+    {
+        return err;
+    }
+
+    add_clean_block(Key{ torrent->id(), block }, buf);
+    setme = std::move(buf);
+    return {};
 }
 
-Cache::CIter Cache::get_block(tr_torrent const* torrent, tr_block_info::Location const& loc) noexcept
+void Cache::add_clean_block(Key const& key, std::shared_ptr<BlockData> buf)
 {
-    if (auto const [begin, end] = std::equal_range(
-            std::begin(blocks_),
-            std::end(blocks_),
-            make_key(torrent, loc),
-            CompareCacheBlockByKey);
-        begin < end)
+    TR_ASSERT(clean_block_index_.count(key) == 0U);
+
+    if (max_clean_blocks_ == 0U)
+    {
+        return;
+    }
+
+    if (std::size(clean_blocks_) < max_clean_blocks_)
     {
-        return begin;
+        clean_block_index_.try_emplace(key, std::size(clean_blocks_));
+        clean_blocks_.push_back(CleanBlock{ key, std::move(buf) });
+        return;
     }
 
-    return std::end(blocks_);
+    // advance the clock hand to the first block that hasn't been used lately
+    auto const n_clean = std::size(clean_blocks_);
+    while (clean_blocks_[clock_hand_].referenced)
+    {
+        clean_blocks_[clock_hand_].referenced = false;
+        clock_hand_ = (clock_hand_ + 1U) % n_clean;
+    }
+
+    auto& victim = clean_blocks_[clock_hand_];
+    clean_block_index_.erase(victim.key);
+    victim = CleanBlock{ key, std::move(buf) };
+    clean_block_index_.try_emplace(key, clock_hand_);
+    clock_hand_ = (clock_hand_ + 1U) % n_clean;
+}
+
+void Cache::remove_clean_block(Key const& key)
+{
+    auto const iter = clean_block_index_.find(key);
+    if (iter == std::end(clean_block_index_))
+    {
+        return;
+    }
+
+    // fill the hole with the last block so that removal is O(1)
+    auto const idx = iter->second;
+    clean_block_index_.erase(iter);
+    if (idx + 1U != std::size(clean_blocks_))
+    {
+        clean_blocks_[idx] = std::move(clean_blocks_.back());
+        clean_block_index_[clean_blocks_[idx].key] = idx;
+    }
+    clean_blocks_.pop_back();
+
+    if (clock_hand_ >= std::size(clean_blocks_))
+    {
+        clock_hand_ = 0U;
+    }
+}
+
+template<typename Pred>
+void Cache::remove_clean_blocks_if(Pred pred)
+{
+    auto const end = std::remove_if(
+        std::begin(clean_blocks_),
+        std::end(clean_blocks_),
+        [&pred](auto const& clean) { return pred(clean.key); });
+
+    if (end == std::end(clean_blocks_))
+    {
+        return;
+    }
+
+    clean_blocks_.erase(end, std::end(clean_blocks_));
+    clean_block_index_.clear();
+    for (size_t idx = 0, n = std::size(clean_blocks_); idx < n; ++idx)
+    {
+        clean_block_index_.try_emplace(clean_blocks_[idx].key, idx);
+    }
+
+    clock_hand_ = 0U;
+}
+
+int Cache::read_from_block(tr_torrent* torrent, tr_block_info::Location const& loc, uint32_t len, uint8_t* setme)
+{
+    TR_ASSERT(loc.block_offset + len <= torrent->block_size(loc.block));
+
+    auto const key = Key{ torrent->id(), loc.block };
+    auto const* data = get_block(torrent, loc);
+    if (data == nullptr)
+    {
+        if (auto const* const clean = get_clean_block(key); clean != nullptr)
+        {
+            data = clean->get();
+        }
+    }
+
+    if (data != nullptr)
+    {
+        ++stats_.read_hits;
+        std::copy_n(std::data(*data) + loc.block_offset, len, setme);
+        return {};
+    }
+
+    ++stats_.read_misses;
+
+    if (max_clean_blocks_ == 0U)
+    {
+        return tr_ioRead(torrent, loc, len, setme);
+    }
+
+    // read the entire block so that other peers' requests for it can be served from memory
+    auto buf = std::shared_ptr<BlockData>{};
+    if (auto const err = read_clean_block(torrent, loc.block, buf); err != 0)
+    {
+        return err;
+    }
+
+    std::copy_n(std::data(*buf) + loc.block_offset, len, setme);
+    return {};
 }
 
 int Cache::read_block(tr_torrent* torrent, tr_block_info::Location const& loc, uint32_t len, uint8_t* setme)
 {
-    if (auto const iter = get_block(torrent, loc); iter != std::end(blocks_))
+    // peers' requests are usually block-aligned, but don't have to be
+    for (auto walk = loc; len > 0U;)
+    {
+        auto const len_this_block = std::min(len, torrent->block_size(walk.block) - walk.block_offset);
+
+        if (auto const err = read_from_block(torrent, walk, len_this_block, setme); err != 0)
+        {
+            return err;
+        }
+
+        setme += len_this_block;
+        len -= len_this_block;
+        walk = torrent->byte_loc(walk.byte + len_this_block);
+    }
+
+    return {};
+}
+
+int Cache::read_block_shared(
+    tr_torrent* torrent,
+    tr_block_info::Location const& loc,
+    uint32_t len,
+    std::shared_ptr<uint8_t const>& setme)
+{
+    // Blocks that are waiting to be written aren't shared: they're freed
+    // when they're flushed. So those, and requests that span more than
+    // one block, get copied into a new buffer.
+    if (loc.block_offset + len <= torrent->block_size(loc.block) && get_block(torrent, loc) == nullptr &&
+        max_clean_blocks_ != 0U)
     {
-        std::copy_n(std::begin(*iter->buf), len, setme);
+        auto buf = std::shared_ptr<BlockData>{};
+        if (auto const* const clean = get_clean_block(Key{ torrent->id(), loc.block }); clean != nullptr)
+        {
+            ++stats_.read_hits;
+            buf = *clean;
+        }
+        else
+        {
+            ++stats_.read_misses;
+
+            if (auto const err = read_clean_block(torrent, loc.block, buf); err != 0)
+            {
+                return err;
+            }
+        }
+
+        setme = { buf, std::data(*buf) + loc.block_offset };
         return {};
     }
 
-    return tr_ioRead(torrent, loc, len, setme);
+    auto buf = std::make_shared<BlockData>(len);
+    if (auto const err = read_block(torrent, loc, len, std::data(*buf)); err != 0)
+    {
+        return err;
+    }
+
+    setme = { buf, std::data(*buf) };
+    return {};
+}
+
+bool Cache::is_on_disk(tr_torrent const* torrent, tr_block_info::Location const& loc, uint32_t len) const noexcept
+{
+    if (len == 0U)
+    {
+        return true;
+    }
+
+    auto const last_block = torrent->byte_loc(loc.byte + len - 1U).block;
+    for (auto block = loc.block; block <= last_block; ++block)
+    {
+        if (get_block(torrent, torrent->block_loc(block)) != nullptr)
+        {
+            return false;
+        }
+    }
+
+    return true;
 }
 
 int Cache::prefetch_block(tr_torrent* torrent, tr_block_info::Location const& loc, uint32_t len)
 {
-    if (auto const iter = get_block(torrent, loc); iter != std::end(blocks_))
+    auto const key = Key{ torrent->id(), loc.block };
+    if (get_block(torrent, loc) != nullptr || clean_block_index_.count(key) != 0U || pending_prefetches_.count(key) != 0U)
     {
         return {}; // already have it
     }
 
-    return tr_ioPrefetch(torrent, loc, len);
+    if (!io_pool_)
+    {
+        return tr_ioPrefetch(torrent, loc, len);
+    }
+
+    if (max_clean_blocks_ == 0U)
+    {
+        io_pool_->prefetch(torrent, loc, len);
+        return {};
+    }
+
+    // read the entire block in the background so that it's
+    // in the read cache by the time that the peer asks for it
+    auto const block_size = torrent->block_size(loc.block);
+    auto buf = std::make_shared<std::unique_ptr<BlockData>>(std::make_unique<BlockData>(block_size));
+    auto* const setme = std::data(**buf);
+    pending_prefetches_.insert(key);
+    io_pool_->read(
+        torrent,
+        torrent->block_loc(loc.block),
+        block_size,
+        setme,
+        [this, key, buf](int err)
+        {
+            // skip it if the block was written or its file was closed in the meantime
+            if (pending_prefetches_.erase(key) == 0U || err != 0 || clean_block_index_.count(key) != 0U)
+            {
+                return;
+            }
+
+            add_clean_block(key, std::move(*buf));
+        });
+    return {};
 }
 
 // ---
 
-int Cache::flush_span(CIter const begin, CIter const end)
+int Cache::flush_run(Run const run)
+{
+    auto const tb_iter = blocks_.find(run.tor_id);
+    TR_ASSERT(tb_iter != std::end(blocks_));
+    auto& tb = tb_iter->second;
+
+    if (auto const err = write_contiguous(tb, run); err != 0)
+    {
+        return err;
+    }
+
+    remove_run(tb, run);
+    for (auto block = run.begin; block < run.end; ++block)
+    {
+        tb.blocks.erase(block);
+    }
+    n_blocks_ -= run.size();
+
+    if (std::empty(tb.blocks))
+    {
+        blocks_.erase(tb_iter);
+    }
+
+    return {};
+}
+
+void Cache::write_async(tr_torrent* tor, tr_block_index_t begin, std::vector<std::unique_ptr<BlockData>> blocks)
 {
-    for (auto span_begin = begin; span_begin < end;)
+    auto const tor_id = tor->id();
+    auto bufs = std::vector<tr_sys_iovec>{};
+    bufs.reserve(std::size(blocks));
+    for (size_t i = 0, n = std::size(blocks); i < n; ++i)
     {
-        auto const span_end = find_span_end(span_begin, end);
+        auto const* const data = blocks[i].get();
+        bufs.push_back({ std::data(*data), std::size(*data) });
+        in_flight_.insert_or_assign(Key{ tor_id, static_cast<tr_block_index_t>(begin + i) }, data);
+    }
 
-        if (auto const err = write_contiguous(span_begin, span_end); err != 0)
+    io_pool_->write(
+        tor,
+        tor->block_loc(begin),
+        std::move(bufs),
+        [this, tor_id, begin, blocks = std::make_shared<decltype(blocks)>(std::move(blocks))](int err)
         {
-            return err;
+            auto n_bytes = size_t{};
+            for (size_t i = 0, n = std::size(*blocks); i < n; ++i)
+            {
+                auto& data = (*blocks)[i];
+                n_bytes += std::size(*data);
+
+                // skip the block if it's been replaced by a newer copy or its file was closed
+                auto const key = Key{ tor_id, static_cast<tr_block_index_t>(begin + i) };
+                auto const iter = in_flight_.find(key);
+                if (iter == std::end(in_flight_) || iter->second != data.get())
+                {
+                    continue;
+                }
+
+                in_flight_.erase(iter);
+
+                // Like a failed synchronous flush, keep the block in the cache so that it isn't lost.
+                // The pool reports the write error to the torrent after this callback returns.
+                if (err != 0 && max_blocks_ != 0U && torrents_.get(tor_id) != nullptr)
+                {
+                    restore_block(key, std::move(data));
+                }
+            }
+
+            if (err == 0)
+            {
+                ++stats_.disk_writes;
+                stats_.disk_write_bytes += n_bytes;
+            }
+        });
+}
+
+int Cache::flush_run_async(Run const run)
+{
+    auto* const tor = torrents_.get(run.tor_id);
+    if (tor == nullptr)
+    {
+        return EINVAL;
+    }
+
+    auto const tb_iter = blocks_.find(run.tor_id);
+    TR_ASSERT(tb_iter != std::end(blocks_));
+    auto& tb = tb_iter->second;
+
+    auto blocks = std::vector<std::unique_ptr<BlockData>>{};
+    blocks.reserve(run.size());
+    for (auto block = run.begin; block < run.end; ++block)
+    {
+        auto const iter = tb.blocks.find(block);
+        blocks.emplace_back(std::move(iter->second));
+        tb.blocks.erase(iter);
+    }
+
+    remove_run(tb, run);
+    n_blocks_ -= run.size();
+
+    if (std::empty(tb.blocks))
+    {
+        blocks_.erase(tb_iter);
+    }
+
+    write_async(tor, run.begin, std::move(blocks));
+    return {};
+}
+
+void Cache::restore_block(Key const& key, std::unique_ptr<BlockData> data)
+{
+    auto& tb = blocks_[key.first];
+    auto& buf = tb.blocks[key.second];
+    TR_ASSERT(!buf);
+    buf = std::move(data);
+
+    ++n_blocks_;
+    add_to_runs(tb, key.first, key.second);
+}
+
+void Cache::forget_io(tr_torrent_id_t tor_id, tr_block_index_t begin, tr_block_index_t end)
+{
+    auto const in_span = [tor_id, begin, end](Key const& key)
+    {
+        return key.first == tor_id && begin <= key.second && key.second < end;
+    };
+
+    for (auto iter = std::begin(in_flight_); iter != std::end(in_flight_);)
+    {
+        iter = in_span(iter->first) ? in_flight_.erase(iter) : std::next(iter);
+    }
+
+    for (auto iter = std::begin(pending_prefetches_); iter != std::end(pending_prefetches_);)
+    {
+        iter = in_span(*iter) ? pending_prefetches_.erase(iter) : std::next(iter);
+    }
+}
+
+int Cache::flush_runs(tr_torrent_id_t tor_id, tr_block_index_t begin, tr_block_index_t end)
+{
+    auto const tb_iter = blocks_.find(tor_id);
+    if (tb_iter == std::end(blocks_))
+    {
+        return {};
+    }
+
+    // Runs that stick out of [begin, end) are flushed in their entirety.
+    // Writing their neighboring blocks a little early is harmless.
+    auto runs = std::vector<Run>{};
+    for (auto const& [run_begin, run_end] : tb_iter->second.run_ends)
+    {
+        if (run_begin < end && begin < run_end)
+        {
+            runs.push_back(Run{ tor_id, run_begin, run_end });
         }
+    }
 
-        span_begin = span_end;
+    // flush in block order so that the writes are sequential
+    std::sort(
+        std::begin(runs),
+        std::end(runs),
+        [](auto const& lhs, auto const& rhs) { return lhs.begin < rhs.begin; });
+
+    for (auto const& run : runs)
+    {
+        if (auto const err = flush_run(run); err != 0)
+        {
+            return err;
+        }
     }
 
-    blocks_.erase(begin, end);
     return {};
 }
 
 int Cache::flush_file(tr_torrent const* torrent, tr_file_index_t file)
 {
     auto const tor_id = torrent->id();
-    auto const [block_begin, block_end] = tr_torGetFileBlockSpan(torrent, file);
+    auto const span = tr_torGetFileBlockSpan(torrent, file);
 
-    return flush_span(
-        std::lower_bound(std::begin(blocks_), std::end(blocks_), std::make_pair(tor_id, block_begin), CompareCacheBlockByKey),
-        std::lower_bound(std::begin(blocks_), std::end(blocks_), std::make_pair(tor_id, block_end), CompareCacheBlockByKey));
+    remove_clean_blocks_if(
+        [tor_id, span](Key const& key) { return key.first == tor_id && span.begin <= key.second && key.second < span.end; });
+
+    // Closing also runs the callbacks of the writes that have finished, so
+    // any that failed have put their blocks back to be flushed again here.
+    if (io_pool_)
+    {
+        io_pool_->close_file(tor_id, file);
+        forget_io(tor_id, span.begin, span.end);
+    }
+
+    return flush_runs(tor_id, span.begin, span.end);
 }
 
 int Cache::flush_torrent(tr_torrent const* torrent)
 {
     auto const tor_id = torrent->id();
 
-    return flush_span(
-        std::lower_bound(std::begin(blocks_), std::end(blocks_), std::make_pair(tor_id, 0), CompareCacheBlockByKey),
-        std::lower_bound(std::begin(blocks_), std::end(blocks_), std::make_pair(tor_id + 1, 0), CompareCacheBlockByKey));
+    remove_clean_blocks_if([tor_id](Key const& key) { return key.first == tor_id; });
+
+    if (io_pool_)
+    {
+        io_pool_->close_torrent(tor_id);
+        forget_io(tor_id, 0, std::numeric_limits<tr_block_index_t>::max());
+    }
+
+    return flush_runs(tor_id, 0, std::numeric_limits<tr_block_index_t>::max());
 }
 
 int Cache::flush_biggest()
 {
-    auto const [begin, end] = find_biggest_span(std::begin(blocks_), std::end(blocks_));
-
-    if (begin == end) // nothing to flush
+    if (std::empty(runs_)) // nothing to flush
     {
         return 0;
     }
 
-    if (auto const err = write_contiguous(begin, end); err != 0)
-    {
-        return err;
-    }
-
-    blocks_.erase(begin, end);
-    return 0;
+    auto const run = *std::prev(std::end(runs_));
+    return io_pool_ ? flush_run_async(run) : flush_run(run);
 }
 
 int Cache::cache_trim()
 {
-    while (std::size(blocks_) > max_blocks_)
+    while (n_blocks_ > max_blocks_)
     {
         if (auto const err = flush_biggest(); err != 0)
         {
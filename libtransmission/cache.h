@@ -11,7 +11,12 @@
 
 #include <cstddef> // for size_t
 #include <cstdint> // for intX_t, uintX_t
-#include <memory> // for std::unique_ptr
+#include <functional> // for std::hash
+#include <memory> // for std::shared_ptr, std::unique_ptr
+#include <set>
+#include <tuple> // for std::tie
+#include <unordered_map>
+#include <unordered_set>
 #include <utility> // for std::pair
 #include <vector>
 
@@ -21,6 +26,7 @@
 
 #include "block-info.h"
 
+class tr_io_pool;
 class tr_torrents;
 struct tr_torrent;
 
@@ -29,14 +35,64 @@ class Cache
 public:
     using BlockData = small::max_size_vector<uint8_t, tr_block_info::BlockSize>;
 
+    struct Stats
+    {
+        uint64_t read_hits = 0; // blocks read from memory
+        uint64_t read_misses = 0; // blocks read from disk
+        uint64_t cache_writes = 0; // blocks added to the cache
+        uint64_t cache_write_bytes = 0;
+        uint64_t disk_writes = 0; // spans flushed to disk
+        uint64_t disk_write_bytes = 0;
+        size_t cached_blocks = 0;
+        size_t read_cache_blocks = 0;
+    };
+
     Cache(tr_torrents& torrents, size_t max_bytes);
+    ~Cache();
+
+    Cache(Cache const&) = delete;
+    Cache& operator=(Cache const&) = delete;
+    Cache(Cache&&) = delete;
+    Cache& operator=(Cache&&) = delete;
 
     int set_limit(size_t new_limit);
 
+    // Set the memory budget for clean blocks that were read from disk.
+    // Popular blocks are then read once and served to many peers.
+    void set_read_cache_limit(size_t new_limit);
+
+    // Flush and prefetch blocks in the background with `io_pool`, or go
+    // back to blocking I/O if it's nullptr. Flushed blocks stay readable
+    // from memory until they're on disk, and prefetched blocks go into the
+    // read cache. Closing a torrent's or file's files waits for its I/O.
+    void set_io_pool(std::unique_ptr<tr_io_pool> io_pool);
+
+    [[nodiscard]] Stats stats() const noexcept
+    {
+        auto ret = stats_;
+        ret.cached_blocks = n_blocks_;
+        ret.read_cache_blocks = std::size(clean_blocks_);
+        return ret;
+    }
+
     // @return any error code from cacheTrim()
     int write_block(tr_torrent_id_t tor, tr_block_index_t block, std::unique_ptr<BlockData> writeme);
 
     int read_block(tr_torrent* torrent, tr_block_info::Location const& loc, uint32_t len, uint8_t* setme);
+
+    // Like read_block(), but instead of copying the data to the caller,
+    // `setme` points at it and shares ownership of the buffer that holds it.
+    // Requests inside a single block share the read cache's copy of it.
+    // @return any error code from tr_ioRead()
+    int read_block_shared(
+        tr_torrent* torrent,
+        tr_block_info::Location const& loc,
+        uint32_t len,
+        std::shared_ptr<uint8_t const>& setme);
+
+    // Whether all of [loc, loc + len) is on disk, i.e. none
+    // of it is in the cache waiting to be written.
+    [[nodiscard]] bool is_on_disk(tr_torrent const* torrent, tr_block_info::Location const& loc, uint32_t len) const noexcept;
     int prefetch_block(tr_torrent* torrent, tr_block_info::Location const& loc, uint32_t len);
     int flush_torrent(tr_torrent const* torrent);
     int flush_file(tr_torrent const* torrent, tr_file_index_t file);
@@ -44,26 +100,84 @@ public:
 private:
     using Key = std::pair<tr_torrent_id_t, tr_block_index_t>;
 
-    struct CacheBlock
+    struct KeyHash
+    {
+        [[nodiscard]] size_t operator()(Key const& key) const noexcept
+        {
+            return std::hash<uint64_t>{}(uint64_t{ static_cast<uint32_t>(key.first) } << 32U | key.second);
+        }
+    };
+
+    // A clean block that was read from disk. These are evicted with the
+    // CLOCK algorithm: a hit sets `referenced`, and referenced blocks
+    // get a second chance when the clock hand passes over them.
+    struct CleanBlock
     {
         Key key;
-        std::unique_ptr<BlockData> buf;
+        std::shared_ptr<BlockData> buf; // shared with peers that are uploading from it
+        bool referenced = false;
+    };
+
+    // a span of contiguous cached blocks [begin, end) in a torrent
+    struct Run
+    {
+        tr_torrent_id_t tor_id;
+        tr_block_index_t begin;
+        tr_block_index_t end;
+
+        [[nodiscard]] constexpr auto size() const noexcept
+        {
+            return end - begin;
+        }
+
+        [[nodiscard]] bool operator<(Run const& that) const noexcept
+        {
+            auto const this_size = size();
+            auto const that_size = that.size();
+            return std::tie(this_size, tor_id, begin) < std::tie(that_size, that.tor_id, that.begin);
+        }
     };
 
-    using Blocks = std::vector<CacheBlock>;
-    using CIter = Blocks::const_iterator;
+    // the cached blocks of a single torrent
+    struct TorrentBlocks
+    {
+        std::unordered_map<tr_block_index_t, std::unique_ptr<BlockData>> blocks;
+
+        // the runs of contiguous blocks, looked up by either endpoint
+        std::unordered_map<tr_block_index_t /*begin*/, tr_block_index_t /*end*/> run_ends;
+        std::unordered_map<tr_block_index_t /*end*/, tr_block_index_t /*begin*/> run_begins;
+    };
 
-    [[nodiscard]] static Key make_key(tr_torrent const* torrent, tr_block_info::Location loc) noexcept;
+    void add_run(TorrentBlocks& tb, Run const& run);
 
-    [[nodiscard]] static std::pair<CIter, CIter> find_biggest_span(CIter begin, CIter end) noexcept;
+    void remove_run(TorrentBlocks& tb, Run const& run);
 
-    [[nodiscard]] static CIter find_span_end(CIter span_begin, CIter end) noexcept;
+    // add a new block to the runs, merging it with its neighbors
+    void add_to_runs(TorrentBlocks& tb, tr_torrent_id_t tor_id, tr_block_index_t block);
 
     // @return any error code from tr_ioWrite()
-    [[nodiscard]] int write_contiguous(CIter begin, CIter end) const;
+    [[nodiscard]] int write_contiguous(TorrentBlocks const& tb, Run const& run) const;
+
+    // @return any error code from writeContiguous()
+    [[nodiscard]] int flush_run(Run run);
 
+    // flush every run that has blocks in [begin, end)
     // @return any error code from writeContiguous()
-    [[nodiscard]] int flush_span(CIter begin, CIter end);
+    [[nodiscard]] int flush_runs(tr_torrent_id_t tor_id, tr_block_index_t begin, tr_block_index_t end);
+
+    // hand `blocks`, which start at `begin`, to the I/O pool
+    void write_async(tr_torrent* tor, tr_block_index_t begin, std::vector<std::unique_ptr<BlockData>> blocks);
+
+    // put a block whose background write failed back into the cache
+    void restore_block(Key const& key, std::unique_ptr<BlockData> data);
+
+    // like flush_run(), but in the background
+    // @return EINVAL if the torrent isn't found
+    [[nodiscard]] int flush_run_async(Run run);
+
+    // Called after the I/O pool has drained a torrent's queue:
+    // forget the in-flight and prefetching blocks in [begin, end).
+    void forget_io(tr_torrent_id_t tor_id, tr_block_index_t begin, tr_block_index_t end);
 
     // @return any error code from writeContiguous()
     [[nodiscard]] int flush_biggest();
@@ -73,27 +187,49 @@ private:
 
     [[nodiscard]] static size_t get_max_blocks(size_t max_bytes) noexcept;
 
-    [[nodiscard]] CIter get_block(tr_torrent const* torrent, tr_block_info::Location const& loc) noexcept;
+    [[nodiscard]] BlockData const* get_block(tr_torrent const* torrent, tr_block_info::Location const& loc) const noexcept;
+
+    // read from a single block. `len` must not go past the end of the block.
+    // @return any error code from tr_ioRead()
+    [[nodiscard]] int read_from_block(tr_torrent* torrent, tr_block_info::Location const& loc, uint32_t len, uint8_t* setme);
+
+    [[nodiscard]] std::shared_ptr<BlockData> const* get_clean_block(Key const& key) noexcept;
+
+    // read an entire block from disk and add it to the read cache
+    // @return any error code from tr_ioRead()
+    [[nodiscard]] int read_clean_block(tr_torrent* torrent, tr_block_index_t block, std::shared_ptr<BlockData>& setme);
+
+    void add_clean_block(Key const& key, std::shared_ptr<BlockData> buf);
+
+    void remove_clean_block(Key const& key);
+
+    template<typename Pred>
+    void remove_clean_blocks_if(Pred pred);
 
     tr_torrents& torrents_;
 
-    Blocks blocks_ = {};
+    std::unordered_map<tr_torrent_id_t, TorrentBlocks> blocks_;
+
+    // every run in the cache, sorted by size so the biggest is last
+    std::set<Run> runs_;
+
+    size_t n_blocks_ = 0;
     size_t max_blocks_ = 0;
 
-    mutable size_t disk_writes_ = 0;
-    mutable size_t disk_write_bytes_ = 0;
-    mutable size_t cache_writes_ = 0;
-    mutable size_t cache_write_bytes_ = 0;
+    // the read cache
+    std::vector<CleanBlock> clean_blocks_;
+    std::unordered_map<Key, size_t /*index into clean_blocks_*/, KeyHash> clean_block_index_;
+    size_t clock_hand_ = 0;
+    size_t max_clean_blocks_ = 0;
 
-    static constexpr struct
-    {
-        [[nodiscard]] constexpr bool operator()(Key const& key, CacheBlock const& block)
-        {
-            return key < block.key;
-        }
-        [[nodiscard]] constexpr bool operator()(CacheBlock const& block, Key const& key)
-        {
-            return block.key < key;
-        }
-    } CompareCacheBlockByKey{};
+    // blocks that are being written by io_pool_.
+    // The buffers are owned by the pending write.
+    std::unordered_map<Key, BlockData const*, KeyHash> in_flight_;
+
+    // blocks that io_pool_ is reading into the read cache
+    std::unordered_set<Key, KeyHash> pending_prefetches_;
+
+    mutable Stats stats_;
+
+    std::unique_ptr<tr_io_pool> io_pool_;
 };
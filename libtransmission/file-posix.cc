@@ -19,7 +19,9 @@
 
 #include <dirent.h>
 #include <fcntl.h> /* O_LARGEFILE, posix_fadvise(), [posix_]fallocate(), fcntl() */
+#include <sys/mman.h> /* mmap(), munmap() */
 #include <sys/stat.h>
+#include <sys/uio.h> /* pwritev(), struct iovec */
 #include <unistd.h> /* lseek(), write(), ftruncate(), pread(), pwrite(), pathconf(), etc */
 
 #ifdef HAVE_XFS_XFS_H
@@ -81,6 +83,7 @@
 #if defined(__UCLIBC__) && !TR_UCLIBC_CHECK_VERSION(0, 9, 28)
 #undef HAVE_PREAD
 #undef HAVE_PWRITE
+#undef HAVE_PWRITEV
 #endif
 
 #ifdef __APPLE__
@@ -784,6 +787,87 @@ bool tr_sys_file_write_at(
     return ret;
 }
 
+bool tr_sys_file_writev_at(
+    tr_sys_file_t handle,
+    tr_sys_iovec const* buffers,
+    size_t n_buffers,
+    uint64_t offset,
+    uint64_t* bytes_written,
+    tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+    TR_ASSERT(buffers != nullptr || n_buffers == 0);
+    /* seek requires signed offset, so it should be in mod range */
+    TR_ASSERT(offset < UINT64_MAX / 2);
+
+#ifdef HAVE_PWRITEV
+
+    /* a short write is allowed, so just write the first batch of buffers
+     * and let the caller come back for the rest */
+    auto iov = std::array<struct iovec, 64U>{};
+    auto n_iov = std::min(n_buffers, std::size(iov));
+#ifdef IOV_MAX
+    n_iov = std::min(n_iov, static_cast<size_t>(IOV_MAX));
+#endif
+    for (size_t i = 0; i < n_iov; ++i)
+    {
+        iov[i].iov_base = const_cast<void*>(buffers[i].data);
+        iov[i].iov_len = buffers[i].size;
+    }
+
+    auto const my_bytes_written = pwritev(handle, std::data(iov), static_cast<int>(n_iov), static_cast<off_t>(offset));
+    static_assert(sizeof(*bytes_written) >= sizeof(my_bytes_written));
+
+    if (my_bytes_written == -1)
+    {
+        tr_error_set_from_errno(error, errno);
+        return false;
+    }
+
+    if (bytes_written != nullptr)
+    {
+        *bytes_written = my_bytes_written;
+    }
+
+    return true;
+
+#else
+
+    auto total = uint64_t{};
+
+    for (size_t i = 0; i < n_buffers; ++i)
+    {
+        auto n_written = uint64_t{};
+        if (!tr_sys_file_write_at(handle, buffers[i].data, buffers[i].size, offset + total, &n_written, error))
+        {
+            if (total == 0)
+            {
+                return false;
+            }
+
+            /* report the partial write; the caller will see the error on its next attempt */
+            tr_error_clear(error);
+            break;
+        }
+
+        total += n_written;
+
+        if (n_written < buffers[i].size)
+        {
+            break;
+        }
+    }
+
+    if (bytes_written != nullptr)
+    {
+        *bytes_written = total;
+    }
+
+    return true;
+
+#endif
+}
+
 bool tr_sys_file_flush(tr_sys_file_t handle, tr_error** error)
 {
     TR_ASSERT(handle != TR_BAD_SYS_FILE);
@@ -1078,6 +1162,37 @@ bool tr_sys_file_lock([[maybe_unused]] tr_sys_file_t handle, [[maybe_unused]] in
     return ret;
 }
 
+void const* tr_sys_file_map_for_reading(tr_sys_file_t handle, uint64_t offset, uint64_t size, tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+    TR_ASSERT(size > 0);
+
+    void* const ret = mmap(nullptr, size, PROT_READ, MAP_SHARED, handle, offset);
+
+    if (ret == MAP_FAILED)
+    {
+        tr_error_set_from_errno(error, errno);
+        return nullptr;
+    }
+
+    return ret;
+}
+
+bool tr_sys_file_unmap(void const* address, uint64_t size, tr_error** error)
+{
+    TR_ASSERT(address != nullptr);
+    TR_ASSERT(size > 0);
+
+    bool const ret = munmap(const_cast<void*>(address), size) != -1;
+
+    if (!ret)
+    {
+        tr_error_set_from_errno(error, errno);
+    }
+
+    return ret;
+}
+
 std::string tr_sys_dir_get_current(tr_error** error)
 {
     auto buf = std::vector<char>{};
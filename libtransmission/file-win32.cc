@@ -1092,6 +1092,51 @@ bool tr_sys_file_write_at(
     return ret;
 }
 
+bool tr_sys_file_writev_at(
+    tr_sys_file_t handle,
+    tr_sys_iovec const* buffers,
+    size_t n_buffers,
+    uint64_t offset,
+    uint64_t* bytes_written,
+    tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+    TR_ASSERT(buffers != nullptr || n_buffers == 0);
+
+    /* WriteFileGather() needs unbuffered, page-aligned I/O, so write one buffer at a time */
+    auto total = uint64_t{};
+
+    for (size_t i = 0; i < n_buffers; ++i)
+    {
+        auto n_written = uint64_t{};
+        if (!tr_sys_file_write_at(handle, buffers[i].data, buffers[i].size, offset + total, &n_written, error))
+        {
+            if (total == 0)
+            {
+                return false;
+            }
+
+            /* report the partial write; the caller will see the error on its next attempt */
+            tr_error_clear(error);
+            break;
+        }
+
+        total += n_written;
+
+        if (n_written < buffers[i].size)
+        {
+            break;
+        }
+    }
+
+    if (bytes_written != nullptr)
+    {
+        *bytes_written = total;
+    }
+
+    return true;
+}
+
 bool tr_sys_file_flush(tr_sys_file_t handle, tr_error** error)
 {
     TR_ASSERT(handle != TR_BAD_SYS_FILE);
@@ -1213,6 +1258,61 @@ bool tr_sys_file_lock(tr_sys_file_t handle, int operation, tr_error** error)
     return ret;
 }
 
+void const* tr_sys_file_map_for_reading(tr_sys_file_t handle, uint64_t offset, uint64_t size, tr_error** error)
+{
+    TR_ASSERT(handle != TR_BAD_SYS_FILE);
+    TR_ASSERT(size > 0);
+
+    if (size > MAXSIZE_T)
+    {
+        set_system_error(error, ERROR_INVALID_PARAMETER);
+        return nullptr;
+    }
+
+    HANDLE const mapping_handle = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    if (mapping_handle == nullptr)
+    {
+        set_system_error(error, GetLastError());
+        return nullptr;
+    }
+
+    auto native_offset = ULARGE_INTEGER{};
+    native_offset.QuadPart = offset;
+
+    void const* const ret = MapViewOfFile(
+        mapping_handle,
+        FILE_MAP_READ,
+        native_offset.u.HighPart,
+        native_offset.u.LowPart,
+        static_cast<SIZE_T>(size));
+
+    if (ret == nullptr)
+    {
+        set_system_error(error, GetLastError());
+    }
+
+    // the view keeps the mapping object alive
+    CloseHandle(mapping_handle);
+
+    return ret;
+}
+
+bool tr_sys_file_unmap(void const* address, [[maybe_unused]] uint64_t size, tr_error** error)
+{
+    TR_ASSERT(address != nullptr);
+    TR_ASSERT(size > 0);
+
+    bool const ret = UnmapViewOfFile(address) != FALSE;
+
+    if (!ret)
+    {
+        set_system_error(error, GetLastError());
+    }
+
+    return ret;
+}
+
 std::string tr_sys_dir_get_current(tr_error** error)
 {
     if (auto const size = GetCurrentDirectoryW(0, nullptr); size != 0)
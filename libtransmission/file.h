@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include <cstddef> // size_t
 #include <cstdint> // uint64_t
 #include <ctime> // time_t
 #include <functional>
@@ -121,6 +122,13 @@ struct tr_sys_path_capacity
     int64_t total = -1;
 };
 
+/** @brief One of the buffers passed to @ref tr_sys_file_writev_at. */
+struct tr_sys_iovec
+{
+    void const* data = {};
+    uint64_t size = {};
+};
+
 /**
  * @name Platform-specific wrapper functions
  *
@@ -448,6 +456,30 @@ bool tr_sys_file_write_at(
     uint64_t* bytes_written,
     struct tr_error** error = nullptr);
 
+/**
+ * @brief Like `pwritev()`, except that the position is undefined afterwards.
+ *        Writes the buffers one after another, as if they were a single buffer.
+ *        Not thread-safe.
+ *
+ * @param[in]  handle        Valid file descriptor.
+ * @param[in]  buffers       Buffers to get data being written from.
+ * @param[in]  n_buffers     Number of buffers.
+ * @param[in]  offset        File offset in bytes to start writing from.
+ * @param[out] bytes_written Number of bytes actually written. Optional, pass
+ *                           `nullptr` if you are not interested.
+ * @param[out] error         Pointer to error object. Optional, pass `nullptr`
+ *                           if you are not interested in error details.
+ *
+ * @return `True` on success, `false` otherwise (with `error` set accordingly).
+ */
+bool tr_sys_file_writev_at(
+    tr_sys_file_t handle,
+    tr_sys_iovec const* buffers,
+    size_t n_buffers,
+    uint64_t offset,
+    uint64_t* bytes_written,
+    struct tr_error** error = nullptr);
+
 /**
  * @brief Portability wrapper for `fsync()`.
  *
@@ -520,6 +552,36 @@ bool tr_sys_file_preallocate(tr_sys_file_t handle, uint64_t size, int flags, str
  */
 bool tr_sys_file_lock(tr_sys_file_t handle, int operation, struct tr_error** error = nullptr);
 
+/**
+ * @brief Portability wrapper for `mmap()` for files.
+ *
+ * @param[in]  handle Valid file descriptor.
+ * @param[in]  offset Offset in file to map from.
+ * @param[in]  size   Number of bytes to map.
+ * @param[out] error  Pointer to error object. Optional, pass `nullptr` if you
+ *                    are not interested in error details.
+ *
+ * @return Pointer to mapped file data on success, `nullptr` otherwise (with
+ *         `error` set accordingly).
+ */
+void const* tr_sys_file_map_for_reading(
+    tr_sys_file_t handle,
+    uint64_t offset,
+    uint64_t size,
+    struct tr_error** error = nullptr);
+
+/**
+ * @brief Portability wrapper for `munmap()` for files.
+ *
+ * @param[in]  address Pointer to mapped file data.
+ * @param[in]  size    Size of mapped data in bytes.
+ * @param[out] error   Pointer to error object. Optional, pass `nullptr` if you
+ *                     are not interested in error details.
+ *
+ * @return `True` on success, `false` otherwise (with `error` set accordingly).
+ */
+bool tr_sys_file_unmap(void const* address, uint64_t size, struct tr_error** error = nullptr);
+
 /* File-related wrappers (utility) */
 
 /**
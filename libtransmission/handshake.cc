@@ -340,7 +340,9 @@ ReadState tr_handshake::read_handshake(tr_peerIo* peer_io)
 
     set_have_read_anything_from_peer(true);
 
-    if (peer_io->read_buffer_starts_with(HandshakeName)) // unencrypted
+    // NB: an outgoing connection gets here after the encryption handshake,
+    // and then the read buffer holds the already-decrypted payload stream
+    if (!peer_io->is_encrypted() && peer_io->read_buffer_starts_with(HandshakeName)) // unencrypted
     {
         if (encryption_mode_ == TR_ENCRYPTION_REQUIRED)
         {
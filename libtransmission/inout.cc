@@ -6,12 +6,23 @@
 #include <algorithm>
 #include <array>
 #include <cerrno>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <string>
 #include <string_view>
+#include <thread>
 #include <utility> // std::move
+#include <vector>
 
 #include <fmt/core.h>
 
+#include <small/vector.hpp>
+
 #include "libtransmission/transmission.h"
 
 #include "libtransmission/block-info.h" // tr_block_info
@@ -20,9 +31,11 @@
 #include "libtransmission/file.h"
 #include "libtransmission/inout.h"
 #include "libtransmission/log.h"
+#include "libtransmission/open-files.h"
 #include "libtransmission/session.h"
 #include "libtransmission/torrent.h"
 #include "libtransmission/torrent-files.h"
+#include "libtransmission/torrents.h"
 #include "libtransmission/tr-assert.h"
 #include "libtransmission/tr-macros.h" // tr_sha1_digest_t
 #include "libtransmission/tr-strbuf.h" // tr_pathbuf
@@ -52,20 +65,49 @@ bool readEntireBuf(tr_sys_file_t fd, uint64_t file_offset, uint8_t* buf, uint64_
     return true;
 }
 
-bool writeEntireBuf(tr_sys_file_t fd, uint64_t file_offset, uint8_t const* buf, uint64_t buflen, tr_error** error)
+bool readEntireBufs(tr_sys_file_t fd, uint64_t file_offset, tr_sys_iovec const* bufs, size_t n_bufs, tr_error** error)
 {
-    while (buflen > 0)
+    for (size_t i = 0; i < n_bufs; ++i)
+    {
+        // tr_ioRead() hands us its mutable buffer, so it's safe to write to it here
+        auto* const buf = static_cast<uint8_t*>(const_cast<void*>(bufs[i].data));
+        if (!readEntireBuf(fd, file_offset, buf, bufs[i].size, error))
+        {
+            return false;
+        }
+
+        file_offset += bufs[i].size;
+    }
+
+    return true;
+}
+
+bool writeEntireBufs(tr_sys_file_t fd, uint64_t file_offset, tr_sys_iovec* bufs, size_t n_bufs, tr_error** error)
+{
+    while (n_bufs > 0)
     {
         auto n_written = uint64_t{};
 
-        if (!tr_sys_file_write_at(fd, buf, buflen, file_offset, &n_written, error))
+        if (!tr_sys_file_writev_at(fd, bufs, n_bufs, file_offset, &n_written, error))
         {
             return false;
         }
 
-        buf += n_written;
-        buflen -= n_written;
         file_offset += n_written;
+
+        // skip past whatever was written and retry the rest
+        while (n_bufs > 0 && n_written >= bufs->size)
+        {
+            n_written -= bufs->size;
+            ++bufs;
+            --n_bufs;
+        }
+
+        if (n_bufs > 0)
+        {
+            bufs->data = static_cast<uint8_t const*>(bufs->data) + n_written;
+            bufs->size -= n_written;
+        }
     }
 
     return true;
@@ -99,54 +141,125 @@ bool getFilename(tr_pathbuf& setme, tr_torrent const* tor, tr_file_index_t file_
     return true;
 }
 
+// One file's part of a read or write. For jobs that run in a tr_io_pool
+// thread, these are made in the session thread when the job is queued,
+// so that the worker never looks at the torrent's files or paths while
+// e.g. tr_torrent::set_location() is changing them.
+struct FileSpan
+{
+    tr_file_index_t file_index = {};
+    uint64_t file_offset = {};
+    uint64_t n_bytes = {};
+    uint64_t file_size = {};
+    tr_preallocation_mode prealloc = TR_PREALLOCATE_NONE;
+    std::string filename; // where to find the file if it's not open yet; may be empty
+};
+
+using FileSpans = small::vector<FileSpan, 4U>;
+
+// Splits the `buflen` bytes that start at `loc` into their files' parts.
+// With `find_files`, also look up where each of those files is.
+std::optional<FileSpans> makeFileSpans(
+    tr_torrent const* tor,
+    IoMode io_mode,
+    tr_block_info::Location loc,
+    uint64_t buflen,
+    bool find_files)
+{
+    if (loc.piece >= tor->piece_count())
+    {
+        return {};
+    }
+
+    bool const do_write = io_mode == IoMode::Write;
+    auto spans = FileSpans{};
+    for (auto [file_index, file_offset] = tor->file_offset(loc); buflen != 0; ++file_index, file_offset = 0)
+    {
+        auto& span = spans.emplace_back();
+        span.file_index = file_index;
+        span.file_offset = file_offset;
+        span.file_size = tor->file_size(file_index);
+        span.n_bytes = std::min(buflen, span.file_size - file_offset);
+        span.prealloc = (!do_write || !tor->file_is_wanted(file_index)) ? TR_PREALLOCATE_NONE :
+                                                                           tor->session->preallocationMode();
+
+        if (auto filename = tr_pathbuf{}; find_files && span.file_size != 0 && getFilename(filename, tor, file_index, io_mode))
+        {
+            span.filename = filename.sv();
+        }
+
+        buflen -= span.n_bytes;
+    }
+
+    return spans;
+}
+
+// The outcome of reading or writing part of a torrent. The I/O might have
+// run in a tr_io_pool thread, so its effects on the session are applied
+// later in the session thread by applyResult().
+struct IoResult
+{
+    int err = 0;
+    std::string local_error; // set when a write fails
+    std::string log_message; // logged as an error, if set
+    size_t n_files_created = 0;
+};
+
+// `tor` is only needed to find files that `span` doesn't say where to find,
+// so it's nullptr when this is run in a tr_io_pool thread.
 void readOrWriteBytes(
-    tr_session* session,
-    tr_torrent* tor,
+    tr_open_files& open_files,
+    tr_torrent_id_t tor_id,
+    tr_torrent const* tor,
     IoMode io_mode,
-    tr_file_index_t file_index,
-    uint64_t file_offset,
-    uint8_t* buf,
-    size_t buflen,
-    tr_error** error)
+    FileSpan const& span,
+    tr_sys_iovec* bufs,
+    size_t n_bufs,
+    IoResult& result)
 {
-    TR_ASSERT(file_index < tor->file_count());
+    TR_ASSERT(tor == nullptr || span.file_index < tor->file_count());
 
     bool const do_write = io_mode == IoMode::Write;
-    auto const file_size = tor->file_size(file_index);
-    TR_ASSERT(file_size == 0 || file_offset < file_size);
-    TR_ASSERT(file_offset + buflen <= file_size);
+    TR_ASSERT(span.file_size == 0 || span.file_offset < span.file_size);
+    TR_ASSERT(span.file_offset + span.n_bytes <= span.file_size);
 
-    if (file_size == 0)
+    if (span.file_size == 0)
     {
         return;
     }
 
+    auto const subpath = [tor, &span]()
+    {
+        return tor != nullptr ? std::string_view{ tor->file_subpath(span.file_index) } : std::string_view{ span.filename };
+    };
+
     // --- Find the fd
 
-    auto fd = session->openFiles().get(tor->id(), file_index, do_write);
-    auto filename = tr_pathbuf{};
-    if (!fd && !getFilename(filename, tor, file_index, io_mode))
+    auto fd = open_files.get(tor_id, span.file_index, do_write);
+    auto filename = tr_pathbuf{ span.filename };
+    if (!fd && std::empty(filename) && (tor == nullptr || !getFilename(filename, tor, span.file_index, io_mode)))
     {
         auto const err = ENOENT;
-        auto const msg = fmt::format(
-            _("Couldn't get '{path}': {error} ({error_code})"),
-            fmt::arg("path", tor->file_subpath(file_index)),
-            fmt::arg("error", tr_strerror(err)),
-            fmt::arg("error_code", err));
-        tr_error_set(error, err, msg);
+        result.err = err;
+        if (do_write)
+        {
+            result.local_error = fmt::format(
+                _("Couldn't get '{path}': {error} ({error_code})"),
+                fmt::arg("path", subpath()),
+                fmt::arg("error", tr_strerror(err)),
+                fmt::arg("error_code", err));
+        }
         return;
     }
 
     if (!fd) // not in the cache, so open or create it now
     {
         // open (and maybe create) the file
-        auto const prealloc = (!do_write || !tor->file_is_wanted(file_index)) ? TR_PREALLOCATE_NONE :
-                                                                                tor->session->preallocationMode();
-        fd = session->openFiles().get(tor->id(), file_index, do_write, filename, prealloc, file_size);
+        fd = open_files.get(tor_id, span.file_index, do_write, filename, span.prealloc, span.file_size);
         if (fd && do_write)
         {
             // make a note that we just created a file
-            tor->session->add_file_created();
+            ++result.n_files_created;
         }
     }
 
@@ -158,90 +271,140 @@ void readOrWriteBytes(
             fmt::arg("path", filename),
             fmt::arg("error", tr_strerror(err)),
             fmt::arg("error_code", err));
-        tr_error_set(error, err, msg);
-        tr_logAddErrorTor(tor, std::move(msg));
+        result.err = err;
+        if (do_write)
+        {
+            result.local_error = msg;
+        }
+        result.log_message = std::move(msg);
         return;
     }
 
     switch (io_mode)
     {
     case IoMode::Read:
-        if (tr_error* my_error = nullptr; !readEntireBuf(*fd, file_offset, buf, buflen, &my_error) && my_error != nullptr)
+        if (tr_error* my_error = nullptr;
+            !readEntireBufs(*fd, span.file_offset, bufs, n_bufs, &my_error) && my_error != nullptr)
         {
-            tr_logAddErrorTor(
-                tor,
-                fmt::format(
-                    _("Couldn't read '{path}': {error} ({error_code})"),
-                    fmt::arg("path", tor->file_subpath(file_index)),
-                    fmt::arg("error", my_error->message),
-                    fmt::arg("error_code", my_error->code)));
-            tr_error_propagate(error, &my_error);
-            return;
+            result.err = my_error->code;
+            result.log_message = fmt::format(
+                _("Couldn't read '{path}': {error} ({error_code})"),
+                fmt::arg("path", subpath()),
+                fmt::arg("error", my_error->message),
+                fmt::arg("error_code", my_error->code));
+            tr_error_clear(&my_error);
         }
         break;
 
     case IoMode::Write:
-        if (tr_error* my_error = nullptr; !writeEntireBuf(*fd, file_offset, buf, buflen, &my_error) && my_error != nullptr)
+        if (tr_error* my_error = nullptr;
+            !writeEntireBufs(*fd, span.file_offset, bufs, n_bufs, &my_error) && my_error != nullptr)
         {
-            tr_logAddErrorTor(
-                tor,
-                fmt::format(
-                    _("Couldn't save '{path}': {error} ({error_code})"),
-                    fmt::arg("path", tor->file_subpath(file_index)),
-                    fmt::arg("error", my_error->message),
-                    fmt::arg("error_code", my_error->code)));
-            tr_error_propagate(error, &my_error);
-            return;
+            result.err = my_error->code;
+            result.local_error = my_error->message;
+            result.log_message = fmt::format(
+                _("Couldn't save '{path}': {error} ({error_code})"),
+                fmt::arg("path", subpath()),
+                fmt::arg("error", my_error->message),
+                fmt::arg("error_code", my_error->code));
+            tr_error_clear(&my_error);
         }
         break;
 
     case IoMode::Prefetch:
-        tr_sys_file_advise(*fd, file_offset, buflen, TR_SYS_FILE_ADVICE_WILL_NEED);
+        tr_sys_file_advise(*fd, span.file_offset, span.n_bytes, TR_SYS_FILE_ADVICE_WILL_NEED);
         break;
     }
 }
 
-/* returns 0 on success, or an errno on failure */
-int readOrWritePiece(tr_torrent* tor, IoMode io_mode, tr_block_info::Location loc, uint8_t* buf, size_t buflen)
+IoResult readOrWriteSpans(
+    tr_open_files& open_files,
+    tr_torrent_id_t tor_id,
+    tr_torrent const* tor,
+    IoMode io_mode,
+    FileSpans const& spans,
+    tr_sys_iovec const* bufs)
 {
-    if (loc.piece >= tor->piece_count())
-    {
-        return EINVAL;
-    }
+    auto result = IoResult{};
 
-    auto [file_index, file_offset] = tor->file_offset(loc);
+    // the span may cross file boundaries, so walk `bufs` one file at a time
+    auto pass = small::vector<tr_sys_iovec, 16U>{};
+    auto buf_index = size_t{};
+    auto buf_offset = uint64_t{};
 
-    while (buflen != 0)
+    for (auto const& span : spans)
     {
-        uint64_t const bytes_this_pass = std::min(uint64_t{ buflen }, uint64_t{ tor->file_size(file_index) - file_offset });
-
-        tr_error* error = nullptr;
-        readOrWriteBytes(tor->session, tor, io_mode, file_index, file_offset, buf, bytes_this_pass, &error);
-
-        if (error != nullptr)
+        pass.clear();
+        for (auto left = span.n_bytes; left != 0;)
         {
-            if (io_mode == IoMode::Write && tor->error != TR_STAT_LOCAL_ERROR)
+            auto const& buf = bufs[buf_index];
+            auto const n = std::min(left, buf.size - buf_offset);
+            auto const* const data = buf.data == nullptr ? nullptr : static_cast<uint8_t const*>(buf.data) + buf_offset;
+            pass.push_back({ data, n });
+
+            left -= n;
+            buf_offset += n;
+            if (buf_offset == buf.size)
             {
-                tor->set_local_error(error->message);
-                tr_torrentStop(tor);
+                ++buf_index;
+                buf_offset = 0;
             }
-
-            auto const error_code = error->code;
-            tr_error_clear(&error);
-            return error_code;
         }
 
-        if (buf != nullptr)
+        readOrWriteBytes(open_files, tor_id, tor, io_mode, span, std::data(pass), std::size(pass), result);
+
+        if (result.err != 0)
         {
-            buf += bytes_this_pass;
+            break;
         }
-        buflen -= bytes_this_pass;
+    }
+
+    return result;
+}
+
+/* returns 0 on success, or an errno on failure */
+int applyResult(tr_torrent* tor, IoResult const& result)
+{
+    for (size_t i = 0; i < result.n_files_created; ++i)
+    {
+        tor->session->add_file_created();
+    }
 
-        ++file_index;
-        file_offset = 0;
+    if (!std::empty(result.log_message))
+    {
+        tr_logAddErrorTor(tor, std::string{ result.log_message });
+    }
+
+    if (!std::empty(result.local_error) && tor->error != TR_STAT_LOCAL_ERROR)
+    {
+        tor->set_local_error(result.local_error);
+        tr_torrentStop(tor);
     }
 
-    return 0;
+    return result.err;
+}
+
+[[nodiscard]] uint64_t countBytes(tr_sys_iovec const* bufs, size_t n_bufs)
+{
+    auto n_bytes = uint64_t{};
+    for (size_t i = 0; i < n_bufs; ++i)
+    {
+        n_bytes += bufs[i].size;
+    }
+    return n_bytes;
+}
+
+/* returns 0 on success, or an errno on failure */
+int readOrWritePiece(tr_torrent* tor, IoMode io_mode, tr_block_info::Location loc, tr_sys_iovec const* bufs, size_t n_bufs)
+{
+    // we're in the session thread, so look files up only if they're not already open
+    auto const spans = makeFileSpans(tor, io_mode, loc, countBytes(bufs, n_bufs), false);
+    if (!spans)
+    {
+        return EINVAL;
+    }
+
+    return applyResult(tor, readOrWriteSpans(tor->session->openFiles(), tor->id(), tor, io_mode, *spans, bufs));
 }
 
 std::optional<tr_sha1_digest_t> recalculateHash(tr_torrent* tor, tr_piece_index_t piece)
@@ -290,17 +453,25 @@ std::optional<tr_sha1_digest_t> recalculateHash(tr_torrent* tor, tr_piece_index_
 
 int tr_ioRead(tr_torrent* tor, tr_block_info::Location const& loc, size_t len, uint8_t* setme)
 {
-    return readOrWritePiece(tor, IoMode::Read, loc, setme, len);
+    auto const buf = tr_sys_iovec{ setme, len };
+    return readOrWritePiece(tor, IoMode::Read, loc, &buf, 1U);
 }
 
 int tr_ioPrefetch(tr_torrent* tor, tr_block_info::Location const& loc, size_t len)
 {
-    return readOrWritePiece(tor, IoMode::Prefetch, loc, nullptr, len);
+    auto const buf = tr_sys_iovec{ nullptr, len };
+    return readOrWritePiece(tor, IoMode::Prefetch, loc, &buf, 1U);
 }
 
 int tr_ioWrite(tr_torrent* tor, tr_block_info::Location const& loc, size_t len, uint8_t const* writeme)
 {
-    return readOrWritePiece(tor, IoMode::Write, loc, const_cast<uint8_t*>(writeme), len);
+    auto const buf = tr_sys_iovec{ writeme, len };
+    return readOrWritePiece(tor, IoMode::Write, loc, &buf, 1U);
+}
+
+int tr_ioWrite(tr_torrent* tor, tr_block_info::Location const& loc, tr_sys_iovec const* bufs, size_t n_bufs)
+{
+    return readOrWritePiece(tor, IoMode::Write, loc, bufs, n_bufs);
 }
 
 bool tr_ioTestPiece(tr_torrent* tor, tr_piece_index_t piece)
@@ -308,3 +479,250 @@ bool tr_ioTestPiece(tr_torrent* tor, tr_piece_index_t piece)
     auto const hash = recalculateHash(tor, piece);
     return hash && *hash == tor->piece_hash(piece);
 }
+
+// ---
+
+struct tr_io_pool::Worker
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Job> jobs;
+    bool stopping = false;
+    size_t max_open_files = 0;
+    std::thread thread;
+};
+
+tr_io_pool::tr_io_pool(tr_session* session, size_t n_threads)
+    : session_{ session }
+{
+    // The workers' files count against the session's open files limit.
+    // They get up to half of it, and the session thread keeps the rest.
+    static auto constexpr MaxFilesLent = tr_open_files::MaxOpenFiles / 2U;
+    n_threads = std::clamp(n_threads, size_t{ 1U }, MaxFilesLent);
+    auto const files_per_worker = MaxFilesLent / n_threads;
+    n_files_lent_ = files_per_worker * n_threads;
+    session_->openFiles().lend(n_files_lent_);
+
+    for (size_t i = 0; i < n_threads; ++i)
+    {
+        auto& worker = *workers_.emplace_back(std::make_unique<Worker>());
+        worker.max_open_files = files_per_worker;
+        worker.thread = std::thread(&tr_io_pool::worker_func, std::ref(worker));
+    }
+}
+
+tr_io_pool::~tr_io_pool()
+{
+    // let the workers finish their queued jobs, but don't deliver any more results
+    for (auto& worker : workers_)
+    {
+        auto const lock = std::lock_guard(worker->mutex);
+        worker->stopping = true;
+        worker->cv.notify_one();
+    }
+
+    for (auto& worker : workers_)
+    {
+        worker->thread.join();
+    }
+
+    session_->openFiles().take_back(n_files_lent_);
+}
+
+void tr_io_pool::worker_func(Worker& worker)
+{
+    // Each worker has its own files, so they're never shared between threads.
+    // A torrent's jobs always go to the same worker, which keeps them in order.
+    auto open_files = tr_open_files{ worker.max_open_files };
+
+    auto lock = std::unique_lock(worker.mutex);
+    for (;;)
+    {
+        worker.cv.wait(lock, [&worker]() { return worker.stopping || !std::empty(worker.jobs); });
+        if (std::empty(worker.jobs))
+        {
+            break;
+        }
+
+        auto job = std::move(worker.jobs.front());
+        worker.jobs.pop_front();
+
+        lock.unlock();
+        job(open_files);
+        lock.lock();
+    }
+}
+
+void tr_io_pool::submit(tr_torrent_id_t tor_id, Job&& job)
+{
+    auto& worker = *workers_[static_cast<size_t>(tor_id) % std::size(workers_)];
+    auto const lock = std::lock_guard(worker.mutex);
+    worker.jobs.emplace_back(std::move(job));
+    worker.cv.notify_one();
+}
+
+void tr_io_pool::post(std::function<void()>&& func)
+{
+    session_->runInSessionThread(
+        [alive = std::weak_ptr<bool>{ alive_ }, func = std::move(func)]()
+        {
+            if (!alive.expired())
+            {
+                func();
+            }
+        });
+}
+
+void tr_io_pool::finish(tr_torrent_id_t tor_id, DoneFunc&& on_done, int err, std::function<void()>&& then)
+{
+    {
+        auto const lock = std::lock_guard{ done_mutex_ };
+        done_.push_back({ tor_id, std::move(on_done), err });
+    }
+
+    post(
+        [this, tor_id, then = std::move(then)]()
+        {
+            run_done_callbacks(tor_id);
+            then();
+        });
+}
+
+void tr_io_pool::run_done_callbacks(tr_torrent_id_t tor_id)
+{
+    auto done = std::vector<Done>{};
+
+    {
+        auto const lock = std::lock_guard{ done_mutex_ };
+        for (auto iter = std::begin(done_); iter != std::end(done_);)
+        {
+            if (iter->tor_id == tor_id)
+            {
+                done.emplace_back(std::move(*iter));
+                iter = done_.erase(iter);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+    }
+
+    for (auto const& [id, on_done, err] : done)
+    {
+        on_done(err);
+    }
+}
+
+void tr_io_pool::wait_for(tr_torrent_id_t tor_id, Job&& job)
+{
+    auto promise = std::promise<void>{};
+    auto future = promise.get_future();
+    submit(
+        tor_id,
+        [&job, &promise](tr_open_files& open_files)
+        {
+            job(open_files);
+            promise.set_value();
+        });
+    future.wait();
+}
+
+void tr_io_pool::read(tr_torrent* tor, tr_block_info::Location const& loc, size_t len, uint8_t* setme, DoneFunc&& on_done)
+{
+    auto const tor_id = tor->id();
+    auto spans = makeFileSpans(tor, IoMode::Read, loc, len, true);
+    if (!spans)
+    {
+        finish(tor_id, std::move(on_done), EINVAL, []() {});
+        return;
+    }
+
+    submit(
+        tor_id,
+        [this, tor_id, spans = std::move(*spans), len, setme, on_done = std::move(on_done)](tr_open_files& open_files) mutable
+        {
+            auto const buf = tr_sys_iovec{ setme, len };
+            auto result = readOrWriteSpans(open_files, tor_id, nullptr, IoMode::Read, spans, &buf);
+            auto const err = result.err;
+            finish(
+                tor_id,
+                std::move(on_done),
+                err,
+                [this, tor_id, result = std::move(result)]()
+                {
+                    if (auto* const session_tor = session_->torrents().get(tor_id); session_tor != nullptr)
+                    {
+                        applyResult(session_tor, result);
+                    }
+                });
+        });
+}
+
+void tr_io_pool::write(
+    tr_torrent* tor,
+    tr_block_info::Location const& loc,
+    std::vector<tr_sys_iovec>&& bufs,
+    DoneFunc&& on_done)
+{
+    auto const tor_id = tor->id();
+    auto spans = makeFileSpans(tor, IoMode::Write, loc, countBytes(std::data(bufs), std::size(bufs)), true);
+    if (!spans)
+    {
+        finish(tor_id, std::move(on_done), EINVAL, []() {});
+        return;
+    }
+
+    submit(
+        tor_id,
+        [this, tor_id, spans = std::move(*spans), bufs = std::move(bufs), on_done = std::move(on_done)](
+            tr_open_files& open_files) mutable
+        {
+            auto result = readOrWriteSpans(open_files, tor_id, nullptr, IoMode::Write, spans, std::data(bufs));
+            auto const err = result.err;
+
+            // `on_done` is called first, so that the caller can deal with
+            // its blocks before the torrent is stopped for a write error
+            finish(
+                tor_id,
+                std::move(on_done),
+                err,
+                [this, tor_id, result = std::move(result)]()
+                {
+                    if (auto* const session_tor = session_->torrents().get(tor_id); session_tor != nullptr)
+                    {
+                        applyResult(session_tor, result);
+                    }
+                });
+        });
+}
+
+void tr_io_pool::prefetch(tr_torrent* tor, tr_block_info::Location const& loc, size_t len)
+{
+    auto spans = makeFileSpans(tor, IoMode::Prefetch, loc, len, true);
+    if (!spans)
+    {
+        return;
+    }
+
+    auto const tor_id = tor->id();
+    submit(
+        tor_id,
+        [tor_id, spans = std::move(*spans), len](tr_open_files& open_files)
+        {
+            auto const buf = tr_sys_iovec{ nullptr, len };
+            readOrWriteSpans(open_files, tor_id, nullptr, IoMode::Prefetch, spans, &buf);
+        });
+}
+
+void tr_io_pool::close_torrent(tr_torrent_id_t tor_id)
+{
+    wait_for(tor_id, [tor_id](tr_open_files& open_files) { open_files.close_torrent(tor_id); });
+    run_done_callbacks(tor_id);
+}
+
+void tr_io_pool::close_file(tr_torrent_id_t tor_id, tr_file_index_t file_index)
+{
+    wait_for(tor_id, [tor_id, file_index](tr_open_files& open_files) { open_files.close_file(tor_id, file_index); });
+    run_done_callbacks(tor_id);
+}
@@ -11,11 +11,18 @@
 
 #include <cstddef> // size_t
 #include <cstdint> // uint8_t, uint32_t
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include "libtransmission/transmission.h"
 
 #include "libtransmission/block-info.h"
 
+class tr_open_files;
+struct tr_sys_iovec;
 struct tr_torrent;
 
 /**
@@ -37,9 +44,103 @@ int tr_ioPrefetch(tr_torrent* tor, tr_block_info::Location const& loc, size_t le
  */
 [[nodiscard]] int tr_ioWrite(struct tr_torrent* tor, tr_block_info::Location const& loc, size_t len, uint8_t const* writeme);
 
+/**
+ * Writes a contiguous span that starts at `loc` and is split across several
+ * buffers, e.g. a run of cached blocks. Spans may cross file boundaries.
+ * @return 0 on success, or an errno value on failure.
+ */
+[[nodiscard]] int tr_ioWrite(
+    struct tr_torrent* tor,
+    tr_block_info::Location const& loc,
+    struct tr_sys_iovec const* bufs,
+    size_t n_bufs);
+
 /**
  * @brief Test to see if the piece matches its metainfo's SHA1 checksum.
  */
 bool tr_ioTestPiece(tr_torrent* tor, tr_piece_index_t piece);
 
+/**
+ * Runs reads, writes, and prefetches on background threads so that the
+ * session thread doesn't block on the disk. A torrent's jobs always run
+ * in the order they were submitted, and their `on_done` callbacks are
+ * called in the session thread. Right after that, errors are handled
+ * just like tr_ioRead() and tr_ioWrite() handle them.
+ *
+ * Where a job's files are is looked up when the job is submitted, so
+ * the workers never touch the torrent itself. After its files are moved
+ * or renamed, close_torrent() or close_file() must be called so that
+ * the workers stop using the old ones.
+ *
+ * The workers' open files count against the session's open files limit.
+ */
+class tr_io_pool
+{
+public:
+    // 0 on success, or an errno value on failure
+    using DoneFunc = std::function<void(int err)>;
+
+    tr_io_pool(tr_session* session, size_t n_threads);
+    ~tr_io_pool();
+
+    tr_io_pool(tr_io_pool const&) = delete;
+    tr_io_pool& operator=(tr_io_pool const&) = delete;
+    tr_io_pool(tr_io_pool&&) = delete;
+    tr_io_pool& operator=(tr_io_pool&&) = delete;
+
+    // `setme` must stay valid until `on_done` is called,
+    // e.g. by being owned by `on_done`.
+    void read(tr_torrent* tor, tr_block_info::Location const& loc, size_t len, uint8_t* setme, DoneFunc&& on_done);
+
+    // The buffers must stay valid until `on_done` is called,
+    // e.g. by being owned by `on_done`.
+    void write(tr_torrent* tor, tr_block_info::Location const& loc, std::vector<tr_sys_iovec>&& bufs, DoneFunc&& on_done);
+
+    void prefetch(tr_torrent* tor, tr_block_info::Location const& loc, size_t len);
+
+    // Wait for the torrent's queued jobs to finish and close its files.
+    // The finished jobs' `on_done` callbacks are called before returning.
+    void close_torrent(tr_torrent_id_t tor_id);
+    void close_file(tr_torrent_id_t tor_id, tr_file_index_t file_index);
+
+private:
+    struct Worker;
+
+    using Job = std::function<void(tr_open_files&)>;
+
+    void submit(tr_torrent_id_t tor_id, Job&& job);
+
+    // run `func` in the session thread, unless this pool has been destroyed by then
+    void post(std::function<void()>&& func);
+
+    void wait_for(tr_torrent_id_t tor_id, Job&& job);
+
+    // queue a finished job's `on_done`, then call it and `then` in the session thread
+    void finish(tr_torrent_id_t tor_id, DoneFunc&& on_done, int err, std::function<void()>&& then);
+
+    // call the queued `on_done` callbacks of the torrent's finished jobs
+    void run_done_callbacks(tr_torrent_id_t tor_id);
+
+    static void worker_func(Worker& worker);
+
+    struct Done
+    {
+        tr_torrent_id_t tor_id;
+        DoneFunc on_done;
+        int err;
+    };
+
+    tr_session* const session_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    // Finished jobs whose `on_done` hasn't been called yet, oldest first.
+    // They're queued here so that close_torrent() and close_file() can
+    // call them right away instead of waiting for the session thread.
+    std::mutex done_mutex_;
+    std::deque<Done> done_;
+
+    size_t n_files_lent_ = 0;
+    std::shared_ptr<bool> const alive_ = std::make_shared<bool>(true);
+};
+
 /* @} */
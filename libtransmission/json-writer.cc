@@ -0,0 +1,235 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <array>
+#include <cctype> // isprint()
+#include <cmath> // fabs()
+#include <cstddef> // size_t, std::byte
+#include <cstdint> // int64_t, uint16_t
+#include <string_view>
+
+#define UTF_CPP_CPLUSPLUS 201703L
+#include <utf8.h>
+
+#include <fmt/core.h>
+#include <fmt/compile.h>
+
+#include "libtransmission/json-writer.h"
+#include "libtransmission/tr-assert.h"
+
+using namespace std::literals;
+
+namespace
+{
+[[nodiscard]] char* write_escaped_char(char* buf, char const* const end, std::string_view& sv)
+{
+    auto u16buf = std::array<std::uint16_t, 2>{};
+
+    auto const* const begin8 = std::data(sv);
+    auto const* const end8 = begin8 + std::size(sv);
+    auto const* walk8 = begin8;
+    utf8::next(walk8, end8);
+    auto const end16 = utf8::utf8to16(begin8, walk8, std::begin(u16buf));
+
+    for (auto it = std::cbegin(u16buf); it != end16; ++it)
+    {
+        buf = fmt::format_to_n(buf, end - buf - 1, FMT_COMPILE("\\u{:04x}"), *it).out;
+    }
+
+    sv.remove_prefix(walk8 - begin8 - 1);
+    return buf;
+}
+} // namespace
+
+namespace libtransmission
+{
+
+void JsonWriter::write_int(Out& out, int64_t value)
+{
+    auto const [buf, buflen] = out.reserve_space(24U);
+    auto* const begin = reinterpret_cast<char*>(buf);
+    auto const* const end = fmt::format_to(begin, FMT_COMPILE("{:d}"), value);
+    out.commit_space(end - begin);
+}
+
+void JsonWriter::write_real(Out& out, double value)
+{
+    auto const [buf, buflen] = out.reserve_space(64U);
+    auto* walk = reinterpret_cast<char*>(buf);
+    auto const* const begin = walk;
+
+    if (fabs(value - (int)value) < 0.00001)
+    {
+        walk = fmt::format_to(walk, FMT_COMPILE("{:.0f}"), value);
+    }
+    else
+    {
+        walk = fmt::format_to(walk, FMT_COMPILE("{:.4f}"), value);
+    }
+
+    out.commit_space(walk - begin);
+}
+
+void JsonWriter::write_string(Out& out, std::string_view sv)
+{
+    auto const [buf, buflen] = out.reserve_space(std::size(sv) * 6 + 2);
+    auto* walk = reinterpret_cast<char*>(buf);
+    auto const* const begin = walk;
+    auto const* const end = begin + buflen;
+
+    *walk++ = '"';
+
+    for (; !std::empty(sv); sv.remove_prefix(1))
+    {
+        switch (sv.front())
+        {
+        case '\b':
+            *walk++ = '\\';
+            *walk++ = 'b';
+            break;
+
+        case '\f':
+            *walk++ = '\\';
+            *walk++ = 'f';
+            break;
+
+        case '\n':
+            *walk++ = '\\';
+            *walk++ = 'n';
+            break;
+
+        case '\r':
+            *walk++ = '\\';
+            *walk++ = 'r';
+            break;
+
+        case '\t':
+            *walk++ = '\\';
+            *walk++ = 't';
+            break;
+
+        case '"':
+            *walk++ = '\\';
+            *walk++ = '"';
+            break;
+
+        case '\\':
+            *walk++ = '\\';
+            *walk++ = '\\';
+            break;
+
+        default:
+            if (isprint((unsigned char)sv.front()) != 0)
+            {
+                *walk++ = sv.front();
+            }
+            else
+            {
+                try
+                {
+                    walk = write_escaped_char(walk, end, sv);
+                }
+                catch (utf8::exception const&)
+                {
+                    *walk++ = '?';
+                }
+            }
+            break;
+        }
+    }
+
+    *walk++ = '"';
+    TR_ASSERT(walk <= end);
+    out.commit_space(walk - begin);
+}
+
+// ---
+
+void JsonWriter::before_value()
+{
+    if (after_key_)
+    {
+        after_key_ = false;
+        return;
+    }
+
+    if (!std::empty(has_children_))
+    {
+        if (has_children_.back())
+        {
+            out_.push_back(',');
+        }
+
+        has_children_.back() = true;
+    }
+}
+
+void JsonWriter::start_object()
+{
+    before_value();
+    out_.push_back('{');
+    has_children_.push_back(false);
+}
+
+void JsonWriter::end_object()
+{
+    TR_ASSERT(!std::empty(has_children_));
+    TR_ASSERT(!after_key_);
+
+    has_children_.pop_back();
+    out_.push_back('}');
+}
+
+void JsonWriter::start_array()
+{
+    before_value();
+    out_.push_back('[');
+    has_children_.push_back(false);
+}
+
+void JsonWriter::end_array()
+{
+    TR_ASSERT(!std::empty(has_children_));
+    TR_ASSERT(!after_key_);
+
+    has_children_.pop_back();
+    out_.push_back(']');
+}
+
+void JsonWriter::key(std::string_view key)
+{
+    TR_ASSERT(!after_key_);
+
+    before_value();
+    write_string(out_, key);
+    out_.push_back(':');
+    after_key_ = true;
+}
+
+void JsonWriter::add_bool(bool value)
+{
+    before_value();
+    out_.add(value ? "true"sv : "false"sv);
+}
+
+void JsonWriter::add_int(int64_t value)
+{
+    before_value();
+    write_int(out_, value);
+}
+
+void JsonWriter::add_real(double value)
+{
+    before_value();
+    write_real(out_, value);
+}
+
+void JsonWriter::add_str(std::string_view value)
+{
+    before_value();
+    write_string(out_, value);
+}
+
+} // namespace libtransmission
@@ -0,0 +1,105 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstddef> // size_t, std::byte
+#include <cstdint> // int64_t
+#include <string_view>
+
+#include <small/vector.hpp>
+
+#include "libtransmission/quark.h"
+#include "libtransmission/tr-buffer.h"
+
+namespace libtransmission
+{
+
+// Writes lean JSON straight into a buffer, one token at a time.
+// This lets big responses, e.g. RPC's `torrent-get`, be serialized
+// without first building them as a tr_variant tree.
+//
+// Commas and colons are added as needed, so callers only need to
+// give the keys and values in order, e.g.
+//
+// writer.start_object();
+// writer.key(TR_KEY_id);
+// writer.add_int(1);
+// writer.end_object();
+class JsonWriter
+{
+public:
+    using Out = BufferWriter<std::byte>;
+
+    explicit JsonWriter(Out& out)
+        : out_{ out }
+    {
+    }
+
+    void start_object();
+    void end_object();
+    void start_array();
+    void end_array();
+
+    void key(std::string_view key);
+
+    void key(tr_quark key)
+    {
+        this->key(tr_quark_get_string_view(key));
+    }
+
+    void add_bool(bool value);
+    void add_int(int64_t value);
+    void add_real(double value);
+    void add_str(std::string_view value);
+
+    void add_bool(tr_quark key, bool value)
+    {
+        this->key(key);
+        add_bool(value);
+    }
+
+    void add_int(tr_quark key, int64_t value)
+    {
+        this->key(key);
+        add_int(value);
+    }
+
+    void add_real(tr_quark key, double value)
+    {
+        this->key(key);
+        add_real(value);
+    }
+
+    void add_str(tr_quark key, std::string_view value)
+    {
+        this->key(key);
+        add_str(value);
+    }
+
+    // Helpers for writing JSON tokens without any bookkeeping.
+    // These are shared with the tr_variant serializer so that
+    // both ways of making JSON give the same text.
+    static void write_int(Out& out, int64_t value);
+    static void write_real(Out& out, double value);
+    static void write_string(Out& out, std::string_view value);
+
+private:
+    void before_value();
+
+    Out& out_;
+
+    // for each container we're in, whether it already has a child
+    small::vector<bool, 16U> has_children_;
+
+    // true when the next token is a key's value
+    bool after_key_ = false;
+};
+
+} // namespace libtransmission
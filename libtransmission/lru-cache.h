@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <cstddef> // size_t
 #include <cstdint>
@@ -69,6 +70,17 @@ public:
         }
     }
 
+    // Only use the first `capacity` slots, e.g. to share a limit with other caches.
+    // Items in the slots that are given up are erased.
+    void set_capacity(std::size_t capacity)
+    {
+        capacity_ = std::clamp(capacity, std::size_t{ 1U }, N);
+        for (auto i = capacity_; i < N; ++i)
+        {
+            erase(entries_[i]);
+        }
+    }
+
     using PreEraseCallback = std::function<void(Key const&, Val&)>;
 
     void setPreErase(PreEraseCallback&& func)
@@ -129,13 +141,14 @@ private:
     {
         auto const iter = std::min_element(
             std::begin(entries_),
-            std::end(entries_),
+            std::begin(entries_) + capacity_,
             [](auto const& a, auto const& b) { return a.sequence_ < b.sequence_; });
         this->erase(*iter);
         return *iter;
     }
 
     std::array<Entry, N> entries_;
+    std::size_t capacity_ = N;
     uint64_t next_sequence_ = 1;
     static uint64_t constexpr InvalidSeq = 0;
 };
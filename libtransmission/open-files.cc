@@ -262,6 +262,23 @@ void tr_open_files::close_file(tr_torrent_id_t tor_id, tr_file_index_t file_num)
     pool_.erase(make_key(tor_id, file_num));
 }
 
+void tr_open_files::lend(size_t n_files)
+{
+    n_lent_ += n_files;
+    update_capacity();
+}
+
+void tr_open_files::take_back(size_t n_files)
+{
+    n_lent_ -= std::min(n_files, n_lent_);
+    update_capacity();
+}
+
+void tr_open_files::update_capacity()
+{
+    pool_.set_capacity(n_lent_ < max_open_files_ ? max_open_files_ - n_lent_ : 1U);
+}
+
 tr_open_files::Val::~Val()
 {
     if (is_open(fd_))
@@ -24,6 +24,21 @@
 class tr_open_files
 {
 public:
+    static constexpr size_t MaxOpenFiles = 32;
+
+    tr_open_files() = default;
+
+    explicit tr_open_files(size_t max_open_files)
+        : max_open_files_{ max_open_files }
+    {
+        update_capacity();
+    }
+
+    // Let others, e.g. tr_io_pool's workers, keep `n_files` of our files
+    // open instead, so that all of them together stay within one limit.
+    void lend(size_t n_files);
+    void take_back(size_t n_files);
+
     [[nodiscard]] std::optional<tr_sys_file_t> get(tr_torrent_id_t tor_id, tr_file_index_t file_num, bool writable);
 
     [[nodiscard]] std::optional<tr_sys_file_t> get(
@@ -67,6 +82,9 @@ private:
         bool writable_ = false;
     };
 
-    static constexpr size_t MaxOpenFiles = 32;
+    void update_capacity();
+
     tr_lru_cache<Key, Val, MaxOpenFiles> pool_;
+    size_t max_open_files_ = MaxOpenFiles;
+    size_t n_lent_ = 0;
 };
@@ -53,6 +53,9 @@ public:
         Error
     };
 
+    // NB: GotBitfield, GotHaveAll, and GotHaveNone are published before the
+    // peer's `has()` is replaced, so that listeners can see both old and new.
+    // GotHave is published after the piece is added.
     Type type = Type::Error;
 
     tr_bitfield* bitfield = nullptr; // for GotBitfield
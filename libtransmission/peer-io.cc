@@ -3,9 +3,11 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
-#include <array>
 #include <cerrno>
 #include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility> // std::exchange
 
 #ifdef _WIN32
 #include <ws2tcpip.h>
@@ -29,6 +31,7 @@
 #include "libtransmission/peer-io.h"
 #include "libtransmission/peer-socket.h" // tr_peer_socket, tr_netOpen...
 #include "libtransmission/session.h"
+#include "libtransmission/session-thread.h"
 #include "libtransmission/tr-assert.h"
 #include "libtransmission/utils.h" // for _()
 
@@ -77,6 +80,208 @@ size_t get_desired_output_buffer_size(tr_peerIo const* io, uint64_t now)
 
 // ---
 
+tr_peer_io_threads::tr_peer_io_threads(size_t n_threads)
+{
+    TR_ASSERT(n_threads > 0U);
+
+    threads_.reserve(n_threads);
+    for (size_t i = 0; i < n_threads; ++i)
+    {
+        threads_.emplace_back(tr_session_thread::create());
+    }
+}
+
+tr_peer_io_threads::~tr_peer_io_threads() = default;
+
+tr_session_thread& tr_peer_io_threads::next() noexcept
+{
+    auto& thread = *threads_[next_];
+    next_ = (next_ + 1U) % std::size(threads_);
+    return thread;
+}
+
+// ---
+
+// After move_to_thread(), the socket's events fire in an I/O thread.
+// They only use this struct -- never the tr_peerIo -- and trade data
+// with the session thread through the buffers guarded by `mutex`.
+struct tr_peerIo::Offload
+{
+    Offload(std::weak_ptr<tr_peerIo> io_in, tr_session* session_in, tr_socket_t fd_in, Filter const& filter_in)
+        : io{ std::move(io_in) }
+        , session{ session_in }
+        , fd{ fd_in }
+        , filter{ filter_in }
+    {
+    }
+
+    static void event_read_cb(evutil_socket_t fd, short /*event*/, void* voffload);
+    static void event_write_cb(evutil_socket_t fd, short /*event*/, void* voffload);
+
+    void set_error(tr_error const& error)
+    {
+        if (error_code == 0)
+        {
+            error_code = error.code;
+            error_message = error.message;
+        }
+    }
+
+    // ask the session thread to call on_offload_events(), unless it's already been asked
+    void notify()
+    {
+        {
+            auto const lock = std::lock_guard{ mutex };
+            if (std::exchange(is_notify_pending, true))
+            {
+                return;
+            }
+        }
+
+        session->runInSessionThread(
+            [weak_io = io]()
+            {
+                if (auto const peer_io = weak_io.lock(); peer_io)
+                {
+                    peer_io->on_offload_events();
+                }
+            });
+    }
+
+    std::weak_ptr<tr_peerIo> const io;
+    tr_session* const session;
+    tr_socket_t const fd;
+
+    // only used in the I/O thread
+    Filter filter;
+    PeerBuffer raw_in; // read from the socket, not decrypted yet
+    libtransmission::ChainBuffer out; // encrypted, not sent yet
+
+    std::mutex mutex;
+
+    // guarded by `mutex`
+    PeerBuffer in; // decrypted, not picked up by the session thread yet
+    libtransmission::ChainBuffer out_plain; // handed off by the session thread, not encrypted yet
+    size_t n_written = 0U; // sent, not reported to the session thread yet
+    size_t read_budget = 0U; // how many more bytes the bandwidth allows us to read
+    size_t n_reading = 0U; // how much of `read_budget` the read in progress may use
+    int error_code = 0;
+    std::string error_message;
+    bool is_notify_pending = false;
+
+    // These are declared last so that they're freed first. Freeing an event
+    // waits for its callback to return if it's running in the I/O thread.
+    libtransmission::evhelpers::event_unique_ptr event_read;
+    libtransmission::evhelpers::event_unique_ptr event_write;
+};
+
+void tr_peerIo::Offload::event_read_cb([[maybe_unused]] evutil_socket_t fd, short /*event*/, void* voffload)
+{
+    auto* const self = static_cast<Offload*>(voffload);
+    TR_ASSERT(self->fd == fd);
+
+    auto lock = std::unique_lock{ self->mutex };
+    auto const budget = self->read_budget;
+    self->n_reading = budget;
+    lock.unlock();
+
+    // no bandwidth left; the session thread re-arms the event when there is
+    if (budget == 0U)
+    {
+        return;
+    }
+
+    tr_error* error = nullptr;
+    auto const n_read = self->raw_in.add_socket(self->fd, budget, &error);
+    if (n_read == 0U && error != nullptr && canRetryFromError(error->code))
+    {
+        lock.lock();
+        self->n_reading = 0U;
+        lock.unlock();
+
+        tr_error_clear(&error);
+        event_add(self->event_read.get(), nullptr);
+        return;
+    }
+
+    lock.lock();
+    self->n_reading = 0U;
+    auto const [buf, buflen] = self->in.reserve_space(n_read);
+    self->filter.decrypt(std::data(self->raw_in), n_read, buf);
+    self->in.commit_space(n_read);
+    self->raw_in.drain(n_read);
+    self->read_budget -= std::min(self->read_budget, n_read);
+    if (error != nullptr)
+    {
+        self->set_error(*error);
+    }
+    auto const keep_reading = error == nullptr && self->read_budget > 0U && std::size(self->in) < RcvBuf;
+    lock.unlock();
+
+    tr_error_clear(&error);
+
+    if (keep_reading)
+    {
+        event_add(self->event_read.get(), nullptr);
+    }
+
+    self->notify();
+}
+
+void tr_peerIo::Offload::event_write_cb([[maybe_unused]] evutil_socket_t fd, short /*event*/, void* voffload)
+{
+    auto* const self = static_cast<Offload*>(voffload);
+    TR_ASSERT(self->fd == fd);
+
+    auto lock = std::unique_lock{ self->mutex };
+    if (!self->filter.is_active())
+    {
+        self->out.splice(self->out_plain);
+    }
+    else
+    {
+        while (!std::empty(self->out_plain))
+        {
+            auto const [span_begin, span_len] = self->out_plain.front();
+            auto const [buf, buflen] = self->out.reserve_space(span_len);
+            self->filter.encrypt(span_begin, span_len, buf);
+            self->out.commit_space(span_len);
+            self->out_plain.drain(span_len);
+        }
+    }
+    lock.unlock();
+
+    tr_error* error = nullptr;
+    auto const n_written = self->out.to_socket(self->fd, SIZE_MAX, &error);
+    if (error != nullptr && canRetryFromError(error->code))
+    {
+        tr_error_clear(&error);
+    }
+
+    if (error == nullptr && !std::empty(self->out))
+    {
+        event_add(self->event_write.get(), nullptr);
+    }
+
+    if (n_written == 0U && error == nullptr)
+    {
+        return;
+    }
+
+    lock.lock();
+    self->n_written += n_written;
+    if (error != nullptr)
+    {
+        self->set_error(*error);
+    }
+    lock.unlock();
+
+    tr_error_clear(&error);
+    self->notify();
+}
+
+// ---
+
 tr_peerIo::tr_peerIo(
     tr_session* session,
     tr_sha1_digest_t const* info_hash,
@@ -198,13 +403,19 @@ void tr_peerIo::set_socket(tr_peer_socket socket_in)
     {
         TR_ASSERT_MSG(false, "unsupported peer socket type");
     }
+
+    // start reading in the next bandwidth allocation
+    bandwidth_.notify_bandwidth_wanted(TR_DOWN);
 }
 
 void tr_peerIo::close()
 {
-    socket_.close();
+    // free the events before closing their socket
+    offload_.reset();
+    n_out_in_flight_ = 0U;
     event_write_.reset();
     event_read_.reset();
+    socket_.close();
 }
 
 void tr_peerIo::clear()
@@ -219,6 +430,7 @@ bool tr_peerIo::reconnect()
 {
     TR_ASSERT(!this->is_incoming());
     TR_ASSERT(this->session_->allowsTCP());
+    TR_ASSERT(!offload_);
 
     short int const pending_events = this->pending_events_;
     event_disable(EV_READ | EV_WRITE);
@@ -253,7 +465,7 @@ void tr_peerIo::did_write_wrapper(size_t bytes_transferred)
 
     while (bytes_transferred != 0 && !std::empty(outbuf_info_))
     {
-        auto& [n_bytes_left, is_piece_data] = outbuf_info_.front();
+        auto& [n_bytes_left, is_piece_data, file, file_offset] = outbuf_info_.front();
 
         size_t const payload = std::min(uint64_t{ n_bytes_left }, uint64_t{ bytes_transferred });
         /* For µTP sockets, the overhead is computed in utp_on_overhead. */
@@ -274,6 +486,11 @@ void tr_peerIo::did_write_wrapper(size_t bytes_transferred)
 
         bytes_transferred -= payload;
         n_bytes_left -= payload;
+        if (file)
+        {
+            file_offset += payload;
+            n_file_bytes_ -= payload;
+        }
         if (n_bytes_left == 0)
         {
             outbuf_info_.pop_front();
@@ -290,19 +507,52 @@ size_t tr_peerIo::try_write(size_t max)
         return {};
     }
 
-    auto& buf = outbuf_;
-    max = std::min(max, std::size(buf));
-    max = bandwidth().clamp(Dir, max);
+    if (offload_)
+    {
+        return offload_write(max);
+    }
+
+    auto const n_wanted = std::min(max, outbound_size());
+    max = bandwidth().clamp(Dir, n_wanted);
     if (max == 0)
     {
         set_enabled(Dir, false);
+
+        // if we ran out of bandwidth before we ran out of data,
+        // get in line for more
+        if (n_wanted != 0U)
+        {
+            bandwidth().notify_bandwidth_wanted(Dir);
+        }
+
         return {};
     }
 
     tr_error* error = nullptr;
-    auto const n_written = socket_.try_write(buf, max, &error);
+    auto n_written = size_t{};
+    if (auto const& front = outbuf_info_.front(); front.file)
+    {
+        n_written = socket_.try_sendfile(front.file->fd(), front.file_offset, std::min(max, front.n_bytes), &error);
+    }
+    else
+    {
+        // send from outbuf_, stopping at the next message that's in a file
+        auto n_buffered = size_t{};
+        for (auto const& info : outbuf_info_)
+        {
+            if (info.file)
+            {
+                break;
+            }
+
+            n_buffered += info.n_bytes;
+        }
+
+        n_written = socket_.try_write(outbuf_, std::min(max, n_buffered), &error);
+    }
+
     // enable further writes if there's more data to write
-    set_enabled(Dir, !std::empty(buf) && (error == nullptr || canRetryFromError(error->code)));
+    set_enabled(Dir, outbound_size() > n_written && (error == nullptr || canRetryFromError(error->code)));
 
     if (error != nullptr)
     {
@@ -411,21 +661,31 @@ size_t tr_peerIo::try_read(size_t max)
 
     if (max == 0)
     {
+        // the read buffer is full; try again after the next allocation
+        bandwidth().notify_bandwidth_wanted(Dir);
         return {};
     }
 
-    // Do not write more than the bandwidth allows.
-    // If there is no bandwidth left available, disable writes.
+    if (offload_)
+    {
+        return offload_read(max);
+    }
+
+    // Do not read more than the bandwidth allows.
+    // If there is no bandwidth left available, disable reads
+    // until the next allocation.
     max = bandwidth().clamp(TR_DOWN, max);
     if (max == 0)
     {
         set_enabled(Dir, false);
+        bandwidth().notify_bandwidth_wanted(Dir);
         return {};
     }
 
     auto& buf = inbuf_;
     tr_error* error = nullptr;
     auto const n_read = socket_.try_read(buf, max, std::empty(buf), &error);
+    decrypt_inbuf();
     set_enabled(Dir, error == nullptr || canRetryFromError(error->code));
 
     if (error != nullptr)
@@ -470,6 +730,25 @@ void tr_peerIo::event_enable(short event)
 {
     TR_ASSERT(session_ != nullptr);
 
+    if (offload_)
+    {
+        // always top up the read budget, since this is how tr_bandwidth
+        // tells us that a new period's bandwidth is available
+        if ((event & EV_READ) != 0)
+        {
+            pending_events_ |= EV_READ;
+            offload_read(RcvBuf - std::min(RcvBuf, std::size(inbuf_)));
+        }
+
+        if ((event & EV_WRITE) != 0)
+        {
+            pending_events_ |= EV_WRITE;
+            offload_write(SIZE_MAX);
+        }
+
+        return;
+    }
+
     bool const need_events = socket_.is_tcp();
     TR_ASSERT(!need_events || event_read_);
     TR_ASSERT(!need_events || event_write_);
@@ -501,6 +780,20 @@ void tr_peerIo::event_enable(short event)
 
 void tr_peerIo::event_disable(short event)
 {
+    if (offload_)
+    {
+        // Whatever was handed to the I/O thread still gets sent,
+        // but nothing more is read until reading is enabled again.
+        if ((event & EV_READ) != 0)
+        {
+            auto const lock = std::lock_guard{ offload_->mutex };
+            offload_->read_budget = 0U;
+        }
+
+        pending_events_ &= ~event;
+        return;
+    }
+
     bool const need_events = socket_.is_tcp();
     TR_ASSERT(!need_events || event_read_);
     TR_ASSERT(!need_events || event_write_);
@@ -559,14 +852,14 @@ size_t tr_peerIo::flush_outgoing_protocol_msgs()
 
     /* count up how many bytes are used by non-piece-data messages
        at the front of our outbound queue */
-    for (auto const& [n_bytes, is_piece_data] : outbuf_info_)
+    for (auto const& info : outbuf_info_)
     {
-        if (is_piece_data)
+        if (info.is_piece_data)
         {
             break;
         }
 
-        byte_count += n_bytes;
+        byte_count += info.n_bytes;
     }
 
     return flush(TR_UP, byte_count);
@@ -574,10 +867,193 @@ size_t tr_peerIo::flush_outgoing_protocol_msgs()
 
 // ---
 
+void tr_peerIo::move_to_thread(tr_session_thread& thread)
+{
+    TR_ASSERT(session_->am_in_session_thread());
+    TR_ASSERT(!offload_);
+    TR_ASSERT(n_file_bytes_ == 0U);
+
+    if (!socket_.is_tcp() || offload_)
+    {
+        return;
+    }
+
+    auto const pending_events = pending_events_;
+    event_disable(EV_READ | EV_WRITE);
+    event_read_.reset();
+    event_write_.reset();
+
+    auto const fd = socket_.handle.tcp;
+    auto offload = std::make_unique<Offload>(weak_from_this(), session_, fd, filter_);
+
+    // outbuf_ is already encrypted, so it goes straight to the socket
+    if (auto const n_bytes = std::size(outbuf_); n_bytes != 0U)
+    {
+        offload->out.splice(outbuf_);
+        n_out_in_flight_ = n_bytes;
+    }
+
+    offload->event_read.reset(event_new(thread.event_base(), fd, EV_READ, &Offload::event_read_cb, offload.get()));
+    offload->event_write.reset(event_new(thread.event_base(), fd, EV_WRITE, &Offload::event_write_cb, offload.get()));
+    offload_ = std::move(offload);
+
+    tr_logAddTraceIo(this, "moved to an I/O thread");
+
+    if (n_out_in_flight_ != 0U)
+    {
+        event_add(offload_->event_write.get(), nullptr);
+    }
+
+    event_enable(pending_events);
+}
+
+size_t tr_peerIo::offload_read(size_t max)
+{
+    TR_ASSERT(offload_);
+
+    auto budget = bandwidth().clamp(TR_DOWN, max);
+
+    {
+        // The bandwidth doesn't know about bytes that the I/O thread
+        // has read, or may be reading right now, until the session
+        // thread picks them up. Don't grant them a second time.
+        auto const lock = std::lock_guard{ offload_->mutex };
+        budget -= std::min(budget, std::size(offload_->in) + offload_->n_reading);
+        offload_->read_budget = budget;
+    }
+
+    if (budget != 0U)
+    {
+        event_add(offload_->event_read.get(), nullptr);
+    }
+    else
+    {
+        bandwidth().notify_bandwidth_wanted(TR_DOWN);
+    }
+
+    // the bytes show up later, in on_offload_events()
+    return {};
+}
+
+size_t tr_peerIo::offload_write(size_t max)
+{
+    TR_ASSERT(offload_);
+
+    // Hand off one batch at a time, so that the bandwidth
+    // used by the last batch is known before allowing the next
+    if (n_out_in_flight_ != 0U)
+    {
+        return {};
+    }
+
+    auto const n_wanted = std::min(max, std::size(outbuf_));
+    max = bandwidth().clamp(TR_UP, n_wanted);
+    if (max == 0U)
+    {
+        event_disable(EV_WRITE);
+
+        if (n_wanted != 0U)
+        {
+            bandwidth().notify_bandwidth_wanted(TR_UP);
+        }
+
+        return {};
+    }
+
+    {
+        auto const lock = std::lock_guard{ offload_->mutex };
+        offload_->out_plain.splice(outbuf_, max);
+    }
+
+    n_out_in_flight_ = max;
+    event_add(offload_->event_write.get(), nullptr);
+    return max;
+}
+
+void tr_peerIo::on_offload_events()
+{
+    TR_ASSERT(session_->am_in_session_thread());
+
+    if (!offload_)
+    {
+        return;
+    }
+
+    auto const keep_alive = shared_from_this();
+
+    auto n_read = size_t{};
+    auto n_written = size_t{};
+    auto error_code = int{};
+    auto error_message = std::string{};
+
+    {
+        auto const lock = std::lock_guard{ offload_->mutex };
+        offload_->is_notify_pending = false;
+
+        auto& in = offload_->in;
+        n_read = std::size(in);
+        inbuf_.add(std::data(in), n_read);
+        in.drain(n_read);
+        n_decrypted_ = std::size(inbuf_); // the I/O thread decrypted it
+
+        n_written = std::exchange(offload_->n_written, 0U);
+        error_code = std::exchange(offload_->error_code, 0);
+        error_message = std::move(offload_->error_message);
+    }
+
+    if (n_written != 0U)
+    {
+        TR_ASSERT(n_written <= n_out_in_flight_);
+        n_out_in_flight_ -= n_written;
+        did_write_wrapper(n_written);
+    }
+
+    if (n_read != 0U)
+    {
+        can_read_wrapper();
+    }
+
+    if (error_code != 0)
+    {
+        tr_logAddTraceIo(this, fmt::format("I/O thread err: errno:{} ({})", error_code, error_message));
+        tr_error* error = nullptr;
+        tr_error_set(&error, error_code, error_message);
+        call_error_callback(*error);
+        tr_error_clear(&error);
+        return;
+    }
+
+    // the callbacks may have closed the connection
+    if (!offload_)
+    {
+        return;
+    }
+
+    // keep the data flowing
+    if ((pending_events_ & EV_READ) != 0)
+    {
+        offload_read(RcvBuf - std::min(RcvBuf, std::size(inbuf_)));
+    }
+
+    if ((pending_events_ & EV_WRITE) != 0)
+    {
+        if (outbound_size() == 0U)
+        {
+            event_disable(EV_WRITE);
+        }
+        else
+        {
+            offload_write(SIZE_MAX);
+        }
+    }
+}
+
+// ---
+
 size_t tr_peerIo::get_write_buffer_space(uint64_t now) const noexcept
 {
     size_t const desired_len = get_desired_output_buffer_size(this, now);
-    size_t const current_len = std::size(outbuf_);
+    size_t const current_len = outbound_size();
     return desired_len > current_len ? desired_len - current_len : 0U;
 }
 
@@ -597,18 +1073,6 @@ void tr_peerIo::read_uint32(uint32_t* setme)
     *setme = ntohl(tmp);
 }
 
-void tr_peerIo::read_buffer_drain(size_t byte_count)
-{
-    auto buf = std::array<char, 4096>{};
-
-    while (byte_count > 0)
-    {
-        auto const this_pass = std::min(byte_count, std::size(buf));
-        read_bytes(std::data(buf), this_pass);
-        byte_count -= this_pass;
-    }
-}
-
 // --- UTP
 
 #ifdef WITH_UTP
@@ -692,6 +1156,7 @@ void tr_peerIo::utp_init([[maybe_unused]] struct_utp_context* ctx)
             if (auto* const io = static_cast<tr_peerIo*>(utp_get_userdata(args->socket)); io != nullptr)
             {
                 io->inbuf_.add(args->buf, args->len);
+                io->decrypt_inbuf();
                 io->set_enabled(TR_DOWN, true);
                 io->can_read_wrapper();
             }
@@ -703,11 +1168,15 @@ void tr_peerIo::utp_init([[maybe_unused]] struct_utp_context* ctx)
         UTP_GET_READ_BUFFER_SIZE,
         [](utp_callback_arguments* args) -> uint64
         {
-            if (auto const* const io = static_cast<tr_peerIo*>(utp_get_userdata(args->socket)); io != nullptr)
+            if (auto* const io = static_cast<tr_peerIo*>(utp_get_userdata(args->socket)); io != nullptr)
             {
                 // We use this callback to enforce speed limits by telling
                 // libutp to read no more than `target_dl_bytes` bytes.
                 auto const target_dl_bytes = io->bandwidth_.clamp(TR_DOWN, RcvBuf);
+                if (target_dl_bytes == 0U)
+                {
+                    io->bandwidth_.notify_bandwidth_wanted(TR_DOWN);
+                }
 
                 // libutp's private function get_rcv_window() allows libutp
                 // to read up to (UTP_RCVBUF - READ_BUFFER_SIZE) bytes and
@@ -15,6 +15,7 @@
 #include <deque>
 #include <memory>
 #include <utility> // std::pair
+#include <vector>
 
 #include <event2/util.h> // for evutil_socket_t
 
@@ -22,13 +23,16 @@
 
 #include "libtransmission/bandwidth.h"
 #include "libtransmission/block-info.h"
+#include "libtransmission/file.h" // tr_sys_file_t
 #include "libtransmission/net.h" // tr_address
 #include "libtransmission/peer-mse.h"
 #include "libtransmission/peer-socket.h"
+#include "libtransmission/tr-assert.h"
 #include "libtransmission/tr-buffer.h"
 #include "libtransmission/tr-macros.h" // tr_sha1_digest_t, TR_CONSTEXPR20
 #include "libtransmission/utils-ev.h"
 
+class tr_session_thread;
 struct struct_utp_context;
 struct tr_error;
 struct tr_session;
@@ -45,7 +49,37 @@ enum ReadState
     READ_ERR
 };
 
-class tr_peerIo final : public std::enable_shared_from_this<tr_peerIo>
+// The event loops that peers' TCP connections can be spread across with
+// tr_peerIo::move_to_thread(), so that reading from and writing to their
+// sockets -- and encrypting and decrypting the data -- happens outside of
+// the session thread.
+class tr_peer_io_threads
+{
+public:
+    explicit tr_peer_io_threads(size_t n_threads);
+    ~tr_peer_io_threads();
+
+    tr_peer_io_threads(tr_peer_io_threads const&) = delete;
+    tr_peer_io_threads& operator=(tr_peer_io_threads const&) = delete;
+    tr_peer_io_threads(tr_peer_io_threads&&) = delete;
+    tr_peer_io_threads& operator=(tr_peer_io_threads&&) = delete;
+
+    // the thread that the next connection should be moved to
+    [[nodiscard]] tr_session_thread& next() noexcept;
+
+    [[nodiscard]] auto size() const noexcept
+    {
+        return std::size(threads_);
+    }
+
+private:
+    std::vector<std::unique_ptr<tr_session_thread>> threads_;
+    size_t next_ = 0U;
+};
+
+class tr_peerIo final
+    : public tr_bandwidth::Peer
+    , public std::enable_shared_from_this<tr_peerIo>
 {
     using DH = tr_message_stream_encryption::DH;
     using Filter = tr_message_stream_encryption::Filter;
@@ -54,6 +88,34 @@ class tr_peerIo final : public std::enable_shared_from_this<tr_peerIo>
     using GotError = void (*)(tr_peerIo* io, tr_error const& error, void* userData);
 
 public:
+    // An open file that piece data can be sent from by write_file()
+    class SendFile
+    {
+    public:
+        explicit SendFile(tr_sys_file_t fd) noexcept
+            : fd_{ fd }
+        {
+        }
+
+        SendFile(SendFile const&) = delete;
+        SendFile& operator=(SendFile const&) = delete;
+        SendFile(SendFile&&) = delete;
+        SendFile& operator=(SendFile&&) = delete;
+
+        ~SendFile()
+        {
+            tr_sys_file_close(fd_);
+        }
+
+        [[nodiscard]] constexpr auto fd() const noexcept
+        {
+            return fd_;
+        }
+
+    private:
+        tr_sys_file_t const fd_;
+    };
+
     tr_peerIo(
         tr_session* session_in,
         tr_sha1_digest_t const* info_hash,
@@ -61,7 +123,7 @@ public:
         bool is_seed,
         tr_bandwidth* parent_bandwidth);
 
-    ~tr_peerIo();
+    ~tr_peerIo() override;
 
     static std::shared_ptr<tr_peerIo> new_outgoing(
         tr_session* session,
@@ -97,7 +159,7 @@ public:
 
     [[nodiscard]] bool reconnect();
 
-    void set_enabled(tr_direction dir, bool is_enabled);
+    void set_enabled(tr_direction dir, bool is_enabled) override;
 
     ///
 
@@ -106,19 +168,26 @@ public:
         return std::size(inbuf_);
     }
 
+    // NB: compares against the decrypted bytes
     template<typename T>
     [[nodiscard]] auto read_buffer_starts_with(T const& t) const noexcept
     {
         return inbuf_.starts_with(t);
     }
 
-    void read_buffer_drain(size_t byte_count);
+    void read_buffer_drain(size_t byte_count)
+    {
+        byte_count = std::min(byte_count, std::size(inbuf_));
+        TR_ASSERT(byte_count <= n_decrypted_);
+        inbuf_.drain(byte_count);
+        n_decrypted_ -= byte_count;
+    }
 
     void read_bytes(void* bytes, size_t n_bytes)
     {
         n_bytes = std::min(n_bytes, std::size(inbuf_));
-        filter_.decrypt(std::data(inbuf_), n_bytes, reinterpret_cast<std::byte*>(bytes));
-        inbuf_.drain(n_bytes);
+        std::copy_n(std::data(inbuf_), n_bytes, reinterpret_cast<std::byte*>(bytes));
+        read_buffer_drain(n_bytes);
     }
 
     void read_uint8(uint8_t* setme)
@@ -136,11 +205,36 @@ public:
 
     void write_bytes(void const* bytes, size_t n_bytes, bool is_piece_data)
     {
-        outbuf_info_.emplace_back(n_bytes, is_piece_data);
+        outbuf_info_.push_back(OutbufInfo{ n_bytes, is_piece_data });
+
+        if (offload_)
+        {
+            // the I/O thread encrypts it
+            outbuf_.add(bytes, n_bytes);
+            bandwidth_.notify_bandwidth_wanted(TR_UP);
+            return;
+        }
 
         auto [resbuf, reslen] = outbuf_.reserve_space(n_bytes);
         filter_.encrypt(reinterpret_cast<std::byte const*>(bytes), n_bytes, resbuf);
         outbuf_.commit_space(n_bytes);
+        bandwidth_.notify_bandwidth_wanted(TR_UP);
+    }
+
+    // Queue `n_bytes` at `bytes`, which `owner` keeps alive -- e.g. a block
+    // in the read cache. Unless they have to be encrypted in this thread,
+    // outbuf_ references the bytes instead of copying them.
+    void write_shared(std::shared_ptr<void const> owner, void const* bytes, size_t n_bytes, bool is_piece_data)
+    {
+        if (!offload_ && filter_.is_active())
+        {
+            write_bytes(bytes, n_bytes, is_piece_data);
+            return;
+        }
+
+        outbuf_info_.push_back(OutbufInfo{ n_bytes, is_piece_data });
+        outbuf_.add_shared(std::move(owner), bytes, n_bytes);
+        bandwidth_.notify_bandwidth_wanted(TR_UP);
     }
 
     // Write all the data from `buf`.
@@ -153,13 +247,30 @@ public:
         buf.drain(n_bytes);
     }
 
-    size_t flush_outgoing_protocol_msgs();
+    // Whether piece data can be sent straight from a file with write_file().
+    // This needs an unencrypted TCP connection in the session thread and kernel support.
+    [[nodiscard]] bool can_write_file() const noexcept
+    {
+        return !filter_.is_active() && !offload_ && socket_.supports_sendfile();
+    }
+
+    // Queue `n_bytes` of piece data from `file`, starting at `offset`.
+    // The kernel sends it to the socket without copying it into outbuf_.
+    void write_file(std::shared_ptr<SendFile> file, uint64_t offset, size_t n_bytes)
+    {
+        TR_ASSERT(can_write_file());
+        n_file_bytes_ += n_bytes;
+        outbuf_info_.push_back(OutbufInfo{ n_bytes, true, std::move(file), offset });
+        bandwidth_.notify_bandwidth_wanted(TR_UP);
+    }
+
+    size_t flush_outgoing_protocol_msgs() override;
 
-    size_t flush(tr_direction dir, size_t byte_limit);
+    size_t flush(tr_direction dir, size_t byte_limit) override;
 
     ///
 
-    [[nodiscard]] auto has_bandwidth_left(tr_direction dir) const noexcept
+    [[nodiscard]] bool has_bandwidth_left(tr_direction dir) const noexcept override
     {
         return bandwidth_.clamp(dir, 1024) > 0;
     }
@@ -236,18 +347,6 @@ public:
 
     ///
 
-    [[nodiscard]] constexpr auto priority() const noexcept
-    {
-        return priority_;
-    }
-
-    constexpr void set_priority(tr_priority_t priority)
-    {
-        priority_ = priority;
-    }
-
-    ///
-
     [[nodiscard]] constexpr auto supports_utp() const noexcept
     {
         return utp_supported_;
@@ -283,6 +382,10 @@ public:
     void decrypt_init(bool is_incoming, DH const& dh, tr_sha1_digest_t const& info_hash)
     {
         filter_.decrypt_init(is_incoming, dh, info_hash);
+
+        // whatever hasn't been read yet was sent after the peer started encrypting
+        n_decrypted_ = 0U;
+        decrypt_inbuf();
     }
 
     void encrypt_init(bool is_incoming, DH const& dh, tr_sha1_digest_t const& info_hash)
@@ -292,6 +395,19 @@ public:
 
     ///
 
+    // Move this connection's socket I/O and encryption to `thread`.
+    // Afterwards, the session thread only sees decrypted input and hands
+    // plaintext output to `thread`. Only TCP connections can be moved:
+    // libutp isn't thread-safe, so uTP connections stay where they are.
+    void move_to_thread(tr_session_thread& thread);
+
+    [[nodiscard]] bool is_offloaded() const noexcept
+    {
+        return offload_ != nullptr;
+    }
+
+    ///
+
     static void utp_init(struct_utp_context* ctx);
 
 private:
@@ -333,9 +449,34 @@ private:
     void can_read_wrapper();
     void did_write_wrapper(size_t bytes_transferred);
 
+    // Decrypt, in place, the bytes that were added to inbuf_ since the
+    // last call. That way each byte is decrypted once, as it arrives,
+    // rather than every time that a message field is read.
+    void decrypt_inbuf() noexcept
+    {
+        if (auto const n_bytes = std::size(inbuf_) - n_decrypted_; n_bytes != 0U)
+        {
+            filter_.decrypt(std::data(inbuf_) + n_decrypted_, n_bytes);
+            n_decrypted_ += n_bytes;
+        }
+    }
+
     size_t try_read(size_t max);
     size_t try_write(size_t max);
 
+    // The state that's shared with the I/O thread after move_to_thread()
+    struct Offload;
+
+    size_t offload_read(size_t max);
+    size_t offload_write(size_t max);
+    void on_offload_events();
+
+    // outbound bytes that haven't been sent yet, whether in outbuf_, in a file, or in the I/O thread
+    [[nodiscard]] TR_CONSTEXPR20 size_t outbound_size() const noexcept
+    {
+        return std::size(outbuf_) + n_file_bytes_ + n_out_in_flight_;
+    }
+
     // this is only public for testing purposes.
     // production code should use new_outgoing() or new_incoming()
     static std::shared_ptr<tr_peerIo> create(
@@ -347,7 +488,20 @@ private:
 
     Filter filter_;
 
-    std::deque<std::pair<size_t /*n_bytes*/, bool /*is_piece_data*/>> outbuf_info_;
+    // The outbound messages, in the order they're sent. Each is either in
+    // outbuf_ or, if `file` is set, read by the kernel from that file.
+    struct OutbufInfo
+    {
+        size_t n_bytes;
+        bool is_piece_data;
+        std::shared_ptr<SendFile> file = {};
+        uint64_t file_offset = {};
+    };
+
+    std::deque<OutbufInfo> outbuf_info_;
+
+    // the number of bytes in outbuf_info_ that will be sent from files
+    size_t n_file_bytes_ = 0;
 
     tr_peer_socket socket_ = {};
 
@@ -356,7 +510,10 @@ private:
     tr_sha1_digest_t info_hash_;
 
     PeerBuffer inbuf_;
-    PeerBuffer outbuf_;
+    libtransmission::ChainBuffer outbuf_;
+
+    // how many bytes at the front of inbuf_ are decrypted
+    size_t n_decrypted_ = 0U;
 
     tr_session* const session_;
 
@@ -370,7 +527,10 @@ private:
 
     short int pending_events_ = 0;
 
-    tr_priority_t priority_ = TR_PRI_NORMAL;
+    std::unique_ptr<Offload> offload_;
+
+    // the outbound bytes that have been handed to the I/O thread but not sent yet
+    size_t n_out_in_flight_ = 0U;
 
     bool const is_seed_;
     bool const is_incoming_;
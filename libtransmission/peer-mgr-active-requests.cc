@@ -3,12 +3,14 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
-#include <algorithm>
 #include <cstddef> // size_t
 #include <ctime>
 #include <memory>
+#include <set>
+#include <tuple>
 #include <utility>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <small/map.hpp>
@@ -26,46 +28,53 @@ class tr_peer;
 class ActiveRequests::Impl
 {
 public:
-    size_t size() const
+    [[nodiscard]] size_t size() const
     {
-        return size_;
+        return std::size(by_time_);
     }
 
-    size_t count(tr_peer const* peer) const
+    [[nodiscard]] size_t count(tr_peer const* peer) const
     {
-        auto const it = count_.find(peer);
-        return it != std::end(count_) ? it->second : size_t{};
+        auto const it = peers_.find(peer);
+        return it != std::end(peers_) ? std::size(it->second) : size_t{};
     }
 
-    void incCount(tr_peer const* peer)
+    bool add(tr_block_index_t block, tr_peer const* peer, time_t when)
     {
-        ++count_[peer];
-        ++size_;
+        if (!blocks_[block].try_emplace(peer, when).second)
+        {
+            return false;
+        }
+
+        peers_[peer].insert(block);
+        by_time_.emplace(when, block, peer);
+        return true;
     }
 
-    void decCount(tr_peer const* peer)
+    // Erase the request from `peers_` and `by_time_`, but not `blocks_`.
+    // The caller does that so that it can erase from a `blocks_` entry
+    // that it's iterating.
+    void unindex(tr_block_index_t block, tr_peer const* peer, time_t when)
     {
-        auto it = count_.find(peer);
-        TR_ASSERT(it != std::end(count_));
-        TR_ASSERT(it->second > 0);
-        TR_ASSERT(size_ > 0);
-
-        if (it != std::end(count_))
+        auto const it = peers_.find(peer);
+        TR_ASSERT(it != std::end(peers_));
+        if (it != std::end(peers_) && it->second.erase(block) != 0U && std::empty(it->second))
         {
-            if (--it->second == 0)
-            {
-                count_.erase(it);
-            }
-            --size_;
+            peers_.erase(it);
         }
-    }
 
-    std::unordered_map<tr_peer const*, size_t> count_;
+        [[maybe_unused]] auto const n_erased = by_time_.erase({ when, block, peer });
+        TR_ASSERT(n_erased == 1U);
+    }
 
+    // block -> the peers we've asked for it, and when
     std::unordered_map<tr_block_index_t, small::map<tr_peer const*, time_t, Wishlist::EndgameMaxPeers>> blocks_;
 
-private:
-    size_t size_ = 0;
+    // peer -> the blocks we've asked it for
+    std::unordered_map<tr_peer const*, std::unordered_set<tr_block_index_t>> peers_;
+
+    // every request, oldest first
+    std::set<std::tuple<time_t, tr_block_index_t, tr_peer const*>> by_time_;
 };
 
 ActiveRequests::ActiveRequests()
@@ -77,52 +86,65 @@ ActiveRequests::~ActiveRequests() = default;
 
 bool ActiveRequests::add(tr_block_index_t block, tr_peer* peer, time_t when)
 {
-    bool const added = impl_->blocks_[block].emplace(peer, when).second;
-
-    if (added)
-    {
-        impl_->incCount(peer);
-    }
-
-    return added;
+    return impl_->add(block, peer, when);
 }
 
 // remove a request to `peer` for `block`
 bool ActiveRequests::remove(tr_block_index_t block, tr_peer const* peer)
 {
-    auto const it = impl_->blocks_.find(block);
-    auto const removed = it != std::end(impl_->blocks_) && it->second.erase(peer) != 0;
+    auto& blocks = impl_->blocks_;
+    auto const block_it = blocks.find(block);
+    if (block_it == std::end(blocks))
+    {
+        return false;
+    }
 
-    if (removed)
+    auto& peers_at = block_it->second;
+    auto const peer_it = peers_at.find(peer);
+    if (peer_it == std::end(peers_at))
     {
-        impl_->decCount(peer);
+        return false;
+    }
 
-        if (std::empty(it->second))
-        {
-            impl_->blocks_.erase(it);
-        }
+    impl_->unindex(block, peer, peer_it->second);
+    peers_at.erase(peer_it);
+    if (std::empty(peers_at))
+    {
+        blocks.erase(block_it);
     }
 
-    return removed;
+    return true;
 }
 
 // remove requests to `peer` and return the associated blocks
 std::vector<tr_block_index_t> ActiveRequests::remove(tr_peer const* peer)
 {
     auto removed = std::vector<tr_block_index_t>{};
-    removed.reserve(impl_->blocks_.size());
 
-    for (auto const& [block, peers_at] : impl_->blocks_)
+    auto node = impl_->peers_.extract(peer);
+    if (node.empty())
     {
-        if (peers_at.count(peer) != 0U)
-        {
-            removed.push_back(block);
-        }
+        return removed;
     }
 
-    for (auto block : removed)
+    auto& blocks = impl_->blocks_;
+    removed.reserve(std::size(node.mapped()));
+    for (auto const block : node.mapped())
     {
-        remove(block, peer);
+        auto const block_it = blocks.find(block);
+        TR_ASSERT(block_it != std::end(blocks));
+        auto& peers_at = block_it->second;
+        auto const peer_it = peers_at.find(peer);
+        TR_ASSERT(peer_it != std::end(peers_at));
+
+        impl_->by_time_.erase({ peer_it->second, block, peer });
+        peers_at.erase(peer_it);
+        if (std::empty(peers_at))
+        {
+            blocks.erase(block_it);
+        }
+
+        removed.push_back(block);
     }
 
     return removed;
@@ -135,19 +157,13 @@ std::vector<tr_peer*> ActiveRequests::remove(tr_block_index_t block)
 
     if (auto it = impl_->blocks_.find(block); it != std::end(impl_->blocks_))
     {
-        auto const n = std::size(it->second);
-        removed.resize(n);
-        std::transform(
-            std::begin(it->second),
-            std::end(it->second),
-            std::begin(removed),
-            [](auto const& iter) { return const_cast<tr_peer*>(iter.first); });
-        impl_->blocks_.erase(block);
-    }
-
-    for (auto const* const peer : removed)
-    {
-        impl_->decCount(peer);
+        removed.reserve(std::size(it->second));
+        for (auto const& [peer, sent_at] : it->second)
+        {
+            impl_->unindex(block, peer, sent_at);
+            removed.push_back(const_cast<tr_peer*>(peer));
+        }
+        impl_->blocks_.erase(it);
     }
 
     return removed;
@@ -184,17 +200,11 @@ size_t ActiveRequests::size() const
 std::vector<std::pair<tr_block_index_t, tr_peer*>> ActiveRequests::sentBefore(time_t when) const
 {
     auto sent_before = std::vector<std::pair<tr_block_index_t, tr_peer*>>{};
-    sent_before.reserve(std::size(impl_->blocks_));
 
-    for (auto const& [block, peers_at] : impl_->blocks_)
+    auto const& by_time = impl_->by_time_;
+    for (auto it = std::begin(by_time), end = std::end(by_time); it != end && std::get<0>(*it) < when; ++it)
     {
-        for (auto const& [peer, sent_at] : peers_at)
-        {
-            if (sent_at < when)
-            {
-                sent_before.emplace_back(block, const_cast<tr_peer*>(peer));
-            }
-        }
+        sent_before.emplace_back(std::get<1>(*it), const_cast<tr_peer*>(std::get<2>(*it)));
     }
 
     return sent_before;
@@ -0,0 +1,79 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <ctime> // time_t
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#define LIBTRANSMISSION_PEER_MODULE
+
+#include "libtransmission/peer-mgr-candidates.h"
+
+namespace
+{
+// std::push_heap() et al. build max-heaps, so these put the
+// candidate with the smallest score or wake time on top
+[[nodiscard]] constexpr bool worse_score(tr_peer_candidates::Candidate const& a, tr_peer_candidates::Candidate const& b)
+{
+    return a.score > b.score;
+}
+
+[[nodiscard]] constexpr bool later_wake(
+    std::pair<time_t, tr_peer_candidates::Candidate> const& a,
+    std::pair<time_t, tr_peer_candidates::Candidate> const& b)
+{
+    return a.first > b.first;
+}
+} // namespace
+
+void tr_peer_candidates::push(Candidate const& candidate)
+{
+    queued_.push_back(candidate);
+    std::push_heap(std::begin(queued_), std::end(queued_), worse_score);
+}
+
+void tr_peer_candidates::push_later(Candidate const& candidate, time_t when)
+{
+    asleep_.emplace_back(when, candidate);
+    std::push_heap(std::begin(asleep_), std::end(asleep_), later_wake);
+}
+
+void tr_peer_candidates::wake(time_t now)
+{
+    while (!std::empty(asleep_) && asleep_.front().first <= now)
+    {
+        std::pop_heap(std::begin(asleep_), std::end(asleep_), later_wake);
+        push(asleep_.back().second);
+        asleep_.pop_back();
+    }
+}
+
+std::optional<tr_peer_candidates::Candidate> tr_peer_candidates::pop()
+{
+    if (std::empty(queued_))
+    {
+        return {};
+    }
+
+    std::pop_heap(std::begin(queued_), std::end(queued_), worse_score);
+    auto ret = std::move(queued_.back());
+    queued_.pop_back();
+    return ret;
+}
+
+void tr_peer_candidates::remove_if(std::function<bool(Candidate const&)> const& test)
+{
+    queued_.erase(std::remove_if(std::begin(queued_), std::end(queued_), test), std::end(queued_));
+    std::make_heap(std::begin(queued_), std::end(queued_), worse_score);
+
+    asleep_.erase(
+        std::remove_if(std::begin(asleep_), std::end(asleep_), [&test](auto const& entry) { return test(entry.second); }),
+        std::end(asleep_));
+    std::make_heap(std::begin(asleep_), std::end(asleep_), later_wake);
+}
@@ -0,0 +1,83 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef LIBTRANSMISSION_PEER_MODULE
+#error only the libtransmission peer module should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <ctime> // time_t
+#include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "libtransmission/transmission.h" // tr_torrent_id_t
+
+#include "libtransmission/net.h" // tr_socket_address
+
+/**
+ * The peers that we might initiate outbound connections to, sorted by score
+ * across all torrents so that the best one can be popped in O(log n).
+ *
+ * This is kept up-to-date incrementally: whenever something about a peer
+ * changes that could affect its score, the owner pushes it again with its
+ * new score. That leaves the old entry behind, so the owner remembers each
+ * peer's current score and skips entries whose score is out-of-date when
+ * they're popped.
+ *
+ * Peers that can't be tried until later, e.g. because we tried them
+ * recently, sleep outside of the queue until `wake()` is called.
+ */
+class tr_peer_candidates
+{
+public:
+    struct Candidate
+    {
+        uint64_t score = {}; // smaller is better
+        tr_torrent_id_t tor_id = {};
+        tr_socket_address socket_address;
+    };
+
+    // add `candidate` to the queue
+    void push(Candidate const& candidate);
+
+    // add `candidate` to the queue when `wake()` is called at or after `when`
+    void push_later(Candidate const& candidate, time_t when);
+
+    // move the candidates whose time has come into the queue
+    void wake(time_t now);
+
+    // remove and return the candidate with the best score
+    [[nodiscard]] std::optional<Candidate> pop();
+
+    // remove the candidates, both queued and sleeping, that `test` returns true for
+    void remove_if(std::function<bool(Candidate const&)> const& test);
+
+    // the number of candidates in the queue
+    [[nodiscard]] constexpr auto size() const noexcept
+    {
+        return std::size(queued_);
+    }
+
+    // the number of candidates waiting for `wake()`
+    [[nodiscard]] constexpr auto size_asleep() const noexcept
+    {
+        return std::size(asleep_);
+    }
+
+    void clear() noexcept
+    {
+        queued_.clear();
+        asleep_.clear();
+    }
+
+private:
+    std::vector<Candidate> queued_;
+    std::vector<std::pair<time_t, Candidate>> asleep_;
+};
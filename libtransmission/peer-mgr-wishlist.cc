@@ -3,145 +3,170 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
-#include <algorithm> // std::min, std::partial_sort
+#include <algorithm> // std::sort
 #include <cstddef>
-#include <set>
-#include <utility>
 #include <vector>
 
 #define LIBTRANSMISSION_PEER_MODULE
 
 #include "libtransmission/transmission.h"
 
-#include "libtransmission/crypto-utils.h" // for tr_salt_shaker
 #include "libtransmission/peer-mgr-wishlist.h"
 #include "libtransmission/utils.h"
 
 namespace
 {
-using SaltType = tr_piece_index_t;
-
-struct Candidate
+std::vector<tr_block_span_t> makeSpans(tr_block_index_t const* sorted_blocks, size_t n_blocks)
 {
-    tr_piece_index_t piece;
-    size_t n_blocks_missing;
-    tr_priority_t priority;
-    SaltType salt;
-
-    Candidate(tr_piece_index_t piece_in, size_t missing_in, tr_priority_t priority_in, SaltType salt_in)
-        : piece{ piece_in }
-        , n_blocks_missing{ missing_in }
-        , priority{ priority_in }
-        , salt{ salt_in }
+    if (n_blocks == 0)
     {
+        return {};
     }
 
-    [[nodiscard]] constexpr auto compare(Candidate const& that) const noexcept // <=>
+    auto spans = std::vector<tr_block_span_t>{};
+    auto cur = tr_block_span_t{ sorted_blocks[0], sorted_blocks[0] + 1 };
+    for (size_t i = 1; i < n_blocks; ++i)
     {
-        // prefer pieces closer to completion
-        if (auto const val = tr_compare_3way(n_blocks_missing, that.n_blocks_missing); val != 0)
+        if (cur.end == sorted_blocks[i])
         {
-            return val;
+            ++cur.end;
         }
-
-        // prefer higher priority
-        if (auto const val = tr_compare_3way(priority, that.priority); val != 0)
+        else
         {
-            return -val;
+            spans.push_back(cur);
+            cur = tr_block_span_t{ sorted_blocks[i], sorted_blocks[i] + 1 };
         }
+    }
+    spans.push_back(cur);
+
+    return spans;
+}
+} // namespace
+
+int Wishlist::Candidate::compare(Candidate const& that) const noexcept // <=>
+{
+    // prefer pieces closer to completion
+    if (auto const val = tr_compare_3way(n_blocks_missing, that.n_blocks_missing); val != 0)
+    {
+        return val;
+    }
+
+    // prefer higher priority
+    if (auto const val = tr_compare_3way(priority, that.priority); val != 0)
+    {
+        return -val;
+    }
 
-        return tr_compare_3way(salt, that.salt);
+    // prefer rarer pieces
+    if (auto const val = tr_compare_3way(replication, that.replication); val != 0)
+    {
+        return val;
     }
 
-    bool operator<(Candidate const& that) const // less than
+    if (auto const val = tr_compare_3way(salt, that.salt); val != 0)
     {
-        return compare(that) < 0;
+        return val;
     }
-};
 
-std::vector<Candidate> getCandidates(Wishlist::Mediator const& mediator)
+    return tr_compare_3way(piece, that.piece);
+}
+
+tr_piece_index_t Wishlist::make_salt(tr_piece_index_t piece)
+{
+    return mediator_.isSequentialDownload() ? piece : salter_();
+}
+
+Wishlist::Candidate Wishlist::make_candidate(tr_piece_index_t piece, size_t n_missing, tr_piece_index_t salt) const
 {
-    // count up the pieces that we still want
-    auto wanted_pieces = std::vector<std::pair<tr_piece_index_t, size_t>>{};
-    auto const n_pieces = mediator.countAllPieces();
-    wanted_pieces.reserve(n_pieces);
-    for (tr_piece_index_t i = 0; i < n_pieces; ++i)
+    // sequential downloads ignore rarity so that the salt decides the order
+    auto const replication = mediator_.isSequentialDownload() ? size_t{} : mediator_.pieceReplication(piece);
+    return Candidate{ piece, n_missing, mediator_.priority(piece), replication, salt };
+}
+
+void Wishlist::rebuild()
+{
+    candidates_.clear();
+
+    auto const n_pieces = mediator_.countAllPieces();
+    piece_to_candidate_.assign(n_pieces, std::end(candidates_));
+
+    for (tr_piece_index_t piece = 0; piece < n_pieces; ++piece)
     {
-        if (!mediator.clientCanRequestPiece(i))
+        if (!mediator_.clientCanRequestPiece(piece))
         {
             continue;
         }
 
-        size_t const n_missing = mediator.countMissingBlocks(i);
-        if (n_missing == 0)
+        auto const n_missing = mediator_.countMissingBlocks(piece);
+        if (n_missing == 0U)
         {
             continue;
         }
 
-        wanted_pieces.emplace_back(i, n_missing);
+        piece_to_candidate_[piece] = candidates_.insert(make_candidate(piece, n_missing, make_salt(piece))).first;
     }
 
-    // transform them into candidates
-    auto salter = tr_salt_shaker<SaltType>{};
-    auto const n = std::size(wanted_pieces);
-    auto candidates = std::vector<Candidate>{};
-    auto const is_sequential = mediator.isSequentialDownload();
-    candidates.reserve(n);
-    for (size_t i = 0; i < n; ++i)
-    {
-        auto const [piece, n_missing] = wanted_pieces[i];
-        auto const salt = is_sequential ? piece : salter();
-        candidates.emplace_back(piece, n_missing, mediator.priority(piece), salt);
-    }
-
-    return candidates;
+    is_dirty_ = false;
 }
 
-std::vector<tr_block_span_t> makeSpans(tr_block_index_t const* sorted_blocks, size_t n_blocks)
+void Wishlist::on_piece_changed(tr_piece_index_t piece)
 {
-    if (n_blocks == 0)
+    if (is_dirty_ || piece >= std::size(piece_to_candidate_))
     {
-        return {};
+        return;
     }
 
-    auto spans = std::vector<tr_block_span_t>{};
-    auto cur = tr_block_span_t{ sorted_blocks[0], sorted_blocks[0] + 1 };
-    for (size_t i = 1; i < n_blocks; ++i)
+    auto& where = piece_to_candidate_[piece];
+    auto salt = tr_piece_index_t{};
+    if (where != std::end(candidates_))
     {
-        if (cur.end == sorted_blocks[i])
-        {
-            ++cur.end;
-        }
-        else
-        {
-            spans.push_back(cur);
-            cur = tr_block_span_t{ sorted_blocks[i], sorted_blocks[i] + 1 };
-        }
+        salt = where->salt;
+        candidates_.erase(where);
+        where = std::end(candidates_);
+    }
+    else
+    {
+        salt = make_salt(piece);
     }
-    spans.push_back(cur);
 
-    return spans;
-}
+    if (!mediator_.clientCanRequestPiece(piece))
+    {
+        return;
+    }
 
-} // namespace
+    if (auto const n_missing = mediator_.countMissingBlocks(piece); n_missing != 0U)
+    {
+        where = candidates_.insert(make_candidate(piece, n_missing, salt)).first;
+    }
+}
 
 std::vector<tr_block_span_t> Wishlist::next(size_t n_wanted_blocks)
+{
+    static auto const PeerHasPiece = PeerHasPieceFunc{ [](tr_piece_index_t) { return true; } };
+    static auto const PeerHasRequest = PeerHasRequestFunc{ [](tr_block_index_t) { return false; } };
+    return next(n_wanted_blocks, PeerHasPiece, PeerHasRequest);
+}
+
+std::vector<tr_block_span_t> Wishlist::next(
+    size_t n_wanted_blocks,
+    PeerHasPieceFunc const& peer_has_piece,
+    PeerHasRequestFunc const& peer_has_request)
 {
     if (n_wanted_blocks == 0)
     {
         return {};
     }
 
-    auto candidates = getCandidates(mediator_);
+    if (is_dirty_)
+    {
+        rebuild();
+    }
 
-    // We usually won't need all the candidates to be sorted until endgame, so don't
-    // waste cycles sorting all of them here. partial sort is enough.
-    static auto constexpr MaxSortedPieces = size_t{ 30 };
-    auto const middle = std::min(std::size(candidates), MaxSortedPieces);
-    std::partial_sort(std::begin(candidates), std::begin(candidates) + middle, std::end(candidates));
+    auto const max_peers = mediator_.isEndgame() ? EndgameMaxPeers : size_t{ 1U };
 
-    auto blocks = std::set<tr_block_index_t>{};
-    for (auto const& candidate : candidates)
+    auto blocks = std::vector<tr_block_index_t>{};
+    blocks.reserve(n_wanted_blocks);
+    for (auto iter = std::begin(candidates_); iter != std::end(candidates_);)
     {
         // do we have enough?
         if (std::size(blocks) >= n_wanted_blocks)
@@ -149,9 +174,18 @@ std::vector<tr_block_span_t> Wishlist::next(size_t n_wanted_blocks)
             break;
         }
 
+        auto const piece = iter->piece;
+        if (!peer_has_piece(piece))
+        {
+            ++iter;
+            continue;
+        }
+
         // walk the blocks in this piece
-        auto const [begin, end] = mediator_.blockSpan(candidate.piece);
-        for (tr_block_index_t block = begin; block < end && std::size(blocks) < n_wanted_blocks; ++block)
+        auto const [begin, end] = mediator_.blockSpan(piece);
+        auto is_fully_requested = true;
+        auto block = begin;
+        for (; block < end && std::size(blocks) < n_wanted_blocks; ++block)
         {
             // don't request blocks we've already got
             if (!mediator_.clientCanRequestBlock(block))
@@ -160,16 +194,33 @@ std::vector<tr_block_span_t> Wishlist::next(size_t n_wanted_blocks)
             }
 
             // don't request from too many peers
-            size_t const n_peers = mediator_.countActiveRequests(block);
-            if (size_t const max_peers = mediator_.isEndgame() ? 2 : 1; n_peers >= max_peers)
+            if (mediator_.countActiveRequests(block) >= max_peers)
             {
                 continue;
             }
 
-            blocks.insert(block);
+            is_fully_requested = false;
+
+            if (!peer_has_request(block))
+            {
+                blocks.push_back(block);
+            }
+        }
+
+        // Every block that we still need has already been requested from
+        // as many peers as it can be, so there's nothing here for anyone.
+        // Drop the piece until a block arrives or a request is cancelled.
+        if (block == end && is_fully_requested)
+        {
+            piece_to_candidate_[piece] = std::end(candidates_);
+            iter = candidates_.erase(iter);
+        }
+        else
+        {
+            ++iter;
         }
     }
 
-    auto const blocks_v = std::vector<tr_block_index_t>{ std::begin(blocks), std::end(blocks) };
-    return makeSpans(std::data(blocks_v), std::size(blocks_v));
+    std::sort(std::begin(blocks), std::end(blocks));
+    return makeSpans(std::data(blocks), std::size(blocks));
 }
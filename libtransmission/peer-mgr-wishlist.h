@@ -10,18 +10,31 @@
 #endif
 
 #include <cstddef> // size_t
+#include <functional>
+#include <set>
 #include <vector>
 
 #include "libtransmission/transmission.h"
 
+#include "libtransmission/crypto-utils.h" // for tr_salt_shaker
+
 /**
  * Figures out what blocks we want to request next.
+ *
+ * The wishlist keeps its candidate pieces sorted between calls and is
+ * updated incrementally as blocks and pieces arrive, so `next()` only
+ * walks as many candidates as it needs to fill the request. Pieces whose
+ * missing blocks have all been requested are dropped from the candidates
+ * until `on_piece_changed()` says that one of their requests went away.
  */
 class Wishlist
 {
 public:
     static auto constexpr EndgameMaxPeers = size_t{ 2U };
 
+    using PeerHasPieceFunc = std::function<bool(tr_piece_index_t)>;
+    using PeerHasRequestFunc = std::function<bool(tr_block_index_t)>;
+
     struct Mediator
     {
         [[nodiscard]] virtual bool clientCanRequestBlock(tr_block_index_t block) const = 0;
@@ -33,17 +46,84 @@ public:
         [[nodiscard]] virtual tr_block_span_t blockSpan(tr_piece_index_t) const = 0;
         [[nodiscard]] virtual tr_piece_index_t countAllPieces() const = 0;
         [[nodiscard]] virtual tr_priority_t priority(tr_piece_index_t) const = 0;
+
+        // how many peers have this piece, for rarest-first piece selection.
+        // Return the same value for every piece to pick pieces at random.
+        [[nodiscard]] virtual size_t pieceReplication(tr_piece_index_t) const = 0;
+
         virtual ~Mediator() = default;
     };
 
-    constexpr explicit Wishlist(Mediator const& mediator)
+    explicit Wishlist(Mediator const& mediator)
         : mediator_{ mediator }
     {
     }
 
+    Wishlist(Wishlist&&) = delete;
+    Wishlist(Wishlist const&) = delete;
+    Wishlist& operator=(Wishlist&&) = delete;
+    Wishlist& operator=(Wishlist const&) = delete;
+
+    ~Wishlist() = default;
+
     // the next blocks that we should request from a peer
+    [[nodiscard]] std::vector<tr_block_span_t> next(
+        size_t n_wanted_blocks,
+        PeerHasPieceFunc const& peer_has_piece,
+        PeerHasRequestFunc const& peer_has_request);
+
+    // the next blocks that we should request from a peer that has every
+    // piece and that we haven't sent any requests to yet
     [[nodiscard]] std::vector<tr_block_span_t> next(size_t n_wanted_blocks);
 
+    // A piece got a block, was completed, failed its checksum, a peer
+    // announced that it has it, or one of its requests was cancelled:
+    // re-read the piece from the mediator and move it to its new place.
+    void on_piece_changed(tr_piece_index_t piece);
+
+    // Something that affects many pieces at once changed, e.g. which files
+    // are wanted, file priorities, or sequential download mode.
+    // The candidate list will be rebuilt the next time it's needed.
+    constexpr void invalidate() noexcept
+    {
+        is_dirty_ = true;
+    }
+
 private:
+    struct Candidate
+    {
+        tr_piece_index_t piece;
+        size_t n_blocks_missing;
+        tr_priority_t priority;
+        size_t replication;
+        tr_piece_index_t salt;
+
+        [[nodiscard]] int compare(Candidate const& that) const noexcept; // <=>
+
+        bool operator<(Candidate const& that) const noexcept // less than
+        {
+            return compare(that) < 0;
+        }
+    };
+
+    using Candidates = std::set<Candidate>;
+
+    void rebuild();
+
+    [[nodiscard]] Candidate make_candidate(tr_piece_index_t piece, size_t n_missing, tr_piece_index_t salt) const;
+
+    [[nodiscard]] tr_piece_index_t make_salt(tr_piece_index_t piece);
+
     Mediator const& mediator_;
+
+    // sorted by preference: nearly-complete pieces first, then by priority,
+    // then rarest first, then by salt
+    Candidates candidates_;
+
+    // piece index -> that piece's position in `candidates_`, or `end()` if absent
+    std::vector<Candidates::const_iterator> piece_to_candidate_;
+
+    tr_salt_shaker<tr_piece_index_t> salter_;
+
+    bool is_dirty_ = true;
 };
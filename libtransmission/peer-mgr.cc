@@ -12,6 +12,7 @@
 #include <cstdint>
 #include <ctime> // time_t
 #include <iterator> // std::back_inserter
+#include <limits>
 #include <map>
 #include <optional>
 #include <tuple> // std::tie
@@ -19,8 +20,6 @@
 #include <utility>
 #include <vector>
 
-#include <small/vector.hpp>
-
 #include <fmt/core.h>
 
 #define LIBTRANSMISSION_PEER_MODULE
@@ -38,6 +37,7 @@
 #include "libtransmission/peer-common.h"
 #include "libtransmission/peer-io.h"
 #include "libtransmission/peer-mgr-active-requests.h"
+#include "libtransmission/peer-mgr-candidates.h"
 #include "libtransmission/peer-mgr-wishlist.h"
 #include "libtransmission/peer-mgr.h"
 #include "libtransmission/peer-msgs.h"
@@ -152,15 +152,19 @@ public:
         , tags_{ {
               tor_in->done_.observe([this](tr_torrent*, bool) { on_torrent_done(); }),
               tor_in->doomed_.observe([this](tr_torrent*) { on_torrent_doomed(); }),
+              tor_in->files_closed_.observe([this](tr_torrent*) { on_torrent_files_closed(); }),
+              tor_in->files_wanted_changed_.observe([this](tr_torrent*) { wishlist.invalidate(); }),
               tor_in->got_bad_piece_.observe([this](tr_torrent*, tr_piece_index_t p) { on_got_bad_piece(p); }),
               tor_in->got_metainfo_.observe([this](tr_torrent*) { on_got_metainfo(); }),
               tor_in->piece_completed_.observe([this](tr_torrent*, tr_piece_index_t p) { on_piece_completed(p); }),
+              tor_in->priority_changed_.observe([this](tr_torrent*) { wishlist.invalidate(); }),
+              tor_in->sequential_download_changed_.observe([this](tr_torrent*) { wishlist.invalidate(); }),
               tor_in->started_.observe([this](tr_torrent*) { on_torrent_started(); }),
               tor_in->stopped_.observe([this](tr_torrent*) { on_torrent_stopped(); }),
               tor_in->swarm_is_all_seeds_.observe([this](tr_torrent* /*tor*/) { on_swarm_is_all_seeds(); }),
           } }
     {
-
+        rebuild_piece_replication();
         rebuildWebseeds();
     }
 
@@ -188,6 +192,15 @@ public:
         {
             maybeSendCancelRequest(peer, block, nullptr);
             active_requests.remove(block, peer);
+            on_block_changed(block);
+        }
+    }
+
+    void removeRequestsToPeer(tr_peer const* peer)
+    {
+        for (auto const block : active_requests.remove(peer))
+        {
+            on_block_changed(block);
         }
     }
 
@@ -224,6 +237,19 @@ public:
         is_running = false;
         removeAllPeers();
         outgoing_handshakes.clear();
+
+        // Forget the parked peers' scores too. Otherwise they'd look like
+        // they're already filed, and be skipped when the pool gets refiled
+        // after the torrent starts again.
+        for (auto const& candidate : parked_candidates)
+        {
+            if (auto* const info = get_existing_peer_info(candidate.socket_address);
+                info != nullptr && info->candidate_score() == candidate.score)
+            {
+                info->set_candidate_score({});
+            }
+        }
+        parked_candidates.clear();
     }
 
     void removePeer(tr_peer* peer)
@@ -236,10 +262,12 @@ public:
         if (auto iter = std::find(std::begin(peers), std::end(peers), peer); iter != std::end(peers))
         {
             peers.erase(iter);
+            update_piece_replication(peer->has(), -1);
         }
 
         --stats.peer_count;
         --stats.peer_from_count[peer_info->from_first()];
+        tor->bump_change_version(tr_torrent::ChangeGroup::Activity);
 
         TR_ASSERT(stats.peer_count == peerCount());
 
@@ -262,7 +290,16 @@ public:
     {
         /* we consider ourselves to be in endgame if the number of bytes
            we've got requested is >= the number of bytes left to download */
-        is_endgame_ = uint64_t(std::size(active_requests)) * tr_block_info::BlockSize >= tor->left_until_done();
+        auto const was_endgame = std::exchange(
+            is_endgame_,
+            uint64_t(std::size(active_requests)) * tr_block_info::BlockSize >= tor->left_until_done());
+
+        // blocks can be requested from more peers now, so bring back
+        // the pieces that the wishlist dropped as fully requested
+        if (is_endgame_ && !was_endgame)
+        {
+            wishlist.invalidate();
+        }
     }
 
     [[nodiscard]] constexpr auto isEndgame() const noexcept
@@ -270,6 +307,97 @@ public:
         return is_endgame_;
     }
 
+    // how many connected peers have this piece
+    [[nodiscard]] size_t piece_replication(tr_piece_index_t piece) const noexcept
+    {
+        return piece < std::size(piece_replication_) ? n_seeds_ + piece_replication_[piece] : 0U;
+    }
+
+    // how many connected peers that don't have every piece have this piece.
+    // Seeds add the same amount to every piece, so leaving them out
+    // doesn't change which pieces are rarest.
+    [[nodiscard]] size_t partial_piece_replication(tr_piece_index_t piece) const noexcept
+    {
+        return piece < std::size(piece_replication_) ? piece_replication_[piece] : 0U;
+    }
+
+    // a block arrived, or a request for it went away
+    void on_block_changed(tr_block_index_t block)
+    {
+        // the block may straddle a piece boundary, so update every piece it touches
+        auto const block_loc = tor->block_loc(block);
+        auto const last_piece = tor->byte_loc(block_loc.byte + tor->block_size(block) - 1U).piece;
+        for (auto piece = block_loc.piece; piece <= last_piece; ++piece)
+        {
+            wishlist.on_piece_changed(piece);
+        }
+    }
+
+    void on_got_have(tr_piece_index_t piece)
+    {
+        if (piece < std::size(piece_replication_) && add_replication(piece_replication_[piece], +1))
+        {
+            wishlist.on_piece_changed(piece);
+        }
+    }
+
+    // add `delta` to the replication count of every piece in `have`
+    void update_piece_replication(tr_bitfield const& have, int delta)
+    {
+        if (have.has_all())
+        {
+            update_piece_replication(delta);
+            return;
+        }
+
+        if (have.has_none())
+        {
+            return;
+        }
+
+        auto const n_pieces = std::size(piece_replication_);
+        for (size_t piece = 0; piece < n_pieces; ++piece)
+        {
+            if (have.test(piece) && add_replication(piece_replication_[piece], delta))
+            {
+                wishlist.on_piece_changed(piece);
+            }
+        }
+    }
+
+    // add `delta` to the replication count of every piece.
+    // Seeds are counted in `n_seeds_` instead of in each piece's count,
+    // so the wishlist's counts from `partial_piece_replication()` stay
+    // correct and it needn't know.
+    void update_piece_replication(int delta)
+    {
+        add_replication(n_seeds_, delta);
+    }
+
+    // Add `delta` to a replication count. Returns true if it changed.
+    // Every peer's +1 should be matched by a -1 later, but saturate
+    // instead of wrapping around in case they aren't.
+    template<typename Count>
+    static bool add_replication(Count& count, int delta) noexcept
+    {
+        auto const old_count = count;
+
+        if (delta < 0)
+        {
+            auto const n = static_cast<Count>(-delta);
+            TR_ASSERT(count >= n);
+            count -= std::min(count, n);
+        }
+        else
+        {
+            auto const n = static_cast<Count>(delta);
+            TR_ASSERT(count <= std::numeric_limits<Count>::max() - n);
+            count += std::min(static_cast<Count>(std::numeric_limits<Count>::max() - count), n);
+        }
+
+        return count != old_count;
+    }
+
     void addStrike(tr_peer* peer) const
     {
         tr_logAddTraceSwarm(
@@ -332,6 +460,7 @@ public:
         }
 
         mark_all_seeds_flag_dirty();
+        on_peer_info_changed(peer_info);
 
         return peer_info;
     }
@@ -341,8 +470,13 @@ public:
         tr_logAddTraceSwarm(this, fmt::format("marking peer {} as a seed", peer_info.display_name()));
         peer_info.set_seed();
         mark_all_seeds_flag_dirty();
+        on_peer_info_changed(peer_info);
     }
 
+    // Something about `peer_info` changed that may affect whether or how
+    // soon we'd try connecting to it, so refile it in the outbound candidates
+    void on_peer_info_changed(tr_peer_info& peer_info);
+
     static void peerCallbackFunc(tr_peer* peer, tr_peer_event const& event, void* vs)
     {
         TR_ASSERT(peer != nullptr);
@@ -389,19 +523,34 @@ public:
             }
 
         case tr_peer_event::Type::ClientGotHave:
+            s->on_got_have(event.pieceIndex);
+            break;
+
+        // NB: these are published before the peer's `has()` is replaced
         case tr_peer_event::Type::ClientGotHaveAll:
+            s->update_piece_replication(peer->has(), -1);
+            s->update_piece_replication(+1);
+            break;
+
         case tr_peer_event::Type::ClientGotHaveNone:
+            s->update_piece_replication(peer->has(), -1);
+            break;
+
         case tr_peer_event::Type::ClientGotBitfield:
-            /* TODO: if we don't need these, should these events be removed? */
-            /* noop */
+            s->update_piece_replication(peer->has(), -1);
+            s->update_piece_replication(*event.bitfield, +1);
             break;
 
         case tr_peer_event::Type::ClientGotRej:
-            s->active_requests.remove(s->tor->piece_loc(event.pieceIndex, event.offset).block, peer);
-            break;
+            {
+                auto const block = s->tor->piece_loc(event.pieceIndex, event.offset).block;
+                s->active_requests.remove(block, peer);
+                s->on_block_changed(block);
+                break;
+            }
 
         case tr_peer_event::Type::ClientGotChoke:
-            s->active_requests.remove(peer);
+            s->removeRequestsToPeer(peer);
             break;
 
         case tr_peer_event::Type::ClientGotPort:
@@ -424,6 +573,7 @@ public:
                 s->cancelAllRequestsForBlock(loc.block, peer);
                 peer->blocks_sent_to_client.add(tr_time(), 1);
                 tr_torrentGotBlock(tor, loc.block);
+                s->on_block_changed(loc.block);
                 break;
             }
 
@@ -461,6 +611,75 @@ public:
 
     ActiveRequests active_requests;
 
+private:
+    class WishlistMediator final : public Wishlist::Mediator
+    {
+    public:
+        explicit WishlistMediator(tr_swarm const& swarm)
+            : swarm_{ swarm }
+        {
+        }
+
+        [[nodiscard]] bool clientCanRequestBlock(tr_block_index_t block) const override
+        {
+            return !swarm_.tor->has_block(block);
+        }
+
+        [[nodiscard]] bool clientCanRequestPiece(tr_piece_index_t piece) const override
+        {
+            return swarm_.tor->piece_is_wanted(piece);
+        }
+
+        [[nodiscard]] bool isEndgame() const override
+        {
+            return swarm_.isEndgame();
+        }
+
+        [[nodiscard]] size_t countActiveRequests(tr_block_index_t block) const override
+        {
+            return swarm_.active_requests.count(block);
+        }
+
+        [[nodiscard]] size_t countMissingBlocks(tr_piece_index_t piece) const override
+        {
+            return swarm_.tor->count_missing_blocks_in_piece(piece);
+        }
+
+        [[nodiscard]] tr_block_span_t blockSpan(tr_piece_index_t piece) const override
+        {
+            return swarm_.tor->block_span_for_piece(piece);
+        }
+
+        [[nodiscard]] tr_piece_index_t countAllPieces() const override
+        {
+            return swarm_.tor->piece_count();
+        }
+
+        [[nodiscard]] tr_priority_t priority(tr_piece_index_t piece) const override
+        {
+            return swarm_.tor->piece_priority(piece);
+        }
+
+        [[nodiscard]] bool isSequentialDownload() const override
+        {
+            return swarm_.tor->is_sequential_download();
+        }
+
+        [[nodiscard]] size_t pieceReplication(tr_piece_index_t piece) const override
+        {
+            return swarm_.picks_pieces_randomly_ ? 0U : swarm_.partial_piece_replication(piece);
+        }
+
+    private:
+        tr_swarm const& swarm_;
+    };
+
+    WishlistMediator wishlist_mediator_{ *this };
+
+public:
+    // depends-on: wishlist_mediator_
+    Wishlist wishlist{ wishlist_mediator_ };
+
     // depends-on: active_requests
     std::vector<std::unique_ptr<tr_peer>> webseeds;
 
@@ -475,6 +694,14 @@ public:
 
     time_t lastCancel = 0;
 
+    // The torrent's part of its peers' candidate scores when they were last
+    // filed, or nullopt if the swarm wasn't running. When this changes, the
+    // whole pool gets refiled.
+    std::optional<uint8_t> candidate_key;
+
+    // outbound candidates that were popped while this swarm had no room for more peers
+    std::vector<tr_peer_candidates::Candidate> parked_candidates;
+
 private:
     static void maybeSendCancelRequest(tr_peer* peer, tr_block_index_t block, tr_peer const* muted)
     {
@@ -516,8 +743,19 @@ private:
         mark_all_seeds_flag_dirty();
     }
 
+    void on_torrent_files_closed()
+    {
+        for (auto* const peer : peers)
+        {
+            peer->on_torrent_files_closed();
+        }
+    }
+
     void on_piece_completed(tr_piece_index_t piece)
     {
+        wishlist.on_piece_changed(piece);
+        update_random_piece_picking();
+
         bool piece_came_from_peers = false;
 
         for (auto* const peer : peers)
@@ -539,6 +777,8 @@ private:
 
     void on_got_bad_piece(tr_piece_index_t piece)
     {
+        wishlist.on_piece_changed(piece);
+
         auto const byte_count = tor->piece_size(piece);
 
         for (auto* const peer : peers)
@@ -561,6 +801,10 @@ private:
 
     void on_got_metainfo()
     {
+        rebuild_piece_replication();
+        update_random_piece_picking();
+        wishlist.invalidate();
+
         // the webseed list may have changed...
         rebuildWebseeds();
 
@@ -580,17 +824,51 @@ private:
     void on_torrent_started();
     void on_torrent_stopped();
 
+    void rebuild_piece_replication()
+    {
+        wishlist.invalidate();
+        piece_replication_.assign(tor->has_metainfo() ? tor->piece_count() : 0U, 0U);
+        n_seeds_ = 0U;
+
+        for (auto const* const peer : peers)
+        {
+            update_piece_replication(peer->has(), +1);
+        }
+    }
+
+    void update_random_piece_picking()
+    {
+        // Rarest-first is good for the swarm, but until we have a few pieces
+        // to trade, just grab whichever pieces we can get the quickest.
+        auto const n_pieces = uint64_t{ tor->session->initialRandomPieces() };
+        auto const is_random = tor->has_total() < n_pieces * tor->piece_size();
+
+        if (picks_pieces_randomly_ != is_random)
+        {
+            picks_pieces_randomly_ = is_random;
+            wishlist.invalidate();
+        }
+    }
+
     // number of bad pieces a peer is allowed to send before we ban them
     static auto constexpr MaxBadPiecesPerPeer = int{ 5 };
 
     // how long we'll let requests we've made linger before we cancel them
     static auto constexpr RequestTtlSecs = int{ 90 };
 
-    std::array<libtransmission::ObserverTag, 8> const tags_;
+    std::array<libtransmission::ObserverTag, 12> const tags_;
 
     mutable std::optional<bool> pool_is_all_seeds_;
 
+    // how many connected peers that don't have every piece have each piece
+    std::vector<uint16_t> piece_replication_;
+
+    // how many connected peers have every piece
+    size_t n_seeds_ = 0U;
+
     bool is_endgame_ = false;
+
+    bool picks_pieces_randomly_ = true;
 };
 
 struct tr_peerMgr
@@ -605,22 +883,7 @@ private:
     static auto constexpr MaxConnectionsPerSecond = size_t{ 18U };
     static auto constexpr MaxConnectionsPerPulse = size_t(MaxConnectionsPerSecond * BandwidthTimerPeriod / 1s);
 
-    // Building a peer candidate list is expensive, so cache it across pulses.
-    // We want to cache it long enough to avoid excess CPU cycles,
-    // but short enough that the data isn't too stale.
-    static auto constexpr OutboundCandidatesListTtl = BandwidthTimerPeriod * 4U;
-
-    // How big the candidate list should be when we create it.
-    static auto constexpr OutboundCandidateListCapacity = MaxConnectionsPerPulse * OutboundCandidatesListTtl /
-        BandwidthTimerPeriod;
-
 public:
-    // The peers we might try connecting to in the next few seconds.
-    // This list is cached between pulses so use resilient keys, e.g.
-    // a `tr_torrent_id_t` instead of a `tr_torrent*` that can be freed.
-    using OutboundCandidates = small::
-        max_size_vector<std::pair<tr_torrent_id_t, tr_socket_address>, OutboundCandidateListCapacity>;
-
     explicit tr_peerMgr(tr_session* session_in)
         : session{ session_in }
         , handshake_mediator_{ *session }
@@ -661,6 +924,17 @@ public:
     void refillUpkeep() const;
     void make_new_peer_connections();
 
+    // (re)add `peer_info` to the outbound candidates with an up-to-date score
+    void file_candidate(tr_swarm* swarm, tr_peer_info& peer_info, time_t now);
+
+    [[nodiscard]] tr_peer_mgr_reconnect_stats reconnect_stats() const
+    {
+        auto stats = reconnect_stats_;
+        stats.n_candidates = candidates_.size();
+        stats.n_candidates_asleep = candidates_.size_asleep();
+        return stats;
+    }
+
     [[nodiscard]] tr_swarm* get_existing_swarm(tr_sha1_digest_t const& hash) const
     {
         auto* const tor = session->torrents().get(hash);
@@ -679,7 +953,7 @@ private:
         rechoke_timer_->set_interval(RechokePeriod);
     }
 
-    void on_blocklist_changed() const
+    void on_blocklist_changed()
     {
         /* we cache whether or not a peer is blocklisted...
            since the blocklist has changed, erase that cached value */
@@ -688,11 +962,21 @@ private:
             for (auto& [socket_address, atom] : tor->swarm->pool)
             {
                 atom.set_blocklisted_dirty();
+                tor->swarm->on_peer_info_changed(atom);
             }
         }
     }
 
-    OutboundCandidates outbound_candidates_;
+    void refresh_candidate_keys(time_t now);
+    void compact_candidates();
+
+    // The peers we might try connecting to, best first. This is kept across
+    // pulses so use resilient keys, e.g. a `tr_torrent_id_t` instead of a
+    // `tr_torrent*` that can be freed.
+    tr_peer_candidates candidates_;
+    tr_salt_shaker<uint8_t> candidate_salter_;
+
+    tr_peer_mgr_reconnect_stats reconnect_stats_;
 
     std::unique_ptr<libtransmission::Timer> const bandwidth_timer_;
     std::unique_ptr<libtransmission::Timer> const rechoke_timer_;
@@ -719,12 +1003,17 @@ tr_peer::~tr_peer()
 {
     if (swarm != nullptr)
     {
-        swarm->active_requests.remove(this);
+        swarm->removeRequestsToPeer(this);
     }
 
     if (auto* const info = peer_info; info != nullptr)
     {
         info->set_connected(tr_time(), false);
+
+        if (swarm != nullptr)
+        {
+            swarm->on_peer_info_changed(*info);
+        }
     }
 }
 
@@ -740,6 +1029,12 @@ void tr_peerMgrFree(tr_peerMgr* manager)
     delete manager;
 }
 
+tr_peer_mgr_reconnect_stats tr_peerMgrGetReconnectStats(tr_peerMgr const* manager)
+{
+    auto const lock = manager->unique_lock();
+    return manager->reconnect_stats();
+}
+
 // ---
 
 /**
@@ -772,77 +1067,12 @@ void tr_peerMgrClientSentRequests(tr_torrent* torrent, tr_peer* peer, tr_block_s
 
 std::vector<tr_block_span_t> tr_peerMgrGetNextRequests(tr_torrent* torrent, tr_peer const* peer, size_t numwant)
 {
-    class MediatorImpl final : public Wishlist::Mediator
-    {
-    public:
-        MediatorImpl(tr_torrent const* torrent_in, tr_peer const* peer_in)
-            : torrent_{ torrent_in }
-            , swarm_{ torrent_in->swarm }
-            , peer_{ peer_in }
-        {
-        }
-
-        MediatorImpl(MediatorImpl&&) = delete;
-        MediatorImpl(MediatorImpl const&) = delete;
-        MediatorImpl& operator=(MediatorImpl&&) = delete;
-        MediatorImpl& operator=(MediatorImpl const&) = delete;
-
-        ~MediatorImpl() override = default;
-
-        [[nodiscard]] bool clientCanRequestBlock(tr_block_index_t block) const override
-        {
-            return !torrent_->has_block(block) && !swarm_->active_requests.has(block, peer_);
-        }
-
-        [[nodiscard]] bool clientCanRequestPiece(tr_piece_index_t piece) const override
-        {
-            return torrent_->piece_is_wanted(piece) && peer_->hasPiece(piece);
-        }
-
-        [[nodiscard]] bool isEndgame() const override
-        {
-            return swarm_->isEndgame();
-        }
-
-        [[nodiscard]] size_t countActiveRequests(tr_block_index_t block) const override
-        {
-            return swarm_->active_requests.count(block);
-        }
-
-        [[nodiscard]] size_t countMissingBlocks(tr_piece_index_t piece) const override
-        {
-            return torrent_->count_missing_blocks_in_piece(piece);
-        }
-
-        [[nodiscard]] tr_block_span_t blockSpan(tr_piece_index_t piece) const override
-        {
-            return torrent_->block_span_for_piece(piece);
-        }
-
-        [[nodiscard]] tr_piece_index_t countAllPieces() const override
-        {
-            return torrent_->piece_count();
-        }
-
-        [[nodiscard]] tr_priority_t priority(tr_piece_index_t piece) const override
-        {
-            return torrent_->piece_priority(piece);
-        }
-
-        [[nodiscard]] bool isSequentialDownload() const override
-        {
-            return torrent_->is_sequential_download();
-        }
-
-    private:
-        tr_torrent const* const torrent_;
-        tr_swarm const* const swarm_;
-        tr_peer const* const peer_;
-    };
-
-    torrent->swarm->updateEndgame();
-    auto const mediator = MediatorImpl{ torrent, peer };
-    return Wishlist{ mediator }.next(numwant);
+    auto* const swarm = torrent->swarm;
+    swarm->updateEndgame();
+    return swarm->wishlist.next(
+        numwant,
+        [peer](tr_piece_index_t piece) { return peer->hasPiece(piece); },
+        [swarm, peer](tr_block_index_t block) { return swarm->active_requests.has(block, peer); });
 }
 
 // --- Piece List Manipulation / Accessors
@@ -879,12 +1109,19 @@ void create_bit_torrent_peer(tr_torrent* tor, std::shared_ptr<tr_peerIo> io, tr_
 
     tr_swarm* swarm = tor->swarm;
 
+    // the handshake is done, so the rest of this connection's socket I/O can move out of the session thread
+    if (auto* const threads = tor->session->peer_io_threads(); threads != nullptr && !io->is_utp())
+    {
+        io->move_to_thread(threads->next());
+    }
+
     auto* peer = tr_peerMsgsNew(tor, peer_info, std::move(io), client, &tr_swarm::peerCallbackFunc, swarm);
 
     swarm->peers.push_back(peer);
 
     ++swarm->stats.peer_count;
     ++swarm->stats.peer_from_count[peer_info->from_first()];
+    tor->bump_change_version(tr_torrent::ChangeGroup::Activity);
 
     TR_ASSERT(swarm->stats.peer_count == swarm->peerCount());
     TR_ASSERT(swarm->stats.peer_from_count[peer_info->from_first()] <= swarm->stats.peer_count);
@@ -931,6 +1168,8 @@ void create_bit_torrent_peer(tr_torrent* tor, std::shared_ptr<tr_peerIo> io, tr_
                             info->connection_failure_count()));
                     info->set_connectable(false);
                 }
+
+                s->on_peer_info_changed(*info);
             }
         }
     }
@@ -1208,6 +1447,9 @@ void tr_swarm::on_torrent_started()
 {
     auto const lock = tor->unique_lock();
     is_running = true;
+    candidate_key.reset(); // refile the pool on the next reconnect pulse
+    update_random_piece_picking();
+    wishlist.invalidate(); // pieces may have been verified while we were stopped
     manager->rechokeSoon();
 }
 
@@ -1237,8 +1479,8 @@ int8_t tr_peerMgrPieceAvailability(tr_torrent const* tor, tr_piece_index_t piece
         return -1;
     }
 
-    auto const& peers = tor->swarm->peers;
-    return std::count_if(std::begin(peers), std::end(peers), [piece](auto const* peer) { return peer->hasPiece(piece); });
+    auto const replication = tor->swarm->piece_replication(piece);
+    return static_cast<int8_t>(std::min(replication, size_t{ INT8_MAX }));
 }
 
 void tr_peerMgrTorrentAvailability(tr_torrent const* tor, int8_t* tab, unsigned int n_tabs)
@@ -1897,6 +2139,7 @@ void tr_peerMgr::reconnectPulse()
 
     auto const lock = session->unique_lock();
     auto const now_sec = tr_time();
+    auto const begin = std::chrono::steady_clock::now();
 
     // remove crappy peers
     for (auto* const tor : session->torrents())
@@ -1927,6 +2170,16 @@ void tr_peerMgr::reconnectPulse()
 
     // try to make new peer connections
     make_new_peer_connections();
+
+    auto const pulse_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin);
+    ++reconnect_stats_.n_pulses;
+    reconnect_stats_.last_pulse_time = pulse_time;
+    reconnect_stats_.max_pulse_time = std::max(reconnect_stats_.max_pulse_time, pulse_time);
+    tr_logAddTrace(fmt::format(
+        "Reconnect pulse took {} us; {} candidates queued, {} asleep",
+        pulse_time.count(),
+        candidates_.size(),
+        candidates_.size_asleep()));
 }
 
 // --- Bandwidth Allocation
@@ -1977,8 +2230,7 @@ void tr_peerMgr::bandwidthPulse()
     pumpAllPeers(this);
 
     // allocate bandwidth to the peers
-    static auto constexpr Msec = std::chrono::duration_cast<std::chrono::milliseconds>(BandwidthTimerPeriod).count();
-    session->top_bandwidth_.allocate(Msec);
+    session->top_bandwidth_.allocate(tr_time_msec());
 
     // torrent upkeep
     for (auto* const tor : session->torrents())
@@ -2048,22 +2300,6 @@ namespace connect_helpers
     return true;
 }
 
-struct peer_candidate
-{
-    peer_candidate() = default;
-
-    peer_candidate(uint64_t score_in, tr_torrent* tor_in, tr_peer_info* peer_info_in)
-        : score{ score_in }
-        , tor{ tor_in }
-        , peer_info{ peer_info_in }
-    {
-    }
-
-    uint64_t score;
-    tr_torrent* tor;
-    tr_peer_info* peer_info;
-};
-
 [[nodiscard]] bool torrentWasRecentlyStarted(tr_torrent const* tor)
 {
     return difftime(tr_time(), tor->startDate) < 120;
@@ -2134,78 +2370,42 @@ struct peer_candidate
     return score;
 }
 
-[[nodiscard]] tr_peerMgr::OutboundCandidates get_peer_candidates(tr_session* session)
+// the parts of getPeerCandidateScore() that come from the torrent rather than the peer
+[[nodiscard]] uint8_t getTorrentCandidateKey(tr_torrent const* tor)
 {
-    auto const now = tr_time();
-    auto const now_msec = tr_time_msec();
-
-    // leave 5% of connection slots for incoming connections -- ticket #2609
-    if (auto const max_candidates = static_cast<size_t>(session->peerLimit() * 0.95); max_candidates <= tr_peerMsgs::size())
-    {
-        return {};
-    }
+    auto key = uint8_t{};
+    key |= static_cast<uint8_t>(tor->get_priority() + 1) << 2U;
+    key |= torrentWasRecentlyStarted(tor) ? 2U : 0U;
+    key |= tor->is_done() ? 1U : 0U;
+    return key;
+}
 
-    auto candidates = std::vector<peer_candidate>{};
-    candidates.reserve(tr_peer_info::known_peer_count());
+// does this swarm have room for another peer connection?
+[[nodiscard]] bool swarmWantsMorePeers(tr_torrent const* tor, uint64_t now_msec)
+{
+    auto const* const swarm = tor->swarm;
 
-    /* populate the candidate array */
-    auto salter = tr_salt_shaker{};
-    for (auto* const tor : session->torrents())
+    /* if everyone in the swarm is seeds and pex is disabled because
+     * the torrent is private, then don't initiate connections */
+    bool const seeding = tor->is_done();
+    if (seeding && swarm->isAllSeeds() && tor->is_private())
     {
-        auto* const swarm = tor->swarm;
-
-        if (!swarm->is_running)
-        {
-            continue;
-        }
-
-        /* if everyone in the swarm is seeds and pex is disabled because
-         * the torrent is private, then don't initiate connections */
-        bool const seeding = tor->is_done();
-        if (seeding && swarm->isAllSeeds() && tor->is_private())
-        {
-            continue;
-        }
-
-        /* if we've already got enough peers in this torrent... */
-        if (tor->peer_limit() <= swarm->peerCount())
-        {
-            continue;
-        }
-
-        /* if we've already got enough speed in this torrent... */
-        if (seeding && tor->bandwidth_.is_maxed_out(TR_UP, now_msec))
-        {
-            continue;
-        }
-
-        for (auto& [socket_address, atom] : swarm->pool)
-        {
-            if (isPeerCandidate(tor, atom, now))
-            {
-                candidates.emplace_back(getPeerCandidateScore(tor, atom, salter()), tor, &atom);
-            }
-        }
+        return false;
     }
 
-    // only keep the best `max` candidates
-    if (auto const max = tr_peerMgr::OutboundCandidates::requested_inline_size; max < std::size(candidates))
+    /* if we've already got enough peers in this torrent... */
+    if (tor->peer_limit() <= swarm->peerCount())
     {
-        std::partial_sort(
-            std::begin(candidates),
-            std::begin(candidates) + max,
-            std::end(candidates),
-            [](auto const& a, auto const& b) { return a.score < b.score; });
-        candidates.resize(max);
+        return false;
     }
 
-    // put the best candiates at the end of the list
-    auto ret = tr_peerMgr::OutboundCandidates{};
-    for (auto it = std::crbegin(candidates), end = std::crend(candidates); it != end; ++it)
+    /* if we've already got enough speed in this torrent... */
+    if (seeding && tor->bandwidth_.is_maxed_out(TR_UP, now_msec))
     {
-        ret.emplace_back(it->tor->id(), it->peer_info->socket_address());
+        return false;
     }
-    return ret;
+
+    return true;
 }
 
 void initiateConnection(tr_peerMgr* mgr, tr_swarm* s, tr_peer_info& peer_info)
@@ -2216,8 +2416,11 @@ void initiateConnection(tr_peerMgr* mgr, tr_swarm* s, tr_peer_info& peer_info)
     auto const utp = mgr->session->allowsUTP() && peer_info.supports_utp().value_or(true);
     auto* const session = mgr->session;
 
-    if (tr_peer_socket::limit_reached(session) || (!utp && !session->allowsTCP()))
+    if (!utp && !session->allowsTCP())
     {
+        // try again later; the session's settings may have changed by then
+        peer_info.set_connection_attempt_time(now);
+        s->on_peer_info_changed(peer_info);
         return;
     }
 
@@ -2250,41 +2453,190 @@ void initiateConnection(tr_peerMgr* mgr, tr_swarm* s, tr_peer_info& peer_info)
     }
 
     peer_info.set_connection_attempt_time(now);
+
+    if (!peer_io)
+    {
+        s->on_peer_info_changed(peer_info);
+    }
 }
 } // namespace connect_helpers
 } // namespace
 
-void tr_peerMgr::make_new_peer_connections()
+void tr_peerMgr::file_candidate(tr_swarm* swarm, tr_peer_info& peer_info, time_t now)
 {
     using namespace connect_helpers;
 
-    auto const lock = session->unique_lock();
+    if (!swarm->is_running)
+    {
+        return;
+    }
+
+    // The low byte is a random salt, so if the rest is unchanged then the
+    // peer is already filed where it belongs and doesn't need another entry.
+    auto* const tor = swarm->tor;
+    auto const score = getPeerCandidateScore(tor, peer_info, candidate_salter_());
+    if (auto const old_score = peer_info.candidate_score(); old_score && (*old_score >> 8U) == (score >> 8U))
+    {
+        return;
+    }
 
-    // get the candidates if we need to
-    auto& candidates = outbound_candidates_;
-    if (std::empty(candidates))
+    peer_info.set_candidate_score(score);
+
+    auto const candidate = tr_peer_candidates::Candidate{ score, tor->id(), peer_info.socket_address() };
+    if (peer_info.reconnect_interval_has_passed(now))
+    {
+        candidates_.push(candidate);
+    }
+    else
     {
-        candidates = get_peer_candidates(session);
+        candidates_.push_later(candidate, peer_info.reconnect_at(now));
     }
+}
+
+void tr_swarm::on_peer_info_changed(tr_peer_info& peer_info)
+{
+    manager->file_candidate(this, peer_info, tr_time());
+}
 
-    // initiate connections to the last N candidates
-    auto const n_this_pass = std::min(std::size(candidates), MaxConnectionsPerPulse);
-    auto const it_end = std::crbegin(candidates) + n_this_pass;
-    for (auto it = std::crbegin(candidates); it != it_end; ++it)
+// Refile a torrent's peers when the torrent's part of their scores changes,
+// and give parked candidates another chance when their swarm has room again.
+// This is O(torrents) unless something changed.
+void tr_peerMgr::refresh_candidate_keys(time_t now)
+{
+    using namespace connect_helpers;
+
+    auto const now_msec = tr_time_msec();
+
+    for (auto* const tor : session->torrents())
     {
-        auto const& [tor_id, sock_addr] = *it;
+        auto* const swarm = tor->swarm;
 
-        if (auto* const tor = session->torrents().get(tor_id); tor != nullptr)
+        auto const key = swarm->is_running ? std::optional<uint8_t>{ getTorrentCandidateKey(tor) } : std::nullopt;
+        if (swarm->candidate_key != key)
         {
-            if (auto* const peer_info = tor->swarm->get_existing_peer_info(sock_addr); peer_info != nullptr)
+            swarm->candidate_key = key;
+
+            for (auto& [socket_address, atom] : swarm->pool)
             {
-                initiateConnection(this, tor->swarm, *peer_info);
+                file_candidate(swarm, atom, now);
             }
         }
+
+        auto& parked = swarm->parked_candidates;
+        if (!std::empty(parked) && swarm->is_running && swarmWantsMorePeers(tor, now_msec))
+        {
+            for (auto const& candidate : parked)
+            {
+                candidates_.push(candidate);
+            }
+
+            parked.clear();
+        }
+    }
+}
+
+// Drop entries that were superseded by a newer score, or whose torrent or
+// peer is gone, so that they don't pile up when peers are refiled often.
+void tr_peerMgr::compact_candidates()
+{
+    auto const is_stale = [this](tr_peer_candidates::Candidate const& candidate)
+    {
+        auto* const tor = session->torrents().get(candidate.tor_id);
+        if (tor == nullptr)
+        {
+            return true;
+        }
+
+        auto const* const info = tor->swarm->get_existing_peer_info(candidate.socket_address);
+        return info == nullptr || info->candidate_score() != candidate.score;
+    };
+
+    candidates_.remove_if(is_stale);
+
+    for (auto* const tor : session->torrents())
+    {
+        auto& parked = tor->swarm->parked_candidates;
+        parked.erase(std::remove_if(std::begin(parked), std::end(parked), is_stale), std::end(parked));
+    }
+}
+
+void tr_peerMgr::make_new_peer_connections()
+{
+    using namespace connect_helpers;
+
+    auto const lock = session->unique_lock();
+    auto const now = tr_time();
+    auto const now_msec = tr_time_msec();
+
+    // bound the number of outdated entries left behind by refiled peers
+    static auto constexpr MinCompactSize = size_t{ 1024U };
+    if (candidates_.size() + candidates_.size_asleep() > tr_peer_info::known_peer_count() * 2U + MinCompactSize)
+    {
+        compact_candidates();
+    }
+
+    refresh_candidate_keys(now);
+    candidates_.wake(now);
+
+    // leave 5% of connection slots for incoming connections -- ticket #2609
+    if (auto const max_candidates = static_cast<size_t>(session->peerLimit() * 0.95); max_candidates <= tr_peerMsgs::size())
+    {
+        return;
+    }
+
+    // initiate connections to the best N candidates
+    auto n_started = size_t{};
+    while (n_started < MaxConnectionsPerPulse && !tr_peer_socket::limit_reached(session))
+    {
+        auto const candidate = candidates_.pop();
+        if (!candidate)
+        {
+            break;
+        }
+
+        auto* const tor = session->torrents().get(candidate->tor_id);
+        if (tor == nullptr)
+        {
+            continue;
+        }
+
+        auto* const swarm = tor->swarm;
+        auto* const peer_info = swarm->get_existing_peer_info(candidate->socket_address);
+        if (peer_info == nullptr || peer_info->candidate_score() != candidate->score)
+        {
+            continue; // superseded by a newer entry
+        }
+
+        if (!swarm->is_running)
+        {
+            // the whole pool gets refiled when the torrent starts again
+            peer_info->set_candidate_score({});
+            continue;
+        }
+
+        if (!swarmWantsMorePeers(tor, now_msec))
+        {
+            swarm->parked_candidates.push_back(*candidate);
+            continue;
+        }
+
+        if (!peer_info->reconnect_interval_has_passed(now))
+        {
+            candidates_.push_later(*candidate, peer_info->reconnect_at(now));
+            continue;
+        }
+
+        // If it's ineligible for any other reason, e.g. it's banned or
+        // already connected, then it'll be refiled when that changes.
+        peer_info->set_candidate_score({});
+        if (isPeerCandidate(tor, *peer_info, now))
+        {
+            initiateConnection(this, swarm, *peer_info);
+            ++n_started;
+        }
     }
 
-    // remove the N candidates that we just consumed
-    candidates.resize(std::size(candidates) - n_this_pass);
+    reconnect_stats_.n_connections_started += n_started;
 }
 
 void HandshakeMediator::set_utp_failed(tr_sha1_digest_t const& info_hash, tr_socket_address const& socket_address)
@@ -10,6 +10,7 @@
 #endif
 
 #include <atomic>
+#include <chrono>
 #include <cstddef> // size_t
 #include <cstdint> // uint8_t, uint64_t
 #include <ctime>
@@ -232,8 +233,13 @@ public:
 
     [[nodiscard]] constexpr auto reconnect_interval_has_passed(time_t const now) const noexcept
     {
-        auto const interval = now - std::max(connection_attempted_at_, connection_changed_at_);
-        return interval >= get_reconnect_interval_secs(now);
+        return now >= reconnect_at(now);
+    }
+
+    // the earliest time that we'd try to reconnect to this peer, as seen at `now`
+    [[nodiscard]] constexpr time_t reconnect_at(time_t const now) const noexcept
+    {
+        return std::max(connection_attempted_at_, connection_changed_at_) + get_reconnect_interval_secs(now);
     }
 
     [[nodiscard]] constexpr std::optional<time_t> idle_secs(time_t now) const noexcept
@@ -263,6 +269,19 @@ public:
 
     // ---
 
+    // the score this peer was last filed under in the outbound candidates, if any
+    [[nodiscard]] constexpr auto const& candidate_score() const noexcept
+    {
+        return candidate_score_;
+    }
+
+    void set_candidate_score(std::optional<uint64_t> score) noexcept
+    {
+        candidate_score_ = score;
+    }
+
+    // ---
+
     constexpr void set_pex_flags(uint8_t pex_flags) noexcept
     {
         pex_flags_ = pex_flags;
@@ -377,6 +396,8 @@ private:
     time_t connection_changed_at_ = {};
     time_t piece_data_at_ = {};
 
+    std::optional<uint64_t> candidate_score_;
+
     mutable std::optional<bool> blocklisted_;
     std::optional<bool> is_connectable_;
     std::optional<bool> is_utp_supported_;
@@ -502,6 +523,20 @@ constexpr bool tr_isPex(tr_pex const* pex)
 
 void tr_peerMgrFree(tr_peerMgr* manager);
 
+struct tr_peer_mgr_reconnect_stats
+{
+    size_t n_pulses = 0;
+    size_t n_connections_started = 0;
+    size_t n_candidates = 0; // outbound candidates that can be tried now
+    size_t n_candidates_asleep = 0; // outbound candidates waiting for their reconnect interval
+
+    // how long the most recent reconnect pulse took, and the slowest pulse
+    std::chrono::microseconds last_pulse_time = {};
+    std::chrono::microseconds max_pulse_time = {};
+};
+
+[[nodiscard]] tr_peer_mgr_reconnect_stats tr_peerMgrGetReconnectStats(tr_peerMgr const* manager);
+
 [[nodiscard]] std::vector<tr_block_span_t> tr_peerMgrGetNextRequests(tr_torrent* torrent, tr_peer const* peer, size_t numwant);
 
 [[nodiscard]] bool tr_peerMgrDidPeerRequest(tr_torrent const* torrent, tr_peer const* peer, tr_block_index_t block);
@@ -84,6 +84,17 @@ public:
         process(buf_in, buf_len, buf_out, dec_active_, dec_key_);
     }
 
+    // Decrypt `buf_len` bytes in place. Until decrypt_init(), this does nothing.
+    template<typename T>
+    constexpr void decrypt(T* buf, size_t buf_len) noexcept
+    {
+        if (dec_active_)
+        {
+            auto* const bytes = reinterpret_cast<uint8_t*>(buf);
+            dec_key_.process(bytes, buf_len, bytes);
+        }
+    }
+
     void encrypt_init(bool is_incoming, DH const&, tr_sha1_digest_t const& info_hash);
 
     template<typename T>
@@ -12,7 +12,7 @@
 #include <ctime>
 #include <iterator>
 #include <map>
-#include <memory> // std::unique_ptr
+#include <memory> // std::shared_ptr, std::unique_ptr
 #include <optional>
 #include <queue>
 #include <string>
@@ -479,6 +479,12 @@ public:
         updateInterest();
     }
 
+    void on_torrent_files_closed() override
+    {
+        // blocks that are already queued keep the file open until they've been sent
+        send_file_.reset();
+    }
+
     void set_interested(bool interested) override
     {
         if (client_is_interested() != interested)
@@ -654,6 +660,10 @@ public:
 
     std::vector<QueuedPeerRequest> peer_requested_;
 
+    // the file that piece data was last sent from without copying it
+    std::shared_ptr<tr_peerIo::SendFile> send_file_;
+    tr_file_index_t send_file_index_ = {};
+
     std::vector<tr_pex> pex;
     std::vector<tr_pex> pex6;
 
@@ -1493,12 +1503,15 @@ ReadResult process_peer_message(tr_peerMsgsImpl* msgs, uint8_t id, MessageReader
         break;
 
     case BtPeerMsgs::Bitfield:
-        logtrace(msgs, "got a bitfield");
-        msgs->have_ = tr_bitfield{ msgs->torrent->has_metainfo() ? msgs->torrent->piece_count() : std::size(payload) * 8 };
-        msgs->have_.set_raw(reinterpret_cast<uint8_t const*>(std::data(payload)), std::size(payload));
-        msgs->publish(tr_peer_event::GotBitfield(&msgs->have_));
-        msgs->invalidatePercentDone();
-        break;
+        {
+            logtrace(msgs, "got a bitfield");
+            auto have = tr_bitfield{ msgs->torrent->has_metainfo() ? msgs->torrent->piece_count() : std::size(payload) * 8 };
+            have.set_raw(reinterpret_cast<uint8_t const*>(std::data(payload)), std::size(payload));
+            msgs->publish(tr_peer_event::GotBitfield(&have));
+            msgs->have_ = std::move(have);
+            msgs->invalidatePercentDone();
+            break;
+        }
 
     case BtPeerMsgs::Request:
         {
@@ -1596,8 +1609,8 @@ ReadResult process_peer_message(tr_peerMsgsImpl* msgs, uint8_t id, MessageReader
 
         if (fext)
         {
-            msgs->have_.set_has_all();
             msgs->publish(tr_peer_event::GotHaveAll());
+            msgs->have_.set_has_all();
             msgs->invalidatePercentDone();
         }
         else
@@ -1613,8 +1626,8 @@ ReadResult process_peer_message(tr_peerMsgsImpl* msgs, uint8_t id, MessageReader
 
         if (fext)
         {
-            msgs->have_.set_has_none();
             msgs->publish(tr_peer_event::GotHaveNone());
+            msgs->have_.set_has_none();
             msgs->invalidatePercentDone();
         }
         else
@@ -1907,6 +1920,59 @@ namespace peer_pulse_helpers
     return n_bytes_written;
 }
 
+// Queue the header of a 'piece' message whose payload is queued separately.
+// @return the number of bytes queued
+size_t write_piece_header(tr_peerMsgsImpl* msgs, peer_request const& req)
+{
+    auto out = MessageBuffer{};
+    out.add_uint32(sizeof(uint8_t) + sizeof(req.index) + sizeof(req.offset) + req.length);
+    out.add_uint8(BtPeerMsgs::Piece);
+    out.add_uint32(req.index);
+    out.add_uint32(req.offset);
+    auto const n_header_bytes = std::size(out);
+    msgs->io->write(out, true);
+    return n_header_bytes;
+}
+
+// Send the block straight from its file, without copying it through userspace.
+// @return the number of bytes queued, or 0 if the block has to be copied instead
+[[nodiscard]] size_t add_next_piece_from_file(tr_peerMsgsImpl* msgs, peer_request const& req)
+{
+    auto* const tor = msgs->torrent;
+    auto const loc = tor->piece_loc(req.index, req.offset);
+    if (!msgs->io->can_write_file() || !msgs->session->cache->is_on_disk(tor, loc, req.length))
+    {
+        return {};
+    }
+
+    // the block has to be in a single file
+    auto const [file_index, file_offset] = tor->file_offset(loc);
+    if (file_offset + req.length > tor->file_size(file_index))
+    {
+        return {};
+    }
+
+    if (!msgs->send_file_ || msgs->send_file_index_ != file_index)
+    {
+        auto const found = tor->find_file(file_index);
+        auto const fd = found ? tr_sys_file_open(found->filename(), TR_SYS_FILE_READ, 0) : TR_BAD_SYS_FILE;
+        if (fd == TR_BAD_SYS_FILE)
+        {
+            return {};
+        }
+
+        msgs->send_file_ = std::make_shared<tr_peerIo::SendFile>(fd);
+        msgs->send_file_index_ = file_index;
+    }
+
+    logtrace(msgs, fmt::format(FMT_STRING("sending 'piece' {:d} {:d} {:d} from file"), req.index, req.offset, req.length));
+
+    // the message header goes through the output buffer as usual
+    auto const n_header_bytes = write_piece_header(msgs, req);
+    msgs->io->write_file(msgs->send_file_, file_offset, req.length);
+    return n_header_bytes + req.length;
+}
+
 [[nodiscard]] size_t add_next_piece(tr_peerMsgsImpl* msgs, uint64_t now)
 {
     if (msgs->io->get_write_buffer_space(now) == 0U || std::empty(msgs->peer_requested_))
@@ -1917,7 +1983,6 @@ namespace peer_pulse_helpers
     auto const req = msgs->peer_requested_.front();
     msgs->peer_requested_.erase(std::begin(msgs->peer_requested_));
 
-    auto buf = std::array<uint8_t, tr_block_info::BlockSize>{};
     auto ok = msgs->isValidRequest(req) && msgs->torrent->has_piece(req.index);
 
     if (ok)
@@ -1933,14 +1998,25 @@ namespace peer_pulse_helpers
 
     if (ok)
     {
-        ok = msgs->session->cache
-                 ->read_block(msgs->torrent, msgs->torrent->piece_loc(req.index, req.offset), req.length, std::data(buf)) == 0;
-    }
+        if (auto const n_bytes = add_next_piece_from_file(msgs, req); n_bytes != 0U)
+        {
+            return n_bytes;
+        }
 
-    if (ok)
-    {
-        auto const piece_data = std::string_view{ reinterpret_cast<char const*>(std::data(buf)), req.length };
-        return protocol_send_message(msgs, BtPeerMsgs::Piece, req.index, req.offset, piece_data);
+        // the output buffer shares the block with the cache instead of copying it
+        auto piece_data = std::shared_ptr<uint8_t const>{};
+        auto const loc = msgs->torrent->piece_loc(req.index, req.offset);
+        ok = msgs->session->cache->read_block_shared(msgs->torrent, loc, req.length, piece_data) == 0;
+
+        if (ok)
+        {
+            logtrace(msgs, fmt::format(FMT_STRING("sending 'piece' {:d} {:d} {:d}"), req.index, req.offset, req.length));
+
+            auto const n_header_bytes = write_piece_header(msgs, req);
+            auto const* const payload = piece_data.get();
+            msgs->io->write_shared(std::move(piece_data), payload, req.length, true);
+            return n_header_bytes + req.length;
+        }
     }
 
     if (msgs->io->supports_fext())
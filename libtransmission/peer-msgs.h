@@ -114,6 +114,9 @@ public:
 
     virtual void on_piece_completed(tr_piece_index_t) = 0;
 
+    // the torrent's files may be moved or removed now, so stop using them
+    virtual void on_torrent_files_closed() = 0;
+
 protected:
     constexpr void set_client_choked(bool val) noexcept
     {
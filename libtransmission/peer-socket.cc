@@ -3,6 +3,14 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#if defined(__linux__) && defined(HAVE_SENDFILE64)
+#include <sys/sendfile.h>
+#define USE_SENDFILE64
+#endif
+
+#include <array>
+#include <cerrno>
+
 #include <fmt/core.h>
 
 #include <libutp/utp.h>
@@ -83,10 +91,12 @@ size_t tr_peer_socket::try_write(OutBuf& buf, size_t max, tr_error** error) cons
 #ifdef WITH_UTP
     if (is_utp())
     {
+        // hand libutp all of the segments at once so that it can fill whole packets
+        auto iovs = std::array<utp_iovec, OutBuf::MaxIovecs>{};
+        auto const n_iovs = buf.to_iovecs(std::data(iovs), std::size(iovs), max);
+
         errno = 0;
-        // NB: utp_write() does not modify its 2nd arg, but a wart in
-        // libutp's public API requires it to be non-const anyway :shrug:
-        auto const n_written = utp_write(handle.utp, const_cast<std::byte*>(std::data(buf)), std::min(std::size(buf), max));
+        auto const n_written = utp_writev(handle.utp, std::data(iovs), n_iovs);
         auto const error_code = errno;
 
         if (n_written > 0)
@@ -105,6 +115,47 @@ size_t tr_peer_socket::try_write(OutBuf& buf, size_t max, tr_error** error) cons
     return {};
 }
 
+bool tr_peer_socket::supports_sendfile() const noexcept
+{
+#ifdef USE_SENDFILE64
+    return is_tcp();
+#else
+    return false;
+#endif
+}
+
+size_t tr_peer_socket::try_sendfile(
+    [[maybe_unused]] tr_sys_file_t fd,
+    [[maybe_unused]] uint64_t offset,
+    size_t max,
+    tr_error** error) const
+{
+    if (max == size_t{})
+    {
+        return {};
+    }
+
+    TR_ASSERT(supports_sendfile());
+
+#ifdef USE_SENDFILE64
+    auto file_offset = static_cast<off64_t>(offset);
+    auto const n_sent = sendfile64(handle.tcp, fd, &file_offset, max);
+
+    if (n_sent > 0)
+    {
+        return static_cast<size_t>(n_sent);
+    }
+
+    // sendfile() returns 0 at end-of-file, e.g. if the file was truncated
+    auto const err = n_sent == 0 ? EIO : errno;
+    tr_error_set(error, err, tr_net_strerror(err));
+#else
+    tr_error_set(error, ENOTSUP, tr_net_strerror(ENOTSUP));
+#endif
+
+    return {};
+}
+
 size_t tr_peer_socket::try_read(InBuf& buf, size_t max, [[maybe_unused]] bool buf_is_empty, tr_error** error) const
 {
     if (max == size_t{})
@@ -11,6 +11,7 @@
 
 #include <atomic>
 #include <cstddef> // size_t
+#include <cstdint> // uint64_t
 #include <string>
 #include <string_view>
 #include <utility> // for std::make_pair()
@@ -18,6 +19,7 @@
 #include "transmission.h"
 
 #include "error.h"
+#include "file.h" // tr_sys_file_t
 #include "net.h"
 #include "tr-assert.h"
 #include "tr-buffer.h"
@@ -29,7 +31,7 @@ class tr_peer_socket
 {
 public:
     using InBuf = libtransmission::BufferWriter<std::byte>;
-    using OutBuf = libtransmission::BufferReader<std::byte>;
+    using OutBuf = libtransmission::ChainBuffer;
 
     tr_peer_socket() = default;
     tr_peer_socket(tr_session const* session, tr_socket_address const& socket_address, tr_socket_t sock);
@@ -60,6 +62,12 @@ public:
     size_t try_read(InBuf& buf, size_t max, bool buf_is_empty, tr_error** error) const;
     size_t try_write(OutBuf& buf, size_t max, tr_error** error) const;
 
+    // Send up to `max` bytes of a file, starting at `offset`, without
+    // copying them through userspace. Needs supports_sendfile().
+    size_t try_sendfile(tr_sys_file_t fd, uint64_t offset, size_t max, tr_error** error) const;
+
+    [[nodiscard]] bool supports_sendfile() const noexcept;
+
     [[nodiscard]] constexpr auto const& socketAddress() const noexcept
     {
         return socket_address_;
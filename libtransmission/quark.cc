@@ -5,6 +5,7 @@
 
 #include <algorithm>
 #include <array>
+#include <mutex>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -16,7 +17,7 @@ using namespace std::literals;
 namespace
 {
 
-auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
+auto constexpr MyStatic = std::array<std::string_view, 422>{ ""sv,
                                                              "activeTorrentCount"sv,
                                                              "activity-date"sv,
                                                              "activityDate"sv,
@@ -57,6 +58,10 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "blocks"sv,
                                                              "bytesCompleted"sv,
                                                              "cache-size-mb"sv,
+                                                             "cache-stats"sv,
+                                                             "cacheWriteBytes"sv,
+                                                             "cacheWrites"sv,
+                                                             "cachedBlocks"sv,
                                                              "clientIsChoked"sv,
                                                              "clientIsInterested"sv,
                                                              "clientName"sv,
@@ -83,6 +88,9 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "details-window-height"sv,
                                                              "details-window-width"sv,
                                                              "dht-enabled"sv,
+                                                             "disk-io-threads"sv,
+                                                             "diskWriteBytes"sv,
+                                                             "diskWrites"sv,
                                                              "dnd"sv,
                                                              "done-date"sv,
                                                              "doneDate"sv,
@@ -154,6 +162,7 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "incomplete-dir-enabled"sv,
                                                              "info"sv,
                                                              "inhibit-desktop-hibernation"sv,
+                                                             "initial-random-pieces"sv,
                                                              "ipv4"sv,
                                                              "ipv6"sv,
                                                              "isBackup"sv,
@@ -180,6 +189,7 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "leecherCount"sv,
                                                              "leftUntilDone"sv,
                                                              "length"sv,
+                                                             "loadingTorrentCount"sv,
                                                              "location"sv,
                                                              "lpd-enabled"sv,
                                                              "m"sv,
@@ -217,6 +227,7 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "paused"sv,
                                                              "pausedTorrentCount"sv,
                                                              "peer-congestion-algorithm"sv,
+                                                             "peer-io-threads"sv,
                                                              "peer-limit"sv,
                                                              "peer-limit-global"sv,
                                                              "peer-limit-per-torrent"sv,
@@ -271,7 +282,11 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "ratio-limit"sv,
                                                              "ratio-limit-enabled"sv,
                                                              "ratio-mode"sv,
+                                                             "read-cache-size-mb"sv,
                                                              "read-clipboard"sv,
+                                                             "readCacheBlocks"sv,
+                                                             "readHits"sv,
+                                                             "readMisses"sv,
                                                              "recent-download-dir-1"sv,
                                                              "recent-download-dir-2"sv,
                                                              "recent-download-dir-3"sv,
@@ -292,6 +307,7 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "rename-partial-files"sv,
                                                              "reqq"sv,
                                                              "result"sv,
+                                                             "resume-database-enabled"sv,
                                                              "rpc-authentication-required"sv,
                                                              "rpc-bind-address"sv,
                                                              "rpc-enabled"sv,
@@ -341,6 +357,7 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "show-statusbar"sv,
                                                              "show-toolbar"sv,
                                                              "show-tracker-scrapes"sv,
+                                                             "since"sv,
                                                              "sitename"sv,
                                                              "size-bytes"sv,
                                                              "size-units"sv,
@@ -413,6 +430,8 @@ auto constexpr MyStatic = std::array<std::string_view, 404>{ ""sv,
                                                              "ut_recommend"sv,
                                                              "utp-enabled"sv,
                                                              "v"sv,
+                                                             "verify-read-limit-mb"sv,
+                                                             "verify-threads"sv,
                                                              "version"sv,
                                                              "wanted"sv,
                                                              "watch-dir"sv,
@@ -437,13 +456,13 @@ bool constexpr quarks_are_sorted()
 static_assert(quarks_are_sorted(), "Predefined quarks must be sorted by their string value");
 static_assert(std::size(MyStatic) == TR_N_KEYS);
 
+// Quarks can be created from any thread, e.g. when parsing
+// benc on a worker thread, so guard the runtime list
 auto& my_runtime{ *new std::vector<std::string_view>{} };
+auto& my_runtime_mutex{ *new std::mutex{} };
 
-} // namespace
-
-std::optional<tr_quark> tr_quark_lookup(std::string_view key)
+std::optional<tr_quark> static_lookup(std::string_view key)
 {
-    // is it in our static array?
     auto constexpr Sbegin = std::begin(MyStatic);
     auto constexpr Send = std::end(MyStatic);
 
@@ -452,7 +471,12 @@ std::optional<tr_quark> tr_quark_lookup(std::string_view key)
         return std::distance(Sbegin, sit);
     }
 
-    /* was it added during runtime? */
+    return {};
+}
+
+// caller must hold my_runtime_mutex
+std::optional<tr_quark> runtime_lookup(std::string_view key)
+{
     auto const rbegin = std::begin(my_runtime);
     auto const rend = std::end(my_runtime);
     if (auto const rit = std::find(rbegin, rend, key); rit != rend)
@@ -463,9 +487,31 @@ std::optional<tr_quark> tr_quark_lookup(std::string_view key)
     return {};
 }
 
+} // namespace
+
+std::optional<tr_quark> tr_quark_lookup(std::string_view key)
+{
+    // is it in our static array?
+    if (auto const quark = static_lookup(key); quark)
+    {
+        return quark;
+    }
+
+    /* was it added during runtime? */
+    auto const lock = std::scoped_lock{ my_runtime_mutex };
+    return runtime_lookup(key);
+}
+
 tr_quark tr_quark_new(std::string_view str)
 {
-    if (auto const prior = tr_quark_lookup(str); prior)
+    if (auto const prior = static_lookup(str); prior)
+    {
+        return *prior;
+    }
+
+    auto const lock = std::scoped_lock{ my_runtime_mutex };
+
+    if (auto const prior = runtime_lookup(str); prior)
     {
         return *prior;
     }
@@ -481,5 +527,11 @@ tr_quark tr_quark_new(std::string_view str)
 
 std::string_view tr_quark_get_string_view(tr_quark q)
 {
-    return q < TR_N_KEYS ? MyStatic[q] : my_runtime[q - TR_N_KEYS];
+    if (q < TR_N_KEYS)
+    {
+        return MyStatic[q];
+    }
+
+    auto const lock = std::scoped_lock{ my_runtime_mutex };
+    return my_runtime[q - TR_N_KEYS];
 }
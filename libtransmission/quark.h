@@ -62,6 +62,10 @@ enum
     TR_KEY_blocks,
     TR_KEY_bytesCompleted,
     TR_KEY_cache_size_mb,
+    TR_KEY_cache_stats, /* rpc */
+    TR_KEY_cacheWriteBytes, /* rpc */
+    TR_KEY_cacheWrites, /* rpc */
+    TR_KEY_cachedBlocks, /* rpc */
     TR_KEY_clientIsChoked,
     TR_KEY_clientIsInterested,
     TR_KEY_clientName,
@@ -88,6 +92,9 @@ enum
     TR_KEY_details_window_height,
     TR_KEY_details_window_width,
     TR_KEY_dht_enabled,
+    TR_KEY_disk_io_threads,
+    TR_KEY_diskWriteBytes, /* rpc */
+    TR_KEY_diskWrites, /* rpc */
     TR_KEY_dnd,
     TR_KEY_done_date,
     TR_KEY_doneDate,
@@ -159,6 +166,7 @@ enum
     TR_KEY_incomplete_dir_enabled,
     TR_KEY_info,
     TR_KEY_inhibit_desktop_hibernation,
+    TR_KEY_initial_random_pieces,
     TR_KEY_ipv4,
     TR_KEY_ipv6,
     TR_KEY_isBackup,
@@ -185,6 +193,7 @@ enum
     TR_KEY_leecherCount,
     TR_KEY_leftUntilDone,
     TR_KEY_length,
+    TR_KEY_loadingTorrentCount,
     TR_KEY_location,
     TR_KEY_lpd_enabled,
     TR_KEY_m,
@@ -222,6 +231,7 @@ enum
     TR_KEY_paused,
     TR_KEY_pausedTorrentCount,
     TR_KEY_peer_congestion_algorithm,
+    TR_KEY_peer_io_threads,
     TR_KEY_peer_limit,
     TR_KEY_peer_limit_global,
     TR_KEY_peer_limit_per_torrent,
@@ -276,7 +286,11 @@ enum
     TR_KEY_ratio_limit,
     TR_KEY_ratio_limit_enabled,
     TR_KEY_ratio_mode,
+    TR_KEY_read_cache_size_mb,
     TR_KEY_read_clipboard,
+    TR_KEY_readCacheBlocks, /* rpc */
+    TR_KEY_readHits, /* rpc */
+    TR_KEY_readMisses, /* rpc */
     TR_KEY_recent_download_dir_1,
     TR_KEY_recent_download_dir_2,
     TR_KEY_recent_download_dir_3,
@@ -297,6 +311,7 @@ enum
     TR_KEY_rename_partial_files,
     TR_KEY_reqq,
     TR_KEY_result,
+    TR_KEY_resume_database_enabled,
     TR_KEY_rpc_authentication_required,
     TR_KEY_rpc_bind_address,
     TR_KEY_rpc_enabled,
@@ -346,6 +361,7 @@ enum
     TR_KEY_show_statusbar,
     TR_KEY_show_toolbar,
     TR_KEY_show_tracker_scrapes,
+    TR_KEY_since,
     TR_KEY_sitename,
     TR_KEY_size_bytes,
     TR_KEY_size_units,
@@ -418,6 +434,8 @@ enum
     TR_KEY_ut_recommend,
     TR_KEY_utp_enabled,
     TR_KEY_v,
+    TR_KEY_verify_read_limit_mb,
+    TR_KEY_verify_threads,
     TR_KEY_version,
     TR_KEY_wanted,
     TR_KEY_watch_dir,
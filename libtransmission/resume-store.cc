@@ -0,0 +1,508 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <cerrno> // EBADF, EIO
+#include <cstddef> // size_t, std::byte
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "libtransmission/error.h"
+#include "libtransmission/file.h"
+#include "libtransmission/log.h"
+#include "libtransmission/resume-store.h"
+#include "libtransmission/tr-assert.h"
+#include "libtransmission/tr-strbuf.h"
+#include "libtransmission/utils.h" // for _(), tr_file_read()
+
+using namespace std::literals;
+
+namespace
+{
+// File layout, with all integers little-endian:
+//
+// header: "TRRESUME" magic, then a uint32 format version
+// record: uint8 kind, 20-byte info hash, uint32 payload size,
+//         payload, uint32 checksum of everything before it
+auto constexpr Magic = "TRRESUME"sv;
+auto constexpr Version = uint32_t{ 1U };
+auto constexpr HeaderSize = std::size(Magic) + sizeof(uint32_t);
+
+enum class RecordKind : uint8_t
+{
+    Put = 1,
+    Erase = 2
+};
+
+auto constexpr RecordPrefixSize = sizeof(uint8_t) + std::tuple_size_v<tr_sha1_digest_t> + sizeof(uint32_t);
+auto constexpr RecordOverhead = RecordPrefixSize + sizeof(uint32_t);
+
+// Don't bother compacting small files
+auto constexpr MinCompactBytes = uint64_t{ 1024U * 1024U };
+
+void append_u32(std::vector<char>& buf, uint32_t val)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        buf.push_back(static_cast<char>((val >> (i * 8)) & 0xFFU));
+    }
+}
+
+[[nodiscard]] uint32_t read_u32(char const* walk)
+{
+    auto val = uint32_t{};
+    for (int i = 0; i < 4; ++i)
+    {
+        val |= uint32_t{ static_cast<uint8_t>(walk[i]) } << (i * 8);
+    }
+    return val;
+}
+
+[[nodiscard]] uint64_t read_u64(char const* walk)
+{
+    auto val = uint64_t{};
+    for (int i = 0; i < 8; ++i)
+    {
+        val |= uint64_t{ static_cast<uint8_t>(walk[i]) } << (i * 8);
+    }
+    return val;
+}
+
+// FNV-1a, but eight bytes at a time since payloads can be large
+[[nodiscard]] uint32_t checksum(char const* begin, char const* end)
+{
+    auto hash = uint64_t{ 14695981039346656037U };
+    auto const* walk = begin;
+    for (; end - walk >= 8; walk += 8)
+    {
+        hash ^= read_u64(walk);
+        hash *= 1099511628211U;
+    }
+    for (; walk != end; ++walk)
+    {
+        hash ^= static_cast<uint8_t>(*walk);
+        hash *= 1099511628211U;
+    }
+    return static_cast<uint32_t>(hash ^ (hash >> 32U));
+}
+
+void append_header(std::vector<char>& buf)
+{
+    buf.insert(std::end(buf), std::begin(Magic), std::end(Magic));
+    append_u32(buf, Version);
+}
+
+// Returns the offset of the payload in `buf`
+size_t append_record(std::vector<char>& buf, RecordKind kind, tr_sha1_digest_t const& info_hash, std::string_view payload)
+{
+    auto const begin = std::size(buf);
+    buf.push_back(static_cast<char>(kind));
+    for (auto const ch : info_hash)
+    {
+        buf.push_back(static_cast<char>(ch));
+    }
+    append_u32(buf, static_cast<uint32_t>(std::size(payload)));
+    auto const payload_offset = std::size(buf);
+    buf.insert(std::end(buf), std::begin(payload), std::end(payload));
+    append_u32(buf, checksum(std::data(buf) + begin, std::data(buf) + std::size(buf)));
+    return payload_offset;
+}
+
+bool write_all(tr_sys_file_t fd, std::vector<char> const& buf, uint64_t offset, tr_error** error)
+{
+    auto n_written = uint64_t{};
+    if (!tr_sys_file_write_at(fd, std::data(buf), std::size(buf), offset, &n_written, error))
+    {
+        return false;
+    }
+
+    if (n_written != std::size(buf))
+    {
+        tr_error_set(error, EIO, "short write"sv);
+        return false;
+    }
+
+    return tr_sys_file_flush(fd, error);
+}
+
+void log_error(std::string_view filename, tr_error const* error)
+{
+    tr_logAddWarn(fmt::format(
+        _("Couldn't save '{path}': {error} ({error_code})"),
+        fmt::arg("path", filename),
+        fmt::arg("error", error->message),
+        fmt::arg("error_code", error->code)));
+}
+} // namespace
+
+tr_resume_store::tr_resume_store(std::string_view filename)
+    : filename_{ filename }
+{
+    open();
+}
+
+tr_resume_store::~tr_resume_store()
+{
+    tr_error* error = nullptr;
+    if (!flush(&error))
+    {
+        log_error(filename_, error);
+        tr_error_clear(&error);
+    }
+
+    if (fd_ != TR_BAD_SYS_FILE)
+    {
+        tr_sys_file_close(fd_);
+    }
+}
+
+void tr_resume_store::open()
+{
+    auto contents = std::vector<char>{};
+    if (tr_sys_path_exists(filename_))
+    {
+        tr_error* error = nullptr;
+        if (!tr_file_read(filename_, contents, &error))
+        {
+            tr_logAddWarn(fmt::format(
+                _("Couldn't read '{path}': {error} ({error_code})"),
+                fmt::arg("path", filename_),
+                fmt::arg("error", error->message),
+                fmt::arg("error_code", error->code)));
+            tr_error_clear(&error);
+            return;
+        }
+    }
+
+    tr_error* error = nullptr;
+    fd_ = tr_sys_file_open(filename_.c_str(), TR_SYS_FILE_READ | TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE, 0600, &error);
+    if (fd_ == TR_BAD_SYS_FILE)
+    {
+        log_error(filename_, error);
+        tr_error_clear(&error);
+        return;
+    }
+
+    auto const has_header = std::size(contents) >= HeaderSize &&
+        std::string_view{ std::data(contents), std::size(Magic) } == Magic &&
+        read_u32(std::data(contents) + std::size(Magic)) == Version;
+
+    if (!has_header)
+    {
+        if (!std::empty(contents))
+        {
+            tr_logAddWarn(fmt::format(_("Ignoring invalid resume database '{path}'"), fmt::arg("path", filename_)));
+        }
+
+        auto header = std::vector<char>{};
+        append_header(header);
+        if (!tr_sys_file_truncate(fd_, 0, &error) || !write_all(fd_, header, 0, &error))
+        {
+            log_error(filename_, error);
+            tr_error_clear(&error);
+        }
+
+        file_size_ = std::size(header);
+        return;
+    }
+
+    replay(contents);
+}
+
+void tr_resume_store::replay(std::vector<char> const& contents)
+{
+    auto const* const begin = std::data(contents);
+    auto const size = std::size(contents);
+
+    auto pos = HeaderSize;
+    while (pos + RecordOverhead <= size)
+    {
+        auto const* const record = begin + pos;
+        auto const kind = static_cast<RecordKind>(record[0]);
+        auto const payload_size = read_u32(record + RecordPrefixSize - sizeof(uint32_t));
+        if ((kind != RecordKind::Put && kind != RecordKind::Erase) || pos + RecordOverhead + payload_size > size)
+        {
+            break;
+        }
+
+        auto const* const payload_end = record + RecordPrefixSize + payload_size;
+        if (checksum(record, payload_end) != read_u32(payload_end))
+        {
+            break;
+        }
+
+        auto info_hash = tr_sha1_digest_t{};
+        std::copy_n(reinterpret_cast<std::byte const*>(record + 1), std::size(info_hash), std::begin(info_hash));
+        if (kind == RecordKind::Put)
+        {
+            index_[info_hash] = Entry{ pos + RecordPrefixSize, payload_size };
+        }
+        else
+        {
+            index_.erase(info_hash);
+        }
+
+        pos += RecordOverhead + payload_size;
+    }
+
+    // drop a record that was torn by a crash
+    if (pos != size)
+    {
+        tr_logAddWarn(fmt::format(
+            _("Resume database '{path}' is damaged; discarding its last {count} bytes"),
+            fmt::arg("path", filename_),
+            fmt::arg("count", size - pos)));
+
+        if (tr_error* error = nullptr; !tr_sys_file_truncate(fd_, pos, &error))
+        {
+            log_error(filename_, error);
+            tr_error_clear(&error);
+        }
+    }
+
+    file_size_ = pos;
+}
+
+// ---
+
+bool tr_resume_store::get(tr_sha1_digest_t const& info_hash, std::vector<char>& setme) const
+{
+    auto const lock = std::scoped_lock{ mutex_ };
+
+    if (auto const iter = pending_.find(info_hash); iter != std::end(pending_))
+    {
+        if (!iter->second)
+        {
+            return false;
+        }
+
+        setme.assign(std::begin(*iter->second), std::end(*iter->second));
+        return true;
+    }
+
+    auto const iter = index_.find(info_hash);
+    if (iter == std::end(index_))
+    {
+        return false;
+    }
+
+    auto const& [offset, size] = iter->second;
+    setme.resize(size);
+    auto n_read = uint64_t{};
+    return tr_sys_file_read_at(fd_, std::data(setme), size, offset, &n_read) && n_read == size;
+}
+
+bool tr_resume_store::contains(tr_sha1_digest_t const& info_hash) const
+{
+    auto const lock = std::scoped_lock{ mutex_ };
+
+    if (auto const iter = pending_.find(info_hash); iter != std::end(pending_))
+    {
+        return iter->second.has_value();
+    }
+
+    return index_.count(info_hash) != 0U;
+}
+
+bool tr_resume_store::empty() const
+{
+    auto const lock = std::scoped_lock{ mutex_ };
+
+    for (auto const& [info_hash, payload] : pending_)
+    {
+        if (payload)
+        {
+            return false;
+        }
+    }
+
+    // the remaining pending changes are all erasures
+    auto const is_being_erased = [this](auto const& entry)
+    {
+        return pending_.count(entry.first) != 0U;
+    };
+    return std::all_of(std::begin(index_), std::end(index_), is_being_erased);
+}
+
+void tr_resume_store::put(tr_sha1_digest_t const& info_hash, std::string_view payload)
+{
+    auto const lock = std::scoped_lock{ mutex_ };
+    pending_[info_hash] = std::string{ payload };
+}
+
+void tr_resume_store::erase(tr_sha1_digest_t const& info_hash)
+{
+    auto const lock = std::scoped_lock{ mutex_ };
+
+    if (index_.count(info_hash) != 0U)
+    {
+        pending_[info_hash] = std::nullopt;
+    }
+    else
+    {
+        pending_.erase(info_hash);
+    }
+}
+
+void tr_resume_store::remove_after_flush(std::string_view filename)
+{
+    auto const lock = std::scoped_lock{ mutex_ };
+    remove_after_flush_.emplace_back(filename);
+}
+
+bool tr_resume_store::flush(tr_error** error)
+{
+    auto const lock = std::scoped_lock{ mutex_ };
+
+    if (fd_ == TR_BAD_SYS_FILE)
+    {
+        tr_error_set(error, EBADF, "resume database isn't open"sv);
+        return false;
+    }
+
+    if (!std::empty(pending_))
+    {
+        auto buf = std::vector<char>{};
+        auto entries = std::vector<std::pair<tr_sha1_digest_t, std::optional<Entry>>>{};
+        entries.reserve(std::size(pending_));
+
+        for (auto const& [info_hash, payload] : pending_)
+        {
+            if (payload)
+            {
+                auto const offset = file_size_ + append_record(buf, RecordKind::Put, info_hash, *payload);
+                entries.emplace_back(info_hash, Entry{ offset, static_cast<uint32_t>(std::size(*payload)) });
+            }
+            else
+            {
+                append_record(buf, RecordKind::Erase, info_hash, {});
+                entries.emplace_back(info_hash, std::nullopt);
+            }
+        }
+
+        // one write and one sync for the whole batch.
+        // If this fails, the changes stay pending for the next try.
+        if (!write_all(fd_, buf, file_size_, error))
+        {
+            return false;
+        }
+
+        file_size_ += std::size(buf);
+        for (auto const& [info_hash, entry] : entries)
+        {
+            if (entry)
+            {
+                index_[info_hash] = *entry;
+            }
+            else
+            {
+                index_.erase(info_hash);
+            }
+        }
+
+        pending_.clear();
+        ++n_flushes_;
+    }
+
+    for (auto const& filename : remove_after_flush_)
+    {
+        tr_sys_path_remove(filename);
+    }
+    remove_after_flush_.clear();
+
+    if (file_size_ > MinCompactBytes && live_bytes() * 2U < file_size_)
+    {
+        if (tr_error* compact_error = nullptr; !compact(&compact_error))
+        {
+            // not fatal; the log is still valid
+            log_error(filename_, compact_error);
+            tr_error_clear(&compact_error);
+        }
+    }
+
+    return true;
+}
+
+// Rewrite the file with only the live records
+bool tr_resume_store::compact(tr_error** error)
+{
+    auto buf = std::vector<char>{};
+    buf.reserve(live_bytes());
+    append_header(buf);
+
+    auto new_index = decltype(index_){};
+    auto payload = std::vector<char>{};
+    for (auto const& [info_hash, entry] : index_)
+    {
+        payload.resize(entry.size);
+        auto n_read = uint64_t{};
+        if (!tr_sys_file_read_at(fd_, std::data(payload), entry.size, entry.offset, &n_read, error))
+        {
+            return false;
+        }
+
+        // e.g. the file was truncated behind our back; keep it as it is
+        if (n_read != entry.size)
+        {
+            tr_error_set(error, EIO, "short read"sv);
+            return false;
+        }
+
+        auto const offset = append_record(buf, RecordKind::Put, info_hash, std::string_view{ std::data(payload), n_read });
+        new_index.try_emplace(info_hash, Entry{ offset, entry.size });
+    }
+
+    auto const tmpfile = tr_pathbuf{ filename_, ".tmp"sv };
+    auto const flags = TR_SYS_FILE_READ | TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE | TR_SYS_FILE_TRUNCATE;
+    auto const fd = tr_sys_file_open(tmpfile, flags, 0600, error);
+    if (fd == TR_BAD_SYS_FILE)
+    {
+        return false;
+    }
+
+    if (!write_all(fd, buf, 0, error) || !tr_sys_path_rename(tmpfile, filename_, error))
+    {
+        tr_sys_file_close(fd);
+        tr_sys_path_remove(tmpfile);
+        return false;
+    }
+
+    tr_sys_file_close(fd_);
+    fd_ = fd;
+    file_size_ = std::size(buf);
+    index_ = std::move(new_index);
+    ++n_compactions_;
+    return true;
+}
+
+uint64_t tr_resume_store::live_bytes() const noexcept
+{
+    auto n_bytes = uint64_t{ HeaderSize };
+    for (auto const& [info_hash, entry] : index_)
+    {
+        n_bytes += RecordOverhead + entry.size;
+    }
+    return n_bytes;
+}
+
+tr_resume_store::Stats tr_resume_store::stats() const
+{
+    auto const lock = std::scoped_lock{ mutex_ };
+
+    auto stats = Stats{};
+    stats.n_records = std::size(index_);
+    stats.live_bytes = live_bytes();
+    stats.file_bytes = file_size_;
+    stats.n_flushes = n_flushes_;
+    stats.n_compactions = n_compactions_;
+    return stats;
+}
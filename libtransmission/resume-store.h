@@ -0,0 +1,118 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <cstdint> // uint32_t, uint64_t
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "libtransmission/file.h" // tr_sys_file_t
+#include "libtransmission/tr-macros.h" // tr_sha1_digest_t
+
+struct tr_error;
+
+/**
+ * A single-file store for every torrent's resume data, keyed by info hash.
+ *
+ * This is an alternative to keeping one .resume file per torrent.
+ * The file is an append-only log of records: saving a torrent appends
+ * a new record, and removing a torrent appends a tombstone. Saves are
+ * batched in memory until `flush()`, which writes them all at once
+ * and syncs the file once. When most of the file is superseded records,
+ * `flush()` also compacts it by rewriting only the live records.
+ *
+ * A record that was torn by a crash is detected by its checksum, and
+ * the log is truncated there, so a crash loses the most recent batch
+ * at worst.
+ *
+ * All the methods are thread-safe, so e.g. the session thread can look
+ * up records while tr_resume_writer is saving others.
+ */
+class tr_resume_store
+{
+public:
+    struct Stats
+    {
+        size_t n_records = 0; // live records
+        uint64_t live_bytes = 0; // bytes used by live records
+        uint64_t file_bytes = 0; // total size of the file
+        size_t n_flushes = 0;
+        size_t n_compactions = 0;
+    };
+
+    explicit tr_resume_store(std::string_view filename);
+    ~tr_resume_store();
+
+    tr_resume_store(tr_resume_store&&) = delete;
+    tr_resume_store(tr_resume_store const&) = delete;
+    tr_resume_store& operator=(tr_resume_store&&) = delete;
+    tr_resume_store& operator=(tr_resume_store const&) = delete;
+
+    [[nodiscard]] constexpr auto const& filename() const noexcept
+    {
+        return filename_;
+    }
+
+    // Returns false if there's no record for `info_hash`
+    bool get(tr_sha1_digest_t const& info_hash, std::vector<char>& setme) const;
+
+    [[nodiscard]] bool contains(tr_sha1_digest_t const& info_hash) const;
+
+    [[nodiscard]] bool empty() const;
+
+    void put(tr_sha1_digest_t const& info_hash, std::string_view payload);
+
+    void erase(tr_sha1_digest_t const& info_hash);
+
+    // Remove `filename` after the next successful flush, e.g. a .resume
+    // file whose contents have been moved into the store.
+    void remove_after_flush(std::string_view filename);
+
+    // Write any pending changes to disk
+    bool flush(tr_error** error = nullptr);
+
+    [[nodiscard]] Stats stats() const;
+
+private:
+    struct Entry
+    {
+        uint64_t offset = 0; // where the payload starts
+        uint32_t size = 0; // payload size
+    };
+
+    void open();
+    void replay(std::vector<char> const& contents);
+    bool compact(tr_error** error);
+
+    [[nodiscard]] uint64_t live_bytes() const noexcept;
+
+    std::string const filename_;
+
+    mutable std::mutex mutex_;
+
+    tr_sys_file_t fd_ = TR_BAD_SYS_FILE;
+    uint64_t file_size_ = 0;
+
+    // records that are on disk
+    std::map<tr_sha1_digest_t, Entry> index_;
+
+    // changes that haven't been flushed yet. nullopt means erase
+    std::map<tr_sha1_digest_t, std::optional<std::string>> pending_;
+
+    std::vector<std::string> remove_after_flush_;
+
+    size_t n_flushes_ = 0;
+    size_t n_compactions_ = 0;
+};
@@ -0,0 +1,234 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm> // std::max()
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <fmt/core.h>
+
+#include "libtransmission/error.h"
+#include "libtransmission/file.h"
+#include "libtransmission/log.h"
+#include "libtransmission/resume-store.h"
+#include "libtransmission/resume-writer.h"
+#include "libtransmission/utils.h" // for _(), tr_file_save()
+#include "libtransmission/variant.h"
+
+using namespace std::literals;
+
+namespace
+{
+void log_error(std::string_view filename, tr_error const* error)
+{
+    tr_logAddError(fmt::format(
+        _("Couldn't save '{path}': {error} ({error_code})"),
+        fmt::arg("path", filename),
+        fmt::arg("error", error->message),
+        fmt::arg("error_code", error->code)));
+}
+
+[[nodiscard]] auto to_usec(std::chrono::steady_clock::duration duration)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(duration);
+}
+} // namespace
+
+tr_resume_writer::tr_resume_writer(ErrorFunc on_error)
+    : on_error_{ std::move(on_error) }
+{
+    thread_ = std::thread{ &tr_resume_writer::thread_func, this };
+}
+
+tr_resume_writer::~tr_resume_writer()
+{
+    {
+        auto const lock = std::scoped_lock{ mutex_ };
+        stopping_ = true;
+    }
+    queued_cv_.notify_one();
+    thread_.join();
+}
+
+void tr_resume_writer::save(
+    tr_sha1_digest_t const& info_hash,
+    std::string_view filename,
+    tr_resume_store* store,
+    bool use_store,
+    tr_variant&& snapshot)
+{
+    auto job = Job{};
+    job.filename = filename;
+    job.store = store;
+    job.use_store = use_store;
+    job.snapshot = std::exchange(snapshot, tr_variant{});
+    enqueue(info_hash, std::move(job));
+}
+
+void tr_resume_writer::remove(tr_sha1_digest_t const& info_hash, std::string_view filename, tr_resume_store* store)
+{
+    auto job = Job{};
+    job.filename = filename;
+    job.store = store;
+    enqueue(info_hash, std::move(job));
+}
+
+void tr_resume_writer::enqueue(tr_sha1_digest_t const& info_hash, Job&& job)
+{
+    job.queued_at = std::chrono::steady_clock::now();
+
+    {
+        auto const lock = std::scoped_lock{ mutex_ };
+
+        ++stats_.n_queued;
+
+        if (auto iter = queued_.find(info_hash); iter != std::end(queued_))
+        {
+            // the newer snapshot replaces the older one. Keep the older
+            // one's queue time so that the stats show how long this
+            // torrent's changes have been waiting to be written
+            auto& older = iter->second;
+            if (older.snapshot)
+            {
+                tr_variantClear(&*older.snapshot);
+            }
+
+            ++stats_.n_coalesced;
+            job.queued_at = older.queued_at;
+            older = std::move(job);
+        }
+        else
+        {
+            queued_.try_emplace(info_hash, std::move(job));
+        }
+    }
+
+    queued_cv_.notify_one();
+}
+
+void tr_resume_writer::wait()
+{
+    auto lock = std::unique_lock{ mutex_ };
+    idle_cv_.wait(lock, [this]() { return std::empty(queued_) && !is_writing_; });
+}
+
+tr_resume_writer::Stats tr_resume_writer::stats() const
+{
+    auto const lock = std::scoped_lock{ mutex_ };
+    return stats_;
+}
+
+void tr_resume_writer::thread_func()
+{
+    auto lock = std::unique_lock{ mutex_ };
+
+    for (;;)
+    {
+        queued_cv_.wait(lock, [this]() { return stopping_ || !std::empty(queued_); });
+
+        if (std::empty(queued_))
+        {
+            break; // stopping, and nothing left to write
+        }
+
+        auto batch = Jobs{};
+        std::swap(batch, queued_);
+        is_writing_ = true;
+        lock.unlock();
+
+        auto const begin = std::chrono::steady_clock::now();
+        auto max_queued_time = std::chrono::microseconds{};
+        auto stores = std::set<tr_resume_store*>{};
+        for (auto& [info_hash, job] : batch)
+        {
+            max_queued_time = std::max(max_queued_time, to_usec(begin - job.queued_at));
+            write(info_hash, job);
+
+            if (job.store != nullptr)
+            {
+                stores.insert(job.store);
+            }
+        }
+
+        for (auto* const store : stores)
+        {
+            if (tr_error* error = nullptr; !store->flush(&error))
+            {
+                log_error(store->filename(), error);
+                tr_error_clear(&error);
+            }
+        }
+
+        auto const batch_time = to_usec(std::chrono::steady_clock::now() - begin);
+        tr_logAddTrace(fmt::format("Saved resume data for {} torrents in {} us", std::size(batch), batch_time.count()));
+
+        lock.lock();
+        is_writing_ = false;
+        stats_.n_written += std::size(batch);
+        stats_.max_queued_time = std::max(stats_.max_queued_time, max_queued_time);
+        stats_.last_batch_time = batch_time;
+        stats_.max_batch_time = std::max(stats_.max_batch_time, batch_time);
+        idle_cv_.notify_all();
+    }
+
+    is_writing_ = false;
+    idle_cv_.notify_all();
+}
+
+void tr_resume_writer::write(tr_sha1_digest_t const& info_hash, Job& job) const
+{
+    auto* const store = job.store;
+
+    if (!job.snapshot)
+    {
+        tr_sys_path_remove(job.filename);
+
+        if (store != nullptr)
+        {
+            store->erase(info_hash);
+        }
+
+        return;
+    }
+
+    auto const contents = tr_variantToStr(&*job.snapshot, TR_VARIANT_FMT_BENC);
+    tr_variantClear(&*job.snapshot);
+
+    if (store != nullptr && job.use_store)
+    {
+        store->put(info_hash, contents);
+
+        // migrating from a .resume file
+        if (tr_sys_path_exists(job.filename))
+        {
+            store->remove_after_flush(job.filename);
+        }
+
+        return;
+    }
+
+    if (tr_error* error = nullptr; !tr_file_save(job.filename, contents, &error))
+    {
+        log_error(job.filename, error);
+
+        if (on_error_)
+        {
+            on_error_(info_hash, *error);
+        }
+
+        tr_error_clear(&error);
+        return;
+    }
+
+    // migrating from the resume database
+    if (store != nullptr && store->contains(info_hash))
+    {
+        store->erase(info_hash);
+    }
+}
@@ -0,0 +1,121 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef> // size_t
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "libtransmission/tr-macros.h" // tr_sha1_digest_t
+#include "libtransmission/variant.h"
+
+struct tr_error;
+class tr_resume_store;
+
+/**
+ * Saves torrents' resume data in a background thread.
+ *
+ * The session thread builds a snapshot of a torrent's resume fields and
+ * hands it to `save()`, which only queues it. The writer thread then
+ * encodes the snapshot and atomically replaces the torrent's .resume
+ * file, or puts it in the resume database, so that a burst of saves
+ * doesn't keep the session thread from servicing peers.
+ *
+ * If a torrent is saved again before its last snapshot was written,
+ * the newer snapshot replaces the older one.
+ */
+class tr_resume_writer
+{
+public:
+    // Called in the writer thread when a .resume file can't be saved
+    using ErrorFunc = std::function<void(tr_sha1_digest_t const& info_hash, tr_error const& error)>;
+
+    struct Stats
+    {
+        size_t n_queued = 0; // snapshots and removals passed to the writer
+        size_t n_written = 0; // snapshots and removals that were carried out
+        size_t n_coalesced = 0; // snapshots replaced by a newer one before being written
+
+        // the longest time a snapshot waited in the queue
+        std::chrono::microseconds max_queued_time = {};
+
+        // how long it took to encode and write the most recent batch, and the slowest batch
+        std::chrono::microseconds last_batch_time = {};
+        std::chrono::microseconds max_batch_time = {};
+    };
+
+    explicit tr_resume_writer(ErrorFunc on_error = {});
+
+    // Finishes writing everything that's been queued
+    ~tr_resume_writer();
+
+    tr_resume_writer(tr_resume_writer&&) = delete;
+    tr_resume_writer(tr_resume_writer const&) = delete;
+    tr_resume_writer& operator=(tr_resume_writer&&) = delete;
+    tr_resume_writer& operator=(tr_resume_writer const&) = delete;
+
+    // Queue `snapshot` to be saved to `filename`, or into `store`
+    // if `use_store` is true. Takes ownership of `snapshot`.
+    //
+    // When the data is saved in one place, it's removed from the other:
+    // saving into `store` removes `filename` after the store is flushed,
+    // and saving into `filename` erases the torrent from `store`.
+    void save(
+        tr_sha1_digest_t const& info_hash,
+        std::string_view filename,
+        tr_resume_store* store,
+        bool use_store,
+        tr_variant&& snapshot);
+
+    // Queue the removal of a torrent's .resume file and database record
+    void remove(tr_sha1_digest_t const& info_hash, std::string_view filename, tr_resume_store* store);
+
+    // Block until everything queued so far has been written
+    void wait();
+
+    [[nodiscard]] Stats stats() const;
+
+private:
+    struct Job
+    {
+        std::string filename;
+        tr_resume_store* store = nullptr;
+        bool use_store = false;
+        std::optional<tr_variant> snapshot; // nullopt means remove
+        std::chrono::steady_clock::time_point queued_at;
+    };
+
+    using Jobs = std::map<tr_sha1_digest_t, Job>;
+
+    void enqueue(tr_sha1_digest_t const& info_hash, Job&& job);
+    void thread_func();
+    void write(tr_sha1_digest_t const& info_hash, Job& job) const;
+
+    ErrorFunc const on_error_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable queued_cv_;
+    std::condition_variable idle_cv_;
+
+    Jobs queued_;
+    bool is_writing_ = false;
+    bool stopping_ = false;
+
+    Stats stats_;
+
+    std::thread thread_;
+};
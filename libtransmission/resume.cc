@@ -120,7 +120,7 @@ auto loadLabels(tr_variant* dict, tr_torrent* tor)
 
 void saveGroup(tr_variant* dict, tr_torrent const* tor)
 {
-    tr_variantDictAddStrView(dict, TR_KEY_group, tor->bandwidth_group());
+    tr_variantDictAddStr(dict, TR_KEY_group, tor->bandwidth_group());
 }
 
 auto loadGroup(tr_variant* dict, tr_torrent* tor)
@@ -346,7 +346,7 @@ auto loadIdleLimits(tr_variant* dict, tr_torrent* tor)
 
 void saveName(tr_variant* dict, tr_torrent const* tor)
 {
-    tr_variantDictAddStrView(dict, TR_KEY_name, tr_torrentName(tor));
+    tr_variantDictAddStr(dict, TR_KEY_name, tr_torrentName(tor));
 }
 
 auto loadName(tr_variant* dict, tr_torrent* tor)
@@ -379,7 +379,7 @@ void saveFilenames(tr_variant* dict, tr_torrent const* tor)
     tr_variant* const list = tr_variantDictAddList(dict, TR_KEY_files, n);
     for (tr_file_index_t i = 0; i < n; ++i)
     {
-        tr_variantListAddStrView(list, tor->file_subpath(i));
+        tr_variantListAddStr(list, tor->file_subpath(i));
     }
 }
 
@@ -619,33 +619,56 @@ auto loadProgress(tr_variant* dict, tr_torrent* tor)
 
 // ---
 
-auto loadFromFile(tr_torrent* tor, tr_resume::fields_t fields_to_load)
+auto loadFromFile(tr_torrent* tor, tr_resume::fields_t fields_to_load, tr_variant* preloaded)
 {
     auto fields_loaded = tr_resume::fields_t{};
 
     TR_ASSERT(tr_isTorrent(tor));
     auto const was_dirty = tor->is_dirty();
 
-    tr_torrent_metainfo::migrate_file(tor->session->resumeDir(), tor->name(), tor->info_hash_string(), ".resume"sv);
-
-    auto const filename = tor->resume_file();
-    if (!tr_sys_path_exists(filename))
-    {
-        return fields_loaded;
-    }
+    // `top` is only read from and then thrown away, so an arena suits it
+    auto constexpr ParseOpts = TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE | TR_VARIANT_PARSE_ARENA;
 
     auto buf = std::vector<char>{};
-    tr_error* error = nullptr;
     auto top = tr_variant{};
-    if (!tr_file_read(filename, buf, &error) ||
-        !tr_variantFromBuf(&top, TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE, buf, nullptr, &error))
+    if (preloaded != nullptr && !tr_variantIsEmpty(preloaded))
     {
-        tr_logAddDebugTor(tor, fmt::format("Couldn't read '{}': {}", filename, error->message));
-        tr_error_clear(&error);
-        return fields_loaded;
+        std::swap(top, *preloaded);
+        tr_logAddDebugTor(tor, "Using preloaded resume file");
     }
+    else if (auto const* const store = tor->session->resume_store(); store != nullptr && store->get(tor->info_hash(), buf))
+    {
+        if (tr_error* error = nullptr;
+            !tr_variantFromBuf(&top, ParseOpts, buf, nullptr, &error))
+        {
+            tr_logAddDebugTor(tor, fmt::format("Couldn't read '{}': {}", store->filename(), error->message));
+            tr_error_clear(&error);
+            return fields_loaded;
+        }
 
-    tr_logAddDebugTor(tor, fmt::format("Read resume file '{}'", filename));
+        tr_logAddDebugTor(tor, fmt::format("Read resume data from '{}'", store->filename()));
+    }
+    else
+    {
+        tr_torrent_metainfo::migrate_file(tor->session->resumeDir(), tor->name(), tor->info_hash_string(), ".resume"sv);
+
+        auto const filename = tor->resume_file();
+        if (!tr_sys_path_exists(filename))
+        {
+            return fields_loaded;
+        }
+
+        tr_error* error = nullptr;
+        if (!tr_file_read(filename, buf, &error) ||
+            !tr_variantFromBuf(&top, ParseOpts, buf, nullptr, &error))
+        {
+            tr_logAddDebugTor(tor, fmt::format("Couldn't read '{}': {}", filename, error->message));
+            tr_error_clear(&error);
+            return fields_loaded;
+        }
+
+        tr_logAddDebugTor(tor, fmt::format("Read resume file '{}'", filename));
+    }
 
     auto i = int64_t{};
     auto sv = std::string_view{};
@@ -855,7 +878,7 @@ auto useFallbackFields(tr_torrent* tor, tr_resume::fields_t fields, tr_ctor cons
 }
 } // namespace
 
-fields_t load(tr_torrent* tor, fields_t fields_to_load, tr_ctor const* ctor)
+fields_t load(tr_torrent* tor, fields_t fields_to_load, tr_ctor const* ctor, tr_variant* preloaded)
 {
     TR_ASSERT(tr_isTorrent(tor));
 
@@ -863,7 +886,7 @@ fields_t load(tr_torrent* tor, fields_t fields_to_load, tr_ctor const* ctor)
 
     ret |= useMandatoryFields(tor, fields_to_load, ctor);
     fields_to_load &= ~ret;
-    ret |= loadFromFile(tor, fields_to_load);
+    ret |= loadFromFile(tor, fields_to_load, preloaded);
     fields_to_load &= ~ret;
     ret |= useFallbackFields(tor, fields_to_load, ctor);
 
@@ -916,13 +939,15 @@ void save(tr_torrent* tor)
     saveLabels(&top, tor);
     saveGroup(&top, tor);
 
-    auto const resume_file = tor->resume_file();
-    if (auto const err = tr_variantToFile(&top, TR_VARIANT_FMT_BENC, resume_file); err != 0)
-    {
-        tor->set_local_error(fmt::format("Unable to save resume file: {:s}", tr_strerror(err)));
-    }
-
-    tr_variantClear(&top);
+    // `top` is a self-contained snapshot, so the encoding
+    // and writing can be done outside of the session thread
+    auto* const session = tor->session;
+    session->resume_writer().save(
+        tor->info_hash(),
+        tor->resume_file(),
+        session->resume_store(),
+        session->resume_database_enabled(),
+        std::move(top));
 }
 
 } // namespace tr_resume
@@ -13,6 +13,7 @@
 
 struct tr_ctor;
 struct tr_torrent;
+struct tr_variant;
 
 namespace tr_resume
 {
@@ -46,7 +47,9 @@ auto inline constexpr Group = fields_t{ 1 << 23 };
 
 auto inline constexpr All = ~fields_t{ 0 };
 
-fields_t load(tr_torrent* tor, fields_t fields_to_load, tr_ctor const* ctor);
+// `preloaded` is an already-parsed .resume file to use instead of reading
+// it from disk. It may be nullptr or empty, and is left empty afterwards.
+fields_t load(tr_torrent* tor, fields_t fields_to_load, tr_ctor const* ctor, tr_variant* preloaded = nullptr);
 
 void save(tr_torrent* tor);
 
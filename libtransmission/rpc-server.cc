@@ -261,6 +261,24 @@ void send_simple_response(struct evhttp_request* req, int code, char const* text
     return out;
 }
 
+[[nodiscard]] evbuffer* make_response(struct evhttp_request* req, tr_rpc_server const* server, evbuffer* content)
+{
+    char const* encoding = evhttp_find_header(req->input_headers, "Accept-Encoding");
+
+    if (bool const do_compress = encoding != nullptr && tr_strv_contains(encoding, "gzip"sv); !do_compress)
+    {
+        // hand off the content without copying it
+        auto* const out = evbuffer_new();
+        evbuffer_add_buffer(out, content);
+        return out;
+    }
+
+    // libdeflate only compresses contiguous memory
+    auto const len = evbuffer_get_length(content);
+    auto const* const data = reinterpret_cast<char const*>(evbuffer_pullup(content, -1));
+    return make_response(req, server, std::string_view{ data, len });
+}
+
 void add_time_header(struct evkeyvalq* headers, char const* key, time_t now)
 {
     // RFC 2616 says this must follow RFC 1123's date format, so use gmtime instead of localtime
@@ -347,11 +365,11 @@ struct rpc_response_data
     tr_rpc_server* server;
 };
 
-void rpc_response_func(tr_session* /*session*/, tr_variant* content, void* user_data)
+void rpc_response_func(tr_session* /*session*/, evbuffer* content, void* user_data)
 {
     auto* data = static_cast<struct rpc_response_data*>(user_data);
 
-    auto* const response = make_response(data->req, data->server, tr_variantToStr(content, TR_VARIANT_FMT_JSON_LEAN));
+    auto* const response = make_response(data->req, data->server, content);
     evhttp_add_header(data->req->output_headers, "Content-Type", "application/json; charset=UTF-8");
     evhttp_send_reply(data->req, HTTP_OK, "OK", response);
     evbuffer_free(response);
@@ -362,9 +380,12 @@ void rpc_response_func(tr_session* /*session*/, tr_variant* content, void* user_
 void handle_rpc_from_json(struct evhttp_request* req, tr_rpc_server* server, std::string_view json)
 {
     auto top = tr_variant{};
-    auto const have_content = tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE, json);
+    auto const have_content = tr_variantFromBuf(
+        &top,
+        TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE | TR_VARIANT_PARSE_ARENA,
+        json);
 
-    tr_rpc_request_exec_json(
+    tr_rpc_request_exec_serialized(
         server->session,
         have_content ? &top : nullptr,
         rpc_response_func,
@@ -17,16 +17,21 @@
 #include <utility>
 #include <vector>
 
+#include <event2/buffer.h>
+
 #include <fmt/core.h>
 
 #include <libdeflate.h>
 
+#include <small/vector.hpp>
+
 #include "libtransmission/transmission.h"
 
 #include "libtransmission/announcer.h"
 #include "libtransmission/crypto-utils.h"
 #include "libtransmission/error.h"
 #include "libtransmission/file.h"
+#include "libtransmission/json-writer.h"
 #include "libtransmission/log.h"
 #include "libtransmission/peer-mgr.h"
 #include "libtransmission/quark.h"
@@ -34,7 +39,9 @@
 #include "libtransmission/session.h"
 #include "libtransmission/torrent.h"
 #include "libtransmission/tr-assert.h"
+#include "libtransmission/tr-buffer.h"
 #include "libtransmission/tr-strbuf.h"
+#include "libtransmission/utils-ev.h"
 #include "libtransmission/utils.h"
 #include "libtransmission/variant.h"
 #include "libtransmission/version.h"
@@ -299,122 +306,253 @@ char const* torrentVerify(tr_session* session, tr_variant* args_in, tr_variant*
 
 // ---
 
-void addLabels(tr_torrent const* tor, tr_variant* list)
+// Builds a tr_variant with the same calls that libtransmission::JsonWriter uses,
+// so that RPC responses can be written either as a tr_variant or straight to JSON.
+class VariantWriter
 {
-    tr_variantInitList(list, std::size(tor->labels));
+public:
+    // If `top` is a dict or list, values are added to it.
+    // Otherwise, the first value is written into `top`.
+    explicit VariantWriter(tr_variant* top)
+        : top_{ top }
+    {
+        if (tr_variantIsDict(top) || tr_variantIsList(top))
+        {
+            stack_.push_back(top);
+        }
+    }
+
+    void start_object()
+    {
+        auto* const child = next();
+        tr_variantInitDict(child, 0);
+        stack_.push_back(child);
+    }
+
+    void end_object()
+    {
+        stack_.pop_back();
+    }
+
+    void start_array()
+    {
+        auto* const child = next();
+        tr_variantInitList(child, 0);
+        stack_.push_back(child);
+    }
+
+    void end_array()
+    {
+        stack_.pop_back();
+    }
+
+    void key(tr_quark key)
+    {
+        key_ = key;
+    }
+
+    void add_bool(bool value)
+    {
+        tr_variantInitBool(next(), value);
+    }
+
+    void add_int(int64_t value)
+    {
+        tr_variantInitInt(next(), value);
+    }
+
+    void add_real(double value)
+    {
+        tr_variantInitReal(next(), value);
+    }
+
+    void add_str(std::string_view value)
+    {
+        tr_variantInitStr(next(), value);
+    }
+
+    void add_bool(tr_quark key, bool value)
+    {
+        this->key(key);
+        add_bool(value);
+    }
+
+    void add_int(tr_quark key, int64_t value)
+    {
+        this->key(key);
+        add_int(value);
+    }
+
+    void add_real(tr_quark key, double value)
+    {
+        this->key(key);
+        add_real(value);
+    }
+
+    void add_str(tr_quark key, std::string_view value)
+    {
+        this->key(key);
+        add_str(value);
+    }
+
+private:
+    tr_variant* next()
+    {
+        if (std::empty(stack_))
+        {
+            return top_;
+        }
+
+        auto* const parent = stack_.back();
+        return tr_variantIsDict(parent) ? tr_variantDictAdd(parent, key_) : tr_variantListAdd(parent);
+    }
+
+    tr_variant* const top_;
+    small::vector<tr_variant*, 8U> stack_;
+    tr_quark key_ = TR_KEY_NONE;
+};
+
+// ---
+
+template<typename Writer>
+void addLabels(tr_torrent const* tor, Writer& out)
+{
+    out.start_array();
     for (auto const& label : tor->labels)
     {
-        tr_variantListAddQuark(list, label);
+        out.add_str(tr_quark_get_string_view(label));
     }
+    out.end_array();
 }
 
-void addFileStats(tr_torrent const* tor, tr_variant* list)
+template<typename Writer>
+void addFileStats(tr_torrent const* tor, Writer& out)
 {
+    out.start_array();
     for (tr_file_index_t i = 0, n = tor->file_count(); i < n; ++i)
     {
         auto const file = tr_torrentFile(tor, i);
-        tr_variant* d = tr_variantListAddDict(list, 3);
-        tr_variantDictAddInt(d, TR_KEY_bytesCompleted, file.have);
-        tr_variantDictAddInt(d, TR_KEY_priority, file.priority);
-        tr_variantDictAddBool(d, TR_KEY_wanted, file.wanted);
+        out.start_object();
+        out.add_int(TR_KEY_bytesCompleted, file.have);
+        out.add_int(TR_KEY_priority, file.priority);
+        out.add_bool(TR_KEY_wanted, file.wanted);
+        out.end_object();
     }
+    out.end_array();
 }
 
-void addFiles(tr_torrent const* tor, tr_variant* list)
+template<typename Writer>
+void addFiles(tr_torrent const* tor, Writer& out)
 {
+    out.start_array();
     for (tr_file_index_t i = 0, n = tor->file_count(); i < n; ++i)
     {
         auto const file = tr_torrentFile(tor, i);
-        tr_variant* d = tr_variantListAddDict(list, 5);
-        tr_variantDictAddInt(d, TR_KEY_beginPiece, file.beginPiece);
-        tr_variantDictAddInt(d, TR_KEY_bytesCompleted, file.have);
-        tr_variantDictAddInt(d, TR_KEY_endPiece, file.endPiece);
-        tr_variantDictAddInt(d, TR_KEY_length, file.length);
-        tr_variantDictAddStr(d, TR_KEY_name, file.name);
-    }
+        out.start_object();
+        out.add_int(TR_KEY_beginPiece, file.beginPiece);
+        out.add_int(TR_KEY_bytesCompleted, file.have);
+        out.add_int(TR_KEY_endPiece, file.endPiece);
+        out.add_int(TR_KEY_length, file.length);
+        out.add_str(TR_KEY_name, file.name);
+        out.end_object();
+    }
+    out.end_array();
 }
 
-void addWebseeds(tr_torrent const* tor, tr_variant* webseeds)
+template<typename Writer>
+void addWebseeds(tr_torrent const* tor, Writer& out)
 {
+    out.start_array();
     for (size_t i = 0, n = tor->webseed_count(); i < n; ++i)
     {
-        tr_variantListAddStr(webseeds, tor->webseed(i));
+        out.add_str(tor->webseed(i));
     }
+    out.end_array();
 }
 
-void addTrackers(tr_torrent const* tor, tr_variant* trackers)
+template<typename Writer>
+void addTrackers(tr_torrent const* tor, Writer& out)
 {
+    out.start_array();
     for (auto const& tracker : tor->announce_list())
     {
-        auto* const d = tr_variantListAddDict(trackers, 5);
-        tr_variantDictAddQuark(d, TR_KEY_announce, tracker.announce.quark());
-        tr_variantDictAddInt(d, TR_KEY_id, tracker.id);
-        tr_variantDictAddQuark(d, TR_KEY_scrape, tracker.scrape.quark());
-        tr_variantDictAddStrView(d, TR_KEY_sitename, tracker.sitename);
-        tr_variantDictAddInt(d, TR_KEY_tier, tracker.tier);
-    }
-}
-
-void addTrackerStats(tr_tracker_view const& tracker, tr_variant* list)
-{
-    auto* const d = tr_variantListAddDict(list, 27);
-    tr_variantDictAddStr(d, TR_KEY_announce, tracker.announce);
-    tr_variantDictAddInt(d, TR_KEY_announceState, tracker.announceState);
-    tr_variantDictAddInt(d, TR_KEY_downloadCount, tracker.downloadCount);
-    tr_variantDictAddBool(d, TR_KEY_hasAnnounced, tracker.hasAnnounced);
-    tr_variantDictAddBool(d, TR_KEY_hasScraped, tracker.hasScraped);
-    tr_variantDictAddStr(d, TR_KEY_host, tracker.host_and_port);
-    tr_variantDictAddStr(d, TR_KEY_sitename, tracker.sitename);
-    tr_variantDictAddInt(d, TR_KEY_id, tracker.id);
-    tr_variantDictAddBool(d, TR_KEY_isBackup, tracker.isBackup);
-    tr_variantDictAddInt(d, TR_KEY_lastAnnouncePeerCount, tracker.lastAnnouncePeerCount);
-    tr_variantDictAddStr(d, TR_KEY_lastAnnounceResult, tracker.lastAnnounceResult);
-    tr_variantDictAddInt(d, TR_KEY_lastAnnounceStartTime, tracker.lastAnnounceStartTime);
-    tr_variantDictAddBool(d, TR_KEY_lastAnnounceSucceeded, tracker.lastAnnounceSucceeded);
-    tr_variantDictAddInt(d, TR_KEY_lastAnnounceTime, tracker.lastAnnounceTime);
-    tr_variantDictAddBool(d, TR_KEY_lastAnnounceTimedOut, tracker.lastAnnounceTimedOut);
-    tr_variantDictAddStr(d, TR_KEY_lastScrapeResult, tracker.lastScrapeResult);
-    tr_variantDictAddInt(d, TR_KEY_lastScrapeStartTime, tracker.lastScrapeStartTime);
-    tr_variantDictAddBool(d, TR_KEY_lastScrapeSucceeded, tracker.lastScrapeSucceeded);
-    tr_variantDictAddInt(d, TR_KEY_lastScrapeTime, tracker.lastScrapeTime);
-    tr_variantDictAddBool(d, TR_KEY_lastScrapeTimedOut, tracker.lastScrapeTimedOut);
-    tr_variantDictAddInt(d, TR_KEY_leecherCount, tracker.leecherCount);
-    tr_variantDictAddInt(d, TR_KEY_nextAnnounceTime, tracker.nextAnnounceTime);
-    tr_variantDictAddInt(d, TR_KEY_nextScrapeTime, tracker.nextScrapeTime);
-    tr_variantDictAddStr(d, TR_KEY_scrape, tracker.scrape);
-    tr_variantDictAddInt(d, TR_KEY_scrapeState, tracker.scrapeState);
-    tr_variantDictAddInt(d, TR_KEY_seederCount, tracker.seederCount);
-    tr_variantDictAddInt(d, TR_KEY_tier, tracker.tier);
-}
-
-void addPeers(tr_torrent const* tor, tr_variant* list)
+        out.start_object();
+        out.add_str(TR_KEY_announce, tracker.announce.sv());
+        out.add_int(TR_KEY_id, tracker.id);
+        out.add_str(TR_KEY_scrape, tracker.scrape.sv());
+        out.add_str(TR_KEY_sitename, tracker.sitename);
+        out.add_int(TR_KEY_tier, tracker.tier);
+        out.end_object();
+    }
+    out.end_array();
+}
+
+template<typename Writer>
+void addTrackerStats(tr_tracker_view const& tracker, Writer& out)
+{
+    out.start_object();
+    out.add_str(TR_KEY_announce, tracker.announce);
+    out.add_int(TR_KEY_announceState, tracker.announceState);
+    out.add_int(TR_KEY_downloadCount, tracker.downloadCount);
+    out.add_bool(TR_KEY_hasAnnounced, tracker.hasAnnounced);
+    out.add_bool(TR_KEY_hasScraped, tracker.hasScraped);
+    out.add_str(TR_KEY_host, tracker.host_and_port);
+    out.add_str(TR_KEY_sitename, tracker.sitename);
+    out.add_int(TR_KEY_id, tracker.id);
+    out.add_bool(TR_KEY_isBackup, tracker.isBackup);
+    out.add_int(TR_KEY_lastAnnouncePeerCount, tracker.lastAnnouncePeerCount);
+    out.add_str(TR_KEY_lastAnnounceResult, tracker.lastAnnounceResult);
+    out.add_int(TR_KEY_lastAnnounceStartTime, tracker.lastAnnounceStartTime);
+    out.add_bool(TR_KEY_lastAnnounceSucceeded, tracker.lastAnnounceSucceeded);
+    out.add_int(TR_KEY_lastAnnounceTime, tracker.lastAnnounceTime);
+    out.add_bool(TR_KEY_lastAnnounceTimedOut, tracker.lastAnnounceTimedOut);
+    out.add_str(TR_KEY_lastScrapeResult, tracker.lastScrapeResult);
+    out.add_int(TR_KEY_lastScrapeStartTime, tracker.lastScrapeStartTime);
+    out.add_bool(TR_KEY_lastScrapeSucceeded, tracker.lastScrapeSucceeded);
+    out.add_int(TR_KEY_lastScrapeTime, tracker.lastScrapeTime);
+    out.add_bool(TR_KEY_lastScrapeTimedOut, tracker.lastScrapeTimedOut);
+    out.add_int(TR_KEY_leecherCount, tracker.leecherCount);
+    out.add_int(TR_KEY_nextAnnounceTime, tracker.nextAnnounceTime);
+    out.add_int(TR_KEY_nextScrapeTime, tracker.nextScrapeTime);
+    out.add_str(TR_KEY_scrape, tracker.scrape);
+    out.add_int(TR_KEY_scrapeState, tracker.scrapeState);
+    out.add_int(TR_KEY_seederCount, tracker.seederCount);
+    out.add_int(TR_KEY_tier, tracker.tier);
+    out.end_object();
+}
+
+template<typename Writer>
+void addPeers(tr_torrent const* tor, Writer& out)
 {
     auto peer_count = size_t{};
     tr_peer_stat* peers = tr_torrentPeers(tor, &peer_count);
 
-    tr_variantInitList(list, peer_count);
+    out.start_array();
 
     for (size_t i = 0; i < peer_count; ++i)
     {
-        tr_variant* d = tr_variantListAddDict(list, 16);
         tr_peer_stat const* peer = peers + i;
-        tr_variantDictAddStr(d, TR_KEY_address, peer->addr);
-        tr_variantDictAddStr(d, TR_KEY_clientName, peer->client);
-        tr_variantDictAddBool(d, TR_KEY_clientIsChoked, peer->clientIsChoked);
-        tr_variantDictAddBool(d, TR_KEY_clientIsInterested, peer->clientIsInterested);
-        tr_variantDictAddStr(d, TR_KEY_flagStr, peer->flagStr);
-        tr_variantDictAddBool(d, TR_KEY_isDownloadingFrom, peer->isDownloadingFrom);
-        tr_variantDictAddBool(d, TR_KEY_isEncrypted, peer->isEncrypted);
-        tr_variantDictAddBool(d, TR_KEY_isIncoming, peer->isIncoming);
-        tr_variantDictAddBool(d, TR_KEY_isUploadingTo, peer->isUploadingTo);
-        tr_variantDictAddBool(d, TR_KEY_isUTP, peer->isUTP);
-        tr_variantDictAddBool(d, TR_KEY_peerIsChoked, peer->peerIsChoked);
-        tr_variantDictAddBool(d, TR_KEY_peerIsInterested, peer->peerIsInterested);
-        tr_variantDictAddInt(d, TR_KEY_port, peer->port);
-        tr_variantDictAddReal(d, TR_KEY_progress, peer->progress);
-        tr_variantDictAddInt(d, TR_KEY_rateToClient, tr_toSpeedBytes(peer->rateToClient_KBps));
-        tr_variantDictAddInt(d, TR_KEY_rateToPeer, tr_toSpeedBytes(peer->rateToPeer_KBps));
-    }
+        out.start_object();
+        out.add_str(TR_KEY_address, peer->addr);
+        out.add_str(TR_KEY_clientName, peer->client);
+        out.add_bool(TR_KEY_clientIsChoked, peer->clientIsChoked);
+        out.add_bool(TR_KEY_clientIsInterested, peer->clientIsInterested);
+        out.add_str(TR_KEY_flagStr, peer->flagStr);
+        out.add_bool(TR_KEY_isDownloadingFrom, peer->isDownloadingFrom);
+        out.add_bool(TR_KEY_isEncrypted, peer->isEncrypted);
+        out.add_bool(TR_KEY_isIncoming, peer->isIncoming);
+        out.add_bool(TR_KEY_isUploadingTo, peer->isUploadingTo);
+        out.add_bool(TR_KEY_isUTP, peer->isUTP);
+        out.add_bool(TR_KEY_peerIsChoked, peer->peerIsChoked);
+        out.add_bool(TR_KEY_peerIsInterested, peer->peerIsInterested);
+        out.add_int(TR_KEY_port, peer->port);
+        out.add_real(TR_KEY_progress, peer->progress);
+        out.add_int(TR_KEY_rateToClient, tr_toSpeedBytes(peer->rateToClient_KBps));
+        out.add_int(TR_KEY_rateToPeer, tr_toSpeedBytes(peer->rateToPeer_KBps));
+        out.end_object();
+    }
+
+    out.end_array();
 
     tr_torrentPeersFree(peers, peer_count);
 }
@@ -507,207 +645,260 @@ void addPeers(tr_torrent const* tor, tr_variant* list)
     }
 }
 
-void initField(tr_torrent const* const tor, tr_stat const* const st, tr_variant* const initme, tr_quark key)
+// which of the torrent's change versions to check to see if a field has changed
+[[nodiscard]] auto constexpr getTorrentGetFieldGroup(tr_quark key)
+{
+    using ChangeGroup = tr_torrent::ChangeGroup;
+
+    switch (key)
+    {
+    case TR_KEY_addedDate:
+    case TR_KEY_comment:
+    case TR_KEY_creator:
+    case TR_KEY_dateCreated:
+    case TR_KEY_downloadDir:
+    case TR_KEY_editDate:
+    case TR_KEY_file_count:
+    case TR_KEY_hashString:
+    case TR_KEY_isPrivate:
+    case TR_KEY_magnetLink:
+    case TR_KEY_name:
+    case TR_KEY_pieceCount:
+    case TR_KEY_pieceSize:
+    case TR_KEY_primary_mime_type:
+    case TR_KEY_source:
+    case TR_KEY_torrentFile:
+    case TR_KEY_totalSize:
+    case TR_KEY_trackerList:
+    case TR_KEY_trackers:
+    case TR_KEY_webseeds:
+        return ChangeGroup::Edits;
+
+    case TR_KEY_bandwidthPriority:
+    case TR_KEY_downloadLimit:
+    case TR_KEY_downloadLimited:
+    case TR_KEY_group:
+    case TR_KEY_honorsSessionLimits:
+    case TR_KEY_labels:
+    case TR_KEY_maxConnectedPeers:
+    case TR_KEY_peer_limit:
+    case TR_KEY_priorities:
+    case TR_KEY_seedIdleLimit:
+    case TR_KEY_seedIdleMode:
+    case TR_KEY_seedRatioLimit:
+    case TR_KEY_seedRatioMode:
+    case TR_KEY_uploadLimit:
+    case TR_KEY_uploadLimited:
+    case TR_KEY_wanted:
+        return ChangeGroup::Settings;
+
+    default:
+        return ChangeGroup::Activity;
+    }
+}
+
+template<typename Writer>
+void initField(tr_torrent const* const tor, tr_stat const* const st, Writer& out, tr_quark key)
 {
     TR_ASSERT(isSupportedTorrentGetField(key));
 
     switch (key)
     {
     case TR_KEY_activityDate:
-        tr_variantInitInt(initme, st->activityDate);
+        out.add_int(st->activityDate);
         break;
 
     case TR_KEY_addedDate:
-        tr_variantInitInt(initme, st->addedDate);
+        out.add_int(st->addedDate);
         break;
 
     case TR_KEY_availability:
-        tr_variantInitList(initme, tor->piece_count());
+        out.start_array();
         for (tr_piece_index_t piece = 0, n = tor->piece_count(); piece < n; ++piece)
         {
-            tr_variantListAddInt(initme, tr_peerMgrPieceAvailability(tor, piece));
+            out.add_int(tr_peerMgrPieceAvailability(tor, piece));
         }
+        out.end_array();
         break;
 
     case TR_KEY_bandwidthPriority:
-        tr_variantInitInt(initme, tor->get_priority());
+        out.add_int(tor->get_priority());
         break;
 
     case TR_KEY_comment:
-        tr_variantInitStr(initme, tor->comment());
+        out.add_str(tor->comment());
         break;
 
     case TR_KEY_corruptEver:
-        tr_variantInitInt(initme, st->corruptEver);
+        out.add_int(st->corruptEver);
         break;
 
     case TR_KEY_creator:
-        tr_variantInitStrView(initme, tor->creator());
+        out.add_str(tor->creator());
         break;
 
     case TR_KEY_dateCreated:
-        tr_variantInitInt(initme, tor->date_created());
+        out.add_int(tor->date_created());
         break;
 
     case TR_KEY_desiredAvailable:
-        tr_variantInitInt(initme, st->desiredAvailable);
+        out.add_int(st->desiredAvailable);
         break;
 
     case TR_KEY_doneDate:
-        tr_variantInitInt(initme, st->doneDate);
+        out.add_int(st->doneDate);
         break;
 
     case TR_KEY_downloadDir:
-        tr_variantInitStrView(initme, tr_torrentGetDownloadDir(tor));
+        out.add_str(tr_torrentGetDownloadDir(tor));
         break;
 
     case TR_KEY_downloadedEver:
-        tr_variantInitInt(initme, st->downloadedEver);
+        out.add_int(st->downloadedEver);
         break;
 
     case TR_KEY_downloadLimit:
-        tr_variantInitInt(initme, tr_torrentGetSpeedLimit_KBps(tor, TR_DOWN));
+        out.add_int(tr_torrentGetSpeedLimit_KBps(tor, TR_DOWN));
         break;
 
     case TR_KEY_downloadLimited:
-        tr_variantInitBool(initme, tor->uses_speed_limit(TR_DOWN));
+        out.add_bool(tor->uses_speed_limit(TR_DOWN));
         break;
 
     case TR_KEY_error:
-        tr_variantInitInt(initme, st->error);
+        out.add_int(st->error);
         break;
 
     case TR_KEY_errorString:
-        tr_variantInitStrView(initme, st->errorString);
+        out.add_str(st->errorString);
         break;
 
     case TR_KEY_eta:
-        tr_variantInitInt(initme, st->eta);
+        out.add_int(st->eta);
         break;
 
     case TR_KEY_file_count:
-        tr_variantInitInt(initme, tor->file_count());
+        out.add_int(tor->file_count());
         break;
 
     case TR_KEY_files:
-        tr_variantInitList(initme, tor->file_count());
-        addFiles(tor, initme);
+        addFiles(tor, out);
         break;
 
     case TR_KEY_fileStats:
-        tr_variantInitList(initme, tor->file_count());
-        addFileStats(tor, initme);
+        addFileStats(tor, out);
         break;
 
     case TR_KEY_group:
-        tr_variantInitStrView(initme, tor->bandwidth_group().sv());
+        out.add_str(tor->bandwidth_group().sv());
         break;
 
     case TR_KEY_hashString:
-        tr_variantInitStrView(initme, tor->info_hash_string());
+        out.add_str(tor->info_hash_string());
         break;
 
     case TR_KEY_haveUnchecked:
-        tr_variantInitInt(initme, st->haveUnchecked);
+        out.add_int(st->haveUnchecked);
         break;
 
     case TR_KEY_sequentialDownload:
-        tr_variantDictAddBool(initme, TR_KEY_sequentialDownload, tor->is_sequential_download());
+        out.add_bool(tor->is_sequential_download());
         break;
 
     case TR_KEY_haveValid:
-        tr_variantInitInt(initme, st->haveValid);
+        out.add_int(st->haveValid);
         break;
 
     case TR_KEY_honorsSessionLimits:
-        tr_variantInitBool(initme, tor->uses_session_limits());
+        out.add_bool(tor->uses_session_limits());
         break;
 
     case TR_KEY_id:
-        tr_variantInitInt(initme, st->id);
+        out.add_int(st->id);
         break;
 
     case TR_KEY_editDate:
-        tr_variantInitInt(initme, st->editDate);
+        out.add_int(st->editDate);
         break;
 
     case TR_KEY_isFinished:
-        tr_variantInitBool(initme, st->finished);
+        out.add_bool(st->finished);
         break;
 
     case TR_KEY_isPrivate:
-        tr_variantInitBool(initme, tor->is_private());
+        out.add_bool(tor->is_private());
         break;
 
     case TR_KEY_isStalled:
-        tr_variantInitBool(initme, st->isStalled);
+        out.add_bool(st->isStalled);
         break;
 
     case TR_KEY_labels:
-        addLabels(tor, initme);
+        addLabels(tor, out);
         break;
 
     case TR_KEY_leftUntilDone:
-        tr_variantInitInt(initme, st->leftUntilDone);
+        out.add_int(st->leftUntilDone);
         break;
 
     case TR_KEY_manualAnnounceTime:
-        tr_variantInitInt(initme, tr_announcerNextManualAnnounce(tor));
+        out.add_int(tr_announcerNextManualAnnounce(tor));
         break;
 
     case TR_KEY_maxConnectedPeers:
     case TR_KEY_peer_limit:
-        tr_variantInitInt(initme, tor->peer_limit());
+        out.add_int(tor->peer_limit());
         break;
 
     case TR_KEY_magnetLink:
-        tr_variantInitStr(initme, tor->metainfo_.magnet());
+        out.add_str(tor->metainfo_.magnet());
         break;
 
     case TR_KEY_metadataPercentComplete:
-        tr_variantInitReal(initme, st->metadataPercentComplete);
+        out.add_real(st->metadataPercentComplete);
         break;
 
     case TR_KEY_name:
-        tr_variantInitStrView(initme, tr_torrentName(tor));
+        out.add_str(tr_torrentName(tor));
         break;
 
     case TR_KEY_percentComplete:
-        tr_variantInitReal(initme, st->percentComplete);
+        out.add_real(st->percentComplete);
         break;
 
     case TR_KEY_percentDone:
-        tr_variantInitReal(initme, st->percentDone);
+        out.add_real(st->percentDone);
         break;
 
     case TR_KEY_peers:
-        addPeers(tor, initme);
+        addPeers(tor, out);
         break;
 
     case TR_KEY_peersConnected:
-        tr_variantInitInt(initme, st->peersConnected);
+        out.add_int(st->peersConnected);
         break;
 
     case TR_KEY_peersFrom:
         {
-            tr_variantInitDict(initme, 7);
             auto const* f = st->peersFrom;
-            tr_variantDictAddInt(initme, TR_KEY_fromCache, f[TR_PEER_FROM_RESUME]);
-            tr_variantDictAddInt(initme, TR_KEY_fromDht, f[TR_PEER_FROM_DHT]);
-            tr_variantDictAddInt(initme, TR_KEY_fromIncoming, f[TR_PEER_FROM_INCOMING]);
-            tr_variantDictAddInt(initme, TR_KEY_fromLpd, f[TR_PEER_FROM_LPD]);
-            tr_variantDictAddInt(initme, TR_KEY_fromLtep, f[TR_PEER_FROM_LTEP]);
-            tr_variantDictAddInt(initme, TR_KEY_fromPex, f[TR_PEER_FROM_PEX]);
-            tr_variantDictAddInt(initme, TR_KEY_fromTracker, f[TR_PEER_FROM_TRACKER]);
+            out.start_object();
+            out.add_int(TR_KEY_fromCache, f[TR_PEER_FROM_RESUME]);
+            out.add_int(TR_KEY_fromDht, f[TR_PEER_FROM_DHT]);
+            out.add_int(TR_KEY_fromIncoming, f[TR_PEER_FROM_INCOMING]);
+            out.add_int(TR_KEY_fromLpd, f[TR_PEER_FROM_LPD]);
+            out.add_int(TR_KEY_fromLtep, f[TR_PEER_FROM_LTEP]);
+            out.add_int(TR_KEY_fromPex, f[TR_PEER_FROM_PEX]);
+            out.add_int(TR_KEY_fromTracker, f[TR_PEER_FROM_TRACKER]);
+            out.end_object();
             break;
         }
 
     case TR_KEY_peersGettingFromUs:
-        tr_variantInitInt(initme, st->peersGettingFromUs);
+        out.add_int(st->peersGettingFromUs);
         break;
 
     case TR_KEY_peersSendingToUs:
-        tr_variantInitInt(initme, st->peersSendingToUs);
+        out.add_int(st->peersSendingToUs);
         break;
 
     case TR_KEY_pieces:
@@ -715,161 +906,159 @@ void initField(tr_torrent const* const tor, tr_stat const* const st, tr_variant*
         {
             auto const bytes = tor->create_piece_bitfield();
             auto const enc = tr_base64_encode({ reinterpret_cast<char const*>(std::data(bytes)), std::size(bytes) });
-            tr_variantInitStr(initme, enc);
+            out.add_str(enc);
         }
         else
         {
-            tr_variantInitStrView(initme, ""sv);
+            out.add_str(""sv);
         }
 
         break;
 
     case TR_KEY_pieceCount:
-        tr_variantInitInt(initme, tor->piece_count());
+        out.add_int(tor->piece_count());
         break;
 
     case TR_KEY_pieceSize:
-        tr_variantInitInt(initme, tor->piece_size());
+        out.add_int(tor->piece_size());
         break;
 
     case TR_KEY_primary_mime_type:
-        tr_variantInitStrView(initme, tor->primary_mime_type());
+        out.add_str(tor->primary_mime_type());
         break;
 
     case TR_KEY_priorities:
         {
-            auto const n = tor->file_count();
-            tr_variantInitList(initme, n);
-            for (tr_file_index_t i = 0; i < n; ++i)
+            out.start_array();
+            for (tr_file_index_t i = 0, n = tor->file_count(); i < n; ++i)
             {
-                tr_variantListAddInt(initme, tr_torrentFile(tor, i).priority);
+                out.add_int(tr_torrentFile(tor, i).priority);
             }
+            out.end_array();
         }
         break;
 
     case TR_KEY_queuePosition:
-        tr_variantInitInt(initme, st->queuePosition);
+        out.add_int(st->queuePosition);
         break;
 
     case TR_KEY_etaIdle:
-        tr_variantInitInt(initme, st->etaIdle);
+        out.add_int(st->etaIdle);
         break;
 
     case TR_KEY_rateDownload:
-        tr_variantInitInt(initme, tr_toSpeedBytes(st->pieceDownloadSpeed_KBps));
+        out.add_int(tr_toSpeedBytes(st->pieceDownloadSpeed_KBps));
         break;
 
     case TR_KEY_rateUpload:
-        tr_variantInitInt(initme, tr_toSpeedBytes(st->pieceUploadSpeed_KBps));
+        out.add_int(tr_toSpeedBytes(st->pieceUploadSpeed_KBps));
         break;
 
     case TR_KEY_recheckProgress:
-        tr_variantInitReal(initme, st->recheckProgress);
+        out.add_real(st->recheckProgress);
         break;
 
     case TR_KEY_seedIdleLimit:
-        tr_variantInitInt(initme, tor->idle_limit_minutes());
+        out.add_int(tor->idle_limit_minutes());
         break;
 
     case TR_KEY_seedIdleMode:
-        tr_variantInitInt(initme, tor->idle_limit_mode());
+        out.add_int(tor->idle_limit_mode());
         break;
 
     case TR_KEY_seedRatioLimit:
-        tr_variantInitReal(initme, tr_torrentGetRatioLimit(tor));
+        out.add_real(tr_torrentGetRatioLimit(tor));
         break;
 
     case TR_KEY_seedRatioMode:
-        tr_variantInitInt(initme, tr_torrentGetRatioMode(tor));
+        out.add_int(tr_torrentGetRatioMode(tor));
         break;
 
     case TR_KEY_sizeWhenDone:
-        tr_variantInitInt(initme, st->sizeWhenDone);
+        out.add_int(st->sizeWhenDone);
         break;
 
     case TR_KEY_source:
-        tr_variantInitStrView(initme, tor->source());
+        out.add_str(tor->source());
         break;
 
     case TR_KEY_startDate:
-        tr_variantInitInt(initme, st->startDate);
+        out.add_int(st->startDate);
         break;
 
     case TR_KEY_status:
-        tr_variantInitInt(initme, st->activity);
+        out.add_int(st->activity);
         break;
 
     case TR_KEY_secondsDownloading:
-        tr_variantInitInt(initme, st->secondsDownloading);
+        out.add_int(st->secondsDownloading);
         break;
 
     case TR_KEY_secondsSeeding:
-        tr_variantInitInt(initme, st->secondsSeeding);
+        out.add_int(st->secondsSeeding);
         break;
 
     case TR_KEY_trackers:
-        tr_variantInitList(initme, tor->tracker_count());
-        addTrackers(tor, initme);
+        addTrackers(tor, out);
         break;
 
     case TR_KEY_trackerList:
-        tr_variantInitStr(initme, tor->tracker_list());
+        out.add_str(tor->tracker_list());
         break;
 
     case TR_KEY_trackerStats:
         {
-            auto const n = tr_torrentTrackerCount(tor);
-            tr_variantInitList(initme, n);
-            for (size_t i = 0; i < n; ++i)
+            out.start_array();
+            for (size_t i = 0, n = tr_torrentTrackerCount(tor); i < n; ++i)
             {
                 auto const& tracker = tr_torrentTracker(tor, i);
-                addTrackerStats(tracker, initme);
+                addTrackerStats(tracker, out);
             }
+            out.end_array();
             break;
         }
 
     case TR_KEY_torrentFile:
-        tr_variantInitStr(initme, tor->torrent_file());
+        out.add_str(tor->torrent_file());
         break;
 
     case TR_KEY_totalSize:
-        tr_variantInitInt(initme, tor->total_size());
+        out.add_int(tor->total_size());
         break;
 
     case TR_KEY_uploadedEver:
-        tr_variantInitInt(initme, st->uploadedEver);
+        out.add_int(st->uploadedEver);
         break;
 
     case TR_KEY_uploadLimit:
-        tr_variantInitInt(initme, tr_torrentGetSpeedLimit_KBps(tor, TR_UP));
+        out.add_int(tr_torrentGetSpeedLimit_KBps(tor, TR_UP));
         break;
 
     case TR_KEY_uploadLimited:
-        tr_variantInitBool(initme, tor->uses_speed_limit(TR_UP));
+        out.add_bool(tor->uses_speed_limit(TR_UP));
         break;
 
     case TR_KEY_uploadRatio:
-        tr_variantInitReal(initme, st->ratio);
+        out.add_real(st->ratio);
         break;
 
     case TR_KEY_wanted:
         {
-            auto const n = tor->file_count();
-            tr_variantInitList(initme, n);
-            for (tr_file_index_t i = 0; i < n; ++i)
+            out.start_array();
+            for (tr_file_index_t i = 0, n = tor->file_count(); i < n; ++i)
             {
-                tr_variantListAddInt(initme, tr_torrentFile(tor, i).wanted ? 1 : 0);
+                out.add_int(tr_torrentFile(tor, i).wanted ? 1 : 0);
             }
+            out.end_array();
         }
         break;
 
     case TR_KEY_webseeds:
-        tr_variantInitList(initme, tor->webseed_count());
-        addWebseeds(tor, initme);
+        addWebseeds(tor, out);
         break;
 
     case TR_KEY_webseedsSendingToUs:
-        tr_variantInitInt(initme, st->webseedsSendingToUs);
+        out.add_int(st->webseedsSendingToUs);
         break;
 
     default:
@@ -877,15 +1066,16 @@ void initField(tr_torrent const* const tor, tr_stat const* const st, tr_variant*
     }
 }
 
-void addTorrentInfo(tr_torrent* tor, TrFormat format, tr_variant* entry, tr_quark const* fields, size_t field_count)
+template<typename Writer>
+void addTorrentInfo(tr_torrent* tor, TrFormat format, Writer& out, tr_quark const* fields, size_t field_count)
 {
     if (format == TrFormat::Table)
     {
-        tr_variantInitList(entry, field_count);
+        out.start_array();
     }
     else
     {
-        tr_variantInitDict(entry, field_count);
+        out.start_object();
     }
 
     if (field_count > 0)
@@ -894,33 +1084,111 @@ void addTorrentInfo(tr_torrent* tor, TrFormat format, tr_variant* entry, tr_quar
 
         for (size_t i = 0; i < field_count; ++i)
         {
-            tr_variant* child = format == TrFormat::Table ? tr_variantListAdd(entry) : tr_variantDictAdd(entry, fields[i]);
+            if (format == TrFormat::Object)
+            {
+                out.key(fields[i]);
+            }
 
-            initField(tor, st, child, fields[i]);
+            initField(tor, st, out, fields[i]);
         }
     }
+
+    if (format == TrFormat::Table)
+    {
+        out.end_array();
+    }
+    else
+    {
+        out.end_object();
+    }
 }
 
-char const* torrentGet(tr_session* session, tr_variant* args_in, tr_variant* args_out, tr_rpc_idle_data* /*idle_data*/)
+void addTorrentInfo(tr_torrent* tor, TrFormat format, tr_variant* entry, tr_quark const* fields, size_t field_count)
 {
-    auto const torrents = getTorrents(session, args_in);
-    tr_variant* const list = tr_variantDictAddList(args_out, TR_KEY_torrents, std::size(torrents) + 1);
+    auto out = VariantWriter{ entry };
+    addTorrentInfo(tor, format, out, fields, field_count);
+}
+
+// Which of a torrent's field groups have changed since `version`.
+// Transfer rates keep changing for a moment after the last block
+// is transferred, so recently-active torrents' stats are always sent.
+[[nodiscard]] auto getChangedGroups(tr_torrent const* tor, uint64_t version, time_t active_cutoff)
+{
+    using ChangeGroup = tr_torrent::ChangeGroup;
+
+    auto changed = std::array<bool, static_cast<size_t>(ChangeGroup::N_Groups)>{};
+    for (size_t i = 0; i < std::size(changed); ++i)
+    {
+        changed[i] = tor->change_version(static_cast<ChangeGroup>(i)) > version;
+    }
+
+    if (tor->is_running() && tor->activityDate >= active_cutoff)
+    {
+        changed[static_cast<size_t>(ChangeGroup::Activity)] = true;
+    }
+
+    return changed;
+}
+
+template<typename Writer>
+char const* torrentGetImpl(tr_session* session, tr_variant* args_in, Writer& out)
+{
+    auto torrents = getTorrents(session, args_in);
 
     auto sv = std::string_view{};
     auto const format = tr_variantDictFindStrView(args_in, TR_KEY_format, &sv) && sv == "table"sv ? TrFormat::Table :
                                                                                                     TrFormat::Object;
 
-    if (tr_variantDictFindStrView(args_in, TR_KEY_ids, &sv) && sv == "recently-active"sv)
+    // If the client gave us the `version` from its last torrent-get,
+    // only send what has changed since then. Checking the torrents'
+    // change versions is much cheaper than building all their fields.
+    auto since = int64_t{};
+    auto const is_delta = tr_variantDictFindInt(args_in, TR_KEY_since, &since) && since >= 0;
+    auto changed_groups = std::vector<std::array<bool, static_cast<size_t>(tr_torrent::ChangeGroup::N_Groups)>>{};
+    if (is_delta)
+    {
+        // A `since` that we haven't reached yet came from another session,
+        // e.g. before a restart or a change of the clock. Send everything.
+        auto const version = static_cast<uint64_t>(since) <= session->torrents().version() ? static_cast<uint64_t>(since) : 0U;
+        auto const active_cutoff = tr_time() - RecentlyActiveSeconds;
+        out.add_int(TR_KEY_version, static_cast<int64_t>(session->torrents().version()));
+
+        out.key(TR_KEY_removed);
+        out.start_array();
+        for (auto const& id : session->torrents().removedSinceVersion(version))
+        {
+            out.add_int(id);
+        }
+        out.end_array();
+
+        auto changed_torrents = std::vector<tr_torrent*>{};
+        changed_groups.reserve(std::size(torrents));
+        for (auto* tor : torrents)
+        {
+            auto const changed = getChangedGroups(tor, version, active_cutoff);
+            if (std::any_of(std::begin(changed), std::end(changed), [](bool b) { return b; }))
+            {
+                changed_torrents.push_back(tor);
+                changed_groups.push_back(changed);
+            }
+        }
+        torrents = std::move(changed_torrents);
+    }
+    else if (tr_variantDictFindStrView(args_in, TR_KEY_ids, &sv) && sv == "recently-active"sv)
     {
         auto const cutoff = tr_time() - RecentlyActiveSeconds;
-        auto const ids = session->torrents().removedSince(cutoff);
-        auto* const out = tr_variantDictAddList(args_out, TR_KEY_removed, std::size(ids));
-        for (auto const& id : ids)
+        out.key(TR_KEY_removed);
+        out.start_array();
+        for (auto const& id : session->torrents().removedSince(cutoff))
         {
-            tr_variantListAddInt(out, id);
+            out.add_int(id);
         }
+        out.end_array();
     }
 
+    out.key(TR_KEY_torrents);
+    out.start_array();
+
     tr_variant* fields = nullptr;
     char const* errmsg = nullptr;
     if (!tr_variantDictFindList(args_in, TR_KEY_fields, &fields))
@@ -949,22 +1217,57 @@ char const* torrentGet(tr_session* session, tr_variant* args_in, tr_variant* arg
         if (format == TrFormat::Table)
         {
             /* first entry is an array of property names */
-            tr_variant* names = tr_variantListAddList(list, std::size(keys));
+            out.start_array();
             for (auto const& key : keys)
             {
-                tr_variantListAddQuark(names, key);
+                out.add_str(tr_quark_get_string_view(key));
             }
+            out.end_array();
         }
 
-        for (auto* tor : torrents)
+        if (!is_delta || format == TrFormat::Table)
         {
-            addTorrentInfo(tor, format, tr_variantListAdd(list), std::data(keys), std::size(keys));
+            for (auto* tor : torrents)
+            {
+                addTorrentInfo(tor, format, out, std::data(keys), std::size(keys));
+            }
+        }
+        else
+        {
+            // objects can omit fields, so leave out the unchanged ones
+            auto changed_keys = std::vector<tr_quark>{};
+            changed_keys.reserve(std::size(keys) + 1U);
+            for (size_t i = 0, n_torrents = std::size(torrents); i < n_torrents; ++i)
+            {
+                auto const& changed = changed_groups[i];
+                changed_keys.assign({ TR_KEY_id });
+                std::copy_if(
+                    std::begin(keys),
+                    std::end(keys),
+                    std::back_inserter(changed_keys),
+                    [&changed](tr_quark key)
+                    { return key != TR_KEY_id && changed[static_cast<size_t>(getTorrentGetFieldGroup(key))]; });
+                addTorrentInfo(torrents[i], format, out, std::data(changed_keys), std::size(changed_keys));
+            }
         }
     }
 
+    out.end_array();
+
     return errmsg;
 }
 
+char const* torrentGet(tr_session* session, tr_variant* args_in, tr_variant* args_out, tr_rpc_idle_data* /*idle_data*/)
+{
+    auto out = VariantWriter{ args_out };
+    return torrentGetImpl(session, args_in, out);
+}
+
+char const* torrentGetJson(tr_session* session, tr_variant* args_in, libtransmission::JsonWriter& out)
+{
+    return torrentGetImpl(session, args_in, out);
+}
+
 // ---
 
 [[nodiscard]] std::pair<std::vector<tr_quark>, char const* /*errmsg*/> makeLabels(tr_variant* list)
@@ -2070,7 +2373,8 @@ char const* sessionSet(tr_session* session, tr_variant* args_in, tr_variant* /*a
     return nullptr;
 }
 
-char const* sessionStats(tr_session* session, tr_variant* /*args_in*/, tr_variant* args_out, tr_rpc_idle_data* /*idle_data*/)
+template<typename Writer>
+void sessionStatsImpl(tr_session* session, Writer& out)
 {
     auto const& torrents = session->torrents();
     auto const total = std::size(torrents);
@@ -2079,28 +2383,57 @@ char const* sessionStats(tr_session* session, tr_variant* /*args_in*/, tr_varian
         std::end(torrents),
         [](auto const* tor) { return tor->is_running(); });
 
-    tr_variantDictAddInt(args_out, TR_KEY_activeTorrentCount, running);
-    tr_variantDictAddReal(args_out, TR_KEY_downloadSpeed, session->pieceSpeedBps(TR_DOWN));
-    tr_variantDictAddInt(args_out, TR_KEY_pausedTorrentCount, total - running);
-    tr_variantDictAddInt(args_out, TR_KEY_torrentCount, total);
-    tr_variantDictAddReal(args_out, TR_KEY_uploadSpeed, session->pieceSpeedBps(TR_UP));
+    out.add_int(TR_KEY_activeTorrentCount, running);
+    out.add_real(TR_KEY_downloadSpeed, session->pieceSpeedBps(TR_DOWN));
+    out.add_int(TR_KEY_loadingTorrentCount, session->n_torrents_loading());
+    out.add_int(TR_KEY_pausedTorrentCount, total - running);
+    out.add_int(TR_KEY_torrentCount, total);
+    out.add_real(TR_KEY_uploadSpeed, session->pieceSpeedBps(TR_UP));
 
     auto stats = session->stats().cumulative();
-    tr_variant* d = tr_variantDictAddDict(args_out, TR_KEY_cumulative_stats, 5);
-    tr_variantDictAddInt(d, TR_KEY_downloadedBytes, stats.downloadedBytes);
-    tr_variantDictAddInt(d, TR_KEY_filesAdded, stats.filesAdded);
-    tr_variantDictAddInt(d, TR_KEY_secondsActive, stats.secondsActive);
-    tr_variantDictAddInt(d, TR_KEY_sessionCount, stats.sessionCount);
-    tr_variantDictAddInt(d, TR_KEY_uploadedBytes, stats.uploadedBytes);
+    out.key(TR_KEY_cumulative_stats);
+    out.start_object();
+    out.add_int(TR_KEY_downloadedBytes, stats.downloadedBytes);
+    out.add_int(TR_KEY_filesAdded, stats.filesAdded);
+    out.add_int(TR_KEY_secondsActive, stats.secondsActive);
+    out.add_int(TR_KEY_sessionCount, stats.sessionCount);
+    out.add_int(TR_KEY_uploadedBytes, stats.uploadedBytes);
+    out.end_object();
 
     stats = session->stats().current();
-    d = tr_variantDictAddDict(args_out, TR_KEY_current_stats, 5);
-    tr_variantDictAddInt(d, TR_KEY_downloadedBytes, stats.downloadedBytes);
-    tr_variantDictAddInt(d, TR_KEY_filesAdded, stats.filesAdded);
-    tr_variantDictAddInt(d, TR_KEY_secondsActive, stats.secondsActive);
-    tr_variantDictAddInt(d, TR_KEY_sessionCount, stats.sessionCount);
-    tr_variantDictAddInt(d, TR_KEY_uploadedBytes, stats.uploadedBytes);
+    out.key(TR_KEY_current_stats);
+    out.start_object();
+    out.add_int(TR_KEY_downloadedBytes, stats.downloadedBytes);
+    out.add_int(TR_KEY_filesAdded, stats.filesAdded);
+    out.add_int(TR_KEY_secondsActive, stats.secondsActive);
+    out.add_int(TR_KEY_sessionCount, stats.sessionCount);
+    out.add_int(TR_KEY_uploadedBytes, stats.uploadedBytes);
+    out.end_object();
+
+    auto const cache_stats = session->cache->stats();
+    out.key(TR_KEY_cache_stats);
+    out.start_object();
+    out.add_int(TR_KEY_cacheWriteBytes, cache_stats.cache_write_bytes);
+    out.add_int(TR_KEY_cacheWrites, cache_stats.cache_writes);
+    out.add_int(TR_KEY_cachedBlocks, cache_stats.cached_blocks);
+    out.add_int(TR_KEY_diskWriteBytes, cache_stats.disk_write_bytes);
+    out.add_int(TR_KEY_diskWrites, cache_stats.disk_writes);
+    out.add_int(TR_KEY_readCacheBlocks, cache_stats.read_cache_blocks);
+    out.add_int(TR_KEY_readHits, cache_stats.read_hits);
+    out.add_int(TR_KEY_readMisses, cache_stats.read_misses);
+    out.end_object();
+}
 
+char const* sessionStats(tr_session* session, tr_variant* /*args_in*/, tr_variant* args_out, tr_rpc_idle_data* /*idle_data*/)
+{
+    auto out = VariantWriter{ args_out };
+    sessionStatsImpl(session, out);
+    return nullptr;
+}
+
+char const* sessionStatsJson(tr_session* session, tr_variant* /*args_in*/, libtransmission::JsonWriter& out)
+{
+    sessionStatsImpl(session, out);
     return nullptr;
 }
 
@@ -2482,6 +2815,99 @@ void noop_response_callback(tr_session* /*session*/, tr_variant* /*response*/, v
 {
 }
 
+// ---
+
+// Methods with big responses can write them straight to JSON,
+// skipping the tr_variant response that `Methods` would build.
+using json_handler = char const* (*)(tr_session*, tr_variant*, libtransmission::JsonWriter&);
+
+struct rpc_json_method
+{
+    std::string_view name;
+    json_handler func;
+};
+
+auto constexpr JsonMethods = std::array<rpc_json_method, 2>{ {
+    { "session-stats"sv, sessionStatsJson },
+    { "torrent-get"sv, torrentGetJson },
+} };
+
+// A BufferWriter that appends to an evbuffer.
+// Space is reserved from the evbuffer in big chunks so that
+// writing lots of small JSON tokens stays cheap.
+class EvbufferWriter final : public libtransmission::BufferWriter<std::byte>
+{
+public:
+    explicit EvbufferWriter(evbuffer* buf)
+        : buf_{ buf }
+    {
+    }
+
+    EvbufferWriter(EvbufferWriter&&) = delete;
+    EvbufferWriter(EvbufferWriter const&) = delete;
+    EvbufferWriter& operator=(EvbufferWriter&&) = delete;
+    EvbufferWriter& operator=(EvbufferWriter const&) = delete;
+
+    ~EvbufferWriter() override
+    {
+        flush();
+    }
+
+    std::pair<std::byte*, size_t> reserve_space(size_t n_bytes) override
+    {
+        if (iov_.iov_len - n_used_ < n_bytes)
+        {
+            flush();
+            evbuffer_reserve_space(buf_, std::max(n_bytes, ChunkSize), &iov_, 1);
+        }
+
+        return { static_cast<std::byte*>(iov_.iov_base) + n_used_, iov_.iov_len - n_used_ };
+    }
+
+    void commit_space(size_t n_bytes) override
+    {
+        n_used_ += n_bytes;
+    }
+
+    // commit everything written so far to the evbuffer
+    void flush()
+    {
+        if (iov_.iov_base != nullptr)
+        {
+            iov_.iov_len = n_used_;
+            evbuffer_commit_space(buf_, &iov_, 1);
+        }
+
+        iov_ = {};
+        n_used_ = 0U;
+    }
+
+private:
+    static auto constexpr ChunkSize = size_t{ 64U * 1024U };
+
+    evbuffer* const buf_;
+    evbuffer_iovec iov_ = {};
+    size_t n_used_ = 0U;
+};
+
+struct serialize_response_data
+{
+    tr_rpc_serialized_response_func callback;
+    void* callback_user_data;
+};
+
+void serialize_response(tr_session* session, tr_variant* response, void* vdata)
+{
+    auto* const data = static_cast<serialize_response_data*>(vdata);
+
+    auto const json = tr_variantToStr(response, TR_VARIANT_FMT_JSON_LEAN);
+    auto const buf = libtransmission::evhelpers::evbuffer_unique_ptr{ evbuffer_new() };
+    evbuffer_add(buf.get(), std::data(json), std::size(json));
+    (*data->callback)(session, buf.get(), data->callback_user_data);
+
+    delete data;
+}
+
 } // namespace
 
 void tr_rpc_request_exec_json(
@@ -2525,7 +2951,7 @@ void tr_rpc_request_exec_json(
     if (result != nullptr)
     {
         auto response = tr_variant{};
-        tr_variantInitDict(&response, 3);
+        tr_variantInitArenaDict(&response, 3);
         tr_variantDictAddDict(&response, TR_KEY_arguments, 0);
         tr_variantDictAddStr(&response, TR_KEY_result, result);
 
@@ -2541,7 +2967,7 @@ void tr_rpc_request_exec_json(
     else if (method->immediate)
     {
         auto response = tr_variant{};
-        tr_variantInitDict(&response, 3);
+        tr_variantInitArenaDict(&response, 3);
         tr_variant* const args_out = tr_variantDictAddDict(&response, TR_KEY_arguments, 0);
         result = (*method->func)(session, args_in, args_out, nullptr);
 
@@ -2565,7 +2991,7 @@ void tr_rpc_request_exec_json(
     {
         auto* const data = new tr_rpc_idle_data{};
         data->session = session;
-        tr_variantInitDict(&data->response, 3);
+        tr_variantInitArenaDict(&data->response, 3);
 
         if (auto tag = int64_t{}; tr_variantDictFindInt(mutable_request, TR_KEY_tag, &tag))
         {
@@ -2585,6 +3011,58 @@ void tr_rpc_request_exec_json(
     }
 }
 
+void tr_rpc_request_exec_serialized(
+    tr_session* session,
+    tr_variant const* request,
+    tr_rpc_serialized_response_func callback,
+    void* callback_user_data)
+{
+    TR_ASSERT(callback != nullptr);
+
+    auto const lock = session->unique_lock();
+
+    auto* const mutable_request = const_cast<tr_variant*>(request);
+    auto sv = std::string_view{};
+    auto const it = tr_variantDictFindStrView(mutable_request, TR_KEY_method, &sv) ?
+        std::find_if(std::begin(JsonMethods), std::end(JsonMethods), [&sv](auto const& row) { return row.name == sv; }) :
+        std::end(JsonMethods);
+
+    if (it == std::end(JsonMethods))
+    {
+        tr_rpc_request_exec_json(
+            session,
+            request,
+            serialize_response,
+            new serialize_response_data{ callback, callback_user_data });
+        return;
+    }
+
+    auto const buf = libtransmission::evhelpers::evbuffer_unique_ptr{ evbuffer_new() };
+
+    {
+        auto out = EvbufferWriter{ buf.get() };
+        auto writer = libtransmission::JsonWriter{ out };
+        writer.start_object();
+        writer.key(TR_KEY_arguments);
+        writer.start_object();
+        auto const* const result = (*it->func)(session, tr_variantDictFind(mutable_request, TR_KEY_arguments), writer);
+        writer.end_object();
+        writer.key(TR_KEY_result);
+        writer.add_str(result != nullptr ? std::string_view{ result } : SuccessResult);
+
+        if (auto tag = int64_t{}; tr_variantDictFindInt(mutable_request, TR_KEY_tag, &tag))
+        {
+            writer.key(TR_KEY_tag);
+            writer.add_int(tag);
+        }
+
+        writer.end_object();
+        out.push_back('\n');
+    }
+
+    (*callback)(session, buf.get(), callback_user_data);
+}
+
 /**
  * Munge the URI into a usable form.
  *
@@ -7,6 +7,7 @@
 
 #include <string_view>
 
+struct evbuffer;
 struct tr_session;
 struct tr_variant;
 
@@ -19,4 +20,17 @@ void tr_rpc_request_exec_json(
     tr_rpc_response_func callback,
     void* callback_user_data);
 
+using tr_rpc_serialized_response_func = void (*)(tr_session* session, struct evbuffer* response, void* user_data);
+
+/**
+ * Like tr_rpc_request_exec_json(), but the response is given as
+ * lean JSON text. Methods with big responses, e.g. `torrent-get`,
+ * write this straight from the torrents without building a tr_variant.
+ */
+void tr_rpc_request_exec_serialized(
+    tr_session* session,
+    tr_variant const* request,
+    tr_rpc_serialized_response_func callback,
+    void* callback_user_data);
+
 void tr_rpc_parse_list_str(tr_variant* setme, std::string_view str);
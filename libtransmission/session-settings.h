@@ -26,6 +26,7 @@ struct tr_variant;
     V(TR_KEY_cache_size_mb, cache_size_mb, size_t, 4U, "") \
     V(TR_KEY_default_trackers, default_trackers_str, std::string, "", "") \
     V(TR_KEY_dht_enabled, dht_enabled, bool, true, "") \
+    V(TR_KEY_disk_io_threads, disk_io_threads, size_t, 0U, "") \
     V(TR_KEY_download_dir, download_dir, std::string, tr_getDefaultDownloadDir(), "") \
     V(TR_KEY_download_queue_enabled, download_queue_enabled, bool, true, "") \
     V(TR_KEY_download_queue_size, download_queue_size, size_t, 5U, "") \
@@ -34,9 +35,11 @@ struct tr_variant;
     V(TR_KEY_idle_seeding_limit_enabled, idle_seeding_limit_enabled, bool, false, "") \
     V(TR_KEY_incomplete_dir, incomplete_dir, std::string, tr_getDefaultDownloadDir(), "") \
     V(TR_KEY_incomplete_dir_enabled, incomplete_dir_enabled, bool, false, "") \
+    V(TR_KEY_initial_random_pieces, initial_random_pieces, size_t, 4U, "") \
     V(TR_KEY_lpd_enabled, lpd_enabled, bool, true, "") \
     V(TR_KEY_message_level, log_level, tr_log_level, TR_LOG_INFO, "") \
     V(TR_KEY_peer_congestion_algorithm, peer_congestion_algorithm, std::string, "", "") \
+    V(TR_KEY_peer_io_threads, peer_io_threads, size_t, 0U, "") \
     V(TR_KEY_peer_limit_global, peer_limit_global, size_t, TR_DEFAULT_PEER_LIMIT_GLOBAL, "") \
     V(TR_KEY_peer_limit_per_torrent, peer_limit_per_torrent, size_t, TR_DEFAULT_PEER_LIMIT_TORRENT, "") \
     V(TR_KEY_peer_port, peer_port, tr_port, tr_port::fromHost(TR_DEFAULT_PEER_PORT), "The local machine's incoming peer port") \
@@ -52,7 +55,9 @@ struct tr_variant;
     V(TR_KEY_queue_stalled_minutes, queue_stalled_minutes, size_t, 30U, "") \
     V(TR_KEY_ratio_limit, ratio_limit, double, 2.0, "") \
     V(TR_KEY_ratio_limit_enabled, ratio_limit_enabled, bool, false, "") \
+    V(TR_KEY_read_cache_size_mb, read_cache_size_mb, size_t, 0U, "") \
     V(TR_KEY_rename_partial_files, is_incomplete_file_naming_enabled, bool, false, "") \
+    V(TR_KEY_resume_database_enabled, resume_database_enabled, bool, false, "") \
     V(TR_KEY_scrape_paused_torrents_enabled, should_scrape_paused_torrents, bool, true, "") \
     V(TR_KEY_script_torrent_added_enabled, script_torrent_added_enabled, bool, false, "") \
     V(TR_KEY_script_torrent_added_filename, script_torrent_added_filename, std::string, "", "") \
@@ -72,7 +77,9 @@ struct tr_variant;
     V(TR_KEY_umask, umask, tr_mode_t, 022, "") \
     V(TR_KEY_upload_slots_per_torrent, upload_slots_per_torrent, size_t, 8U, "") \
     V(TR_KEY_utp_enabled, utp_enabled, bool, true, "") \
-    V(TR_KEY_torrent_added_verify_mode, torrent_added_verify_mode, tr_verify_added_mode, TR_VERIFY_ADDED_FAST, "")
+    V(TR_KEY_torrent_added_verify_mode, torrent_added_verify_mode, tr_verify_added_mode, TR_VERIFY_ADDED_FAST, "") \
+    V(TR_KEY_verify_read_limit_mb, verify_read_limit_mb, size_t, 0U, "Max MB/s to read when verifying, or 0 for unlimited") \
+    V(TR_KEY_verify_threads, verify_threads, size_t, 1U, "")
 
 struct tr_session_settings
 {
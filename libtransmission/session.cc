@@ -3,7 +3,7 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
-#include <algorithm> // std::partial_sort(), std::min(), std::max()
+#include <algorithm> // std::partial_sort(), std::min(), std::max(), std::remove_if()
 #include <condition_variable>
 #include <csignal>
 #include <cstddef> // size_t
@@ -13,9 +13,11 @@
 #include <iterator> // for std::back_inserter
 #include <limits> // std::numeric_limits
 #include <memory>
+#include <mutex>
 #include <numeric> // for std::accumulate()
 #include <string>
 #include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -36,12 +38,15 @@
 #include "libtransmission/file.h"
 #include "libtransmission/global-ip-cache.h"
 #include "libtransmission/interned-string.h"
+#include "libtransmission/inout.h" // tr_io_pool
 #include "libtransmission/log.h"
 #include "libtransmission/net.h"
+#include "libtransmission/peer-io.h"
 #include "libtransmission/peer-mgr.h"
 #include "libtransmission/peer-socket.h"
 #include "libtransmission/port-forwarding.h"
 #include "libtransmission/quark.h"
+#include "libtransmission/resume-store.h"
 #include "libtransmission/rpc-server.h"
 #include "libtransmission/session.h"
 #include "libtransmission/session-alt-speeds.h"
@@ -698,6 +703,49 @@ void tr_session::setSettings(tr_session_settings&& settings_in, bool force)
         tr_sessionSetCacheLimit_MB(this, val);
     }
 
+    if (auto const& val = new_settings.read_cache_size_mb; force || val != old_settings.read_cache_size_mb)
+    {
+        cache->set_read_cache_limit(tr_toMemBytes(val));
+    }
+
+    if (auto const& val = new_settings.disk_io_threads; force || val != old_settings.disk_io_threads)
+    {
+        cache->set_io_pool(val == 0U ? nullptr : std::make_unique<tr_io_pool>(this, val));
+    }
+
+    // peers' connections can't be moved back out of their threads, so this only happens at startup
+    if (auto const& val = new_settings.peer_io_threads; force && val != 0U)
+    {
+        peer_io_threads_ = std::make_unique<tr_peer_io_threads>(val);
+    }
+
+    if (auto const& val = new_settings.resume_database_enabled; force || val != old_settings.resume_database_enabled)
+    {
+        // Keep using an existing database even when disabled, so that
+        // torrents' resume data can be moved back out of it
+        if (auto const filename = tr_pathbuf{ resume_dir_, "/resume.db"sv };
+            !resume_store_ && (val || tr_sys_path_exists(filename)))
+        {
+            resume_store_ = std::make_unique<tr_resume_store>(filename);
+        }
+
+        // move resume data to wherever the new setting wants it
+        for (auto* const tor : torrents())
+        {
+            tor->set_dirty();
+        }
+    }
+
+    if (auto const& val = new_settings.verify_threads; force || val != old_settings.verify_threads)
+    {
+        verifier_->set_max_threads(val);
+    }
+
+    if (auto const& val = new_settings.verify_read_limit_mb; force || val != old_settings.verify_read_limit_mb)
+    {
+        verifier_->set_bytes_per_second(tr_toMemBytes(val));
+    }
+
     if (auto const& val = new_settings.bind_address_ipv4; force || val != old_settings.bind_address_ipv4)
     {
         global_ip_cache_->update_addr(TR_AF_INET);
@@ -1284,6 +1332,8 @@ void tr_session::closeImplPart1(std::promise<void>* closed_promise, std::chrono:
         tr_torrentFreeInSessionThread(tor);
     }
     torrents.clear();
+    // ...finish saving their resume data
+    resume_writer_->wait();
     // ...now that all the torrents have been closed, any remaining
     // `&event=stopped` announce messages are queued in the announcer.
     // Tell the announcer to start shutdown, which sends out the stop
@@ -1324,6 +1374,7 @@ void tr_session::closeImplPart2(std::promise<void>* closed_promise, std::chrono:
 
     stats().save();
     peer_mgr_.reset();
+    peer_io_threads_.reset();
     openFiles().close_all();
     tr_utpClose(this);
     this->udp_core_.reset();
@@ -1352,43 +1403,219 @@ namespace
 {
 namespace load_torrents_helpers
 {
-void session_load_torrents(tr_session* session, tr_ctor* ctor, std::promise<size_t>* loaded_promise)
+// Reads and parses the .torrent, .magnet, and .resume files on worker threads
+// and hands them back to the session thread, in their original order, to be
+// added. The session thread only runs tr_torrentNew(), a few torrents at a
+// time, so it keeps serving RPC requests while a large torrent dir loads.
+class TorrentLoader : public std::enable_shared_from_this<TorrentLoader>
 {
-    auto n_torrents = size_t{};
-    auto const& folder = session->torrentDir();
+public:
+    TorrentLoader(tr_session* session, tr_ctor* ctor, std::vector<std::string> filenames)
+        : session_{ session }
+        , ctor_{ ctor }
+        , filenames_{ std::move(filenames) }
+        , items_(std::size(filenames_))
+    {
+    }
 
-    for (auto const& name : tr_sys_dir_get_files(folder, [](auto name) { return tr_strv_ends_with(name, ".torrent"sv); }))
+    // Blocks until every file has been added to the session.
+    // Returns the number of torrents that were added.
+    size_t run()
     {
-        auto const path = tr_pathbuf{ folder, '/', name };
+        auto const n_items = std::size(items_);
+        if (n_items == 0U)
+        {
+            return {};
+        }
+
+        auto added_future = added_promise_.get_future();
+        session_->runInSessionThread([session = session_, n_items]() { session->set_n_torrents_loading(n_items); });
+
+        auto const n_threads = std::min(size_t{ std::clamp(std::thread::hardware_concurrency(), 1U, MaxThreads) }, n_items);
+        auto workers = std::vector<std::thread>{};
+        workers.reserve(n_threads);
+        for (size_t i = 0; i < n_threads; ++i)
+        {
+            workers.emplace_back([self = shared_from_this()]() { self->work(); });
+        }
 
-        if (tr_ctorSetMetainfoFromFile(ctor, path.sv(), nullptr) && tr_torrentNew(ctor, nullptr) != nullptr)
+        for (auto& worker : workers)
         {
-            ++n_torrents;
+            worker.join();
         }
+
+        added_future.wait();
+        return added_future.get();
     }
 
-    auto buf = std::vector<char>{};
-    for (auto const& name : tr_sys_dir_get_files(folder, [](auto name) { return tr_strv_ends_with(name, ".magnet"sv); }))
+private:
+    struct Item
     {
-        auto const path = tr_pathbuf{ folder, '/', name };
+        tr_torrent_metainfo metainfo;
+        std::vector<char> contents;
+        tr_variant resume = {};
+        bool is_parsed = false;
+        bool is_ready = false;
+    };
+
+    static auto constexpr MaxThreads = 8U;
+
+    // How far the workers may get ahead of the session thread.
+    // This keeps memory bounded when adding torrents is the bottleneck.
+    static auto constexpr MaxQueued = size_t{ 256U };
+
+    // How many torrents to add per session thread task,
+    // so that other work can run in between
+    static auto constexpr MaxAddsPerTask = size_t{ 16U };
 
-        if (tr_file_read(path, buf) &&
-            tr_ctorSetMetainfoFromMagnetLink(ctor, std::string_view{ std::data(buf), std::size(buf) }, nullptr) &&
-            tr_torrentNew(ctor, nullptr) != nullptr)
+    // --- worker threads
+
+    void work()
+    {
+        auto const n_items = std::size(items_);
+
+        for (;;)
         {
-            ++n_torrents;
+            auto lock = std::unique_lock{ mutex_ };
+            queue_cv_.wait(
+                lock,
+                [this, n_items]() { return next_to_parse_ >= n_items || next_to_parse_ < next_to_add_ + MaxQueued; });
+            if (next_to_parse_ >= n_items)
+            {
+                return;
+            }
+
+            auto const idx = next_to_parse_++;
+            lock.unlock();
+
+            // each item is only touched by one worker until it's ready
+            parse(filenames_[idx], items_[idx]);
+
+            lock.lock();
+            items_[idx].is_ready = true;
+            lock.unlock();
+
+            session_->runInSessionThread([self = shared_from_this()]() { self->add_ready(); });
         }
     }
 
-    if (n_torrents != 0U)
+    void parse(std::string const& name, Item& item) const
     {
-        tr_logAddInfo(fmt::format(
-            tr_ngettext("Loaded {count} torrent", "Loaded {count} torrents", n_torrents),
-            fmt::arg("count", n_torrents)));
+        auto const path = tr_pathbuf{ session_->torrentDir(), '/', name };
+
+        if (tr_strv_ends_with(name, ".magnet"sv))
+        {
+            auto buf = std::vector<char>{};
+            item.is_parsed = tr_file_read(path, buf) &&
+                item.metainfo.parseMagnet(std::string_view{ std::data(buf), std::size(buf) });
+        }
+        else
+        {
+            item.is_parsed = tr_file_read(path, item.contents) &&
+                item.metainfo.parse_benc(std::string_view{ std::data(item.contents), std::size(item.contents) });
+        }
+
+        if (!item.is_parsed)
+        {
+            return;
+        }
+
+        // Parse without TR_VARIANT_PARSE_INPLACE, since `buf` won't outlive this
+        auto constexpr ParseOpts = TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_ARENA;
+        auto const& resume_dir = session_->resumeDir();
+        auto const& metainfo = item.metainfo;
+        if (auto const* const store = session_->resume_store(); store != nullptr)
+        {
+            if (auto buf = std::vector<char>{};
+                store->get(metainfo.info_hash(), buf) && !tr_variantFromBuf(&item.resume, ParseOpts, buf))
+            {
+                tr_variantClear(&item.resume);
+            }
+
+            if (!tr_variantIsEmpty(&item.resume))
+            {
+                return;
+            }
+        }
+
+        tr_torrent_metainfo::migrate_file(resume_dir, metainfo.name(), metainfo.info_hash_string(), ".resume"sv);
+        if (auto const filename = metainfo.resume_file(resume_dir); tr_sys_path_exists(filename))
+        {
+            auto buf = std::vector<char>{};
+            if (!tr_file_read(filename, buf) || !tr_variantFromBuf(&item.resume, ParseOpts, buf))
+            {
+                // tr_resume::load() will try again and log the error
+                tr_variantClear(&item.resume);
+            }
+        }
     }
 
-    loaded_promise->set_value(n_torrents);
-}
+    // --- session thread
+
+    void add_ready()
+    {
+        TR_ASSERT(session_->am_in_session_thread());
+
+        auto const n_items = std::size(items_);
+        auto lock = std::unique_lock{ mutex_ };
+
+        for (size_t n_added = 0U; next_to_add_ < n_items && items_[next_to_add_].is_ready; ++n_added)
+        {
+            if (n_added == MaxAddsPerTask)
+            {
+                session_->runInSessionThread([self = shared_from_this()]() { self->add_ready(); });
+                return;
+            }
+
+            auto const idx = next_to_add_;
+            lock.unlock();
+            add(filenames_[idx], items_[idx]);
+            lock.lock();
+
+            ++next_to_add_;
+            queue_cv_.notify_all();
+            session_->set_n_torrents_loading(n_items - next_to_add_);
+
+            if (next_to_add_ == n_items)
+            {
+                added_promise_.set_value(n_torrents_);
+            }
+        }
+    }
+
+    void add(std::string const& name, Item& item)
+    {
+        if (item.is_parsed)
+        {
+            auto const is_magnet = tr_strv_ends_with(name, ".magnet"sv);
+            auto const path = tr_pathbuf{ session_->torrentDir(), '/', name };
+            tr_ctorSetMetainfo(ctor_, std::move(item.metainfo), std::move(item.contents), is_magnet ? ""sv : path.sv());
+            tr_ctorSetResume(ctor_, &item.resume);
+
+            if (tr_torrentNew(ctor_, nullptr) != nullptr)
+            {
+                ++n_torrents_;
+            }
+        }
+
+        tr_variantClear(&item.resume);
+        item = {};
+    }
+
+    tr_session* const session_;
+    tr_ctor* const ctor_;
+    std::vector<std::string> const filenames_;
+    std::vector<Item> items_;
+
+    std::mutex mutex_;
+    std::condition_variable queue_cv_;
+    size_t next_to_parse_ = 0U;
+    size_t next_to_add_ = 0U;
+
+    // only touched by the session thread
+    size_t n_torrents_ = 0U;
+    std::promise<size_t> added_promise_;
+};
 } // namespace load_torrents_helpers
 } // namespace
 
@@ -1396,12 +1623,21 @@ size_t tr_sessionLoadTorrents(tr_session* session, tr_ctor* ctor)
 {
     using namespace load_torrents_helpers;
 
-    auto loaded_promise = std::promise<size_t>{};
-    auto loaded_future = loaded_promise.get_future();
+    TR_ASSERT(!session->am_in_session_thread());
+
+    auto const& folder = session->torrentDir();
+    auto filenames = tr_sys_dir_get_files(folder, [](auto name) { return tr_strv_ends_with(name, ".torrent"sv); });
+    auto magnets = tr_sys_dir_get_files(folder, [](auto name) { return tr_strv_ends_with(name, ".magnet"sv); });
+    std::move(std::begin(magnets), std::end(magnets), std::back_inserter(filenames));
 
-    session->runInSessionThread(session_load_torrents, session, ctor, &loaded_promise);
-    loaded_future.wait();
-    auto const n_torrents = loaded_future.get();
+    auto const n_torrents = std::make_shared<TorrentLoader>(session, ctor, std::move(filenames))->run();
+
+    if (n_torrents != 0U)
+    {
+        tr_logAddInfo(fmt::format(
+            tr_ngettext("Loaded {count} torrent", "Loaded {count} torrents", n_torrents),
+            fmt::arg("count", n_torrents)));
+    }
 
     return n_torrents;
 }
@@ -1604,19 +1840,24 @@ void tr_session::useBlocklist(bool enabled)
         std::begin(blocklists_),
         std::end(blocklists_),
         [enabled](auto& blocklist) { blocklist.setEnabled(enabled); });
+
+    merged_blocklist_ = libtransmission::Blocklist::merge(blocklists_);
 }
 
 bool tr_session::addressIsBlocked(tr_address const& addr) const noexcept
 {
-    return std::any_of(
-        std::begin(blocklists_),
-        std::end(blocklists_),
-        [&addr](auto& blocklist) { return blocklist.contains(addr); });
+    return merged_blocklist_.contains(addr);
 }
 
 void tr_sessionReloadBlocklists(tr_session* session)
 {
+    // Unmap the old .bin files first, since loading may replace them.
+    // Windows won't rename a file over one that is still mapped.
+    session->merged_blocklist_ = {};
+    session->blocklists_.clear();
+
     session->blocklists_ = libtransmission::Blocklist::loadBlocklists(session->blocklist_dir_, session->useBlocklist());
+    session->merged_blocklist_ = libtransmission::Blocklist::merge(session->blocklists_);
 
     session->blocklist_changed_.emit();
 }
@@ -1658,29 +1899,34 @@ size_t tr_blocklistSetContent(tr_session* session, char const* content_filename)
     // Build the path of the default blocklist .bin file where we'll save these rules.
     auto const bin_file = tr_pathbuf{ session->blocklist_dir_, '/', DEFAULT_BLOCKLIST_FILENAME };
 
+    // Unmap the old .bin file before saving over it.
+    // Windows won't rename a file over one that is still mapped.
+    auto& src = session->blocklists_;
+    auto const old_end = std::remove_if(
+        std::begin(src),
+        std::end(src),
+        [&bin_file](auto const& candidate) { return bin_file == candidate.binFile(); });
+    auto const had_old = old_end != std::end(src);
+    src.erase(old_end, std::end(src));
+    session->merged_blocklist_ = libtransmission::Blocklist::merge(src);
+
     // Try to save it
     auto added = libtransmission::Blocklist::saveNew(content_filename, bin_file, session->useBlocklist());
     if (!added)
     {
+        // the old .bin file wasn't touched, so keep using it
+        if (had_old)
+        {
+            src.emplace_back(bin_file, session->useBlocklist());
+            session->merged_blocklist_ = libtransmission::Blocklist::merge(src);
+        }
+
         return 0U;
     }
 
     auto const n_rules = std::size(*added);
-
-    // Add (or replace) it in our blocklists_ vector
-    auto& src = session->blocklists_;
-    if (auto iter = std::find_if(
-            std::begin(src),
-            std::end(src),
-            [&bin_file](auto const& candidate) { return bin_file == candidate.binFile(); });
-        iter != std::end(src))
-    {
-        *iter = std::move(*added);
-    }
-    else
-    {
-        src.emplace_back(std::move(*added));
-    }
+    src.emplace_back(std::move(*added));
+    session->merged_blocklist_ = libtransmission::Blocklist::merge(src);
 
     return n_rules;
 }
@@ -2042,12 +2288,14 @@ void tr_session::closeTorrentFiles(tr_torrent* tor) noexcept
 {
     this->cache->flush_torrent(tor);
     openFiles().close_torrent(tor->id());
+    tor->files_closed_.emit(tor);
 }
 
 void tr_session::closeTorrentFile(tr_torrent* tor, tr_file_index_t file_num) noexcept
 {
     this->cache->flush_file(tor, file_num);
     openFiles().close_file(tor->id(), file_num);
+    tor->files_closed_.emit(tor);
 }
 
 // ---
@@ -2142,17 +2390,40 @@ tr_session::tr_session(std::string_view config_dir, tr_variant* settings_dict)
     now_timer_ = timerMaker().create([this]() { onNowTimer(); });
     now_timer_->start_repeating(1s);
 
+    resume_writer_ = std::make_unique<tr_resume_writer>(
+        [this](tr_sha1_digest_t const& info_hash, tr_error const& error)
+        {
+            runInSessionThread(
+                [this, info_hash, message = std::string{ error.message }]()
+                {
+                    if (auto* const tor = torrents().get(info_hash); tor != nullptr)
+                    {
+                        tor->set_local_error(fmt::format("Unable to save resume file: {:s}", message));
+                    }
+                });
+        });
+
     // Periodically save the .resume files of any torrents whose
     // status has recently changed. This prevents loss of metadata
     // in the case of a crash, unclean shutdown, clumsy user, etc.
+    // This only snapshots the torrents; resume_writer_ does the writing.
     save_timer_ = timerMaker().create(
         [this]()
         {
+            auto const begin = std::chrono::steady_clock::now();
+            auto n_saved = size_t{};
             for (auto* const tor : torrents())
             {
+                n_saved += tor->is_dirty() ? 1U : 0U;
                 tr_torrentSave(tor);
             }
 
+            auto const elapsed = std::chrono::steady_clock::now() - begin;
+            tr_logAddDebug(fmt::format(
+                "Queued resume data for {} torrents in {} us",
+                n_saved,
+                std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+
             stats().save();
         });
     save_timer_->start_repeating(SaveIntervalSecs);
@@ -2169,5 +2440,10 @@ void tr_session::addTorrent(tr_torrent* tor)
 {
     tor->unique_id_ = torrents().add(tor);
 
+    // a new torrent is news to every RPC client
+    tor->bump_change_version(tr_torrent::ChangeGroup::Activity);
+    tor->bump_change_version(tr_torrent::ChangeGroup::Settings);
+    tor->bump_change_version(tr_torrent::ChangeGroup::Edits);
+
     tr_peerMgrAddTorrent(peer_mgr_.get(), tor);
 }
@@ -50,6 +50,8 @@
 #include "libtransmission/open-files.h"
 #include "libtransmission/port-forwarding.h"
 #include "libtransmission/quark.h"
+#include "libtransmission/resume-store.h"
+#include "libtransmission/resume-writer.h"
 #include "libtransmission/session-alt-speeds.h"
 #include "libtransmission/session-id.h"
 #include "libtransmission/session-settings.h"
@@ -60,12 +62,14 @@
 #include "libtransmission/tr-dht.h"
 #include "libtransmission/tr-lpd.h"
 #include "libtransmission/tr-macros.h"
+#include "libtransmission/tr-udp-batch.h"
 #include "libtransmission/utils-ev.h"
 #include "libtransmission/verify.h"
 #include "libtransmission/web.h"
 
 tr_peer_id_t tr_peerIdInit();
 
+class tr_peer_io_threads;
 class tr_peer_socket;
 struct tr_pex;
 class tr_rpc_server;
@@ -325,7 +329,12 @@ private:
         tr_udp_core(tr_session& session, tr_port udp_port);
         ~tr_udp_core();
 
-        void sendto(void const* buf, size_t buflen, struct sockaddr const* to, socklen_t tolen) const;
+        // Queue a datagram to be sent. The queue is flushed once per
+        // event loop iteration, or sooner if it fills up.
+        void sendto(void const* buf, size_t buflen, struct sockaddr const* to, socklen_t tolen);
+
+        // send the datagrams that were queued by `sendto()`
+        void flush();
 
         [[nodiscard]] constexpr auto socket4() const noexcept
         {
@@ -338,12 +347,17 @@ private:
         }
 
     private:
+        static void on_readable(evutil_socket_t sock, short type, void* vself);
+
         tr_port const udp_port_;
         tr_session& session_;
         tr_socket_t udp4_socket_ = TR_BAD_SOCKET;
         tr_socket_t udp6_socket_ = TR_BAD_SOCKET;
         libtransmission::evhelpers::event_unique_ptr udp4_event_;
         libtransmission::evhelpers::event_unique_ptr udp6_event_;
+        libtransmission::evhelpers::event_unique_ptr flush_event_;
+        tr_udp_send_queue outbox_;
+        tr_udp_recv_batch inbox_;
     };
 
 public:
@@ -390,6 +404,17 @@ public:
         return torrents_;
     }
 
+    // how many torrents tr_sessionLoadTorrents() has found but not yet added
+    [[nodiscard]] constexpr auto n_torrents_loading() const noexcept
+    {
+        return n_torrents_loading_;
+    }
+
+    constexpr void set_n_torrents_loading(size_t n_torrents) noexcept
+    {
+        n_torrents_loading_ = n_torrents;
+    }
+
     [[nodiscard]] auto unique_lock() const
     {
         return std::unique_lock(session_mutex_);
@@ -412,6 +437,32 @@ public:
         return resume_dir_;
     }
 
+    // The single-file resume database, or nullptr if it's not in use.
+    // This is non-null if `resume-database-enabled` is set, or if it was
+    // set in the past and the database still holds some torrents' data.
+    [[nodiscard]] auto* resume_store() const noexcept
+    {
+        return resume_store_.get();
+    }
+
+    [[nodiscard]] constexpr auto resume_database_enabled() const noexcept
+    {
+        return settings_.resume_database_enabled;
+    }
+
+    [[nodiscard]] auto& resume_writer() noexcept
+    {
+        return *resume_writer_;
+    }
+
+    // The event loops that peers' TCP connections are moved to after their
+    // handshake, or nullptr if `peer-io-threads` is 0 and peer I/O is done
+    // in the session thread.
+    [[nodiscard]] auto* peer_io_threads() const noexcept
+    {
+        return peer_io_threads_.get();
+    }
+
     [[nodiscard]] constexpr auto const& downloadDir() const noexcept
     {
         return settings_.download_dir;
@@ -721,6 +772,11 @@ public:
         return settings_.upload_slots_per_torrent;
     }
 
+    [[nodiscard]] constexpr auto initialRandomPieces() const noexcept
+    {
+        return settings_.initial_random_pieces;
+    }
+
     [[nodiscard]] constexpr auto isClosing() const noexcept
     {
         return is_closing_;
@@ -1118,6 +1174,9 @@ private:
 
     std::vector<libtransmission::Blocklist> blocklists_;
 
+    // the rules of all the enabled `blocklists_`, merged into one lookup table
+    libtransmission::Blocklist merged_blocklist_;
+
 public:
     libtransmission::SimpleObservable<> blocklist_changed_;
 
@@ -1158,6 +1217,8 @@ private:
     // depends-on: open_files_
     tr_torrents torrents_;
 
+    size_t n_torrents_loading_ = 0U;
+
     // depends-on: settings_, session_thread_, timer_maker_, web_
     GlobalIPCacheMediator global_ip_cache_mediator_{ *this };
     std::unique_ptr<tr_global_ip_cache> global_ip_cache_ = tr_global_ip_cache::create(global_ip_cache_mediator_);
@@ -1171,7 +1232,9 @@ public:
     std::unique_ptr<Cache> cache = std::make_unique<Cache>(torrents_, 1024 * 1024 * 2);
 
 private:
-    // depends-on: timer_maker_, top_bandwidth_, utp_context, torrents_, web_, blocklist_changed_
+    std::unique_ptr<tr_peer_io_threads> peer_io_threads_;
+
+    // depends-on: timer_maker_, top_bandwidth_, utp_context, torrents_, web_, blocklist_changed_, peer_io_threads_
     std::unique_ptr<struct tr_peerMgr, void (*)(struct tr_peerMgr*)> peer_mgr_;
 
     // depends-on: peer_mgr_, advertised_peer_port_, torrents_
@@ -1203,7 +1266,12 @@ private:
     // depends-on: alt_speeds_, udp_core_, torrents_
     std::unique_ptr<libtransmission::Timer> now_timer_;
 
-    // depends-on: torrents_
+    std::unique_ptr<tr_resume_store> resume_store_;
+
+    // depends-on: resume_store_
+    std::unique_ptr<tr_resume_writer> resume_writer_;
+
+    // depends-on: torrents_, resume_writer_
     std::unique_ptr<libtransmission::Timer> save_timer_;
 
     std::unique_ptr<tr_verify_worker> verifier_ = std::make_unique<tr_verify_worker>();
@@ -21,6 +21,7 @@
 #include "libtransmission/torrent.h"
 #include "libtransmission/tr-assert.h"
 #include "libtransmission/utils.h"
+#include "libtransmission/variant.h"
 
 using namespace std::literals;
 
@@ -60,10 +61,23 @@ struct tr_ctor
 
     std::vector<char> contents;
 
+    // an already-parsed .resume file, or empty to read it from disk
+    tr_variant resume = {};
+
     explicit tr_ctor(tr_session const* session_in)
         : session{ session_in }
     {
     }
+
+    tr_ctor(tr_ctor const&) = delete;
+    tr_ctor& operator=(tr_ctor const&) = delete;
+    tr_ctor(tr_ctor&&) = delete;
+    tr_ctor& operator=(tr_ctor&&) = delete;
+
+    ~tr_ctor()
+    {
+        tr_variantClear(&resume);
+    }
 };
 
 // ---
@@ -99,6 +113,13 @@ bool tr_ctorSetMetainfo(tr_ctor* ctor, char const* metainfo, size_t len, tr_erro
     return ctor->metainfo.parse_benc(contents_sv, error);
 }
 
+void tr_ctorSetMetainfo(tr_ctor* ctor, tr_torrent_metainfo&& metainfo, std::vector<char>&& contents, std::string_view filename)
+{
+    ctor->torrent_filename = filename;
+    ctor->contents = std::move(contents);
+    ctor->metainfo = std::move(metainfo);
+}
+
 bool tr_ctorSetMetainfoFromMagnetLink(tr_ctor* ctor, std::string_view magnet_link, tr_error** error)
 {
     ctor->torrent_filename.clear();
@@ -294,6 +315,19 @@ tr_torrent_metainfo tr_ctorStealMetainfo(tr_ctor* ctor)
     return metainfo;
 }
 
+void tr_ctorSetResume(tr_ctor* ctor, tr_variant* resume)
+{
+    tr_variantClear(&ctor->resume);
+    std::swap(ctor->resume, *resume);
+}
+
+tr_variant tr_ctorStealResume(tr_ctor* ctor)
+{
+    auto resume = tr_variant{};
+    std::swap(ctor->resume, resume);
+    return resume;
+}
+
 tr_torrent_metainfo const* tr_ctorGetMetainfo(tr_ctor const* ctor)
 {
     return !std::empty(ctor->metainfo.info_hash_string()) ? &ctor->metainfo : nullptr;
@@ -164,6 +164,7 @@ void tr_torrentClearError(tr_torrent* tor)
     tor->error = TR_STAT_OK;
     tor->error_announce_url.clear();
     tor->error_string.clear();
+    tor->bump_change_version(tr_torrent::ChangeGroup::Activity);
 }
 
 /* returns true if the seed ratio applies --
@@ -239,7 +240,7 @@ void tr_torrentUseSessionLimits(tr_torrent* tor, bool enabled)
 
     if (tor->bandwidth_.honor_parent_limits(TR_UP, enabled) || tor->bandwidth_.honor_parent_limits(TR_DOWN, enabled))
     {
-        tor->set_dirty();
+        tor->mark_settings_changed();
     }
 }
 
@@ -275,7 +276,7 @@ void tr_torrentSetRatioLimit(tr_torrent* tor, double desired_ratio)
     {
         tor->desiredRatio = desired_ratio;
 
-        tor->set_dirty();
+        tor->mark_settings_changed();
     }
 }
 
@@ -333,7 +334,7 @@ void tr_torrentSetIdleMode(tr_torrent* tor, tr_idlelimit mode)
     {
         tor->idle_limit_mode_ = mode;
 
-        tor->set_dirty();
+        tor->mark_settings_changed();
     }
 }
 
@@ -928,6 +929,9 @@ void tr_torrentFreeInSessionThread(tr_torrent* tor)
         tr_torrent_metainfo::remove_file(tor->session->torrentDir(), tor->name(), tor->info_hash_string(), ".torrent"sv);
         tr_torrent_metainfo::remove_file(tor->session->torrentDir(), tor->name(), tor->info_hash_string(), ".magnet"sv);
         tr_torrent_metainfo::remove_file(tor->session->resumeDir(), tor->name(), tor->info_hash_string(), ".resume"sv);
+
+        // this also discards any pending save, so the resume data isn't written back
+        tor->session->resume_writer().remove(tor->info_hash(), tor->resume_file(), tor->session->resume_store());
     }
 
     freeTorrent(tor);
@@ -1018,7 +1022,7 @@ void on_metainfo_completed(tr_torrent* tor)
     }
 }
 
-void torrentInit(tr_torrent* tor, tr_ctor const* ctor)
+void torrentInit(tr_torrent* tor, tr_ctor const* ctor, tr_variant* resume)
 {
     tr_session* session = tr_ctorGetSession(ctor);
     TR_ASSERT(session != nullptr);
@@ -1070,9 +1074,17 @@ void torrentInit(tr_torrent* tor, tr_ctor const* ctor)
         // the same ones that would be saved back again, so don't let them
         // affect the 'is dirty' flag.
         auto const was_dirty = tor->is_dirty_;
-        loaded = tr_resume::load(tor, tr_resume::All, ctor);
+        loaded = tr_resume::load(tor, tr_resume::All, ctor, resume);
         tor->is_dirty_ = was_dirty;
         tr_torrent_metainfo::migrate_file(session->torrentDir(), tor->name(), tor->info_hash_string(), ".torrent"sv);
+
+        // If the resume data is in a .resume file but should be in the
+        // resume database, or vice versa, move it on the next save.
+        if (auto const* const store = session->resume_store();
+            store != nullptr && store->contains(tor->info_hash()) != session->resume_database_enabled())
+        {
+            tor->is_dirty_ = true;
+        }
     }
 
     tor->completeness = tor->completion.status();
@@ -1190,10 +1202,14 @@ tr_torrent* tr_torrentNew(tr_ctor* ctor, tr_torrent** setme_duplicate_of)
     auto* const session = tr_ctorGetSession(ctor);
     TR_ASSERT(session != nullptr);
 
-    // is the metainfo valid?
+    // take these now so that they can't leak into the next torrent that uses this ctor
     auto metainfo = tr_ctorStealMetainfo(ctor);
+    auto resume = tr_ctorStealResume(ctor);
+
+    // is the metainfo valid?
     if (std::empty(metainfo.info_hash_string()))
     {
+        tr_variantClear(&resume);
         return nullptr;
     }
 
@@ -1205,11 +1221,13 @@ tr_torrent* tr_torrentNew(tr_ctor* ctor, tr_torrent** setme_duplicate_of)
             *setme_duplicate_of = duplicate_of;
         }
 
+        tr_variantClear(&resume);
         return nullptr;
     }
 
     auto* const tor = new tr_torrent{ std::move(metainfo) };
-    torrentInit(tor, ctor);
+    torrentInit(tor, ctor, &resume);
+    tr_variantClear(&resume);
     return tor;
 }
 
@@ -1954,7 +1972,7 @@ void tr_torrent::setLabels(std::vector<tr_quark> const& new_labels)
         }
     }
     this->labels.shrink_to_fit();
-    this->set_dirty();
+    this->mark_settings_changed();
 }
 
 // ---
@@ -1976,7 +1994,7 @@ void tr_torrent::set_bandwidth_group(std::string_view group_name) noexcept
         this->bandwidth_.set_parent(&this->session->getBandwidthGroup(group_name));
     }
 
-    this->set_dirty();
+    this->mark_settings_changed();
 }
 
 // ---
@@ -1997,7 +2015,7 @@ void tr_torrentSetPriority(tr_torrent* tor, tr_priority_t priority)
     {
         tor->bandwidth_.set_priority(priority);
 
-        tor->set_dirty();
+        tor->mark_settings_changed();
     }
 }
 
@@ -2011,7 +2029,7 @@ void tr_torrentSetPeerLimit(tr_torrent* tor, uint16_t max_connected_peers)
     {
         tor->max_connected_peers_ = max_connected_peers;
 
-        tor->set_dirty();
+        tor->mark_settings_changed();
     }
 }
 
@@ -2171,12 +2189,14 @@ void tr_torrent::on_tracker_response(tr_tracker_event const* event)
         error = TR_STAT_TRACKER_WARNING;
         error_announce_url = event->announce_url;
         error_string = event->text;
+        bump_change_version(ChangeGroup::Activity);
         break;
 
     case tr_tracker_event::Type::Error:
         error = TR_STAT_TRACKER_ERROR;
         error_announce_url = event->announce_url;
         error_string = event->text;
+        bump_change_version(ChangeGroup::Activity);
         break;
 
     case tr_tracker_event::Type::ErrorClear:
@@ -2329,8 +2349,10 @@ void onPieceFailed(tr_torrent* tor, tr_piece_index_t piece)
     auto const n = tor->piece_size(piece);
     tor->corruptCur += n;
     tor->downloadedCur -= std::min(tor->downloadedCur, uint64_t{ n });
-    tor->got_bad_piece_.emit(tor, piece);
+
+    // clear the piece first so that observers see its blocks as missing again
     tor->set_has_piece(piece, false);
+    tor->got_bad_piece_.emit(tor, piece);
 }
 } // namespace got_block_helpers
 } // namespace
@@ -2681,11 +2703,13 @@ bool tr_torrentHasMetadata(tr_torrent const* tor)
 void tr_torrent::mark_edited()
 {
     this->editDate = tr_time();
+    bump_change_version(ChangeGroup::Edits);
 }
 
 void tr_torrent::mark_changed()
 {
     this->anyDate = tr_time();
+    bump_change_version(ChangeGroup::Activity);
 }
 
 void tr_torrent::set_blocks(tr_bitfield blocks)
@@ -9,7 +9,9 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <array>
 #include <cstddef> // size_t
+#include <cstdint> // uint8_t, uint64_t
 #include <ctime>
 #include <optional>
 #include <string>
@@ -32,6 +34,7 @@
 #include "session.h"
 #include "torrent-metainfo.h"
 #include "tr-macros.h"
+#include "variant.h"
 
 class tr_swarm;
 struct tr_error;
@@ -134,7 +137,7 @@ public:
     {
         if (bandwidth().set_desired_speed_bytes_per_second(dir, bytes_per_second))
         {
-            set_dirty();
+            mark_settings_changed();
         }
     }
 
@@ -142,7 +145,7 @@ public:
     {
         if (bandwidth().set_limited(dir, do_use))
         {
-            set_dirty();
+            mark_settings_changed();
         }
     }
 
@@ -349,13 +352,17 @@ public:
     void set_file_priorities(tr_file_index_t const* files, tr_file_index_t file_count, tr_priority_t priority)
     {
         file_priorities_.set(files, file_count, priority);
-        set_dirty();
+        priority_changed_.emit(this);
+        mark_settings_changed();
+        bump_change_version(ChangeGroup::Activity); // for `fileStats`
     }
 
     void set_file_priority(tr_file_index_t file, tr_priority_t priority)
     {
         file_priorities_.set(file, priority);
-        set_dirty();
+        priority_changed_.emit(this);
+        mark_settings_changed();
+        bump_change_version(ChangeGroup::Activity); // for `fileStats`
     }
 
     /// LOCATION
@@ -581,6 +588,7 @@ public:
         this->error = TR_STAT_LOCAL_ERROR;
         this->error_announce_url = TR_KEY_NONE;
         this->error_string = errmsg;
+        bump_change_version(ChangeGroup::Activity);
     }
 
     void set_download_dir(std::string_view path, bool is_new_torrent = false);
@@ -617,6 +625,7 @@ public:
     constexpr void set_date_active(time_t t) noexcept
     {
         this->activityDate = t;
+        bump_change_version(ChangeGroup::Activity);
 
         if (this->anyDate < t)
         {
@@ -665,9 +674,13 @@ public:
         torrent's content than any other mime-type. */
     [[nodiscard]] std::string_view primary_mime_type() const;
 
-    constexpr void set_sequential_download(bool is_sequential) noexcept
+    void set_sequential_download(bool is_sequential)
     {
-        sequential_download_ = is_sequential;
+        if (sequential_download_ != is_sequential)
+        {
+            sequential_download_ = is_sequential;
+            sequential_download_changed_.emit(this);
+        }
     }
 
     [[nodiscard]] constexpr auto is_sequential_download() const noexcept
@@ -698,6 +711,46 @@ public:
     void mark_edited();
     void mark_changed();
 
+    // Marks the torrent's user-editable settings as changed,
+    // so that they get saved and RPC clients see the change.
+    constexpr void mark_settings_changed() noexcept
+    {
+        set_dirty();
+        bump_change_version(ChangeGroup::Settings);
+    }
+
+    /// CHANGE VERSIONS
+
+    // The torrent's properties, grouped by how often they change.
+    // Each group remembers the tr_torrents::version() of its last change,
+    // so RPC clients can ask for only what changed since they last looked.
+    enum class ChangeGroup : uint8_t
+    {
+        // stats, e.g. transfer rates, peers, progress, tracker status
+        Activity,
+
+        // user-editable settings, e.g. speed limits, priorities, labels
+        Settings,
+
+        // metainfo and location, e.g. name, files, trackers, download dir
+        Edits,
+
+        N_Groups
+    };
+
+    [[nodiscard]] constexpr auto change_version(ChangeGroup group) const noexcept
+    {
+        return change_versions_[static_cast<size_t>(group)];
+    }
+
+    constexpr void bump_change_version(ChangeGroup group) noexcept
+    {
+        if (session != nullptr)
+        {
+            change_versions_[static_cast<size_t>(group)] = session->torrents().next_version();
+        }
+    }
+
     void set_bandwidth_group(std::string_view group_name) noexcept;
 
     [[nodiscard]] constexpr auto get_priority() const noexcept
@@ -730,7 +783,7 @@ public:
         if (ratioLimitMode != mode)
         {
             ratioLimitMode = mode;
-            set_dirty();
+            mark_settings_changed();
         }
     }
 
@@ -739,7 +792,7 @@ public:
         if ((idle_limit_minutes_ != idle_minutes) && (idle_minutes > 0))
         {
             idle_limit_minutes_ = idle_minutes;
-            set_dirty();
+            mark_settings_changed();
         }
     }
 
@@ -825,7 +878,11 @@ public:
     libtransmission::SimpleObservable<tr_torrent*, tr_piece_index_t> got_bad_piece_;
     libtransmission::SimpleObservable<tr_torrent*, tr_piece_index_t> piece_completed_;
     libtransmission::SimpleObservable<tr_torrent*> doomed_;
+    libtransmission::SimpleObservable<tr_torrent*> files_closed_;
+    libtransmission::SimpleObservable<tr_torrent*> files_wanted_changed_;
     libtransmission::SimpleObservable<tr_torrent*> got_metainfo_;
+    libtransmission::SimpleObservable<tr_torrent*> priority_changed_;
+    libtransmission::SimpleObservable<tr_torrent*> sequential_download_changed_;
     libtransmission::SimpleObservable<tr_torrent*> started_;
     libtransmission::SimpleObservable<tr_torrent*> stopped_;
     libtransmission::SimpleObservable<tr_torrent*> swarm_is_all_seeds_;
@@ -876,6 +933,8 @@ public:
 
     time_t lastStatTime = 0;
 
+    std::array<uint64_t, static_cast<size_t>(ChangeGroup::N_Groups)> change_versions_ = {};
+
     time_t seconds_downloading_before_current_start_ = 0;
     time_t seconds_seeding_before_current_start_ = 0;
 
@@ -957,10 +1016,12 @@ private:
 
         files_wanted_.set(files, n_files, wanted);
         completion.invalidate_size_when_done();
+        files_wanted_changed_.emit(this);
 
         if (!is_bootstrapping)
         {
-            set_dirty();
+            mark_settings_changed();
+            bump_change_version(ChangeGroup::Activity);
             recheck_completeness();
         }
     }
@@ -1002,11 +1063,18 @@ void tr_torrentGotBlock(tr_torrent* tor, tr_block_index_t block);
 tr_torrent_metainfo tr_ctorStealMetainfo(tr_ctor* ctor);
 
 bool tr_ctorSetMetainfoFromFile(tr_ctor* ctor, std::string_view filename, tr_error** error = nullptr);
+// Use metainfo that's already been parsed, e.g. on a worker thread.
+// `contents` is the benc it was parsed from, or empty for magnet links.
+void tr_ctorSetMetainfo(tr_ctor* ctor, tr_torrent_metainfo&& metainfo, std::vector<char>&& contents, std::string_view filename);
 bool tr_ctorSetMetainfoFromMagnetLink(tr_ctor* ctor, std::string_view magnet_link, tr_error** error = nullptr);
 void tr_ctorSetLabels(tr_ctor* ctor, tr_quark const* labels, size_t n_labels);
 void tr_ctorSetBandwidthPriority(tr_ctor* ctor, tr_priority_t priority);
 tr_priority_t tr_ctorGetBandwidthPriority(tr_ctor const* ctor);
 tr_torrent::labels_t const& tr_ctorGetLabels(tr_ctor const* ctor);
+// Use an already-parsed .resume file instead of reading it from disk.
+// Takes ownership of `resume`'s contents and leaves it empty.
+void tr_ctorSetResume(tr_ctor* ctor, tr_variant* resume);
+tr_variant tr_ctorStealResume(tr_ctor* ctor);
 
 void tr_torrentOnVerifyDone(tr_torrent* tor, bool aborted);
 
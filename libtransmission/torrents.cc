@@ -4,6 +4,7 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <chrono>
 #include <set>
 #include <string_view>
 #include <vector>
@@ -77,20 +78,43 @@ void tr_torrents::remove(tr_torrent const* tor, time_t current_time)
     by_id_[tor->id()] = nullptr;
     auto const [begin, end] = std::equal_range(std::begin(by_hash_), std::end(by_hash_), tor, CompareTorrentByHash);
     by_hash_.erase(begin, end);
-    removed_.emplace_back(tor->id(), current_time);
+    removed_.push_back({ tor->id(), current_time, next_version() });
 }
 
 std::vector<tr_torrent_id_t> tr_torrents::removedSince(time_t timestamp) const
 {
     auto ids = std::set<tr_torrent_id_t>{};
 
-    for (auto const& [id, removed_at] : removed_)
+    for (auto const& removed : removed_)
     {
-        if (removed_at >= timestamp)
+        if (removed.removed_at >= timestamp)
         {
-            ids.insert(id);
+            ids.insert(removed.id);
         }
     }
 
     return { std::begin(ids), std::end(ids) };
 }
+
+uint64_t tr_torrents::initial_version() noexcept
+{
+    using namespace std::chrono;
+
+    // An earlier session would have had to change more than a million
+    // times a second to catch up with this, and it's still small enough
+    // for JSON clients that use doubles to represent exactly.
+    return duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+std::vector<tr_torrent_id_t> tr_torrents::removedSinceVersion(uint64_t version) const
+{
+    auto ids = std::set<tr_torrent_id_t>{};
+
+    // removed_ is sorted by version, so walk back from the newest
+    for (auto it = std::rbegin(removed_), end = std::rend(removed_); it != end && it->version > version; ++it)
+    {
+        ids.insert(it->id);
+    }
+
+    return { std::begin(ids), std::end(ids) };
+}
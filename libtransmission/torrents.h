@@ -10,6 +10,7 @@
 #endif
 
 #include <cstddef> // size_t
+#include <cstdint> // uint64_t
 #include <ctime>
 #include <string_view>
 #include <utility>
@@ -65,6 +66,22 @@ public:
     }
 
     [[nodiscard]] std::vector<tr_torrent_id_t> removedSince(time_t timestamp) const;
+    [[nodiscard]] std::vector<tr_torrent_id_t> removedSinceVersion(uint64_t version) const;
+
+    // A counter that increases whenever a torrent in this set changes,
+    // or is removed from it. RPC clients can give the value they last
+    // saw to get only the torrents that have changed since then.
+    // It starts at the current time in microseconds, so that it stays
+    // ahead of the versions that an earlier session handed out.
+    [[nodiscard]] constexpr auto version() const noexcept
+    {
+        return version_;
+    }
+
+    constexpr uint64_t next_version() noexcept
+    {
+        return ++version_;
+    }
 
     [[nodiscard]] TR_CONSTEXPR20 auto cbegin() const noexcept
     {
@@ -121,5 +138,16 @@ private:
     // may be testing for >0 as a validity check.
     std::vector<tr_torrent*> by_id_{ nullptr };
 
-    std::vector<std::pair<tr_torrent_id_t, time_t>> removed_;
+    struct Removed
+    {
+        tr_torrent_id_t id;
+        time_t removed_at;
+        uint64_t version;
+    };
+
+    std::vector<Removed> removed_;
+
+    [[nodiscard]] static uint64_t initial_version() noexcept;
+
+    uint64_t version_ = initial_version();
 };
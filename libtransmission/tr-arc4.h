@@ -37,30 +37,45 @@ public:
     {
         for (size_t i = 0; i < 256; ++i)
         {
-            s_[i] = static_cast<uint8_t>(i);
+            s_[i] = static_cast<uint32_t>(i);
         }
 
         for (size_t i = 0, j = 0; i < 256; ++i)
         {
-            j = static_cast<uint8_t>(j + s_[i] + ((uint8_t const*)key)[i % key_length]);
+            j = (j + s_[i] + ((uint8_t const*)key)[i % key_length]) & 0xFFU;
             arc4_swap(i, j);
         }
     }
 
     constexpr void process(uint8_t const* const src, size_t n_bytes, uint8_t* const tgt)
     {
-        for (size_t i = 0; i != n_bytes; ++i)
+        // `tgt` is a char type that could alias anything, so keep the
+        // indices in locals; otherwise every write to `tgt` would force
+        // them to be reloaded from memory
+        auto i = i_;
+        auto j = j_;
+
+        for (size_t pos = 0; pos != n_bytes; ++pos)
         {
-            tgt[i] = src[i] ^ arc4_next();
+            tgt[pos] = src[pos] ^ arc4_next(i, j);
         }
+
+        i_ = i;
+        j_ = j;
     }
 
     constexpr void discard(size_t length)
     {
+        auto i = i_;
+        auto j = j_;
+
         while (length-- > 0)
         {
-            arc4_next();
+            arc4_next(i, j);
         }
+
+        i_ = i;
+        j_ = j;
     }
 
 private:
@@ -71,17 +86,22 @@ private:
         s_[j] = tmp;
     }
 
-    constexpr uint8_t arc4_next()
+    constexpr uint8_t arc4_next(uint32_t& i, uint32_t& j)
     {
-        i_ += 1;
-        j_ += s_[i_];
-
-        arc4_swap(i_, j_);
+        i = (i + 1U) & 0xFFU;
+        auto const si = s_[i];
+        j = (j + si) & 0xFFU;
+        auto const sj = s_[j];
+        s_[i] = sj;
+        s_[j] = si;
 
-        return s_[static_cast<uint8_t>(s_[i_] + s_[j_])];
+        return static_cast<uint8_t>(s_[(si + sj) & 0xFFU]);
     }
 
-    std::array<uint8_t, 256> s_ = {};
-    uint8_t i_ = 0;
-    uint8_t j_ = 0;
+    // The permutation only holds byte values, but word-sized entries are
+    // about twice as fast: byte-sized loads and stores in the inner loop
+    // stall on partial-register and store-forwarding hazards.
+    std::array<uint32_t, 256> s_ = {};
+    uint32_t i_ = 0;
+    uint32_t j_ = 0;
 };
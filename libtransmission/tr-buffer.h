@@ -6,11 +6,21 @@
 #pragma once
 
 #include <algorithm> // for std::copy_n
+#include <array>
+#include <atomic>
 #include <cstddef>
+#include <deque>
 #include <iterator>
 #include <limits>
+#include <memory>
+#include <ratio>
 #include <string>
 #include <string_view>
+#include <utility>
+
+#ifndef _WIN32
+#include <sys/uio.h> // writev()
+#endif
 
 #include <small/vector.hpp>
 
@@ -252,6 +262,11 @@ public:
         return std::data(buf_) + begin_pos_;
     }
 
+    [[nodiscard]] value_type* data()
+    {
+        return std::data(buf_) + begin_pos_;
+    }
+
     void drain(size_t n_bytes) override
     {
         begin_pos_ += std::min(n_bytes, size());
@@ -294,4 +309,275 @@ private:
     size_t end_pos_ = {};
 };
 
+/**
+ * An outbound byte queue that's a chain of segments instead of one
+ * contiguous array. A segment either points into memory that the buffer
+ * allocated itself for add() et al., or shares ownership of a caller's
+ * memory that was queued with add_shared() -- e.g. a block from the read
+ * cache -- so that big payloads are sent without being copied first.
+ *
+ * The segments are sent with scatter/gather I/O.
+ */
+class ChainBuffer final : public BufferWriter<std::byte>
+{
+public:
+    // the most segments to send in a single syscall
+    static auto constexpr MaxIovecs = size_t{ 64U };
+
+    ChainBuffer() = default;
+    ChainBuffer(ChainBuffer&&) = delete;
+    ChainBuffer(ChainBuffer const&) = delete;
+    ChainBuffer& operator=(ChainBuffer&&) = delete;
+    ChainBuffer& operator=(ChainBuffer const&) = delete;
+
+    [[nodiscard]] constexpr size_t size() const noexcept
+    {
+        return size_;
+    }
+
+    [[nodiscard]] constexpr auto empty() const noexcept
+    {
+        return size_ == 0U;
+    }
+
+    std::pair<std::byte*, size_t> reserve_space(size_t n_bytes) override
+    {
+        if (chunk_ && chunk_->capacity - chunk_->used < n_bytes)
+        {
+            // If no segment uses the chunk anymore, reuse it from the start.
+            // The fence pairs with the release when the last user let go of it.
+            if (chunk_.use_count() == 1 && chunk_->capacity >= n_bytes)
+            {
+                std::atomic_thread_fence(std::memory_order_acquire);
+                chunk_->used = 0U;
+            }
+            else
+            {
+                chunk_.reset();
+            }
+        }
+
+        if (!chunk_)
+        {
+            chunk_ = std::make_shared<Chunk>(std::max(n_bytes, ChunkSize));
+        }
+
+        return { chunk_->data.get() + chunk_->used, n_bytes };
+    }
+
+    void commit_space(size_t n_bytes) override
+    {
+        if (n_bytes == 0U)
+        {
+            return;
+        }
+
+        auto const* const span_begin = chunk_->data.get() + chunk_->used;
+        chunk_->used += n_bytes;
+        size_ += n_bytes;
+
+        // grow the last segment if the new bytes come right after it
+        if (!std::empty(segments_))
+        {
+            if (auto& back = segments_.back(); back.owner == chunk_ && back.data + back.len == span_begin)
+            {
+                back.len += n_bytes;
+                return;
+            }
+        }
+
+        segments_.push_back(Segment{ chunk_, span_begin, n_bytes });
+    }
+
+    // Queue `span_len` bytes at `span_begin` without copying them.
+    // `owner` keeps them alive until they've been drained.
+    void add_shared(std::shared_ptr<void const> owner, void const* span_begin, size_t span_len)
+    {
+        if (span_len == 0U)
+        {
+            return;
+        }
+
+        segments_.push_back(Segment{ std::move(owner), static_cast<std::byte const*>(span_begin), span_len });
+        size_ += span_len;
+    }
+
+    // Move up to `n_bytes` from the front of `that` to the end of this buffer.
+    // Only the segments are moved, not the bytes.
+    void splice(ChainBuffer& that, size_t n_bytes = std::numeric_limits<size_t>::max())
+    {
+        n_bytes = std::min(n_bytes, std::size(that));
+        that.size_ -= n_bytes;
+        size_ += n_bytes;
+
+        while (n_bytes != 0U)
+        {
+            auto& front = that.segments_.front();
+
+            if (front.len > n_bytes)
+            {
+                segments_.push_back(Segment{ front.owner, front.data, n_bytes });
+                front.data += n_bytes;
+                front.len -= n_bytes;
+                return;
+            }
+
+            n_bytes -= front.len;
+            segments_.push_back(std::move(front));
+            that.segments_.pop_front();
+        }
+    }
+
+    // the first contiguous span of bytes
+    [[nodiscard]] std::pair<std::byte const*, size_t> front() const noexcept
+    {
+        if (std::empty(segments_))
+        {
+            return {};
+        }
+
+        auto const& front = segments_.front();
+        return { front.data, front.len };
+    }
+
+    void drain(size_t n_bytes)
+    {
+        n_bytes = std::min(n_bytes, size());
+        size_ -= n_bytes;
+
+        while (n_bytes != 0U)
+        {
+            auto& front = segments_.front();
+
+            if (front.len > n_bytes)
+            {
+                front.data += n_bytes;
+                front.len -= n_bytes;
+                return;
+            }
+
+            n_bytes -= front.len;
+            segments_.pop_front();
+        }
+    }
+
+    void clear()
+    {
+        drain(size());
+    }
+
+    void to_buf(void* tgt, size_t n_bytes)
+    {
+        auto* walk = static_cast<std::byte*>(tgt);
+
+        for (n_bytes = std::min(n_bytes, size()); n_bytes != 0U;)
+        {
+            auto const [span_begin, span_len] = front();
+            auto const n_this_span = std::min(n_bytes, span_len);
+            walk = std::copy_n(span_begin, n_this_span, walk);
+            drain(n_this_span);
+            n_bytes -= n_this_span;
+        }
+    }
+
+    // Point `iovs` at the segments that hold the first `n_bytes`.
+    // Works with any struct that has `iov_base` and `iov_len`,
+    // e.g. POSIX's `iovec` or libutp's `utp_iovec`.
+    // @return the number of iovecs that were filled in
+    template<typename Iovec>
+    size_t to_iovecs(Iovec* iovs, size_t n_iovs, size_t n_bytes) const
+    {
+        auto n_filled = size_t{};
+
+        for (auto it = std::begin(segments_), end = std::end(segments_); it != end && n_filled < n_iovs && n_bytes != 0U; ++it)
+        {
+            auto const len = std::min(it->len, n_bytes);
+            // the iovec structs aren't const-correct, but nothing writes to them
+            iovs[n_filled].iov_base = const_cast<std::byte*>(it->data);
+            iovs[n_filled].iov_len = len;
+            n_bytes -= len;
+            ++n_filled;
+        }
+
+        return n_filled;
+    }
+
+    // Returns the number of bytes written. Check `error` for error.
+    size_t to_socket(tr_socket_t sockfd, size_t n_bytes, tr_error** error = nullptr)
+    {
+        n_bytes = std::min(n_bytes, size());
+
+        if (n_bytes == 0U)
+        {
+            return {};
+        }
+
+#ifdef _WIN32
+        auto bufs = std::array<WSABUF, MaxIovecs>{};
+        auto n_bufs = DWORD{};
+        for (auto it = std::begin(segments_), end = std::end(segments_); it != end && n_bufs < MaxIovecs && n_bytes != 0U; ++it)
+        {
+            auto const len = std::min(it->len, n_bytes);
+            bufs[n_bufs].buf = reinterpret_cast<CHAR*>(const_cast<std::byte*>(it->data));
+            bufs[n_bufs].len = static_cast<ULONG>(len);
+            n_bytes -= len;
+            ++n_bufs;
+        }
+
+        if (auto n_sent = DWORD{}; WSASend(sockfd, std::data(bufs), n_bufs, &n_sent, 0, nullptr, nullptr) == 0)
+        {
+            drain(n_sent);
+            return n_sent;
+        }
+#else
+        auto iovs = std::array<iovec, MaxIovecs>{};
+        auto const n_iovs = to_iovecs(std::data(iovs), std::size(iovs), n_bytes);
+
+        if (auto const n_sent = writev(sockfd, std::data(iovs), static_cast<int>(n_iovs)); n_sent >= 0)
+        {
+            drain(n_sent);
+            return n_sent;
+        }
+#endif
+
+        auto const err = sockerrno;
+        tr_error_set(error, err, tr_net_strerror(err));
+        return {};
+    }
+
+private:
+    // A span of bytes and whatever keeps them alive
+    struct Segment
+    {
+        std::shared_ptr<void const> owner;
+        std::byte const* data;
+        size_t len;
+    };
+
+    // memory that the buffer allocated for reserve_space()
+    struct Chunk
+    {
+        explicit Chunk(size_t capacity_in)
+            : data{ new std::byte[capacity_in] }
+            , capacity{ capacity_in }
+        {
+        }
+
+        std::unique_ptr<std::byte[]> data;
+        size_t const capacity;
+        size_t used = 0U;
+    };
+
+    // enough for a handful of protocol messages,
+    // or a block that had to be copied, e.g. to encrypt it
+    static auto constexpr ChunkSize = size_t{ 16U * 1024U };
+
+    std::deque<Segment> segments_;
+
+    // the chunk that reserve_space() is filling
+    std::shared_ptr<Chunk> chunk_;
+
+    size_t size_ = 0U;
+};
+
 } // namespace libtransmission
@@ -0,0 +1,178 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef> // size_t
+#include <cstring> // memcpy()
+#include <iterator>
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h> // sendto(), recvfrom(), sendmmsg(), recvmmsg()
+#include <sys/uio.h> // iovec
+#endif
+
+#include "libtransmission/net.h"
+#include "libtransmission/tr-assert.h"
+#include "libtransmission/tr-udp-batch.h"
+
+void tr_udp_send_queue::push(tr_socket_t sock, void const* buf, size_t buflen, sockaddr const* to, socklen_t tolen)
+{
+    TR_ASSERT(tolen <= static_cast<socklen_t>(sizeof(sockaddr_storage)));
+
+    auto& datagram = datagrams_.emplace_back();
+    datagram.sock = sock;
+    datagram.offset = std::size(payloads_);
+    datagram.len = buflen;
+    std::memcpy(&datagram.to, to, tolen);
+    datagram.tolen = tolen;
+
+    auto const* const begin = static_cast<unsigned char const*>(buf);
+    payloads_.insert(std::end(payloads_), begin, begin + buflen);
+}
+
+#ifdef HAVE_SENDMMSG
+
+void tr_udp_send_queue::flush(ErrorFunc const& on_error)
+{
+    auto iovs = std::array<iovec, MaxSize>{};
+    auto msgs = std::array<mmsghdr, MaxSize>{};
+
+    // sendmmsg() sends on a single socket, so send one socket's datagrams at a
+    // time. That keeps each destination's datagrams in order, which is all µTP needs.
+    for (auto begin = std::begin(datagrams_), end = std::end(datagrams_); begin != end;)
+    {
+        auto const sock = begin->sock;
+        auto const other_socks = std::stable_partition(
+            begin,
+            end,
+            [sock](Datagram const& datagram) { return datagram.sock == sock; });
+
+        for (auto it = begin; it != other_socks;)
+        {
+            auto n_msgs = size_t{};
+            for (; it != other_socks && n_msgs < MaxSize; ++it, ++n_msgs)
+            {
+                iovs[n_msgs] = { std::data(payloads_) + it->offset, it->len };
+                msgs[n_msgs] = {};
+                msgs[n_msgs].msg_hdr.msg_name = &it->to;
+                msgs[n_msgs].msg_hdr.msg_namelen = it->tolen;
+                msgs[n_msgs].msg_hdr.msg_iov = &iovs[n_msgs];
+                msgs[n_msgs].msg_hdr.msg_iovlen = 1;
+            }
+
+            // sendmmsg() stops at the first datagram that fails,
+            // so report that one and carry on with the rest
+            auto const batch = it - n_msgs;
+            for (size_t i = 0; i < n_msgs;)
+            {
+                auto const n_sent = sendmmsg(sock, &msgs[i], static_cast<unsigned int>(n_msgs - i), 0);
+                if (n_sent > 0)
+                {
+                    i += static_cast<size_t>(n_sent);
+                    continue;
+                }
+
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+
+                if (on_error)
+                {
+                    on_error(reinterpret_cast<sockaddr const*>(&batch[i].to), batch[i].tolen, errno);
+                }
+
+                ++i;
+            }
+        }
+
+        begin = other_socks;
+    }
+
+    datagrams_.clear();
+    payloads_.clear();
+}
+
+#else
+
+void tr_udp_send_queue::flush(ErrorFunc const& on_error)
+{
+    for (auto const& datagram : datagrams_)
+    {
+        auto const* const payload = reinterpret_cast<char const*>(std::data(payloads_) + datagram.offset);
+        auto const* const to = reinterpret_cast<sockaddr const*>(&datagram.to);
+
+        if (::sendto(datagram.sock, payload, datagram.len, 0, to, datagram.tolen) == -1 && on_error)
+        {
+            on_error(to, datagram.tolen, sockerrno);
+        }
+    }
+
+    datagrams_.clear();
+    payloads_.clear();
+}
+
+#endif
+
+// ---
+
+tr_udp_recv_batch::tr_udp_recv_batch()
+    : bufs_(MaxSize * BufSize)
+{
+}
+
+#ifdef HAVE_RECVMMSG
+
+size_t tr_udp_recv_batch::read(tr_socket_t sock)
+{
+    auto iovs = std::array<iovec, MaxSize>{};
+    auto msgs = std::array<mmsghdr, MaxSize>{};
+
+    for (size_t i = 0; i < MaxSize; ++i)
+    {
+        iovs[i] = { &bufs_[i * BufSize], BufSize - 1U };
+        msgs[i].msg_hdr.msg_name = &froms_[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(froms_[i]);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    auto const n_read = recvmmsg(sock, std::data(msgs), MaxSize, MSG_DONTWAIT, nullptr);
+    size_ = n_read > 0 ? static_cast<size_t>(n_read) : 0U;
+
+    for (size_t i = 0; i < size_; ++i)
+    {
+        lens_[i] = msgs[i].msg_len;
+        fromlens_[i] = msgs[i].msg_hdr.msg_namelen;
+    }
+
+    return size_;
+}
+
+#else
+
+// The socket is readable, so a single recvfrom() won't block.
+size_t tr_udp_recv_batch::read(tr_socket_t sock)
+{
+    fromlens_[0] = sizeof(froms_[0]);
+
+    auto const n_read = recvfrom(
+        sock,
+        reinterpret_cast<char*>(std::data(bufs_)),
+        BufSize - 1U,
+        0,
+        reinterpret_cast<sockaddr*>(&froms_[0]),
+        &fromlens_[0]);
+
+    lens_[0] = n_read > 0 ? static_cast<size_t>(n_read) : 0U;
+    size_ = n_read > 0 ? 1U : 0U;
+    return size_;
+}
+
+#endif
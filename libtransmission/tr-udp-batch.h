@@ -0,0 +1,112 @@
+// This file Copyright © 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <array>
+#include <cstddef> // size_t
+#include <functional>
+#include <vector>
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h> // sockaddr_storage, socklen_t
+#endif
+
+#include "libtransmission/net.h" // tr_socket_t
+
+/**
+ * Datagrams waiting to be sent on the session's UDP sockets.
+ *
+ * µTP sends lots of small packets, so instead of making one syscall per
+ * packet, they're queued here and sent together with `sendmmsg()` where
+ * it's available.
+ */
+class tr_udp_send_queue
+{
+public:
+    // the most datagrams that should be queued before flushing
+    static auto constexpr MaxSize = size_t{ 64U };
+
+    // called with the destination and `errno` of a datagram that couldn't be sent
+    using ErrorFunc = std::function<void(sockaddr const* to, socklen_t tolen, int error_code)>;
+
+    void push(tr_socket_t sock, void const* buf, size_t buflen, sockaddr const* to, socklen_t tolen);
+
+    // send everything in the queue, in the order it was queued
+    void flush(ErrorFunc const& on_error);
+
+    [[nodiscard]] constexpr auto size() const noexcept
+    {
+        return std::size(datagrams_);
+    }
+
+    [[nodiscard]] constexpr auto empty() const noexcept
+    {
+        return std::empty(datagrams_);
+    }
+
+private:
+    struct Datagram
+    {
+        tr_socket_t sock;
+        size_t offset; // where the payload starts in `payloads_`
+        size_t len;
+        sockaddr_storage to;
+        socklen_t tolen;
+    };
+
+    std::vector<Datagram> datagrams_;
+    std::vector<unsigned char> payloads_;
+};
+
+/**
+ * Reads the datagrams that are waiting on a UDP socket, as many at a time
+ * as `recvmmsg()` allows where it's available, or one at a time otherwise.
+ */
+class tr_udp_recv_batch
+{
+public:
+    static auto constexpr MaxSize = size_t{ 32U };
+
+    // One byte more than the largest datagram we'll read, so that the
+    // payload can be zero-terminated, which libdht requires.
+    static auto constexpr BufSize = size_t{ 8192U };
+
+    struct Datagram
+    {
+        unsigned char* buf;
+        size_t len;
+        sockaddr* from;
+        socklen_t fromlen;
+    };
+
+    tr_udp_recv_batch();
+
+    // read the datagrams waiting on `sock` without blocking; returns how many were read
+    size_t read(tr_socket_t sock);
+
+    [[nodiscard]] constexpr auto size() const noexcept
+    {
+        return size_;
+    }
+
+    [[nodiscard]] Datagram operator[](size_t i) noexcept
+    {
+        return { &bufs_[i * BufSize], lens_[i], reinterpret_cast<sockaddr*>(&froms_[i]), fromlens_[i] };
+    }
+
+private:
+    std::vector<unsigned char> bufs_;
+    std::array<size_t, MaxSize> lens_ = {};
+    std::array<sockaddr_storage, MaxSize> froms_ = {};
+    std::array<socklen_t, MaxSize> fromlens_ = {};
+    size_t size_ = 0;
+};
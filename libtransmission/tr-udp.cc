@@ -89,18 +89,25 @@ void set_socket_buffers(tr_socket_t fd, bool large)
     }
 }
 
-void event_callback(evutil_socket_t s, [[maybe_unused]] short type, void* vsession)
+void log_send_error(sockaddr const* to, int error_code)
 {
-    TR_ASSERT(vsession != nullptr);
-    TR_ASSERT(type == EV_READ);
+    auto display_name = std::string{};
+    if (auto const addrport = tr_address::from_sockaddr(to); addrport)
+    {
+        auto const& [addr, port] = *addrport;
+        display_name = addr.display_name(port);
+    }
 
-    auto buf = std::array<unsigned char, 8192>{};
-    auto from = sockaddr_storage{};
-    auto fromlen = socklen_t{ sizeof(from) };
-    auto* const from_sa = reinterpret_cast<sockaddr*>(&from);
+    tr_logAddWarn(fmt::format(
+        "Couldn't send to {address}: {errno} ({error})",
+        fmt::arg("address", display_name),
+        fmt::arg("errno", error_code),
+        fmt::arg("error", tr_strerror(error_code))));
+}
 
-    auto const rc = recvfrom(s, reinterpret_cast<char*>(std::data(buf)), std::size(buf) - 1, 0, from_sa, &fromlen);
-    if (rc <= 0)
+void handle_datagram(tr_session* session, unsigned char* buf, size_t buflen, sockaddr* from, socklen_t fromlen)
+{
+    if (buflen == 0U)
     {
         return;
     }
@@ -112,25 +119,24 @@ void event_callback(evutil_socket_t s, [[maybe_unused]] short type, void* vsessi
          is between 0 and 3
        - the above cannot be µTP packets, since these start with a 4-bit
          version number (1). */
-    auto* const session = static_cast<tr_session*>(vsession);
     if (buf[0] == 'd')
     {
         if (session->dht_)
         {
-            buf[rc] = '\0'; // libdht requires zero-terminated messages
-            session->dht_->handle_message(std::data(buf), rc, from_sa, fromlen);
+            buf[buflen] = '\0'; // libdht requires zero-terminated messages
+            session->dht_->handle_message(buf, buflen, from, fromlen);
         }
     }
-    else if (rc >= 8 && buf[0] == 0 && buf[1] == 0 && buf[2] == 0 && buf[3] <= 3)
+    else if (buflen >= 8 && buf[0] == 0 && buf[1] == 0 && buf[2] == 0 && buf[3] <= 3)
     {
-        if (!session->announcer_udp_->handle_message(std::data(buf), rc))
+        if (!session->announcer_udp_->handle_message(buf, buflen))
         {
             tr_logAddTrace("Couldn't parse UDP tracker packet.");
         }
     }
     else if (session->allowsUTP() && (session->utp_context != nullptr))
     {
-        if (!tr_utpPacket(std::data(buf), rc, from_sa, fromlen, session))
+        if (!tr_utpPacket(buf, buflen, from, fromlen, session))
         {
             tr_logAddTrace("Unexpected UDP packet");
         }
@@ -174,7 +180,7 @@ tr_session::tr_udp_core::tr_udp_core(tr_session& session, tr_port udp_port)
             session_.setSocketTOS(sock, TR_AF_INET);
             set_socket_buffers(sock, session_.allowsUTP());
             udp4_socket_ = sock;
-            udp4_event_.reset(event_new(session_.event_base(), udp4_socket_, EV_READ | EV_PERSIST, event_callback, &session_));
+            udp4_event_.reset(event_new(session_.event_base(), udp4_socket_, EV_READ | EV_PERSIST, on_readable, this));
             event_add(udp4_event_.get(), nullptr);
         }
     }
@@ -208,7 +214,7 @@ tr_session::tr_udp_core::tr_udp_core(tr_session& session, tr_port udp_port)
             session_.setSocketTOS(sock, TR_AF_INET6);
             set_socket_buffers(sock, session_.allowsUTP());
             udp6_socket_ = sock;
-            udp6_event_.reset(event_new(session_.event_base(), udp6_socket_, EV_READ | EV_PERSIST, event_callback, &session_));
+            udp6_event_.reset(event_new(session_.event_base(), udp6_socket_, EV_READ | EV_PERSIST, on_readable, this));
             event_add(udp6_event_.get(), nullptr);
 
 #ifdef IPV6_V6ONLY
@@ -219,10 +225,23 @@ tr_session::tr_udp_core::tr_udp_core(tr_session& session, tr_port udp_port)
 #endif
         }
     }
+
+    if (udp4_socket_ != TR_BAD_SOCKET || udp6_socket_ != TR_BAD_SOCKET)
+    {
+        flush_event_.reset(event_new(
+            session_.event_base(),
+            -1,
+            0,
+            [](evutil_socket_t, short, void* vself) { static_cast<tr_udp_core*>(vself)->flush(); },
+            this));
+    }
 }
 
 tr_session::tr_udp_core::~tr_udp_core()
 {
+    flush_event_.reset();
+    flush();
+
     udp6_event_.reset();
 
     if (udp6_socket_ != TR_BAD_SOCKET)
@@ -240,7 +259,39 @@ tr_session::tr_udp_core::~tr_udp_core()
     }
 }
 
-void tr_session::tr_udp_core::sendto(void const* buf, size_t buflen, struct sockaddr const* to, socklen_t const tolen) const
+void tr_session::tr_udp_core::on_readable(evutil_socket_t sock, [[maybe_unused]] short type, void* vself)
+{
+    TR_ASSERT(vself != nullptr);
+    TR_ASSERT(type == EV_READ);
+
+    // Read until the socket is drained, but give other events
+    // a turn if the datagrams are arriving faster than that.
+    static auto constexpr MaxBatches = 8;
+
+    auto* const self = static_cast<tr_udp_core*>(vself);
+    auto* const session = &self->session_;
+    auto& inbox = self->inbox_;
+
+    for (int batch = 0; batch < MaxBatches; ++batch)
+    {
+        auto const n_read = inbox.read(sock);
+
+        for (size_t i = 0; i < n_read; ++i)
+        {
+            auto const [buf, buflen, from, fromlen] = inbox[i];
+            handle_datagram(session, buf, buflen, from, fromlen);
+        }
+
+        if (n_read < tr_udp_recv_batch::MaxSize)
+        {
+            break;
+        }
+    }
+
+    tr_utpSocketDrained(session);
+}
+
+void tr_session::tr_udp_core::sendto(void const* buf, size_t buflen, struct sockaddr const* to, socklen_t const tolen)
 {
     auto const addrport = tr_address::from_sockaddr(to);
     if (to->sa_family != AF_INET && to->sa_family != AF_INET6)
@@ -259,21 +310,26 @@ void tr_session::tr_udp_core::sendto(void const* buf, size_t buflen, struct sock
         // don't try to connect to a global address if we don't have connectivity to public internet
         return;
     }
-    else if (::sendto(sock, static_cast<char const*>(buf), buflen, 0, to, tolen) != -1)
+    else
     {
+        outbox_.push(sock, buf, buflen, to, tolen);
+
+        if (std::size(outbox_) >= tr_udp_send_queue::MaxSize)
+        {
+            flush();
+        }
+        else if (std::size(outbox_) == 1U && flush_event_)
+        {
+            event_active(flush_event_.get(), 0, 0);
+        }
+
         return;
     }
 
-    auto display_name = std::string{};
-    if (addrport)
-    {
-        auto const& [addr, port] = *addrport;
-        display_name = addr.display_name(port);
-    }
+    log_send_error(to, errno);
+}
 
-    tr_logAddWarn(fmt::format(
-        "Couldn't send to {address}: {errno} ({error})",
-        fmt::arg("address", display_name),
-        fmt::arg("errno", errno),
-        fmt::arg("error", tr_strerror(errno))));
+void tr_session::tr_udp_core::flush()
+{
+    outbox_.flush([](sockaddr const* to, socklen_t /*tolen*/, int error_code) { log_send_error(to, error_code); });
 }
@@ -16,4 +16,7 @@ void tr_utpInit(tr_session* session);
 
 bool tr_utpPacket(unsigned char const* buf, size_t buflen, struct sockaddr const* from, socklen_t fromlen, tr_session* ss);
 
+// Call after reading everything waiting on the UDP socket
+void tr_utpSocketDrained(tr_session* session);
+
 void tr_utpClose(tr_session*);
@@ -43,6 +43,9 @@ void tr_variantWalk(tr_variant const* top, VariantWalkFuncs const* walk_funcs, v
 /** @brief Private function that's exposed here only for unit tests */
 [[nodiscard]] std::optional<std::string_view> tr_bencParseStr(std::string_view* benc_inout);
 
+// Allocates `n` empty children for a container, from `arena` if it's non-null and from the heap otherwise.
+[[nodiscard]] tr_variant* tr_variantNewChildren(tr_variant_arena* arena, size_t n);
+
 bool tr_variantParseBenc(tr_variant& top, int parse_opts, std::string_view benc, char const** setme_end, tr_error** error);
 
 bool tr_variantParseJson(tr_variant& setme, int opts, std::string_view json, char const** setme_end, tr_error** error);
@@ -5,30 +5,38 @@
 
 #include <algorithm>
 #include <array>
-#include <cctype>
 #include <cerrno> /* EILSEQ, EINVAL */
-#include <cmath> /* fabs() */
 #include <cstddef> // std::byte
-#include <cstdint> // uint16_t
-#include <cstdlib>
+#include <cstdint> // uint16_t, uint32_t, uint64_t
 #include <cstring>
 #include <deque>
 #include <iterator> // std::back_inserter
+#include <limits>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <utility>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define TR_JSON_X86_KERNELS
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define TR_JSON_NEON_KERNELS
+#include <arm_neon.h>
+#endif
 
 #define UTF_CPP_CPLUSPLUS 201703L
 #include <utf8.h>
 
 #include <fmt/core.h>
-#include <fmt/compile.h>
 
-#include <jsonsl.h>
+#include <small/vector.hpp>
 
 #define LIBTRANSMISSION_VARIANT_MODULE
 
 #include "libtransmission/error.h"
+#include "libtransmission/json-writer.h"
 #include "libtransmission/quark.h"
 #include "libtransmission/tr-assert.h"
 #include "libtransmission/tr-buffer.h"
@@ -45,93 +53,6 @@ namespace parse_helpers
 /* arbitrary value... this is much deeper than our code goes */
 auto constexpr MaxDepth = size_t{ 64 };
 
-struct json_wrapper_data
-{
-    bool has_content;
-    size_t size;
-    std::string_view key;
-    std::string keybuf;
-    std::string strbuf;
-    tr_error* error;
-    std::deque<tr_variant*> stack;
-    tr_variant* top;
-    int parse_opts;
-
-    /* A very common pattern is for a container's children to be similar,
-     * e.g. they may all be objects with the same set of keys. So when
-     * a container is popped off the stack, remember its size to use as
-     * a preallocation heuristic for the next container at that depth. */
-    std::array<size_t, MaxDepth> preallocGuess;
-};
-
-tr_variant* get_node(struct jsonsl_st* jsn)
-{
-    auto* data = static_cast<struct json_wrapper_data*>(jsn->data);
-
-    auto* parent = std::empty(data->stack) ? nullptr : data->stack.back();
-
-    tr_variant* node = nullptr;
-    if (parent == nullptr)
-    {
-        node = data->top;
-    }
-    else if (tr_variantIsList(parent))
-    {
-        node = tr_variantListAdd(parent);
-    }
-    else if (tr_variantIsDict(parent) && !std::empty(data->key))
-    {
-        node = tr_variantDictAdd(parent, tr_quark_new(data->key));
-        data->key = ""sv;
-    }
-
-    return node;
-}
-
-void error_handler(jsonsl_t jsn, jsonsl_error_t error, jsonsl_state_st* /*state*/, jsonsl_char_t const* buf)
-{
-    auto* data = static_cast<struct json_wrapper_data*>(jsn->data);
-
-    tr_error_set(
-        &data->error,
-        EILSEQ,
-        fmt::format(
-            _("Couldn't parse JSON at position {position} '{text}': {error} ({error_code})"),
-            fmt::arg("position", jsn->pos),
-            fmt::arg("text", std::string_view{ buf, std::min(size_t{ 16U }, data->size - jsn->pos) }),
-            fmt::arg("error", jsonsl_strerror(error)),
-            fmt::arg("error_code", static_cast<int>(error))));
-}
-
-int error_callback(jsonsl_t jsn, jsonsl_error_t error, struct jsonsl_state_st* state, jsonsl_char_t* at)
-{
-    error_handler(jsn, error, state, at);
-    return 0; /* bail */
-}
-
-void action_callback_PUSH(jsonsl_t jsn, jsonsl_action_t /*action*/, struct jsonsl_state_st* state, jsonsl_char_t const* /*buf*/)
-{
-    auto* const data = static_cast<json_wrapper_data*>(jsn->data);
-
-    if ((state->type == JSONSL_T_LIST) || (state->type == JSONSL_T_OBJECT))
-    {
-        data->has_content = true;
-        tr_variant* node = get_node(jsn);
-        data->stack.push_back(node);
-
-        size_t const depth = std::size(data->stack);
-        size_t const n = depth < MaxDepth ? data->preallocGuess[depth] : 0;
-        if (state->type == JSONSL_T_LIST)
-        {
-            tr_variantInitList(node, n);
-        }
-        else
-        {
-            tr_variantInitDict(node, n);
-        }
-    }
-}
-
 /* like sscanf(in+2, "%4x", &val) but less slow */
 [[nodiscard]] constexpr bool decode_hex_string(char const* in, std::uint16_t& setme)
 {
@@ -187,7 +108,7 @@ void decode_single_uchar(char const*& in, char const* const in_end, Iter& buf16_
     auto buf16_out_it = std::begin(buf16);
 
     decode_single_uchar(in, in_end, buf16_out_it);
-    if (in[0] == '\\' && in[1] == 'u')
+    if (in_end - in >= 2 && in[0] == '\\' && in[1] == 'u')
     {
         decode_single_uchar(in, in_end, buf16_out_it);
     }
@@ -290,86 +211,894 @@ void decode_single_uchar(char const*& in, char const* const in_end, Iter& buf16_
     return buf;
 }
 
-[[nodiscard]] std::pair<std::string_view, bool> extract_string(jsonsl_t jsn, struct jsonsl_state_st* state, std::string& buf)
+// --- Stage 1: find the structural characters
+//
+// Like simdjson, the input is read in 64-byte blocks and each block is
+// summarized as bitmasks, one bit per byte. Escapes, strings, and token
+// boundaries are then found with word-sized bit math rather than with a
+// branch per byte. See Langdale and Lemire, "Parsing Gigabytes of JSON
+// per Second" (2019).
+//
+// The output is the offset of every '{', '}', '[', ']', ':', and ','
+// outside of a string, of every unescaped '"', and of the first byte
+// of every other token, e.g. `true` or `-12.5`.
+
+auto constexpr BlockSize = size_t{ 64U };
+
+struct BlockMasks
+{
+    uint64_t backslash;
+    uint64_t quote;
+    uint64_t op; // {}[]:,
+    uint64_t whitespace;
+};
+
+namespace scalar_kernels
+{
+BlockMasks classify(char const* block)
+{
+    auto masks = BlockMasks{};
+
+    for (size_t i = 0; i < BlockSize; ++i)
+    {
+        auto const bit = uint64_t{ 1U } << i;
+
+        switch (block[i])
+        {
+        case '\\':
+            masks.backslash |= bit;
+            break;
+
+        case '"':
+            masks.quote |= bit;
+            break;
+
+        case '{':
+        case '}':
+        case '[':
+        case ']':
+        case ':':
+        case ',':
+            masks.op |= bit;
+            break;
+
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+            masks.whitespace |= bit;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    return masks;
+}
+} // namespace scalar_kernels
+
+#if defined(TR_JSON_X86_KERNELS)
+
+namespace sse2_kernels
+{
+__attribute__((target("sse2"))) uint64_t movemask(__m128i const* vecs)
+{
+    return static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(vecs[0]))) |
+        static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(vecs[1]))) << 16U |
+        static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(vecs[2]))) << 32U |
+        static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(vecs[3]))) << 48U;
+}
+
+__attribute__((target("sse2"))) BlockMasks classify(char const* block)
+{
+    // OR'ing in 0x20 folds '[' and ']' onto '{' and '}'
+    auto const case_bit = _mm_set1_epi8(0x20);
+
+    __m128i backslash[4];
+    __m128i quote[4];
+    __m128i op[4];
+    __m128i whitespace[4];
+
+    for (size_t i = 0; i < 4U; ++i)
+    {
+        auto const in = _mm_loadu_si128(reinterpret_cast<__m128i const*>(block + i * 16U));
+        auto const folded = _mm_or_si128(in, case_bit);
+
+        backslash[i] = _mm_cmpeq_epi8(in, _mm_set1_epi8('\\'));
+        quote[i] = _mm_cmpeq_epi8(in, _mm_set1_epi8('"'));
+        op[i] = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')), _mm_cmpeq_epi8(folded, _mm_set1_epi8('}'))),
+            _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8(':')), _mm_cmpeq_epi8(in, _mm_set1_epi8(','))));
+        whitespace[i] = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(in, _mm_set1_epi8('\t'))),
+            _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(in, _mm_set1_epi8('\r'))));
+    }
+
+    return { movemask(backslash), movemask(quote), movemask(op), movemask(whitespace) };
+}
+} // namespace sse2_kernels
+
+namespace avx2_kernels
+{
+__attribute__((target("avx2"))) uint64_t movemask(__m256i lo, __m256i hi)
+{
+    return static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(lo))) |
+        static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(hi))) << 32U;
+}
+
+__attribute__((target("avx2"))) __m256i find_op(__m256i in)
+{
+    // OR'ing in 0x20 folds '[' and ']' onto '{' and '}'
+    auto const folded = _mm256_or_si256(in, _mm256_set1_epi8(0x20));
+
+    return _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}'))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(in, _mm256_set1_epi8(','))));
+}
+
+__attribute__((target("avx2"))) __m256i find_whitespace(__m256i in)
+{
+    return _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(in, _mm256_set1_epi8('\t'))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(in, _mm256_set1_epi8('\r'))));
+}
+
+__attribute__((target("avx2"))) BlockMasks classify(char const* block)
+{
+    auto const lo = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(block));
+    auto const hi = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(block + 32U));
+    auto const backslash = _mm256_set1_epi8('\\');
+    auto const quote = _mm256_set1_epi8('"');
+
+    return {
+        movemask(_mm256_cmpeq_epi8(lo, backslash), _mm256_cmpeq_epi8(hi, backslash)),
+        movemask(_mm256_cmpeq_epi8(lo, quote), _mm256_cmpeq_epi8(hi, quote)),
+        movemask(find_op(lo), find_op(hi)),
+        movemask(find_whitespace(lo), find_whitespace(hi)),
+    };
+}
+} // namespace avx2_kernels
+
+#elif defined(TR_JSON_NEON_KERNELS)
+
+namespace neon_kernels
+{
+// NEON has no movemask, so weight each lane by its bit and add pairwise
+// until each byte holds the bits of eight lanes
+uint64_t movemask(uint8x16_t const* vecs)
+{
+    static constexpr uint8_t Bits[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    auto const bits = vld1q_u8(Bits);
+
+    auto sum0 = vpaddq_u8(vandq_u8(vecs[0], bits), vandq_u8(vecs[1], bits));
+    auto const sum1 = vpaddq_u8(vandq_u8(vecs[2], bits), vandq_u8(vecs[3], bits));
+    sum0 = vpaddq_u8(sum0, sum1);
+    sum0 = vpaddq_u8(sum0, sum0);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(sum0), 0);
+}
+
+BlockMasks classify(char const* block)
+{
+    // OR'ing in 0x20 folds '[' and ']' onto '{' and '}'
+    auto const case_bit = vdupq_n_u8(0x20);
+
+    uint8x16_t backslash[4];
+    uint8x16_t quote[4];
+    uint8x16_t op[4];
+    uint8x16_t whitespace[4];
+
+    for (size_t i = 0; i < 4U; ++i)
+    {
+        auto const in = vld1q_u8(reinterpret_cast<uint8_t const*>(block + i * 16U));
+        auto const folded = vorrq_u8(in, case_bit);
+
+        backslash[i] = vceqq_u8(in, vdupq_n_u8('\\'));
+        quote[i] = vceqq_u8(in, vdupq_n_u8('"'));
+        op[i] = vorrq_u8(
+            vorrq_u8(vceqq_u8(folded, vdupq_n_u8('{')), vceqq_u8(folded, vdupq_n_u8('}'))),
+            vorrq_u8(vceqq_u8(in, vdupq_n_u8(':')), vceqq_u8(in, vdupq_n_u8(','))));
+        whitespace[i] = vorrq_u8(
+            vorrq_u8(vceqq_u8(in, vdupq_n_u8(' ')), vceqq_u8(in, vdupq_n_u8('\t'))),
+            vorrq_u8(vceqq_u8(in, vdupq_n_u8('\n')), vceqq_u8(in, vdupq_n_u8('\r'))));
+    }
+
+    return { movemask(backslash), movemask(quote), movemask(op), movemask(whitespace) };
+}
+} // namespace neon_kernels
+
+#endif
+
+using ClassifyFunc = BlockMasks (*)(char const* block);
+
+[[nodiscard]] ClassifyFunc pickClassifier() noexcept
+{
+#if defined(TR_JSON_X86_KERNELS)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return avx2_kernels::classify;
+    }
+
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return sse2_kernels::classify;
+    }
+#elif defined(TR_JSON_NEON_KERNELS)
+    return neon_kernels::classify;
+#endif
+
+    return scalar_kernels::classify;
+}
+
+[[nodiscard]] ClassifyFunc getClassifier() noexcept
+{
+    static auto const classify = pickClassifier();
+    return classify;
+}
+
+[[nodiscard]] constexpr uint64_t prefixXor(uint64_t bits) noexcept
+{
+    bits ^= bits << 1U;
+    bits ^= bits << 2U;
+    bits ^= bits << 4U;
+    bits ^= bits << 8U;
+    bits ^= bits << 16U;
+    bits ^= bits << 32U;
+    return bits;
+}
+
+[[nodiscard]] size_t countTrailingZeroes(uint64_t word) noexcept
+{
+    TR_ASSERT(word != 0U);
+
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<size_t>(__builtin_ctzll(word));
+#else
+    auto n = size_t{};
+    for (; (word & 1U) == 0U; word >>= 1U)
+    {
+        ++n;
+    }
+    return n;
+#endif
+}
+
+class StructuralScanner
+{
+public:
+    // Returns the bits of the characters that follow an odd-length run of
+    // backslashes, i.e. the characters that are escaped.
+    // See section 3.1.1 of Langdale and Lemire.
+    [[nodiscard]] uint64_t find_escaped(uint64_t backslash) noexcept
+    {
+        auto constexpr EvenBits = uint64_t{ 0x5555555555555555U };
+        auto constexpr OddBits = ~EvenBits;
+
+        auto const starts = backslash & ~(backslash << 1U);
+        auto const even_start_mask = EvenBits ^ prev_ends_odd_backslash_;
+        auto const even_starts = starts & even_start_mask;
+        auto const odd_starts = starts & ~even_start_mask;
+
+        auto const even_carries = backslash + even_starts;
+        auto odd_carries = backslash + odd_starts;
+        auto const ends_odd_backslash = odd_carries < backslash;
+        odd_carries |= prev_ends_odd_backslash_;
+        prev_ends_odd_backslash_ = ends_odd_backslash ? 1U : 0U;
+
+        auto const even_start_odd_end = even_carries & ~backslash & OddBits;
+        auto const odd_start_even_end = odd_carries & ~backslash & EvenBits;
+        return even_start_odd_end | odd_start_even_end;
+    }
+
+    // Returns the structural bits for one block
+    [[nodiscard]] uint64_t next(BlockMasks const& masks) noexcept
+    {
+        auto const quote = masks.quote & ~find_escaped(masks.backslash);
+
+        // each string's bits run from its opening quote up to, but not including, its closing quote
+        auto const in_string = prefixXor(quote) ^ prev_in_string_;
+        prev_in_string_ = static_cast<uint64_t>(static_cast<int64_t>(in_string) >> 63U);
+
+        // the first byte of each token that isn't a string or an op, e.g. `true` or `-12.5`
+        auto const scalar = ~(masks.op | masks.whitespace | quote | in_string);
+        auto const scalar_starts = scalar & ~((scalar << 1U) | prev_scalar_);
+        prev_scalar_ = scalar >> 63U;
+
+        return (masks.op & ~in_string) | quote | scalar_starts;
+    }
+
+    // True iff the input ended inside a string
+    [[nodiscard]] constexpr bool in_string() const noexcept
+    {
+        return prev_in_string_ != 0U;
+    }
+
+private:
+    uint64_t prev_ends_odd_backslash_ = 0U;
+    uint64_t prev_in_string_ = 0U;
+    uint64_t prev_scalar_ = 0U;
+};
+
+// Appends the offsets of `json`'s structural characters to `setme`.
+// Returns false if `json` ends inside a string.
+[[nodiscard]] bool find_structurals(std::string_view json, std::vector<uint32_t>& setme)
 {
-    // figure out where the string is
-    char const* in_begin = jsn->base + state->pos_begin;
-    if (*in_begin == '"')
+    auto const classify = getClassifier();
+    auto scanner = StructuralScanner{};
+    auto n_found = size_t{};
+    setme.resize(std::size(json) / 8U + BlockSize);
+
+    auto const add = [&setme, &n_found](uint64_t bits, size_t offset)
     {
-        in_begin++;
+        if (std::size(setme) < n_found + BlockSize)
+        {
+            setme.resize(std::size(setme) * 2U);
+        }
+
+        for (; bits != 0U; bits &= bits - 1U)
+        {
+            setme[n_found++] = static_cast<uint32_t>(offset + countTrailingZeroes(bits));
+        }
+    };
+
+    auto const* const begin = std::data(json);
+    auto const n_bytes = std::size(json);
+    auto offset = size_t{};
+    for (; offset + BlockSize <= n_bytes; offset += BlockSize)
+    {
+        add(scanner.next(classify(begin + offset)), offset);
     }
 
-    char const* const in_end = jsn->base + state->pos_cur;
-    size_t const in_len = in_end - in_begin;
-    if (memchr(in_begin, '\\', in_len) == nullptr)
+    if (offset < n_bytes)
     {
-        /* it's not escaped */
-        return std::make_pair(std::string_view{ in_begin, in_len }, true);
+        // pad the last partial block with whitespace
+        auto tail = std::array<char, BlockSize>{};
+        tail.fill(' ');
+        std::copy_n(begin + offset, n_bytes - offset, std::data(tail));
+        add(scanner.next(classify(std::data(tail))), offset);
     }
 
-    return std::make_pair(extract_escaped_string(in_begin, in_len, buf), false);
+    setme.resize(n_found);
+    return !scanner.in_string();
 }
 
-void action_callback_POP(jsonsl_t jsn, jsonsl_action_t /*action*/, struct jsonsl_state_st* state, jsonsl_char_t const* /*buf*/)
+// --- Stage 2: build the tr_variant
+//
+// Walks the structural offsets, checking the grammar and building values
+// on a scratch stack. When a container is closed, its children are moved
+// off of the stack into a single allocation of exactly the right size, so
+// parsing never has to grow a container.
+
+enum class ParseError
 {
-    auto* data = static_cast<struct json_wrapper_data*>(jsn->data);
+    None,
+    TooBig,
+    UnclosedString,
+    UnexpectedEnd,
+    InvalidToken,
+    InvalidEscape,
+    KeyExpected,
+    ColonExpected,
+    CommaExpected,
+    BracketMismatch,
+    TooDeep,
+    TrailingGarbage
+};
+
+[[nodiscard]] constexpr std::string_view to_string(ParseError const err)
+{
+    switch (err)
+    {
+    case ParseError::None:
+        return "no error"sv;
+    case ParseError::TooBig:
+        return "input is too large"sv;
+    case ParseError::UnclosedString:
+        return "unclosed string"sv;
+    case ParseError::UnexpectedEnd:
+        return "unexpected end of input"sv;
+    case ParseError::InvalidToken:
+        return "invalid token"sv;
+    case ParseError::InvalidEscape:
+        return "invalid escape sequence"sv;
+    case ParseError::KeyExpected:
+        return "expected a key"sv;
+    case ParseError::ColonExpected:
+        return "expected ':'"sv;
+    case ParseError::CommaExpected:
+        return "expected ',' or a closing bracket"sv;
+    case ParseError::BracketMismatch:
+        return "mismatched bracket"sv;
+    case ParseError::TooDeep:
+        return "too many levels of nesting"sv;
+    case ParseError::TrailingGarbage:
+        return "unexpected data after the end"sv;
+    }
 
-    if (state->type == JSONSL_T_STRING)
+    return "unknown error"sv;
+}
+
+[[nodiscard]] constexpr bool is_digit(char const ch)
+{
+    return '0' <= ch && ch <= '9';
+}
+
+// Checks that each backslash in `str` starts one of JSON's escape sequences.
+// `\u` isn't checked for hex digits: as in earlier versions, extract_escaped_string()
+// keeps an invalid one like `\uzzzz` as-is.
+[[nodiscard]] constexpr bool has_valid_escapes(std::string_view str)
+{
+    for (auto pos = str.find('\\'); pos != std::string_view::npos; pos = str.find('\\', pos + 2U))
     {
-        auto const [str, inplace] = extract_string(jsn, state, data->strbuf);
-        if (inplace && ((data->parse_opts & TR_VARIANT_PARSE_INPLACE) != 0))
+        if (pos + 1U >= std::size(str))
         {
-            tr_variantInitStrView(get_node(jsn), str);
+            return false;
         }
-        else
+
+        switch (str[pos + 1U])
         {
-            tr_variantInitStr(get_node(jsn), str);
+        case '"':
+        case '\\':
+        case '/':
+        case 'b':
+        case 'f':
+        case 'n':
+        case 'r':
+        case 't':
+        case 'u':
+            break;
+
+        default:
+            return false;
         }
-        data->has_content = true;
     }
-    else if (state->type == JSONSL_T_HKEY)
+
+    return true;
+}
+
+[[nodiscard]] constexpr bool is_delimiter(char const ch)
+{
+    switch (ch)
     {
-        data->has_content = true;
-        auto const [key, inplace] = extract_string(jsn, state, data->keybuf);
-        data->key = key;
+    case ' ':
+    case '\t':
+    case '\n':
+    case '\r':
+    case '{':
+    case '}':
+    case '[':
+    case ']':
+    case ':':
+    case ',':
+    case '"':
+        return true;
+
+    default:
+        return false;
     }
-    else if (state->type == JSONSL_T_LIST || state->type == JSONSL_T_OBJECT)
+}
+
+// Checks `token` against JSON's number grammar and says whether it's an
+// integer, i.e. whether it has neither a fraction nor an exponent.
+// Leading zeroes are tolerated.
+[[nodiscard]] constexpr std::optional<bool> check_number(std::string_view token)
+{
+    auto const skip_digits = [&token]()
     {
-        auto const depth = std::size(data->stack);
-        auto const* const v = data->stack.back();
-        data->stack.pop_back();
-        if (depth < MaxDepth)
+        auto n = size_t{};
+        while (n < std::size(token) && is_digit(token[n]))
         {
-            data->preallocGuess[depth] = v->val.l.count;
+            ++n;
         }
+        token.remove_prefix(n);
+        return n;
+    };
+
+    if (!std::empty(token) && token.front() == '-')
+    {
+        token.remove_prefix(1U);
     }
-    else if (state->type == JSONSL_T_SPECIAL)
+
+    if (skip_digits() == 0U)
     {
-        if ((state->special_flags & JSONSL_SPECIALf_NUMNOINT) != 0)
+        return {};
+    }
+
+    auto is_int = true;
+
+    if (!std::empty(token) && token.front() == '.')
+    {
+        token.remove_prefix(1U);
+        is_int = false;
+
+        if (skip_digits() == 0U)
         {
-            auto sv = std::string_view{ jsn->base + state->pos_begin, jsn->pos - state->pos_begin };
-            tr_variantInitReal(get_node(jsn), tr_num_parse<double>(sv).value_or(0.0));
+            return {};
         }
-        else if ((state->special_flags & JSONSL_SPECIALf_NUMERIC) != 0)
+    }
+
+    if (!std::empty(token) && (token.front() == 'e' || token.front() == 'E'))
+    {
+        token.remove_prefix(1U);
+        is_int = false;
+
+        if (!std::empty(token) && (token.front() == '+' || token.front() == '-'))
         {
-            char const* begin = jsn->base + state->pos_begin;
-            data->has_content = true;
-            tr_variantInitInt(get_node(jsn), std::strtoll(begin, nullptr, 10));
+            token.remove_prefix(1U);
         }
-        else if ((state->special_flags & JSONSL_SPECIALf_BOOLEAN) != 0)
+
+        if (skip_digits() == 0U)
         {
-            bool const b = (state->special_flags & JSONSL_SPECIALf_TRUE) != 0;
-            data->has_content = true;
-            tr_variantInitBool(get_node(jsn), b);
+            return {};
         }
-        else if ((state->special_flags & JSONSL_SPECIALf_NULL) != 0)
+    }
+
+    if (!std::empty(token))
+    {
+        return {};
+    }
+
+    return is_int;
+}
+
+// Like strtoll(), the value saturates if it's out of range
+[[nodiscard]] constexpr int64_t parse_int(std::string_view token)
+{
+    auto const negative = token.front() == '-';
+    if (negative)
+    {
+        token.remove_prefix(1U);
+    }
+
+    auto constexpr Max = std::numeric_limits<int64_t>::max();
+    auto val = uint64_t{};
+    for (auto const ch : token)
+    {
+        auto const digit = static_cast<uint64_t>(ch - '0');
+        if (val > (uint64_t{ Max } + 1U - digit) / 10U)
         {
-            data->has_content = true;
-            tr_variantInitQuark(get_node(jsn), TR_KEY_NONE);
+            return negative ? std::numeric_limits<int64_t>::min() : Max;
         }
+        val = val * 10U + digit;
     }
+
+    if (negative)
+    {
+        return val > uint64_t{ Max } ? std::numeric_limits<int64_t>::min() : -static_cast<int64_t>(val);
+    }
+
+    return val > uint64_t{ Max } ? Max : static_cast<int64_t>(val);
 }
 
+class JsonParser
+{
+public:
+    JsonParser(std::string_view json, int parse_opts)
+        : json_{ json }
+        , inplace_{ (parse_opts & TR_VARIANT_PARSE_INPLACE) != 0 }
+    {
+    }
+
+    JsonParser(JsonParser&&) = delete;
+    JsonParser(JsonParser const&) = delete;
+    JsonParser& operator=(JsonParser&&) = delete;
+    JsonParser& operator=(JsonParser const&) = delete;
+
+    ~JsonParser()
+    {
+        for (auto& value : values_)
+        {
+            tr_variantClear(&value);
+        }
+    }
+
+    [[nodiscard]] ParseError parse(tr_variant& setme)
+    {
+        if (std::size(json_) > std::numeric_limits<uint32_t>::max())
+        {
+            return ParseError::TooBig;
+        }
+
+        arena_ = setme.arena;
+
+        if (!find_structurals(json_, idx_))
+        {
+            pos_ = std::size(idx_);
+            return ParseError::UnclosedString;
+        }
+
+        if (auto const err = parse_document(); err != ParseError::None)
+        {
+            return err;
+        }
+
+        TR_ASSERT(std::size(values_) == 1U);
+        setme = values_.front();
+        setme.key = TR_KEY_NONE;
+        values_.clear();
+        return ParseError::None;
+    }
+
+    [[nodiscard]] bool has_content() const noexcept
+    {
+        return !std::empty(idx_);
+    }
+
+    // the offset of the token being parsed when parsing stopped
+    [[nodiscard]] size_t offset() const noexcept
+    {
+        return pos_ < std::size(idx_) ? idx_[pos_] : std::size(json_);
+    }
+
+private:
+    struct Frame
+    {
+        size_t first_child;
+        tr_quark key;
+        bool is_dict;
+    };
+
+    [[nodiscard]] char peek() const noexcept
+    {
+        return pos_ < std::size(idx_) ? json_[idx_[pos_]] : '\0';
+    }
+
+    [[nodiscard]] ParseError parse_document()
+    {
+        if (std::empty(idx_))
+        {
+            return ParseError::UnexpectedEnd;
+        }
+
+        for (;;)
+        {
+            // parse a value
+            switch (peek())
+            {
+            case '{':
+            case '[':
+                if (std::size(frames_) >= MaxDepth)
+                {
+                    return ParseError::TooDeep;
+                }
+
+                frames_.push_back({ std::size(values_), TR_KEY_NONE, peek() == '{' });
+                ++pos_;
+
+                if (peek() == (frames_.back().is_dict ? '}' : ']'))
+                {
+                    ++pos_;
+                    close_container();
+                    break;
+                }
+
+                if (frames_.back().is_dict)
+                {
+                    if (auto const err = parse_key(); err != ParseError::None)
+                    {
+                        return err;
+                    }
+                }
+                continue;
+
+            case '"':
+                if (auto const err = add_string(); err != ParseError::None)
+                {
+                    return err;
+                }
+                break;
+
+            case '\0':
+                return ParseError::UnexpectedEnd;
+
+            default:
+                if (auto const err = add_scalar(); err != ParseError::None)
+                {
+                    return err;
+                }
+                break;
+            }
+
+            // a value has been added. what comes after it?
+            for (;;)
+            {
+                if (std::empty(frames_))
+                {
+                    return pos_ == std::size(idx_) ? ParseError::None : ParseError::TrailingGarbage;
+                }
+
+                auto const& frame = frames_.back();
+                auto const ch = peek();
+                ++pos_;
+
+                if (ch == ',')
+                {
+                    if (frame.is_dict)
+                    {
+                        if (auto const err = parse_key(); err != ParseError::None)
+                        {
+                            return err;
+                        }
+                    }
+                    break;
+                }
+
+                if (ch == '}' || ch == ']')
+                {
+                    if ((ch == '}') != frame.is_dict)
+                    {
+                        --pos_;
+                        return ParseError::BracketMismatch;
+                    }
+
+                    close_container();
+                    continue;
+                }
+
+                --pos_;
+                return ch == '\0' ? ParseError::UnexpectedEnd : ParseError::CommaExpected;
+            }
+        }
+    }
+
+    [[nodiscard]] ParseError parse_key()
+    {
+        if (peek() != '"')
+        {
+            return peek() == '\0' ? ParseError::UnexpectedEnd : ParseError::KeyExpected;
+        }
+
+        auto const key = get_string(strbuf_);
+        if (!key)
+        {
+            return ParseError::InvalidEscape;
+        }
+
+        frames_.back().key = tr_quark_new(key->first);
+        pos_ += 2U;
+
+        if (peek() != ':')
+        {
+            return peek() == '\0' ? ParseError::UnexpectedEnd : ParseError::ColonExpected;
+        }
+
+        ++pos_;
+        return ParseError::None;
+    }
+
+    // Returns the string that starts at the current token, and whether it's
+    // a view into the input instead of into `buf`
+    [[nodiscard]] std::optional<std::pair<std::string_view, bool>> get_string(std::string& buf) const
+    {
+        // stage 1 guarantees that an opening quote is followed by its closing quote
+        TR_ASSERT(pos_ + 1U < std::size(idx_));
+        auto const* const begin = std::data(json_) + idx_[pos_] + 1U;
+        auto const len = static_cast<size_t>(idx_[pos_ + 1U] - idx_[pos_] - 1U);
+
+        if (memchr(begin, '\\', len) == nullptr)
+        {
+            return std::make_pair(std::string_view{ begin, len }, true);
+        }
+
+        if (!has_valid_escapes({ begin, len }))
+        {
+            return {};
+        }
+
+        return std::make_pair(extract_escaped_string(begin, len, buf), false);
+    }
+
+    [[nodiscard]] ParseError add_string()
+    {
+        auto const got = get_string(strbuf_);
+        if (!got)
+        {
+            return ParseError::InvalidEscape;
+        }
+
+        auto const [str, is_view] = *got;
+        auto& value = add_value();
+
+        if (is_view && inplace_)
+        {
+            tr_variantInitStrView(&value, str);
+        }
+        else
+        {
+            tr_variantInitStr(&value, str);
+        }
+
+        pos_ += 2U;
+        return ParseError::None;
+    }
+
+    [[nodiscard]] ParseError add_scalar()
+    {
+        auto const begin = static_cast<size_t>(idx_[pos_]);
+        auto end = begin + 1U;
+        while (end < std::size(json_) && !is_delimiter(json_[end]))
+        {
+            ++end;
+        }
+
+        auto const token = json_.substr(begin, end - begin);
+        if (token == "true"sv || token == "false"sv)
+        {
+            tr_variantInitBool(&add_value(), token == "true"sv);
+        }
+        else if (token == "null"sv)
+        {
+            tr_variantInitQuark(&add_value(), TR_KEY_NONE);
+        }
+        else if (auto const is_int = check_number(token); !is_int)
+        {
+            return ParseError::InvalidToken;
+        }
+        else if (*is_int)
+        {
+            tr_variantInitInt(&add_value(), parse_int(token));
+        }
+        else
+        {
+            tr_variantInitReal(&add_value(), tr_num_parse<double>(token).value_or(0.0));
+        }
+
+        ++pos_;
+        return ParseError::None;
+    }
+
+    [[nodiscard]] tr_variant& add_value()
+    {
+        auto& value = values_.emplace_back();
+        value.arena = arena_;
+
+        if (!std::empty(frames_) && frames_.back().is_dict)
+        {
+            value.key = frames_.back().key;
+        }
+
+        return value;
+    }
+
+    void close_container()
+    {
+        auto const frame = frames_.back();
+        frames_.pop_back();
+
+        auto const n_children = std::size(values_) - frame.first_child;
+        tr_variant* children = nullptr;
+        if (n_children > 0U)
+        {
+            children = tr_variantNewChildren(arena_, n_children);
+            std::copy_n(std::data(values_) + frame.first_child, n_children, children);
+            values_.resize(frame.first_child);
+        }
+
+        auto& container = add_value();
+        tr_variantInit(&container, frame.is_dict ? TR_VARIANT_TYPE_DICT : TR_VARIANT_TYPE_LIST);
+        container.val.l.vals = children;
+        container.val.l.alloc = n_children;
+        container.val.l.count = n_children;
+    }
+
+    std::string_view const json_;
+    bool const inplace_;
+
+    // where the tree's children and strings are allocated, or nullptr for the heap
+    tr_variant_arena* arena_ = nullptr;
+
+    // per-parse scratch space
+    std::vector<uint32_t> idx_;
+    std::vector<tr_variant> values_;
+    small::vector<Frame, MaxDepth> frames_;
+    std::string strbuf_;
+
+    // index into idx_ of the current token
+    size_t pos_ = 0U;
+};
+
 } // namespace parse_helpers
 } // namespace
 
@@ -379,47 +1108,38 @@ bool tr_variantParseJson(tr_variant& setme, int parse_opts, std::string_view jso
 
     TR_ASSERT((parse_opts & TR_VARIANT_PARSE_JSON) != 0);
 
-    auto data = json_wrapper_data{};
-
-    jsonsl_t jsn = jsonsl_new(MaxDepth);
-    jsn->action_callback_PUSH = action_callback_PUSH;
-    jsn->action_callback_POP = action_callback_POP;
-    jsn->error_callback = error_callback;
-    jsn->data = &data;
-    jsonsl_enable_all_callbacks(jsn);
-
-    data.error = nullptr;
-    data.size = std::size(json);
-    data.has_content = false;
-    data.key = ""sv;
-    data.parse_opts = parse_opts;
-    data.preallocGuess = {};
-    data.stack = {};
-    data.top = &setme;
+    auto parser = JsonParser{ json, parse_opts };
+    auto const err = parser.parse(setme);
+    auto const offset = err == ParseError::None ? std::size(json) : parser.offset();
 
-    /* parse it */
-    jsonsl_feed(jsn, static_cast<jsonsl_char_t const*>(std::data(json)), std::size(json));
-
-    /* EINVAL if there was no content */
-    if (data.error == nullptr && !data.has_content)
+    if (setme_end != nullptr)
     {
-        tr_error_set(&data.error, EINVAL, "No content");
+        *setme_end = std::data(json) + offset;
     }
 
-    /* maybe set the end ptr */
-    if (setme_end != nullptr)
+    if (err == ParseError::None)
     {
-        *setme_end = std::data(json) + jsn->pos;
+        return true;
     }
 
-    /* cleanup */
-    auto const success = data.error == nullptr;
-    if (data.error != nullptr)
+    if (!parser.has_content())
     {
-        tr_error_propagate(error, &data.error);
+        tr_error_set(error, EINVAL, "No content");
     }
-    jsonsl_destroy(jsn);
-    return success;
+    else
+    {
+        tr_error_set(
+            error,
+            EILSEQ,
+            fmt::format(
+                _("Couldn't parse JSON at position {position} '{text}': {error} ({error_code})"),
+                fmt::arg("position", offset),
+                fmt::arg("text", json.substr(offset, 16U)),
+                fmt::arg("error", to_string(err)),
+                fmt::arg("error_code", static_cast<int>(err))));
+    }
+
+    return false;
 }
 
 // ---
@@ -522,10 +1242,8 @@ void jsonPopParent(struct JsonWalk* data)
 
 void jsonIntFunc(tr_variant const* val, void* vdata)
 {
-    auto buf = std::array<char, 64>{};
-    auto const* const out = fmt::format_to(std::data(buf), FMT_COMPILE("{:d}"), val->val.i);
     auto* const data = static_cast<JsonWalk*>(vdata);
-    data->out.add(std::data(buf), static_cast<size_t>(out - std::data(buf)));
+    libtransmission::JsonWriter::write_int(data->out, val->val.i);
     jsonChildFunc(data);
 }
 
@@ -548,121 +1266,17 @@ void jsonBoolFunc(tr_variant const* val, void* vdata)
 void jsonRealFunc(tr_variant const* val, void* vdata)
 {
     auto* const data = static_cast<struct JsonWalk*>(vdata);
-
-    auto const [buf, buflen] = data->out.reserve_space(64);
-    auto* walk = reinterpret_cast<char*>(buf);
-    auto const* const begin = walk;
-
-    if (fabs(val->val.d - (int)val->val.d) < 0.00001)
-    {
-        walk = fmt::format_to(walk, FMT_COMPILE("{:.0f}"), val->val.d);
-    }
-    else
-    {
-        walk = fmt::format_to(walk, FMT_COMPILE("{:.4f}"), val->val.d);
-    }
-
-    data->out.commit_space(walk - begin);
-
+    libtransmission::JsonWriter::write_real(data->out, val->val.d);
     jsonChildFunc(data);
 }
 
-[[nodiscard]] char* write_escaped_char(char* buf, char const* const end, std::string_view& sv)
-{
-    auto u16buf = std::array<std::uint16_t, 2>{};
-
-    auto const* const begin8 = std::data(sv);
-    auto const* const end8 = begin8 + std::size(sv);
-    auto const* walk8 = begin8;
-    utf8::next(walk8, end8);
-    auto const end16 = utf8::utf8to16(begin8, walk8, std::begin(u16buf));
-
-    for (auto it = std::cbegin(u16buf); it != end16; ++it)
-    {
-        buf = fmt::format_to_n(buf, end - buf - 1, FMT_COMPILE("\\u{:04x}"), *it).out;
-    }
-
-    sv.remove_prefix(walk8 - begin8 - 1);
-    return buf;
-}
-
 void jsonStringFunc(tr_variant const* val, void* vdata)
 {
     auto* const data = static_cast<struct JsonWalk*>(vdata);
 
     auto sv = std::string_view{};
     (void)!tr_variantGetStrView(val, &sv);
-
-    auto& out = data->out;
-    auto const [buf, buflen] = out.reserve_space(std::size(sv) * 6 + 2);
-    auto* walk = reinterpret_cast<char*>(buf);
-    auto const* const begin = walk;
-    auto const* const end = begin + buflen;
-
-    *walk++ = '"';
-
-    for (; !std::empty(sv); sv.remove_prefix(1))
-    {
-        switch (sv.front())
-        {
-        case '\b':
-            *walk++ = '\\';
-            *walk++ = 'b';
-            break;
-
-        case '\f':
-            *walk++ = '\\';
-            *walk++ = 'f';
-            break;
-
-        case '\n':
-            *walk++ = '\\';
-            *walk++ = 'n';
-            break;
-
-        case '\r':
-            *walk++ = '\\';
-            *walk++ = 'r';
-            break;
-
-        case '\t':
-            *walk++ = '\\';
-            *walk++ = 't';
-            break;
-
-        case '"':
-            *walk++ = '\\';
-            *walk++ = '"';
-            break;
-
-        case '\\':
-            *walk++ = '\\';
-            *walk++ = '\\';
-            break;
-
-        default:
-            if (isprint((unsigned char)sv.front()) != 0)
-            {
-                *walk++ = sv.front();
-            }
-            else
-            {
-                try
-                {
-                    walk = write_escaped_char(walk, end, sv);
-                }
-                catch (utf8::exception const&)
-                {
-                    *walk++ = '?';
-                }
-            }
-            break;
-        }
-    }
-
-    *walk++ = '"';
-    TR_ASSERT(walk <= end);
-    out.commit_space(walk - begin);
+    libtransmission::JsonWriter::write_string(data->out, sv);
 
     jsonChildFunc(data);
 }
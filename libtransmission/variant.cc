@@ -4,6 +4,10 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm> // std::sort
+#include <array>
+#include <cstddef> // std::byte, std::max_align_t
+#include <cstdint> // uintptr_t
+#include <memory>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -28,6 +32,78 @@
 
 using namespace std::literals;
 
+// A bump allocator for the strings and children of an arena-backed tree.
+// Nothing is freed until the arena itself is destroyed.
+struct tr_variant_arena
+{
+public:
+    tr_variant_arena() = default;
+    tr_variant_arena(tr_variant_arena&&) = delete;
+    tr_variant_arena(tr_variant_arena const&) = delete;
+    tr_variant_arena& operator=(tr_variant_arena&&) = delete;
+    tr_variant_arena& operator=(tr_variant_arena const&) = delete;
+    ~tr_variant_arena() = default;
+
+    [[nodiscard]] void* allocate(size_t size, size_t align)
+    {
+        auto const pos = align_up(pos_, align);
+        if (pos + size > end_)
+        {
+            return grow(size, align);
+        }
+
+        pos_ = pos + size;
+        return reinterpret_cast<void*>(pos);
+    }
+
+    [[nodiscard]] tr_variant* new_children(size_t n)
+    {
+        auto* const children = static_cast<tr_variant*>(allocate(n * sizeof(tr_variant), alignof(tr_variant)));
+        std::uninitialized_default_construct_n(children, n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            children[i].arena = this;
+        }
+
+        return children;
+    }
+
+private:
+    static auto constexpr InitialBlockSize = size_t{ 2048U };
+    static auto constexpr MaxBlockSize = size_t{ 64U * 1024U };
+
+    [[nodiscard]] static constexpr uintptr_t align_up(uintptr_t pos, size_t align)
+    {
+        return (pos + align - 1U) & ~uintptr_t{ align - 1U };
+    }
+
+    [[nodiscard]] void* grow(size_t size, size_t align)
+    {
+        auto const needed = size + align - 1U;
+
+        // big allocations get a block of their own so that
+        // the rest of the current block doesn't go to waste
+        if (needed > block_size_ / 4U)
+        {
+            auto& block = blocks_.emplace_back(new std::byte[needed]);
+            return reinterpret_cast<void*>(align_up(reinterpret_cast<uintptr_t>(block.get()), align));
+        }
+
+        block_size_ = std::min(block_size_ * 2U, MaxBlockSize);
+        auto& block = blocks_.emplace_back(new std::byte[block_size_]);
+        pos_ = reinterpret_cast<uintptr_t>(block.get());
+        end_ = pos_ + block_size_;
+        return allocate(size, align);
+    }
+
+    // the first block is inline so that small trees need only one allocation
+    alignas(std::max_align_t) std::array<std::byte, InitialBlockSize> initial_block_;
+    small::vector<std::unique_ptr<std::byte[]>, 4> blocks_;
+    uintptr_t pos_ = reinterpret_cast<uintptr_t>(std::data(initial_block_));
+    uintptr_t end_ = pos_ + InitialBlockSize;
+    size_t block_size_ = InitialBlockSize;
+};
+
 namespace
 {
 constexpr bool tr_variantIsContainer(tr_variant const* v)
@@ -38,59 +114,61 @@ constexpr bool tr_variantIsContainer(tr_variant const* v)
 // ---
 
 auto constexpr StringInit = tr_variant_string{
-    TR_STRING_TYPE_QUARK,
     0,
     {},
 };
 
-void tr_variant_string_clear(struct tr_variant_string* str)
+void tr_variant_string_clear(tr_variant* v)
 {
-    if (str->type == TR_STRING_TYPE_HEAP)
+    if (v->string_type == TR_STRING_TYPE_HEAP)
     {
-        delete[] const_cast<char*>(str->str.str);
+        delete[] const_cast<char*>(v->val.s.str.str);
     }
 
-    *str = StringInit;
+    v->string_type = TR_STRING_TYPE_QUARK;
+    v->val.s = StringInit;
 }
 
 /* returns a const pointer to the variant's string */
-constexpr char const* tr_variant_string_get_string(struct tr_variant_string const* str)
+constexpr char const* tr_variant_string_get_string(tr_variant const* v)
 {
-    switch (str->type)
+    switch (v->string_type)
     {
     case TR_STRING_TYPE_BUF:
-        return str->str.buf;
+        return v->val.s.str.buf;
 
     case TR_STRING_TYPE_HEAP:
     case TR_STRING_TYPE_QUARK:
     case TR_STRING_TYPE_VIEW:
-        return str->str.str;
+    case TR_STRING_TYPE_ARENA:
+        return v->val.s.str.str;
 
     default:
         return nullptr;
     }
 }
 
-void tr_variant_string_set_quark(struct tr_variant_string* str, tr_quark quark)
+void tr_variant_string_set_quark(tr_variant* v, tr_quark quark)
 {
-    tr_variant_string_clear(str);
+    tr_variant_string_clear(v);
 
-    str->type = TR_STRING_TYPE_QUARK;
+    v->string_type = TR_STRING_TYPE_QUARK;
     auto const sv = tr_quark_get_string_view(quark);
-    str->str.str = std::data(sv);
-    str->len = std::size(sv);
+    v->val.s.str.str = std::data(sv);
+    v->val.s.len = std::size(sv);
 }
 
-void tr_variant_string_set_string(struct tr_variant_string* str, std::string_view in)
+void tr_variant_string_set_string(tr_variant* v, std::string_view in)
 {
-    tr_variant_string_clear(str);
+    tr_variant_string_clear(v);
 
+    auto* const str = &v->val.s;
     auto const* const bytes = std::data(in);
     auto const len = std::size(in);
 
     if (len < sizeof(str->str.buf))
     {
-        str->type = TR_STRING_TYPE_BUF;
+        v->string_type = TR_STRING_TYPE_BUF;
         if (len > 0)
         {
             std::copy_n(bytes, len, str->str.buf);
@@ -101,10 +179,10 @@ void tr_variant_string_set_string(struct tr_variant_string* str, std::string_vie
     }
     else
     {
-        auto* tmp = new char[len + 1];
+        auto* const tmp = v->arena != nullptr ? static_cast<char*>(v->arena->allocate(len + 1, 1)) : new char[len + 1];
         std::copy_n(bytes, len, tmp);
         tmp[len] = '\0';
-        str->type = TR_STRING_TYPE_HEAP;
+        v->string_type = v->arena != nullptr ? TR_STRING_TYPE_ARENA : TR_STRING_TYPE_HEAP;
         str->str.str = tmp;
         str->len = len;
     }
@@ -116,7 +194,7 @@ constexpr char const* getStr(tr_variant const* v)
 {
     TR_ASSERT(tr_variantIsString(v));
 
-    return tr_variant_string_get_string(&v->val.s);
+    return tr_variant_string_get_string(v);
 }
 
 constexpr int dictIndexOf(tr_variant const* dict, tr_quark key)
@@ -155,9 +233,13 @@ tr_variant* containerReserve(tr_variant* v, size_t count)
             n *= 2U;
         }
 
-        auto* vals = new tr_variant[n];
+        auto* vals = tr_variantNewChildren(v->arena, n);
         std::copy_n(v->val.l.vals, v->val.l.count, vals);
-        delete[] v->val.l.vals;
+        if (v->arena == nullptr)
+        {
+            delete[] v->val.l.vals;
+        }
+
         v->val.l.vals = vals;
         v->val.l.alloc = n;
     }
@@ -178,7 +260,7 @@ tr_variant* dictFindOrAdd(tr_variant* dict, tr_quark key, int type)
         }
         else if (child->type == TR_VARIANT_TYPE_STR)
         {
-            tr_variant_string_clear(&child->val.s);
+            tr_variant_string_clear(child);
         }
     }
 
@@ -262,7 +344,7 @@ bool tr_variantGetStrView(tr_variant const* v, std::string_view* setme)
         return false;
     }
 
-    char const* const str = tr_variant_string_get_string(&v->val.s);
+    char const* const str = tr_variant_string_get_string(v);
     size_t const len = v->val.s.len;
     *setme = std::string_view{ str, len };
     return true;
@@ -408,19 +490,19 @@ bool tr_variantDictFindRaw(tr_variant* dict, tr_quark key, std::byte const** set
 void tr_variantInitRaw(tr_variant* initme, void const* value, size_t value_len)
 {
     tr_variantInit(initme, TR_VARIANT_TYPE_STR);
-    tr_variant_string_set_string(&initme->val.s, { static_cast<char const*>(value), value_len });
+    tr_variant_string_set_string(initme, { static_cast<char const*>(value), value_len });
 }
 
 void tr_variantInitQuark(tr_variant* initme, tr_quark value)
 {
     tr_variantInit(initme, TR_VARIANT_TYPE_STR);
-    tr_variant_string_set_quark(&initme->val.s, value);
+    tr_variant_string_set_quark(initme, value);
 }
 
 void tr_variantInitStr(tr_variant* initme, std::string_view value)
 {
     tr_variantInit(initme, TR_VARIANT_TYPE_STR);
-    tr_variant_string_set_string(&initme->val.s, value);
+    tr_variant_string_set_string(initme, value);
 }
 
 void tr_variantInitList(tr_variant* initme, size_t reserve_count)
@@ -429,6 +511,15 @@ void tr_variantInitList(tr_variant* initme, size_t reserve_count)
     tr_variantListReserve(initme, reserve_count);
 }
 
+void tr_variantInitArenaList(tr_variant* initme, size_t reserve_count)
+{
+    tr_variantInit(initme, TR_VARIANT_TYPE_LIST);
+    TR_ASSERT(initme->arena == nullptr); // arenas don't nest
+    initme->arena = new tr_variant_arena{};
+    initme->owns_arena = true;
+    tr_variantListReserve(initme, reserve_count);
+}
+
 void tr_variantListReserve(tr_variant* list, size_t count)
 {
     TR_ASSERT(tr_variantIsList(list));
@@ -442,6 +533,15 @@ void tr_variantInitDict(tr_variant* initme, size_t reserve_count)
     tr_variantDictReserve(initme, reserve_count);
 }
 
+void tr_variantInitArenaDict(tr_variant* initme, size_t reserve_count)
+{
+    tr_variantInit(initme, TR_VARIANT_TYPE_DICT);
+    TR_ASSERT(initme->arena == nullptr); // arenas don't nest
+    initme->arena = new tr_variant_arena{};
+    initme->owns_arena = true;
+    tr_variantDictReserve(initme, reserve_count);
+}
+
 void tr_variantDictReserve(tr_variant* dict, size_t reserve_count)
 {
     TR_ASSERT(tr_variantIsDict(dict));
@@ -456,6 +556,7 @@ tr_variant* tr_variantListAdd(tr_variant* list)
     tr_variant* child = containerReserve(list, 1);
     ++list->val.l.count;
     child->key = 0;
+    child->arena = list->arena;
     tr_variantInit(child, TR_VARIANT_TYPE_INT);
 
     return child;
@@ -531,6 +632,7 @@ tr_variant* tr_variantDictAdd(tr_variant* dict, tr_quark key)
     tr_variant* val = containerReserve(dict, 1);
     ++dict->val.l.count;
     val->key = key;
+    val->arena = dict->arena;
     tr_variantInit(val, TR_VARIANT_TYPE_INT);
 
     return val;
@@ -599,15 +701,6 @@ tr_variant* tr_variantDictAddDict(tr_variant* dict, tr_quark key, size_t reserve
     return child;
 }
 
-tr_variant* tr_variantDictSteal(tr_variant* dict, tr_quark key, tr_variant* value)
-{
-    tr_variant* child = tr_variantDictAdd(dict, key);
-    *child = *value;
-    child->key = key;
-    tr_variantInit(value, value->type);
-    return child;
-}
-
 bool tr_variantDictRemove(tr_variant* dict, tr_quark key)
 {
     bool removed = false;
@@ -877,12 +970,19 @@ void freeDummyFunc(tr_variant const* /*v*/, void* /*buf*/)
 
 void freeStringFunc(tr_variant const* v, void* /*user_data*/)
 {
-    tr_variant_string_clear(&const_cast<tr_variant*>(v)->val.s);
+    tr_variant_string_clear(const_cast<tr_variant*>(v));
 }
 
 void freeContainerEndFunc(tr_variant const* v, void* /*user_data*/)
 {
-    delete[] v->val.l.vals;
+    if (v->owns_arena)
+    {
+        delete v->arena;
+    }
+    else if (v->arena == nullptr)
+    {
+        delete[] v->val.l.vals;
+    }
 }
 
 VariantWalkFuncs constexpr FreeWalkFuncs = {
@@ -901,12 +1001,29 @@ void tr_variantClear(tr_variant* clearme)
 {
     using namespace clear_helpers;
 
-    if (!tr_variantIsEmpty(clearme))
+    // Everything under an arena-backed node lives in the arena, so there's
+    // no need to walk the tree: either free the whole arena or nothing.
+    auto* arena = clearme->arena;
+
+    if (clearme->owns_arena)
+    {
+        delete arena;
+        arena = nullptr;
+    }
+    else if (arena == nullptr && !tr_variantIsEmpty(clearme))
     {
         tr_variantWalk(clearme, &FreeWalkFuncs, nullptr, false);
     }
 
     *clearme = {};
+
+    // a cleared child stays in its tree's arena
+    clearme->arena = arena;
+}
+
+tr_variant* tr_variantNewChildren(tr_variant_arena* arena, size_t n)
+{
+    return arena != nullptr ? arena->new_children(n) : new tr_variant[n];
 }
 
 // ---
@@ -1070,6 +1187,48 @@ void tr_variantMergeDicts(tr_variant* target, tr_variant const* source)
     }
 }
 
+tr_variant* tr_variantDictSteal(tr_variant* dict, tr_quark key, tr_variant* value)
+{
+    using namespace merge_helpers;
+
+    tr_variant* child = tr_variantDictAdd(dict, key);
+    auto const type = value->type;
+
+    if (!value->owns_arena && value->arena == child->arena)
+    {
+        *child = *value;
+        child->key = key;
+        tr_variantInit(value, type);
+        return child;
+    }
+
+    // `value`'s storage is owned by another arena or by the heap,
+    // so it can't be shared with `dict`'s tree. Copy it instead.
+    if (tr_variantIsDict(value))
+    {
+        tr_variantInitDict(child, tr_variantDictSize(value));
+        tr_variantMergeDicts(child, value);
+    }
+    else if (tr_variantIsList(value))
+    {
+        tr_variantInitList(child, tr_variantListSize(value));
+        tr_variantListCopy(child, value);
+    }
+    else if (auto sv = std::string_view{}; tr_variantGetStrView(value, &sv))
+    {
+        tr_variantInitStr(child, sv);
+    }
+    else
+    {
+        tr_variantInit(child, type);
+        child->val = value->val;
+    }
+
+    tr_variantClear(value);
+    tr_variantInit(value, type);
+    return child;
+}
+
 // ---
 
 std::string tr_variantToStr(tr_variant const* v, tr_variant_fmt fmt)
@@ -1117,9 +1276,18 @@ bool tr_variantFromBuf(tr_variant* setme, int opts, std::string_view buf, char c
 
     *setme = {};
 
+    // the parsers build into `setme->arena` if it's set;
+    // `setme` only takes ownership once parsing is done.
+    if ((opts & TR_VARIANT_PARSE_ARENA) != 0)
+    {
+        setme->arena = new tr_variant_arena{};
+    }
+
     auto const success = ((opts & TR_VARIANT_PARSE_BENC) != 0) ? tr_variantParseBenc(*setme, opts, buf, setme_end, error) :
                                                                  tr_variantParseJson(*setme, opts, buf, setme_end, error);
 
+    setme->owns_arena = setme->arena != nullptr;
+
     if (!success)
     {
         tr_variantClear(setme);
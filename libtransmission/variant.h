@@ -14,6 +14,7 @@
 #include "libtransmission/quark.h"
 
 struct tr_error;
+struct tr_variant_arena;
 
 /**
  * @addtogroup tr_variant Variant
@@ -27,12 +28,13 @@ struct tr_error;
  * @{
  */
 
-enum tr_string_type
+enum tr_string_type : uint8_t
 {
     TR_STRING_TYPE_QUARK,
     TR_STRING_TYPE_HEAP,
     TR_STRING_TYPE_BUF,
-    TR_STRING_TYPE_VIEW
+    TR_STRING_TYPE_VIEW,
+    TR_STRING_TYPE_ARENA
 };
 
 /* these are PRIVATE IMPLEMENTATION details that should not be touched.
@@ -40,7 +42,6 @@ enum tr_string_type
  * it's included in the header for inlining and composition */
 struct tr_variant_string
 {
-    tr_string_type type;
     size_t len;
     union
     {
@@ -69,8 +70,20 @@ struct tr_variant
 {
     char type = '\0';
 
+    // which kind of storage `val.s` uses. Kept out of `val.s` so that
+    // the arena pointer below fits without growing the struct.
+    tr_string_type string_type = TR_STRING_TYPE_QUARK;
+
+    // true iff this is the root of an arena-backed tree.
+    // Clearing the root frees `arena` and, with it, the whole tree.
+    bool owns_arena = false;
+
     tr_quark key = TR_KEY_NONE;
 
+    // If non-null, this variant's strings and children are allocated
+    // from `arena` and are never freed individually.
+    tr_variant_arena* arena = nullptr;
+
     union
     {
         bool b;
@@ -117,7 +130,9 @@ enum tr_variant_parse_opts
 {
     TR_VARIANT_PARSE_BENC = (1 << 0),
     TR_VARIANT_PARSE_JSON = (1 << 1),
-    TR_VARIANT_PARSE_INPLACE = (1 << 2)
+    TR_VARIANT_PARSE_INPLACE = (1 << 2),
+    // build the tree in an arena; see tr_variantInitArenaDict()
+    TR_VARIANT_PARSE_ARENA = (1 << 3)
 };
 
 bool tr_variantFromFile(
@@ -174,14 +189,24 @@ void tr_variantInitRaw(tr_variant* initme, void const* value, size_t value_len);
 
 constexpr void tr_variantInit(tr_variant* initme, char type)
 {
+    // An arena-backed child keeps allocating from its tree's arena,
+    // but a root gives up its arena: the idiom for handing a tree off
+    // is to copy the root and then re-initialize the original.
+    if (initme->owns_arena)
+    {
+        initme->owns_arena = false;
+        initme->arena = nullptr;
+    }
+
     initme->val = {};
     initme->type = type;
+    initme->string_type = TR_STRING_TYPE_QUARK;
 }
 
 constexpr void tr_variantInitStrView(tr_variant* initme, std::string_view in)
 {
     tr_variantInit(initme, TR_VARIANT_TYPE_STR);
-    initme->val.s.type = TR_STRING_TYPE_VIEW;
+    initme->string_type = TR_STRING_TYPE_VIEW;
     initme->val.s.len = std::size(in);
     initme->val.s.str.str = std::data(in);
 }
@@ -242,6 +267,7 @@ constexpr void tr_variantInitInt(tr_variant* initme, int64_t value)
 }
 
 void tr_variantInitList(tr_variant* initme, size_t reserve_count);
+void tr_variantInitArenaList(tr_variant* initme, size_t reserve_count);
 void tr_variantListReserve(tr_variant* list, size_t reserve_count);
 
 tr_variant* tr_variantListAdd(tr_variant* list);
@@ -271,6 +297,21 @@ bool tr_variantListRemove(tr_variant* list, size_t pos);
 }
 
 void tr_variantInitDict(tr_variant* initme, size_t reserve_count);
+
+/**
+ * @brief Initialize `initme` as the root of an arena-backed dict.
+ *
+ * Every child and string that's later added anywhere in the tree is
+ * bump-allocated from an arena owned by the root instead of the heap,
+ * so building a tree costs a handful of allocations instead of one
+ * per container or long string, and `tr_variantClear()` on the root
+ * frees the whole tree without walking it.
+ *
+ * Best for trees that are built, read, and thrown away -- e.g. RPC
+ * requests and responses -- since memory released by removing or
+ * overwriting values isn't reused until the root is cleared.
+ */
+void tr_variantInitArenaDict(tr_variant* initme, size_t reserve_count);
 void tr_variantDictReserve(tr_variant* dict, size_t reserve_count);
 bool tr_variantDictRemove(tr_variant* dict, tr_quark key);
 
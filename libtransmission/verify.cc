@@ -4,9 +4,9 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <chrono>
 #include <ctime>
 #include <mutex>
-#include <optional>
 #include <thread>
 #include <vector>
 
@@ -28,9 +28,13 @@ using namespace std::chrono_literals;
 namespace
 {
 
-auto constexpr SleepPerSecondDuringVerify = 100ms;
+// how much data a thread claims at a time.
+// claiming runs of pieces keeps the reads mostly sequential.
+auto constexpr MaxBytesPerClaim = uint64_t{ 1024U * 1024U * 4U };
 
-}
+auto constexpr ReadBufferSize = size_t{ 1024U * 256U };
+
+} // namespace
 
 int tr_verify_worker::Node::compare(tr_verify_worker::Node const& that) const
 {
@@ -52,104 +56,104 @@ int tr_verify_worker::Node::compare(tr_verify_worker::Node const& that) const
     return tr_compare_3way(torrent->id(), that.torrent->id());
 }
 
-bool tr_verify_worker::verify_torrent(tr_torrent* tor, std::atomic<bool> const& stop_flag)
+void tr_verify_worker::wait_for_io_budget(uint64_t n_bytes, std::atomic<bool> const& abort)
 {
-    auto const begin = tr_time();
-
-    tr_sys_file_t fd = TR_BAD_SYS_FILE;
-    uint64_t file_pos = 0;
-    bool changed = false;
-    bool had_piece = false;
-    time_t last_slept_at = 0;
-    uint32_t piece_pos = 0;
-    tr_file_index_t file_index = 0;
-    tr_file_index_t prev_file_index = ~file_index;
-    tr_piece_index_t piece = 0;
-    auto buffer = std::vector<std::byte>(1024 * 256);
-    auto sha = tr_sha1::create();
+    auto const bytes_per_second = bytes_per_second_.load();
+    if (bytes_per_second == 0U)
+    {
+        return;
+    }
 
-    tr_logAddDebugTor(tor, "verifying torrent...");
+    // reserve a timeslot for this read so that the combined
+    // read rate of all the verify threads stays under the limit
+    auto const cost = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>{ static_cast<double>(n_bytes) / bytes_per_second });
+    auto read_at = std::chrono::steady_clock::time_point{};
+    {
+        auto const lock = std::lock_guard(io_budget_mutex_);
+        read_at = std::max(std::chrono::steady_clock::now(), io_budget_next_read_at_);
+        io_budget_next_read_at_ = read_at + cost;
+    }
 
-    while (!stop_flag && piece < tor->piece_count())
+    // sleep in small slices so that remove() doesn't have to wait long
+    for (auto now = std::chrono::steady_clock::now(); !abort && now < read_at; now = std::chrono::steady_clock::now())
     {
-        auto const file_length = tor->file_size(file_index);
+        std::this_thread::sleep_for(std::min(std::chrono::steady_clock::duration{ 100ms }, read_at - now));
+    }
+}
 
-        /* if we're starting a new piece... */
-        if (piece_pos == 0)
-        {
-            had_piece = tor->has_piece(piece);
-        }
+tr_verify_worker::PieceResults tr_verify_worker::verify_pieces(
+    tr_torrent const* tor,
+    tr_piece_index_t begin,
+    tr_piece_index_t end,
+    std::atomic<bool> const& abort)
+{
+    auto results = PieceResults{};
+    results.reserve(end - begin);
 
-        /* if we're starting a new file... */
-        if (file_pos == 0 && fd == TR_BAD_SYS_FILE && file_index != prev_file_index)
+    tr_sys_file_t fd = TR_BAD_SYS_FILE;
+    auto fd_file_index = tr_file_index_t{};
+    auto [file_index, file_pos] = tor->file_offset(tor->piece_loc(begin));
+    auto const n_files = tor->file_count();
+    auto buffer = std::vector<std::byte>(ReadBufferSize);
+    auto sha = tr_sha1::create();
+
+    for (auto piece = begin; piece < end && !abort; ++piece)
+    {
+        for (uint64_t left_in_piece = tor->piece_size(piece); left_in_piece > 0U && file_index < n_files;)
         {
-            auto const found = tor->find_file(file_index);
-            fd = !found ? TR_BAD_SYS_FILE : tr_sys_file_open(found->filename(), TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL, 0);
-            prev_file_index = file_index;
-        }
+            auto const file_length = tor->file_size(file_index);
 
-        /* figure out how much we can read this pass */
-        uint64_t left_in_piece = tor->piece_size(piece) - piece_pos;
-        uint64_t left_in_file = file_length - file_pos;
-        uint64_t bytes_this_pass = std::min(left_in_file, left_in_piece);
-        bytes_this_pass = std::min(bytes_this_pass, uint64_t(std::size(buffer)));
+            /* figure out how much we can read this pass */
+            auto bytes_this_pass = std::min({ file_length - file_pos, left_in_piece, uint64_t{ std::size(buffer) } });
 
-        /* read a bit */
-        if (fd != TR_BAD_SYS_FILE)
-        {
-            auto num_read = uint64_t{};
-            if (tr_sys_file_read_at(fd, std::data(buffer), bytes_this_pass, file_pos, &num_read) && num_read > 0)
+            /* if we're starting a new file... */
+            if (bytes_this_pass > 0U && (fd == TR_BAD_SYS_FILE || fd_file_index != file_index))
             {
-                bytes_this_pass = num_read;
-                sha->add(std::data(buffer), bytes_this_pass);
-                tr_sys_file_advise(fd, file_pos, bytes_this_pass, TR_SYS_FILE_ADVICE_DONT_NEED);
+                if (fd != TR_BAD_SYS_FILE)
+                {
+                    tr_sys_file_close(fd);
+                }
+
+                auto const found = tor->find_file(file_index);
+                fd = !found ? TR_BAD_SYS_FILE :
+                              tr_sys_file_open(found->filename(), TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL, 0);
+                fd_file_index = file_index;
             }
-        }
-
-        /* move our offsets */
-        left_in_piece -= bytes_this_pass;
-        left_in_file -= bytes_this_pass;
-        piece_pos += bytes_this_pass;
-        file_pos += bytes_this_pass;
 
-        /* if we're finishing a piece... */
-        if (left_in_piece == 0)
-        {
-            if (auto const has_piece = sha->finish() == tor->piece_hash(piece); has_piece || had_piece)
+            /* read a bit */
+            if (bytes_this_pass > 0U && fd != TR_BAD_SYS_FILE)
             {
-                tor->set_has_piece(piece, has_piece);
-                changed |= has_piece != had_piece;
+                wait_for_io_budget(bytes_this_pass, abort);
+
+                auto num_read = uint64_t{};
+                if (tr_sys_file_read_at(fd, std::data(buffer), bytes_this_pass, file_pos, &num_read) && num_read > 0)
+                {
+                    bytes_this_pass = num_read;
+                    sha->add(std::data(buffer), bytes_this_pass);
+                    tr_sys_file_advise(fd, file_pos, bytes_this_pass, TR_SYS_FILE_ADVICE_DONT_NEED);
+                }
             }
 
-            tor->checked_pieces_.set(piece, true);
-            tor->mark_changed();
+            /* move our offsets */
+            left_in_piece -= bytes_this_pass;
+            file_pos += bytes_this_pass;
 
-            /* sleeping even just a few msec per second goes a long
-             * way towards reducing IO load... */
-            if (auto const now = tr_time(); last_slept_at != now)
+            /* if we're finishing a file... */
+            if (file_pos == file_length)
             {
-                last_slept_at = now;
-                std::this_thread::sleep_for(SleepPerSecondDuringVerify);
+                ++file_index;
+                file_pos = 0;
             }
-
-            sha->clear();
-            ++piece;
-            tor->set_verify_progress(piece / float(tor->piece_count()));
-            piece_pos = 0;
         }
 
-        /* if we're finishing a file... */
-        if (left_in_file == 0)
+        if (abort)
         {
-            if (fd != TR_BAD_SYS_FILE)
-            {
-                tr_sys_file_close(fd);
-                fd = TR_BAD_SYS_FILE;
-            }
-
-            ++file_index;
-            file_pos = 0;
+            break;
         }
+
+        results.emplace_back(piece, sha->finish() == tor->piece_hash(piece));
+        sha->clear();
     }
 
     /* cleanup */
@@ -158,57 +162,153 @@ bool tr_verify_worker::verify_torrent(tr_torrent* tor, std::atomic<bool> const&
         tr_sys_file_close(fd);
     }
 
+    return results;
+}
+
+void tr_verify_worker::apply_results(Task& task, PieceResults const& results)
+{
+    auto* const tor = task.tor;
+
+    for (auto const& [piece, has_piece] : results)
+    {
+        if (auto const had_piece = tor->has_piece(piece); has_piece || had_piece)
+        {
+            tor->set_has_piece(piece, has_piece);
+            task.changed |= has_piece != had_piece;
+        }
+
+        tor->checked_pieces_.set(piece, true);
+    }
+
+    if (!std::empty(results))
+    {
+        tor->mark_changed();
+        task.n_pieces_done += std::size(results);
+        tor->set_verify_progress(task.n_pieces_done / float(tor->piece_count()));
+    }
+}
+
+tr_verify_worker::Task* tr_verify_worker::next_task()
+{
+    if (stopping_)
+    {
+        return nullptr;
+    }
+
+    // prefer the in-progress torrent with the fewest threads working on it
+    Task* task = nullptr;
+    for (auto& candidate : active_)
+    {
+        if (candidate.finishing || candidate.abort || candidate.next_piece >= candidate.tor->piece_count())
+        {
+            continue;
+        }
+
+        if (task == nullptr || candidate.n_threads < task->n_threads)
+        {
+            task = &candidate;
+        }
+    }
+
+    // if every in-progress torrent already has a thread, start the next one.
+    // this lets torrents on different disks get verified at the same time.
+    if ((task == nullptr || task->n_threads > 0U) && !std::empty(todo_))
+    {
+        auto const it = std::begin(todo_);
+        auto* const tor = it->torrent;
+        todo_.erase(it);
+
+        tr_logAddTraceTor(tor, "Verifying torrent");
+        tr_logAddDebugTor(tor, "verifying torrent...");
+        tor->set_verify_state(TR_VERIFY_NOW);
+        task = &active_.emplace_back(tor, tr_time());
+    }
+
+    return task;
+}
+
+void tr_verify_worker::finish_task(std::unique_lock<std::mutex>& lock, Task& task)
+{
+    TR_ASSERT(task.n_threads == 0U);
+    TR_ASSERT(!task.finishing);
+
+    task.finishing = true;
+    auto* const tor = task.tor;
+    auto const aborted = task.abort.load();
+
     /* stopwatch */
     time_t const end = tr_time();
     tr_logAddDebugTor(
         tor,
         fmt::format(
             "Verification is done. It took {} seconds to verify {} bytes ({} bytes per second)",
-            end - begin,
+            end - task.begin,
             tor->total_size(),
-            tor->total_size() / (1 + (end - begin))));
+            tor->total_size() / (1 + (end - task.begin))));
 
-    return changed;
+    tor->set_verify_state(TR_VERIFY_NONE);
+    TR_ASSERT(tr_isTorrent(tor));
+
+    if (!aborted && task.changed)
+    {
+        tor->set_dirty();
+    }
+
+    lock.unlock();
+    call_callback(tor, aborted);
+    lock.lock();
+
+    active_.remove_if([&task](auto const& candidate) { return &candidate == &task; });
+    verify_cv_.notify_all();
 }
 
 void tr_verify_worker::verify_thread_func()
 {
+    auto lock = std::unique_lock(verify_mutex_);
+
     for (;;)
     {
+        auto* const task = n_threads_ > max_threads_ ? nullptr : next_task();
+        if (task == nullptr)
         {
-            auto const lock = std::lock_guard(verify_mutex_);
-
-            if (stop_current_)
-            {
-                stop_current_ = false;
-                stop_current_cv_.notify_one();
-            }
-
-            if (std::empty(todo_))
-            {
-                current_node_.reset();
-                verify_thread_id_.reset();
-                return;
-            }
+            --n_threads_;
+            verify_cv_.notify_all();
+            return;
+        }
 
-            auto const it = std::begin(todo_);
-            current_node_ = *it;
-            todo_.erase(it);
+        // claim a run of pieces, but not so many that the other threads go idle
+        auto const* const tor = task->tor;
+        auto const max_bytes = std::min(MaxBytesPerClaim, tor->total_size() / max_threads_);
+        auto const begin = task->next_piece;
+        auto end = begin;
+        for (auto n_bytes = uint64_t{}; end < tor->piece_count() && (end == begin || n_bytes < max_bytes); ++end)
+        {
+            n_bytes += tor->piece_size(end);
         }
+        task->next_piece = end;
+        ++task->n_threads;
 
-        auto* const tor = current_node_->torrent;
-        tr_logAddTraceTor(tor, "Verifying torrent");
-        tor->set_verify_state(TR_VERIFY_NOW);
-        auto const changed = verify_torrent(tor, stop_current_);
-        tor->set_verify_state(TR_VERIFY_NONE);
-        TR_ASSERT(tr_isTorrent(tor));
+        lock.unlock();
+        auto const results = verify_pieces(tor, begin, end, task->abort);
+        lock.lock();
 
-        if (!stop_current_ && changed)
+        apply_results(*task, results);
+        --task->n_threads;
+
+        if (task->n_threads == 0U && (task->abort || task->n_pieces_done >= tor->piece_count()))
         {
-            tor->set_dirty();
+            finish_task(lock, *task);
         }
+    }
+}
 
-        call_callback(tor, stop_current_);
+void tr_verify_worker::start_threads_if_needed()
+{
+    // threads that don't find any work will exit on their own
+    while (!stopping_ && n_threads_ < max_threads_)
+    {
+        ++n_threads_;
+        std::thread(&tr_verify_worker::verify_thread_func, this).detach();
     }
 }
 
@@ -224,13 +324,7 @@ void tr_verify_worker::add(tr_torrent* tor)
     auto const lock = std::lock_guard(verify_mutex_);
     tor->set_verify_state(TR_VERIFY_WAIT);
     todo_.insert(node);
-
-    if (!verify_thread_id_)
-    {
-        auto thread = std::thread(&tr_verify_worker::verify_thread_func, this);
-        verify_thread_id_ = thread.get_id();
-        thread.detach();
-    }
+    start_threads_if_needed();
 }
 
 void tr_verify_worker::remove(tr_torrent* tor)
@@ -239,10 +333,32 @@ void tr_verify_worker::remove(tr_torrent* tor)
 
     auto lock = std::unique_lock(verify_mutex_);
 
-    if (current_node_ && current_node_->torrent == tor)
+    auto const is_active = [this, tor]()
+    {
+        return std::any_of(
+            std::begin(active_),
+            std::end(active_),
+            [tor](auto const& task) { return tor == task.tor; });
+    };
+
+    if (is_active())
     {
-        stop_current_ = true;
-        stop_current_cv_.wait(lock, [this]() { return !stop_current_; });
+        for (auto& task : active_)
+        {
+            if (task.tor == tor)
+            {
+                task.abort = true;
+
+                if (task.n_threads == 0U && !task.finishing)
+                {
+                    finish_task(lock, task);
+                }
+
+                break;
+            }
+        }
+
+        verify_cv_.wait(lock, [&is_active]() { return !is_active(); });
     }
     else
     {
@@ -261,16 +377,39 @@ void tr_verify_worker::remove(tr_torrent* tor)
     }
 }
 
+void tr_verify_worker::set_max_threads(size_t n_threads)
+{
+    auto const lock = std::lock_guard(verify_mutex_);
+
+    max_threads_ = std::max(n_threads, size_t{ 1U });
+
+    if (!std::empty(todo_) || !std::empty(active_))
+    {
+        start_threads_if_needed();
+    }
+}
+
+void tr_verify_worker::set_bytes_per_second(uint64_t bytes_per_second)
+{
+    bytes_per_second_ = bytes_per_second;
+}
+
 tr_verify_worker::~tr_verify_worker()
 {
+    auto lock = std::unique_lock(verify_mutex_);
+
+    stopping_ = true;
+    todo_.clear();
+    for (auto& task : active_)
     {
-        auto const lock = std::lock_guard(verify_mutex_);
-        stop_current_ = true;
-        todo_.clear();
+        task.abort = true;
     }
 
-    while (verify_thread_id_.has_value())
+    verify_cv_.wait(lock, [this]() { return n_threads_ == 0U; });
+
+    // finish any tasks that no thread was working on
+    while (!std::empty(active_))
     {
-        std::this_thread::sleep_for(20ms);
+        finish_task(lock, active_.front());
     }
 }
@@ -10,14 +10,19 @@
 #endif
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef> // size_t
 #include <cstdint>
+#include <ctime> // time_t
 #include <functional>
 #include <list>
 #include <mutex>
-#include <optional>
 #include <set>
-#include <thread>
+#include <utility>
+#include <vector>
+
+#include "libtransmission/transmission.h" // tr_piece_index_t
 
 struct tr_session;
 struct tr_torrent;
@@ -38,6 +43,15 @@ public:
 
     void remove(tr_torrent* tor);
 
+    // The max number of threads hashing pieces at the same time.
+    // Idle threads start on the next queued torrent if there is one;
+    // otherwise they help with pieces of torrents already being verified.
+    void set_max_threads(size_t n_threads);
+
+    // The max number of bytes per second that all the verify threads,
+    // combined, may read from disk. Zero means unlimited.
+    void set_bytes_per_second(uint64_t bytes_per_second);
+
 private:
     struct Node
     {
@@ -52,6 +66,30 @@ private:
         }
     };
 
+    // a torrent that is being verified right now
+    struct Task
+    {
+        explicit Task(tr_torrent* tor_in, time_t begin_in) noexcept
+            : tor{ tor_in }
+            , begin{ begin_in }
+        {
+        }
+
+        tr_torrent* const tor;
+        time_t const begin;
+
+        // the first piece that hasn't been claimed by a thread yet
+        tr_piece_index_t next_piece = 0;
+
+        tr_piece_index_t n_pieces_done = 0;
+        size_t n_threads = 0;
+        bool changed = false;
+        bool finishing = false;
+        std::atomic<bool> abort = false;
+    };
+
+    using PieceResults = std::vector<std::pair<tr_piece_index_t, bool /*hash_matched*/>>;
+
     void call_callback(tr_torrent* tor, bool aborted) const
     {
         for (auto const& callback : callbacks_)
@@ -61,16 +99,29 @@ private:
     }
 
     void verify_thread_func();
-    [[nodiscard]] static bool verify_torrent(tr_torrent* tor, std::atomic<bool> const& stop_flag);
+    void start_threads_if_needed();
+    [[nodiscard]] Task* next_task();
+    void finish_task(std::unique_lock<std::mutex>& lock, Task& task);
+    void apply_results(Task& task, PieceResults const& results);
+    [[nodiscard]] PieceResults verify_pieces(
+        tr_torrent const* tor,
+        tr_piece_index_t begin,
+        tr_piece_index_t end,
+        std::atomic<bool> const& abort);
+    void wait_for_io_budget(uint64_t n_bytes, std::atomic<bool> const& abort);
 
     std::list<callback_func> callbacks_;
     std::mutex verify_mutex_;
+    std::condition_variable verify_cv_;
 
     std::set<Node> todo_;
-    std::optional<Node> current_node_;
+    std::list<Task> active_;
 
-    std::optional<std::thread::id> verify_thread_id_;
+    size_t max_threads_ = 1U;
+    size_t n_threads_ = 0U;
+    bool stopping_ = false;
 
-    std::atomic<bool> stop_current_ = false;
-    std::condition_variable stop_current_cv_;
+    std::atomic<uint64_t> bytes_per_second_ = 0U;
+    std::mutex io_budget_mutex_;
+    std::chrono::steady_clock::time_point io_budget_next_read_at_ = {};
 };
@@ -275,9 +275,9 @@ void RpcClient::networkRequestFinished(QNetworkReply* reply)
         auto const json_data = reply->readAll().trimmed();
         auto const json = createVariant();
         RpcResponse result;
-        if (tr_variantFromBuf(json.get(), TR_VARIANT_PARSE_JSON, json_data))
+        if (tr_variantFromBuf(json.get(), TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_ARENA, json_data))
         {
-            result = parseResponseData(*json);
+            result = parseResponseData(json);
         }
 
         promise.setProgressValue(1);
@@ -289,7 +289,7 @@ void RpcClient::localRequestFinished(TrVariantPtr response)
 {
     if (auto node = local_requests_.extract(parseResponseTag(*response)); node)
     {
-        auto const result = parseResponseData(*response);
+        auto const result = parseResponseData(response);
 
         auto& promise = node.mapped();
         promise.setProgressRange(0, 1);
@@ -303,21 +303,21 @@ int64_t RpcClient::parseResponseTag(tr_variant& response) const
     return dictFind<int>(&response, TR_KEY_tag).value_or(-1);
 }
 
-RpcResponse RpcClient::parseResponseData(tr_variant& response) const
+RpcResponse RpcClient::parseResponseData(TrVariantPtr const& response) const
 {
     RpcResponse ret;
 
-    if (auto const result = dictFind<QString>(&response, TR_KEY_result); result)
+    if (auto const result = dictFind<QString>(response.get(), TR_KEY_result); result)
     {
         ret.result = *result;
         ret.success = *result == QStringLiteral("success");
     }
 
-    if (tr_variant* args = nullptr; tr_variantDictFindDict(&response, TR_KEY_arguments, &args))
+    // share ownership with `response` instead of moving `args` out of it:
+    // the response may be arena-backed, so its children can't outlive it
+    if (tr_variant* args = nullptr; tr_variantDictFindDict(response.get(), TR_KEY_arguments, &args))
     {
-        ret.args = createVariant();
-        *ret.args = *args;
-        variantInit(args, false);
+        ret.args = TrVariantPtr{ response, args };
     }
 
     return ret;
@@ -83,7 +83,7 @@ private:
     void sendNetworkRequest(TrVariantPtr json, QFutureInterface<RpcResponse> const& promise);
     void sendLocalRequest(TrVariantPtr json, QFutureInterface<RpcResponse> const& promise, int64_t tag);
     [[nodiscard]] int64_t parseResponseTag(tr_variant& response) const;
-    [[nodiscard]] RpcResponse parseResponseData(tr_variant& response) const;
+    [[nodiscard]] RpcResponse parseResponseData(TrVariantPtr const& response) const;
 
     static void localSessionCallback(tr_session* s, tr_variant* response, void* vself) noexcept;
 
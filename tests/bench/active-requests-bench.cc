@@ -0,0 +1,87 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // size_t
+#include <cstdint> // uintptr_t
+#include <ctime> // time_t
+
+#define LIBTRANSMISSION_PEER_MODULE
+
+#include <benchmark/benchmark.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/peer-mgr-active-requests.h>
+
+class tr_peer;
+
+namespace
+{
+
+auto constexpr RequestsPerPeer = tr_block_index_t{ 250U };
+
+[[nodiscard]] tr_peer* makePeer(size_t i)
+{
+    return reinterpret_cast<tr_peer*>(uintptr_t{ 0x1000U } + i * 16U);
+}
+
+// `n_peers` peers with `RequestsPerPeer` requests each,
+// sent over the course of `n_peers` seconds
+void fill(ActiveRequests& requests, size_t n_peers)
+{
+    for (size_t i = 0; i < n_peers; ++i)
+    {
+        auto const first_block = static_cast<tr_block_index_t>(i * RequestsPerPeer);
+        for (tr_block_index_t block = first_block; block < first_block + RequestsPerPeer; ++block)
+        {
+            requests.add(block, makePeer(i), static_cast<time_t>(i));
+        }
+    }
+}
+
+// A peer disconnects and a new peer takes over its requests
+void BM_ActiveRequestsPeerChurn(benchmark::State& state)
+{
+    auto const n_peers = static_cast<size_t>(state.range(0));
+    auto requests = ActiveRequests{};
+    fill(requests, n_peers);
+
+    auto next_peer = n_peers;
+    auto victim = size_t{};
+    for (auto _ : state)
+    {
+        auto const blocks = requests.remove(makePeer(victim));
+        auto* const replacement = makePeer(next_peer);
+        for (auto const block : blocks)
+        {
+            requests.add(block, replacement, static_cast<time_t>(next_peer));
+        }
+
+        victim = next_peer - n_peers + 1U;
+        ++next_peer;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Find the few requests that have timed out
+void BM_ActiveRequestsSentBefore(benchmark::State& state)
+{
+    auto const n_peers = static_cast<size_t>(state.range(0));
+    auto requests = ActiveRequests{};
+    fill(requests, n_peers);
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(requests.sentBefore(time_t{ 1 }));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+} // namespace
+
+BENCHMARK(BM_ActiveRequestsPeerChurn)->RangeMultiplier(4)->Range(16, 1024);
+BENCHMARK(BM_ActiveRequestsSentBefore)->RangeMultiplier(4)->Range(16, 1024);
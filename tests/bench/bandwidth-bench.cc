@@ -0,0 +1,296 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/bandwidth.h>
+
+namespace
+{
+
+// A peer-io with an endless supply of data to send or receive,
+// on a socket that can move `SocketBytesPerTick` bytes per tick.
+class FakePeer final : public tr_bandwidth::Peer
+{
+public:
+    static auto constexpr SocketBytesPerTick = size_t{ 16384U };
+
+    FakePeer(tr_bandwidth* parent, uint64_t const& now)
+        : bandwidth_{ parent }
+        , now_{ now }
+    {
+    }
+
+    // queue up `n_bytes` more to transfer and ask for bandwidth
+    void want(tr_direction dir, size_t n_bytes)
+    {
+        backlog_[dir] += n_bytes;
+        bandwidth_.notify_bandwidth_wanted(dir);
+    }
+
+    // on-demand I/O, like tr_peerIo's libevent callbacks
+    void tick(tr_direction dir)
+    {
+        if (!is_enabled_[dir])
+        {
+            return;
+        }
+
+        auto const n_wanted = std::min(SocketBytesPerTick, backlog_[dir]);
+        if (transfer(dir, n_wanted) == 0U)
+        {
+            is_enabled_[dir] = false;
+
+            if (n_wanted != 0U)
+            {
+                bandwidth_.notify_bandwidth_wanted(dir);
+            }
+        }
+    }
+
+    size_t flush(tr_direction dir, size_t byte_limit) override
+    {
+        return transfer(dir, std::min(byte_limit, backlog_[dir]));
+    }
+
+    size_t flush_outgoing_protocol_msgs() override
+    {
+        return {};
+    }
+
+    void set_enabled(tr_direction dir, bool is_enabled) override
+    {
+        is_enabled_[dir] = is_enabled;
+    }
+
+    [[nodiscard]] bool has_bandwidth_left(tr_direction dir) const noexcept override
+    {
+        return bandwidth_.clamp(now_, dir, 1024U) > 0U;
+    }
+
+    [[nodiscard]] constexpr auto& bandwidth() noexcept
+    {
+        return bandwidth_;
+    }
+
+    [[nodiscard]] constexpr auto n_transferred(tr_direction dir) const noexcept
+    {
+        return n_transferred_[dir];
+    }
+
+private:
+    size_t transfer(tr_direction dir, size_t n_bytes)
+    {
+        n_bytes = bandwidth_.clamp(now_, dir, n_bytes);
+
+        if (n_bytes != 0U)
+        {
+            backlog_[dir] -= n_bytes;
+            n_transferred_[dir] += n_bytes;
+            bandwidth_.notify_bandwidth_consumed(dir, n_bytes, true, now_);
+        }
+
+        return n_bytes;
+    }
+
+    tr_bandwidth bandwidth_;
+    uint64_t const& now_;
+    std::array<size_t, 2> backlog_ = {};
+    std::array<uint64_t, 2> n_transferred_ = {};
+    std::array<bool, 2> is_enabled_ = {};
+};
+
+// The same shape as a session's bandwidth tree: one session-wide root,
+// one node per torrent, and one leaf per peer under its torrent.
+class BandwidthTree
+{
+public:
+    static auto constexpr UpLimit = size_t{ 10U * 1024U * 1024U };
+    static auto constexpr DownLimit = size_t{ 50U * 1024U * 1024U };
+
+    BandwidthTree(size_t n_torrents, size_t n_peers_per_torrent)
+    {
+        root_.set_limited(TR_UP, true);
+        root_.set_limited(TR_DOWN, true);
+        root_.set_desired_speed_bytes_per_second(TR_UP, UpLimit);
+        root_.set_desired_speed_bytes_per_second(TR_DOWN, DownLimit);
+
+        torrents_.reserve(n_torrents);
+        peers_.reserve(n_torrents * n_peers_per_torrent);
+        for (size_t i = 0; i < n_torrents; ++i)
+        {
+            auto& tor = torrents_.emplace_back(std::make_unique<tr_bandwidth>(&root_));
+            tor->set_priority(static_cast<tr_priority_t>(static_cast<int>(i % 3U) - 1));
+
+            for (size_t j = 0; j < n_peers_per_torrent; ++j)
+            {
+                auto& peer = peers_.emplace_back(std::make_shared<FakePeer>(tor.get(), now_));
+                peer->bandwidth().set_peer(peer);
+            }
+        }
+    }
+
+    ~BandwidthTree()
+    {
+        // children must go before their parents
+        peers_.clear();
+        torrents_.clear();
+    }
+
+    BandwidthTree(BandwidthTree&&) = delete;
+    BandwidthTree(BandwidthTree const&) = delete;
+    BandwidthTree& operator=(BandwidthTree&&) = delete;
+    BandwidthTree& operator=(BandwidthTree const&) = delete;
+
+    [[nodiscard]] auto& root() noexcept
+    {
+        return root_;
+    }
+
+    [[nodiscard]] auto const& peers() const noexcept
+    {
+        return peers_;
+    }
+
+    [[nodiscard]] auto const& torrents() const noexcept
+    {
+        return torrents_;
+    }
+
+    // the virtual clock that the peers use
+    uint64_t now_ = 1000000U;
+
+private:
+    tr_bandwidth root_;
+    std::vector<std::unique_ptr<tr_bandwidth>> torrents_;
+    std::vector<std::shared_ptr<FakePeer>> peers_;
+};
+
+// one bandwidth pulse's allocation pass, with one peer in twenty busy
+void BM_BandwidthAllocate(benchmark::State& state)
+{
+    static auto constexpr ActiveRatio = size_t{ 20U };
+
+    auto tree = BandwidthTree{ static_cast<size_t>(state.range(0)), static_cast<size_t>(state.range(1)) };
+    auto const& peers = tree.peers();
+    auto offset = size_t{};
+
+    // lift the speed limits so that every busy peer finishes its backlog
+    // and the waiting list doesn't grow from one pulse to the next
+    tree.root().set_limited(TR_UP, false);
+    tree.root().set_limited(TR_DOWN, false);
+
+    for (auto _ : state)
+    {
+        for (size_t i = offset; i < std::size(peers); i += ActiveRatio)
+        {
+            peers[i]->want(TR_UP, FakePeer::SocketBytesPerTick);
+            peers[i]->want(TR_DOWN, FakePeer::SocketBytesPerTick);
+        }
+
+        offset = (offset + 1U) % ActiveRatio;
+        tree.now_ += 500U;
+        tree.root().allocate(tree.now_);
+    }
+
+    state.SetItemsProcessed(state.iterations() * std::size(peers));
+}
+
+// Simulate one second of uploading with every peer busy, in 10 msec ticks
+// with a bandwidth pulse every 500 msec. The peers do on-demand I/O in
+// between pulses, the way that libevent drives tr_peerIo.
+//
+// `accuracy` is the upload speed divided by the speed limit.
+// `fairness` is Jain's fairness index of each peer's upload speed
+// divided by its priority's share: 1.0 is perfectly fair.
+void BM_BandwidthSimulate(benchmark::State& state)
+{
+    static auto constexpr TickMSec = uint64_t{ 10U };
+    static auto constexpr PulseMSec = uint64_t{ 500U };
+    static auto constexpr SimMSec = uint64_t{ 1000U };
+
+    auto tree = BandwidthTree{ static_cast<size_t>(state.range(0)), static_cast<size_t>(state.range(1)) };
+    auto const& peers = tree.peers();
+    auto const n_peers_per_torrent = std::size(peers) / std::size(tree.torrents());
+    auto const start_msec = tree.now_;
+    auto start = size_t{};
+
+    for (auto _ : state)
+    {
+        for (uint64_t msec = 0; msec < SimMSec; msec += TickMSec)
+        {
+            if (msec % PulseMSec == 0U)
+            {
+                for (auto const& peer : peers)
+                {
+                    peer->want(TR_UP, PulseMSec / TickMSec * FakePeer::SocketBytesPerTick);
+                }
+
+                tree.root().allocate(tree.now_);
+            }
+
+            // rotate who goes first, since libevent doesn't promise an order
+            for (size_t i = 0; i < std::size(peers); ++i)
+            {
+                peers[(start + i) % std::size(peers)]->tick(TR_UP);
+            }
+
+            start = (start + 7919U) % std::size(peers);
+            tree.now_ += TickMSec;
+        }
+    }
+
+    auto total = double{};
+    auto sum = double{};
+    auto sum_squares = double{};
+    for (size_t i = 0; i < std::size(peers); ++i)
+    {
+        auto const priority = tree.torrents()[i / n_peers_per_torrent]->get_priority();
+        auto const bytes = static_cast<double>(peers[i]->n_transferred(TR_UP));
+        auto const share = bytes / (priority == TR_PRI_HIGH ? 3.0 : 2.0);
+        total += bytes;
+        sum += share;
+        sum_squares += share * share;
+    }
+
+    auto const seconds = static_cast<double>(tree.now_ - start_msec) / 1000.0;
+    state.counters["accuracy"] = total / seconds / BandwidthTree::UpLimit;
+    state.counters["fairness"] = sum * sum / (static_cast<double>(std::size(peers)) * sum_squares);
+    state.SetItemsProcessed(state.iterations() * std::size(peers));
+}
+
+// every peer reports a 16 KiB block read, which updates each ancestor's history too
+void BM_BandwidthNotifyConsumed(benchmark::State& state)
+{
+    auto tree = BandwidthTree{ static_cast<size_t>(state.range(0)), static_cast<size_t>(state.range(1)) };
+    auto now = uint64_t{ 1000000U };
+
+    for (auto _ : state)
+    {
+        for (auto const& peer : tree.peers())
+        {
+            peer->bandwidth().notify_bandwidth_consumed(TR_DOWN, 16384U, true, now);
+        }
+        now += 50U;
+    }
+
+    state.SetItemsProcessed(state.iterations() * std::size(tree.peers()));
+}
+
+} // namespace
+
+// {torrents, peers per torrent}
+BENCHMARK(BM_BandwidthAllocate)->ArgsProduct({ { 100, 1000, 5000 }, { 10, 50 } });
+BENCHMARK(BM_BandwidthSimulate)->ArgsProduct({ { 10, 100 }, { 10, 50 } })->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_BandwidthNotifyConsumed)->ArgsProduct({ { 100, 1000, 5000 }, { 10, 50 } });
@@ -0,0 +1,80 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#include <cstdlib> // getenv()
+#include <string>
+#include <string_view>
+
+#include <fmt/core.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/file.h>
+#include <libtransmission/log.h>
+#include <libtransmission/quark.h>
+#include <libtransmission/variant.h>
+
+namespace libtransmission::bench
+{
+
+// A new directory in $TMPDIR, removed along with everything in it when this is destroyed
+class ScratchDir
+{
+public:
+    ScratchDir()
+        : path_{ fmt::format("{:s}/transmission-bench-XXXXXX", getenv("TMPDIR") != nullptr ? getenv("TMPDIR") : "/tmp") }
+    {
+        tr_sys_dir_create_temp(std::data(path_));
+    }
+
+    ~ScratchDir()
+    {
+        removeRecursive(path_);
+    }
+
+    ScratchDir(ScratchDir&&) = delete;
+    ScratchDir(ScratchDir const&) = delete;
+    ScratchDir& operator=(ScratchDir&&) = delete;
+    ScratchDir& operator=(ScratchDir const&) = delete;
+
+    [[nodiscard]] constexpr auto const& path() const noexcept
+    {
+        return path_;
+    }
+
+private:
+    static void removeRecursive(std::string const& path)
+    {
+        if (auto const info = tr_sys_path_get_info(path); info && info->isFolder())
+        {
+            for (auto const& name : tr_sys_dir_get_files(path, [](std::string_view) { return true; }))
+            {
+                removeRecursive(fmt::format("{:s}/{:s}", path, name));
+            }
+        }
+
+        tr_sys_path_remove(path);
+    }
+
+    std::string path_;
+};
+
+// Settings for a session that stays off the network and only logs errors.
+// Benchmarks can add their own settings before calling tr_sessionInit().
+[[nodiscard]] inline tr_variant sessionSettings()
+{
+    auto settings = tr_variant{};
+    tr_variantInitDict(&settings, 6);
+    tr_variantDictAddBool(&settings, TR_KEY_dht_enabled, false);
+    tr_variantDictAddBool(&settings, TR_KEY_lpd_enabled, false);
+    tr_variantDictAddBool(&settings, TR_KEY_port_forwarding_enabled, false);
+    tr_variantDictAddBool(&settings, TR_KEY_utp_enabled, false);
+    tr_variantDictAddInt(&settings, TR_KEY_message_level, TR_LOG_ERROR);
+    return settings;
+}
+
+} // namespace libtransmission::bench
@@ -0,0 +1,133 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // size_t
+
+#include <benchmark/benchmark.h>
+
+#include <libtransmission/bitfield.h>
+
+namespace
+{
+
+// a bitfield of `n_bits` with every `stride`th bit set
+tr_bitfield makeBitfield(size_t n_bits, size_t stride)
+{
+    auto bitfield = tr_bitfield{ n_bits };
+    for (size_t i = 0; i < n_bits; i += stride)
+    {
+        bitfield.set(i);
+    }
+    return bitfield;
+}
+
+void BM_BitfieldCount(benchmark::State& state)
+{
+    auto const n_bits = static_cast<size_t>(state.range(0));
+    auto const bitfield = makeBitfield(n_bits, 3U);
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(bitfield.count(0, n_bits));
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_BitfieldOr(benchmark::State& state)
+{
+    auto const n_bits = static_cast<size_t>(state.range(0));
+    auto const that = makeBitfield(n_bits, 5U);
+
+    for (auto _ : state)
+    {
+        auto bitfield = makeBitfield(n_bits, 7U);
+        bitfield |= that;
+        benchmark::DoNotOptimize(bitfield.count());
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_BitfieldAndNot(benchmark::State& state)
+{
+    auto const n_bits = static_cast<size_t>(state.range(0));
+    auto const that = makeBitfield(n_bits, 5U);
+
+    for (auto _ : state)
+    {
+        auto bitfield = makeBitfield(n_bits, 7U);
+        bitfield.and_not(that);
+        benchmark::DoNotOptimize(bitfield.count());
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_BitfieldIntersects(benchmark::State& state)
+{
+    auto const n_bits = static_cast<size_t>(state.range(0));
+    auto const lhs = makeBitfield(n_bits, 2U);
+    auto rhs = tr_bitfield{ n_bits };
+    rhs.set(n_bits - 1U); // worst case: the only overlap is at the end
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(lhs.intersects(rhs));
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_BitfieldFindNextSet(benchmark::State& state)
+{
+    auto const n_bits = static_cast<size_t>(state.range(0));
+    auto const bitfield = makeBitfield(n_bits, 4096U);
+
+    for (auto _ : state)
+    {
+        auto n_found = size_t{};
+        for (auto i = bitfield.find_next_set(0U); i < n_bits; i = bitfield.find_next_set(i + 1U))
+        {
+            ++n_found;
+        }
+        benchmark::DoNotOptimize(n_found);
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// e.g. walking the few pieces that a nearly-complete torrent is missing
+void BM_BitfieldFindNextUnset(benchmark::State& state)
+{
+    auto const n_bits = static_cast<size_t>(state.range(0));
+    auto bitfield = tr_bitfield{ n_bits };
+    bitfield.set_has_all();
+    for (size_t i = 0; i < n_bits; i += 1000U)
+    {
+        bitfield.unset(i);
+    }
+
+    for (auto _ : state)
+    {
+        auto n_found = size_t{};
+        for (auto i = bitfield.find_next_unset(0U); i < n_bits; i = bitfield.find_next_unset(i + 1U))
+        {
+            ++n_found;
+        }
+        benchmark::DoNotOptimize(n_found);
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+} // namespace
+
+BENCHMARK(BM_BitfieldCount)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK(BM_BitfieldOr)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK(BM_BitfieldAndNot)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK(BM_BitfieldIntersects)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK(BM_BitfieldFindNextSet)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK(BM_BitfieldFindNextUnset)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
@@ -0,0 +1,146 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // size_t
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <fmt/core.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/blocklist.h>
+#include <libtransmission/net.h>
+#include <libtransmission/tr-strbuf.h>
+#include <libtransmission/utils.h>
+
+#include "bench-fixtures.h"
+
+using namespace std::literals;
+using namespace libtransmission::bench;
+using Blocklist = libtransmission::Blocklist;
+
+namespace
+{
+
+auto constexpr NumLookups = size_t{ 4096U };
+
+[[nodiscard]] tr_address makeIpv4(uint32_t n)
+{
+    auto const str = fmt::format("{:d}.{:d}.{:d}.{:d}", n >> 24U, (n >> 16U) & 0xFFU, (n >> 8U) & 0xFFU, n & 0xFFU);
+    return *tr_address::from_string(str);
+}
+
+[[nodiscard]] tr_address makeIpv6(uint32_t n)
+{
+    auto const str = fmt::format("2001:db8:{:x}:{:x}::", n >> 16U, n & 0xFFFFU);
+    return *tr_address::from_string(str);
+}
+
+// A scratch directory holding a blocklist with `n_ranges` IPv4 ranges and
+// as many IPv6 ranges, spread evenly across the address space
+class BlocklistDir
+{
+public:
+    explicit BlocklistDir(size_t n_ranges)
+    {
+        auto rng = std::mt19937{ 1234U };
+        auto contents = std::string{};
+        auto const stride = static_cast<uint32_t>(0x100000000ULL / n_ranges);
+        for (size_t i = 0; i < n_ranges; ++i)
+        {
+            auto const low = static_cast<uint32_t>(i * stride + rng() % (stride / 2U));
+            auto const high = low + rng() % (stride / 2U);
+            contents += fmt::format("v4 {:d}:{:s}-{:s}\n", i, makeIpv4(low).display_name(), makeIpv4(high).display_name());
+            contents += fmt::format("v6 {:d}:{:s}-{:s}\n", i, makeIpv6(low).display_name(), makeIpv6(high).display_name());
+        }
+        tr_file_save(external_file(), contents);
+
+        Blocklist::saveNew(external_file(), bin_file(), true);
+
+        for (size_t i = 0; i < NumLookups; ++i)
+        {
+            ipv4_lookups_.emplace_back(makeIpv4(static_cast<uint32_t>(rng())));
+            ipv6_lookups_.emplace_back(makeIpv6(static_cast<uint32_t>(rng())));
+        }
+    }
+
+    [[nodiscard]] tr_pathbuf external_file() const
+    {
+        return tr_pathbuf{ dir_.path(), "/external"sv };
+    }
+
+    [[nodiscard]] tr_pathbuf bin_file() const
+    {
+        return tr_pathbuf{ dir_.path(), "/level1.bin"sv };
+    }
+
+    [[nodiscard]] constexpr auto const& ipv4_lookups() const noexcept
+    {
+        return ipv4_lookups_;
+    }
+
+    [[nodiscard]] constexpr auto const& ipv6_lookups() const noexcept
+    {
+        return ipv6_lookups_;
+    }
+
+private:
+    ScratchDir const dir_;
+    std::vector<tr_address> ipv4_lookups_;
+    std::vector<tr_address> ipv6_lookups_;
+};
+
+void BM_BlocklistLoad(benchmark::State& state)
+{
+    auto const dir = BlocklistDir{ static_cast<size_t>(state.range(0)) };
+    auto const& lookups = dir.ipv4_lookups();
+
+    for (auto _ : state)
+    {
+        // includes mapping the .bin file and the first lookup
+        auto const blocklist = Blocklist{ dir.bin_file(), true };
+        benchmark::DoNotOptimize(blocklist.contains(lookups.front()));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_BlocklistContains(benchmark::State& state, bool ipv6)
+{
+    auto const dir = BlocklistDir{ static_cast<size_t>(state.range(0)) };
+    auto const& lookups = ipv6 ? dir.ipv6_lookups() : dir.ipv4_lookups();
+    auto const blocklist = Blocklist{ dir.bin_file(), true };
+
+    auto i = size_t{};
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(blocklist.contains(lookups[i++ % NumLookups]));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_BlocklistContainsIpv4(benchmark::State& state)
+{
+    BM_BlocklistContains(state, false);
+}
+
+void BM_BlocklistContainsIpv6(benchmark::State& state)
+{
+    BM_BlocklistContains(state, true);
+}
+
+} // namespace
+
+BENCHMARK(BM_BlocklistLoad)->RangeMultiplier(10)->Range(1000, 100000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_BlocklistContainsIpv4)->RangeMultiplier(10)->Range(1000, 100000);
+BENCHMARK(BM_BlocklistContainsIpv6)->RangeMultiplier(10)->Range(1000, 100000);
@@ -0,0 +1,143 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <array>
+#include <cstddef> // size_t, std::byte
+#include <cstdint> // int64_t
+#include <limits>
+#include <memory>
+#include <ratio>
+#include <vector>
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#endif
+
+#include <event2/util.h>
+
+#include <benchmark/benchmark.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/block-info.h>
+#include <libtransmission/net.h>
+#include <libtransmission/tr-buffer.h>
+
+#ifdef _WIN32
+#define LOCAL_SOCKETPAIR_AF AF_INET
+#else
+#define LOCAL_SOCKETPAIR_AF AF_UNIX
+#endif
+
+namespace
+{
+
+// the header of a 'piece' message: length, type, index, offset
+auto constexpr HeaderSize = size_t{ 13U };
+
+// how many 'piece' messages to queue per iteration
+auto constexpr PiecesPerIteration = size_t{ 16U };
+
+// A non-blocking, connected pair of stream sockets
+class SocketPair
+{
+public:
+    SocketPair()
+    {
+        evutil_socketpair(LOCAL_SOCKETPAIR_AF, SOCK_STREAM, 0, std::data(socks_));
+        evutil_make_socket_nonblocking(socks_[0]);
+        evutil_make_socket_nonblocking(socks_[1]);
+    }
+
+    ~SocketPair()
+    {
+        tr_net_close_socket(socks_[0]);
+        tr_net_close_socket(socks_[1]);
+    }
+
+    SocketPair(SocketPair&&) = delete;
+    SocketPair(SocketPair const&) = delete;
+    SocketPair& operator=(SocketPair&&) = delete;
+    SocketPair& operator=(SocketPair const&) = delete;
+
+    [[nodiscard]] constexpr auto sender() const noexcept
+    {
+        return socks_[0];
+    }
+
+    // read and discard everything that's waiting to be received
+    void drain_receiver()
+    {
+        while (recv(socks_[1], std::data(sink_), std::size(sink_), 0) > 0)
+        {
+        }
+    }
+
+private:
+    std::array<evutil_socket_t, 2> socks_ = { -1, -1 };
+    std::array<char, 64U * 1024U> sink_ = {};
+};
+
+// Send everything in `buf` through `sockets`
+template<typename Buffer>
+void send_all(Buffer& buf, SocketPair& sockets)
+{
+    while (!std::empty(buf))
+    {
+        buf.to_socket(sockets.sender(), std::numeric_limits<size_t>::max());
+        sockets.drain_receiver();
+    }
+}
+
+// The blocks are copied into one contiguous buffer, as tr_peerIo used to do
+void BM_OutbufCopied(benchmark::State& state)
+{
+    auto sockets = SocketPair{};
+    auto const header = std::array<std::byte, HeaderSize>{};
+    auto const block = std::make_shared<std::vector<std::byte> const>(tr_block_info::BlockSize, std::byte{ 'x' });
+    auto buf = libtransmission::StackBuffer<tr_block_info::BlockSize + 16U, std::byte, std::ratio<5, 1>>{};
+
+    for (auto _ : state)
+    {
+        for (size_t i = 0; i < PiecesPerIteration; ++i)
+        {
+            buf.add(header);
+            buf.add(*block);
+        }
+
+        send_all(buf, sockets);
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * PiecesPerIteration * tr_block_info::BlockSize));
+}
+
+// The blocks are referenced by a ChainBuffer and sent with scatter/gather I/O
+void BM_OutbufShared(benchmark::State& state)
+{
+    auto sockets = SocketPair{};
+    auto const header = std::array<std::byte, HeaderSize>{};
+    auto const block = std::make_shared<std::vector<std::byte> const>(tr_block_info::BlockSize, std::byte{ 'x' });
+    auto buf = libtransmission::ChainBuffer{};
+
+    for (auto _ : state)
+    {
+        for (size_t i = 0; i < PiecesPerIteration; ++i)
+        {
+            buf.add(header);
+            buf.add_shared(block, std::data(*block), std::size(*block));
+        }
+
+        send_all(buf, sockets);
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * PiecesPerIteration * tr_block_info::BlockSize));
+}
+
+} // namespace
+
+BENCHMARK(BM_OutbufCopied);
+BENCHMARK(BM_OutbufShared);
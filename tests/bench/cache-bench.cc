@@ -0,0 +1,104 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cstddef> // size_t
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/block-info.h>
+#include <libtransmission/cache.h>
+#include <libtransmission/torrents.h>
+
+namespace
+{
+
+// The order that blocks arrive in when many peers are each downloading
+// a run of consecutive blocks in many torrents at the same time.
+auto makeArrivals(size_t n_torrents, size_t n_blocks_per_torrent)
+{
+    auto arrivals = std::vector<std::pair<tr_torrent_id_t, tr_block_index_t>>{};
+    arrivals.reserve(n_torrents * n_blocks_per_torrent);
+
+    static auto constexpr RunLength = tr_block_index_t{ 16U };
+    auto runs = std::vector<std::pair<tr_torrent_id_t, tr_block_index_t>>{};
+    for (size_t tor = 0; tor < n_torrents; ++tor)
+    {
+        for (tr_block_index_t begin = 0; begin < n_blocks_per_torrent; begin += RunLength)
+        {
+            runs.emplace_back(static_cast<tr_torrent_id_t>(tor + 1U), begin);
+        }
+    }
+
+    auto rng = std::mt19937{ 1U }; // fixed seed for repeatable runs
+    std::shuffle(std::begin(runs), std::end(runs), rng);
+
+    // interleave the runs the way that concurrent peers would
+    static auto constexpr NumPeers = size_t{ 64U };
+    for (size_t base = 0; base < std::size(runs); base += NumPeers)
+    {
+        auto const end = std::min(base + NumPeers, std::size(runs));
+        for (tr_block_index_t offset = 0; offset < RunLength; ++offset)
+        {
+            for (auto i = base; i < end; ++i)
+            {
+                if (auto const block = runs[i].second + offset; block < n_blocks_per_torrent)
+                {
+                    arrivals.emplace_back(runs[i].first, block);
+                }
+            }
+        }
+    }
+
+    return arrivals;
+}
+
+void BM_CacheWriteBlock(benchmark::State& state)
+{
+    auto const n_torrents = static_cast<size_t>(state.range(0));
+    auto const n_blocks_per_torrent = static_cast<size_t>(state.range(1));
+    auto const arrivals = makeArrivals(n_torrents, n_blocks_per_torrent);
+
+    // Big enough that nothing gets flushed. This measures the cache's
+    // own bookkeeping; flushing would only add the cost of disk I/O.
+    auto const max_bytes = (std::size(arrivals) + 1U) * tr_block_info::BlockSize;
+    auto torrents = tr_torrents{};
+
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        auto cache = std::make_unique<Cache>(torrents, max_bytes);
+        auto blocks = std::vector<std::unique_ptr<Cache::BlockData>>{};
+        blocks.reserve(std::size(arrivals));
+        for (size_t i = 0, n = std::size(arrivals); i < n; ++i)
+        {
+            blocks.emplace_back(std::make_unique<Cache::BlockData>(tr_block_info::BlockSize));
+        }
+        state.ResumeTiming();
+
+        for (size_t i = 0, n = std::size(arrivals); i < n; ++i)
+        {
+            auto const [tor_id, block] = arrivals[i];
+            benchmark::DoNotOptimize(cache->write_block(tor_id, block, std::move(blocks[i])));
+        }
+
+        state.PauseTiming();
+        cache.reset();
+        state.ResumeTiming();
+    }
+
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(std::size(arrivals)));
+}
+
+} // namespace
+
+// {torrents, blocks per torrent}
+BENCHMARK(BM_CacheWriteBlock)->ArgsProduct({ { 10, 100, 1000 }, { 16, 32 } })->Unit(benchmark::kMillisecond);
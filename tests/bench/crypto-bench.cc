@@ -0,0 +1,83 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // std::byte, size_t
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/crypto-utils.h>
+#include <libtransmission/peer-mse.h>
+
+namespace
+{
+
+using tr_message_stream_encryption::DH;
+using tr_message_stream_encryption::Filter;
+
+auto constexpr InfoHash = tr_sha1_digest_t{ std::byte{ 0x1A }, std::byte{ 0x2B }, std::byte{ 0x3C } };
+
+// a Filter that's ready to encrypt and decrypt, keyed the same way as in a real handshake
+Filter makeFilter()
+{
+    auto a_dh = DH{};
+    auto b_dh = DH{};
+    a_dh.setPeerPublicKey(b_dh.publicKey());
+
+    auto filter = Filter{};
+    filter.encrypt_init(false, a_dh, InfoHash);
+    filter.decrypt_init(false, a_dh, InfoHash);
+    return filter;
+}
+
+void BM_MseEncrypt(benchmark::State& state)
+{
+    auto const n_bytes = static_cast<size_t>(state.range(0));
+    auto filter = makeFilter();
+    auto buf = std::vector<std::byte>(n_bytes);
+    tr_rand_buffer(std::data(buf), std::size(buf));
+
+    for (auto _ : state)
+    {
+        filter.encrypt(std::data(buf), std::size(buf), std::data(buf));
+        benchmark::ClobberMemory();
+    }
+
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+// how tr_peerIo decrypts its read buffer as the bytes arrive
+void BM_MseDecryptInPlace(benchmark::State& state)
+{
+    auto const n_bytes = static_cast<size_t>(state.range(0));
+    auto filter = makeFilter();
+    auto buf = std::vector<std::byte>(n_bytes);
+    tr_rand_buffer(std::data(buf), std::size(buf));
+
+    for (auto _ : state)
+    {
+        filter.decrypt(std::data(buf), std::size(buf));
+        benchmark::ClobberMemory();
+    }
+
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+void BM_MseHandshakeKeys(benchmark::State& state)
+{
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(makeFilter());
+    }
+}
+
+} // namespace
+
+// from a single protocol message up to a full 16 KiB block and a socket read
+BENCHMARK(BM_MseEncrypt)->RangeMultiplier(4)->Range(64, 256 << 10);
+BENCHMARK(BM_MseDecryptInPlace)->RangeMultiplier(4)->Range(64, 256 << 10);
+BENCHMARK(BM_MseHandshakeKeys);
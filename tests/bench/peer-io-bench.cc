@@ -0,0 +1,221 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <array>
+#include <condition_variable>
+#include <cstddef> // size_t, std::byte
+#include <cstdint> // int64_t
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#endif
+
+#include <event2/util.h>
+
+#include <benchmark/benchmark.h>
+
+#include <fmt/core.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/crypto-utils.h>
+#include <libtransmission/net.h>
+#include <libtransmission/peer-io.h>
+#include <libtransmission/peer-mse.h>
+#include <libtransmission/peer-socket.h>
+#include <libtransmission/quark.h>
+#include <libtransmission/session.h>
+#include <libtransmission/variant.h>
+
+#include "bench-fixtures.h"
+
+using namespace std::literals;
+using namespace libtransmission::bench;
+
+#ifdef _WIN32
+#define LOCAL_SOCKETPAIR_AF AF_INET
+#else
+#define LOCAL_SOCKETPAIR_AF AF_UNIX
+#endif
+
+namespace
+{
+
+auto constexpr BytesPerPair = size_t{ 4U * 1024U * 1024U };
+
+// A session with `n_pairs` pairs of connected, encrypted peers, like they
+// would be after an MSE handshake. In each pair, one peer only sends and the
+// other only receives. The peers' I/O is done in `n_io_threads` I/O threads,
+// or in the session thread if that's 0.
+class Loopback
+{
+public:
+    Loopback(size_t n_io_threads, size_t n_pairs)
+        : payload_(BytesPerPair, std::byte{ 'x' })
+    {
+        auto settings = sessionSettings();
+        tr_variantDictAddInt(&settings, TR_KEY_peer_io_threads, static_cast<int64_t>(n_io_threads));
+        session_ = tr_sessionInit(dir_.path().c_str(), false, &settings);
+        tr_variantClear(&settings);
+
+        run_in_session_thread(
+            [this, n_pairs]()
+            {
+                for (size_t i = 0; i < n_pairs; ++i)
+                {
+                    add_pair();
+                }
+            });
+    }
+
+    ~Loopback()
+    {
+        run_in_session_thread([this]() { ios_.clear(); });
+        tr_sessionClose(session_);
+    }
+
+    Loopback(Loopback&&) = delete;
+    Loopback(Loopback const&) = delete;
+    Loopback& operator=(Loopback&&) = delete;
+    Loopback& operator=(Loopback const&) = delete;
+
+    // send BytesPerPair through each pair and wait for it to be received
+    size_t transfer()
+    {
+        auto const n_bytes = BytesPerPair * std::size(ios_) / 2U;
+
+        {
+            auto const lock = std::lock_guard{ mutex_ };
+            n_expected_ += n_bytes;
+        }
+
+        run_in_session_thread(
+            [this]()
+            {
+                for (size_t i = 0, n = std::size(ios_); i < n; i += 2U)
+                {
+                    auto& sender = ios_[i];
+                    sender->write_bytes(std::data(payload_), std::size(payload_), true);
+                    sender->set_enabled(TR_UP, true);
+                }
+            });
+
+        auto lock = std::unique_lock{ mutex_ };
+        received_cv_.wait(lock, [this]() { return n_received_ >= n_expected_; });
+        return n_bytes;
+    }
+
+private:
+    static ReadState on_read(tr_peerIo* io, void* vself, size_t* /*piece*/)
+    {
+        auto* const self = static_cast<Loopback*>(vself);
+        auto const n_bytes = io->read_buffer_size();
+        io->read_buffer_drain(n_bytes);
+
+        auto const lock = std::lock_guard{ self->mutex_ };
+        self->n_received_ += n_bytes;
+        if (self->n_received_ >= self->n_expected_)
+        {
+            self->received_cv_.notify_one();
+        }
+
+        return READ_LATER;
+    }
+
+    template<typename Func>
+    void run_in_session_thread(Func&& func)
+    {
+        auto promise = std::promise<void>{};
+        auto future = promise.get_future();
+        session_->runInSessionThread(
+            [&func, &promise]()
+            {
+                func();
+                promise.set_value();
+            });
+        future.wait();
+    }
+
+    void add_pair()
+    {
+        using DH = tr_message_stream_encryption::DH;
+
+        auto sockpair = std::array<evutil_socket_t, 2>{ -1, -1 };
+        evutil_socketpair(LOCAL_SOCKETPAIR_AF, SOCK_STREAM, 0, std::data(sockpair));
+
+        auto const sock_addr = tr_socket_address{ *tr_address::from_string("127.0.0.1"sv), tr_port::fromHost(51413) };
+        auto const info_hash = tr_sha1::digest("peer-io-bench"sv);
+        auto dh = std::array<DH, 2>{};
+        dh[0].setPeerPublicKey(dh[1].publicKey());
+        dh[1].setPeerPublicKey(dh[0].publicKey());
+
+        for (size_t i = 0; i < 2U; ++i)
+        {
+            auto io = tr_peerIo::new_incoming(session_, nullptr, tr_peer_socket(session_, sock_addr, sockpair[i]));
+            auto const is_sender = i == 0U;
+            io->encrypt_init(!is_sender, dh[i], info_hash);
+            io->decrypt_init(!is_sender, dh[i], info_hash);
+
+            if (auto* const threads = session_->peer_io_threads(); threads != nullptr)
+            {
+                io->move_to_thread(threads->next());
+            }
+
+            if (!is_sender)
+            {
+                io->set_callbacks(&Loopback::on_read, nullptr, nullptr, this);
+                io->set_enabled(TR_DOWN, true);
+            }
+
+            ios_.emplace_back(std::move(io));
+        }
+    }
+
+    ScratchDir const dir_;
+    std::vector<std::byte> const payload_;
+    tr_session* session_ = nullptr;
+
+    // senders at even indices, their receivers at odd ones
+    std::vector<std::shared_ptr<tr_peerIo>> ios_;
+
+    std::mutex mutex_;
+    std::condition_variable received_cv_;
+    size_t n_expected_ = 0U;
+    size_t n_received_ = 0U;
+};
+
+// Bytes per second through encrypted loopback connections
+// args: number of I/O threads, number of peer pairs
+void BM_PeerIoThroughput(benchmark::State& state)
+{
+    auto loopback = Loopback{ static_cast<size_t>(state.range(0)), static_cast<size_t>(state.range(1)) };
+
+    auto n_bytes = size_t{};
+    for (auto _ : state)
+    {
+        n_bytes += loopback.transfer();
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(n_bytes));
+}
+
+} // namespace
+
+BENCHMARK(BM_PeerIoThroughput)
+    ->Args({ 0, 16 })
+    ->Args({ 1, 16 })
+    ->Args({ 2, 16 })
+    ->Args({ 4, 16 })
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
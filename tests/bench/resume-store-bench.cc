@@ -0,0 +1,157 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // size_t
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <fmt/core.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/crypto-utils.h>
+#include <libtransmission/resume-store.h>
+#include <libtransmission/tr-strbuf.h>
+#include <libtransmission/utils.h>
+
+#include "bench-fixtures.h"
+
+using namespace std::literals;
+using namespace libtransmission::bench;
+
+namespace
+{
+
+// About the size of a .resume file for a mid-sized torrent
+auto constexpr PayloadSize = size_t{ 2048U };
+
+// A scratch directory holding either N .resume files or one resume.db
+class ResumeDir
+{
+public:
+    explicit ResumeDir(size_t n_torrents)
+        : payload_(PayloadSize, 'x')
+    {
+        hashes_.reserve(n_torrents);
+        for (size_t i = 0; i < n_torrents; ++i)
+        {
+            hashes_.emplace_back(tr_sha1::digest(std::to_string(i)));
+        }
+    }
+
+    [[nodiscard]] auto resume_file(tr_sha1_digest_t const& hash) const
+    {
+        return tr_pathbuf{ dir_.path(), '/', tr_sha1_to_string(hash), ".resume"sv };
+    }
+
+    [[nodiscard]] auto db_file() const
+    {
+        return tr_pathbuf{ dir_.path(), "/resume.db"sv };
+    }
+
+    [[nodiscard]] constexpr auto const& hashes() const noexcept
+    {
+        return hashes_;
+    }
+
+    [[nodiscard]] constexpr auto const& payload() const noexcept
+    {
+        return payload_;
+    }
+
+private:
+    ScratchDir const dir_;
+    std::string const payload_;
+    std::vector<tr_sha1_digest_t> hashes_;
+};
+
+void BM_ResumeFilesSaveAll(benchmark::State& state)
+{
+    auto const dir = ResumeDir{ static_cast<size_t>(state.range(0)) };
+
+    for (auto _ : state)
+    {
+        for (auto const& hash : dir.hashes())
+        {
+            tr_file_save(dir.resume_file(hash), dir.payload());
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_ResumeStoreSaveAll(benchmark::State& state)
+{
+    auto const dir = ResumeDir{ static_cast<size_t>(state.range(0)) };
+    auto store = tr_resume_store{ dir.db_file() };
+
+    for (auto _ : state)
+    {
+        for (auto const& hash : dir.hashes())
+        {
+            store.put(hash, dir.payload());
+        }
+        store.flush();
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_ResumeFilesLoadAll(benchmark::State& state)
+{
+    auto const dir = ResumeDir{ static_cast<size_t>(state.range(0)) };
+    for (auto const& hash : dir.hashes())
+    {
+        tr_file_save(dir.resume_file(hash), dir.payload());
+    }
+
+    auto buf = std::vector<char>{};
+    for (auto _ : state)
+    {
+        for (auto const& hash : dir.hashes())
+        {
+            tr_file_read(dir.resume_file(hash), buf);
+            benchmark::DoNotOptimize(std::data(buf));
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_ResumeStoreLoadAll(benchmark::State& state)
+{
+    auto const dir = ResumeDir{ static_cast<size_t>(state.range(0)) };
+    {
+        auto store = tr_resume_store{ dir.db_file() };
+        for (auto const& hash : dir.hashes())
+        {
+            store.put(hash, dir.payload());
+        }
+    }
+
+    auto buf = std::vector<char>{};
+    for (auto _ : state)
+    {
+        // includes opening the database and replaying its log
+        auto const store = tr_resume_store{ dir.db_file() };
+        for (auto const& hash : dir.hashes())
+        {
+            store.get(hash, buf);
+            benchmark::DoNotOptimize(std::data(buf));
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+} // namespace
+
+BENCHMARK(BM_ResumeFilesSaveAll)->Arg(10000)->Arg(20000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ResumeStoreSaveAll)->Arg(10000)->Arg(20000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ResumeFilesLoadAll)->Arg(10000)->Arg(20000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ResumeStoreLoadAll)->Arg(10000)->Arg(20000)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,164 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <array>
+#include <cstddef> // size_t
+#include <cstdint> // int64_t
+#include <string>
+#include <string_view>
+
+#include <event2/buffer.h>
+
+#include <benchmark/benchmark.h>
+
+#include <fmt/core.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/quark.h>
+#include <libtransmission/rpcimpl.h>
+#include <libtransmission/variant.h>
+
+#include "bench-fixtures.h"
+
+using namespace std::literals;
+using namespace libtransmission::bench;
+
+namespace
+{
+
+// what a client might poll for to show its torrent list
+auto constexpr Fields = std::array<std::string_view, 15>{
+    "downloadDir"sv,
+    "error"sv,
+    "errorString"sv,
+    "eta"sv,
+    "hashString"sv,
+    "id"sv,
+    "labels"sv,
+    "name"sv,
+    "peersConnected"sv,
+    "percentDone"sv,
+    "rateDownload"sv,
+    "rateUpload"sv,
+    "sizeWhenDone"sv,
+    "status"sv,
+    "uploadRatio"sv,
+};
+
+// A session with `n_torrents` paused single-file torrents
+class Library
+{
+public:
+    explicit Library(size_t n_torrents)
+    {
+        auto settings = sessionSettings();
+        tr_variantDictAddStr(&settings, TR_KEY_download_dir, dir_.path());
+        session_ = tr_sessionInit(dir_.path().c_str(), false, &settings);
+        tr_variantClear(&settings);
+
+        auto const pieces = std::string(80U, 'x');
+        for (size_t i = 0; i < n_torrents; ++i)
+        {
+            auto const name = fmt::format("torrent-{:06}.iso", i);
+            auto const benc = fmt::format(
+                "d4:infod6:lengthi1048576e4:name{:d}:{:s}12:piece lengthi262144e6:pieces{:d}:{:s}ee",
+                std::size(name),
+                name,
+                std::size(pieces),
+                pieces);
+
+            auto* const ctor = tr_ctorNew(session_);
+            tr_ctorSetMetainfo(ctor, std::data(benc), std::size(benc), nullptr);
+            tr_ctorSetPaused(ctor, TR_FORCE, true);
+            tr_torrentNew(ctor, nullptr);
+            tr_ctorFree(ctor);
+        }
+
+        tr_variantInitDict(&request_, 2);
+        tr_variantDictAddStrView(&request_, TR_KEY_method, "torrent-get"sv);
+        auto* const args = tr_variantDictAddDict(&request_, TR_KEY_arguments, 1);
+        auto* const fields = tr_variantDictAddList(args, TR_KEY_fields, std::size(Fields));
+        for (auto const& field : Fields)
+        {
+            tr_variantListAddStrView(fields, field);
+        }
+    }
+
+    ~Library()
+    {
+        tr_variantClear(&request_);
+        tr_sessionClose(session_);
+    }
+
+    Library(Library&&) = delete;
+    Library(Library const&) = delete;
+    Library& operator=(Library&&) = delete;
+    Library& operator=(Library const&) = delete;
+
+    // the old way: build a tr_variant response, then serialize it
+    size_t getVariant()
+    {
+        auto n_bytes = size_t{};
+        tr_rpc_request_exec_json(
+            session_,
+            &request_,
+            [](tr_session* /*session*/, tr_variant* response, void* vn_bytes)
+            { *static_cast<size_t*>(vn_bytes) = std::size(tr_variantToStr(response, TR_VARIANT_FMT_JSON_LEAN)); },
+            &n_bytes);
+        return n_bytes;
+    }
+
+    // the new way: write the response straight to JSON
+    size_t getSerialized()
+    {
+        auto n_bytes = size_t{};
+        tr_rpc_request_exec_serialized(
+            session_,
+            &request_,
+            [](tr_session* /*session*/, evbuffer* response, void* vn_bytes)
+            { *static_cast<size_t*>(vn_bytes) = evbuffer_get_length(response); },
+            &n_bytes);
+        return n_bytes;
+    }
+
+private:
+    ScratchDir const dir_;
+    tr_session* session_ = nullptr;
+    tr_variant request_ = {};
+};
+
+// Time to make a `torrent-get` response for a library of torrents
+// args: number of torrents
+void BM_TorrentGetVariant(benchmark::State& state)
+{
+    auto library = Library{ static_cast<size_t>(state.range(0)) };
+
+    auto n_bytes = size_t{};
+    for (auto _ : state)
+    {
+        n_bytes += library.getVariant();
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(n_bytes));
+}
+
+void BM_TorrentGetSerialized(benchmark::State& state)
+{
+    auto library = Library{ static_cast<size_t>(state.range(0)) };
+
+    auto n_bytes = size_t{};
+    for (auto _ : state)
+    {
+        n_bytes += library.getSerialized();
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(n_bytes));
+}
+
+} // namespace
+
+BENCHMARK(BM_TorrentGetVariant)->RangeMultiplier(10)->Range(100, 10000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_TorrentGetSerialized)->RangeMultiplier(10)->Range(100, 10000)->Unit(benchmark::kMillisecond);
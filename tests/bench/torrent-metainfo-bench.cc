@@ -0,0 +1,64 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <string_view>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/torrent-metainfo.h>
+#include <libtransmission/tr-strbuf.h>
+#include <libtransmission/utils.h>
+
+using namespace std::literals;
+
+namespace
+{
+
+void parseTorrentFile(benchmark::State& state, std::string_view basename)
+{
+    auto const filename = tr_pathbuf{ LIBTRANSMISSION_TEST_ASSETS_DIR, '/', basename };
+    auto benc = std::vector<char>{};
+    if (!tr_file_read(filename, benc))
+    {
+        state.SkipWithError("unable to read torrent file");
+        return;
+    }
+
+    auto const benc_sv = std::string_view{ std::data(benc), std::size(benc) };
+    for (auto _ : state)
+    {
+        auto metainfo = tr_torrent_metainfo{};
+        benchmark::DoNotOptimize(metainfo.parse_benc(benc_sv));
+    }
+
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(std::size(benc)));
+}
+
+// a small single-file torrent
+void BM_MetainfoParseSmall(benchmark::State& state)
+{
+    parseTorrentFile(state, "gimp-2.10.32-1-arm64.dmg.torrent"sv);
+}
+
+// a multi-file torrent with hundreds of files
+void BM_MetainfoParseManyFiles(benchmark::State& state)
+{
+    parseTorrentFile(state, "alice_in_wonderland_librivox_archive.torrent"sv);
+}
+
+// a single-file torrent with thousands of pieces
+void BM_MetainfoParseManyPieces(benchmark::State& state)
+{
+    parseTorrentFile(state, "ubuntu-20.04.4-desktop-amd64.iso.torrent"sv);
+}
+
+} // namespace
+
+BENCHMARK(BM_MetainfoParseSmall);
+BENCHMARK(BM_MetainfoParseManyFiles);
+BENCHMARK(BM_MetainfoParseManyPieces);
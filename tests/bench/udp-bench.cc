@@ -0,0 +1,156 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <array>
+#include <cstddef> // size_t
+#include <cstdint> // int64_t
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+#include <event2/util.h>
+
+#include <benchmark/benchmark.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/net.h>
+#include <libtransmission/tr-udp-batch.h>
+
+namespace
+{
+
+// about the size of a µTP data packet
+auto constexpr DatagramSize = size_t{ 1200U };
+
+// Two UDP sockets on the loopback interface. The receiver is non-blocking
+// so that reading stops, rather than waits, once it's drained.
+class LoopbackPair
+{
+public:
+    LoopbackPair()
+    {
+        for (auto* const sock : { &sender_, &receiver_ })
+        {
+            *sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+            auto addr = sockaddr_in{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            bind(*sock, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr));
+        }
+
+        auto size = int{ 4 * 1024 * 1024 };
+        setsockopt(receiver_, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<char const*>(&size), sizeof(size));
+        evutil_make_socket_nonblocking(receiver_);
+
+        to_len_ = sizeof(to_);
+        getsockname(receiver_, reinterpret_cast<sockaddr*>(&to_), &to_len_);
+    }
+
+    ~LoopbackPair()
+    {
+        tr_net_close_socket(sender_);
+        tr_net_close_socket(receiver_);
+    }
+
+    LoopbackPair(LoopbackPair&&) = delete;
+    LoopbackPair(LoopbackPair const&) = delete;
+    LoopbackPair& operator=(LoopbackPair&&) = delete;
+    LoopbackPair& operator=(LoopbackPair const&) = delete;
+
+    [[nodiscard]] constexpr auto sender() const noexcept
+    {
+        return sender_;
+    }
+
+    [[nodiscard]] constexpr auto receiver() const noexcept
+    {
+        return receiver_;
+    }
+
+    [[nodiscard]] auto const* to() const noexcept
+    {
+        return reinterpret_cast<sockaddr const*>(&to_);
+    }
+
+    [[nodiscard]] constexpr auto to_len() const noexcept
+    {
+        return to_len_;
+    }
+
+private:
+    tr_socket_t sender_ = TR_BAD_SOCKET;
+    tr_socket_t receiver_ = TR_BAD_SOCKET;
+    sockaddr_storage to_ = {};
+    socklen_t to_len_ = {};
+};
+
+// one sendto() and one recvfrom() per datagram, as the session used to do
+void BM_UdpOnePerSyscall(benchmark::State& state)
+{
+    auto const n_datagrams = static_cast<size_t>(state.range(0));
+    auto const sockets = LoopbackPair{};
+    auto payload = std::array<char, DatagramSize>{};
+    auto buf = std::array<char, tr_udp_recv_batch::BufSize>{};
+    auto n_received = int64_t{};
+
+    for (auto _ : state)
+    {
+        for (size_t i = 0; i < n_datagrams; ++i)
+        {
+            sendto(sockets.sender(), std::data(payload), std::size(payload), 0, sockets.to(), sockets.to_len());
+        }
+
+        auto from = sockaddr_storage{};
+        auto* const from_sa = reinterpret_cast<sockaddr*>(&from);
+        auto fromlen = socklen_t{ sizeof(from) };
+        while (recvfrom(sockets.receiver(), std::data(buf), std::size(buf), 0, from_sa, &fromlen) > 0)
+        {
+            ++n_received;
+            fromlen = sizeof(from);
+        }
+    }
+
+    state.counters["packets"] = benchmark::Counter(static_cast<double>(n_received), benchmark::Counter::kIsRate);
+}
+
+// the datagrams are queued and sent with tr_udp_send_queue, then read with tr_udp_recv_batch
+void BM_UdpBatched(benchmark::State& state)
+{
+    auto const n_datagrams = static_cast<size_t>(state.range(0));
+    auto const sockets = LoopbackPair{};
+    auto payload = std::array<char, DatagramSize>{};
+    auto outbox = tr_udp_send_queue{};
+    auto inbox = tr_udp_recv_batch{};
+    auto n_received = int64_t{};
+
+    for (auto _ : state)
+    {
+        for (size_t i = 0; i < n_datagrams; ++i)
+        {
+            outbox.push(sockets.sender(), std::data(payload), std::size(payload), sockets.to(), sockets.to_len());
+        }
+
+        outbox.flush({});
+
+        while (auto const n_read = inbox.read(sockets.receiver()))
+        {
+            n_received += static_cast<int64_t>(n_read);
+        }
+    }
+
+    state.counters["packets"] = benchmark::Counter(static_cast<double>(n_received), benchmark::Counter::kIsRate);
+}
+
+} // namespace
+
+// {datagrams per loop iteration}
+BENCHMARK(BM_UdpOnePerSyscall)->Arg(1)->Arg(16)->Arg(64);
+BENCHMARK(BM_UdpBatched)->Arg(1)->Arg(16)->Arg(64);
@@ -0,0 +1,160 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // size_t
+#include <string>
+
+#include <fmt/core.h>
+
+#include <benchmark/benchmark.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/quark.h>
+#include <libtransmission/variant.h>
+
+namespace
+{
+
+// Fill the dict `top` with something shaped like a `torrent-get` response for `n_torrents` torrents
+void buildResponse(tr_variant* top, size_t n_torrents)
+{
+    tr_variantDictAddStrView(top, TR_KEY_result, "success");
+    auto* const args = tr_variantDictAddDict(top, TR_KEY_arguments, 1);
+    auto* const torrents = tr_variantDictAddList(args, TR_KEY_torrents, n_torrents);
+
+    for (size_t i = 0; i < n_torrents; ++i)
+    {
+        auto* const tor = tr_variantListAddDict(torrents, 8);
+        tr_variantDictAddInt(tor, TR_KEY_id, static_cast<int64_t>(i + 1U));
+        tr_variantDictAddStr(tor, TR_KEY_name, fmt::format("torrent-{:06}.iso", i));
+        tr_variantDictAddStr(tor, TR_KEY_hashString, fmt::format("{:040x}", i * 2654435761U));
+        tr_variantDictAddInt(tor, TR_KEY_status, 4);
+        tr_variantDictAddReal(tor, TR_KEY_percentDone, static_cast<double>(i % 1000U) / 1000.0);
+        tr_variantDictAddInt(tor, TR_KEY_rateDownload, static_cast<int64_t>(i * 1024U));
+        tr_variantDictAddInt(tor, TR_KEY_rateUpload, static_cast<int64_t>(i * 512U));
+        tr_variantDictAddInt(tor, TR_KEY_sizeWhenDone, int64_t{ 4 } * 1024 * 1024 * 1024);
+    }
+}
+
+std::string makePayload(size_t n_torrents, tr_variant_fmt fmt)
+{
+    auto top = tr_variant{};
+    tr_variantInitDict(&top, 2);
+    buildResponse(&top, n_torrents);
+
+    auto str = tr_variantToStr(&top, fmt);
+    tr_variantClear(&top);
+    return str;
+}
+
+void parse(benchmark::State& state, tr_variant_fmt fmt, int parse_opts)
+{
+    auto const payload = makePayload(static_cast<size_t>(state.range(0)), fmt);
+
+    for (auto _ : state)
+    {
+        auto var = tr_variant{};
+        benchmark::DoNotOptimize(tr_variantFromBuf(&var, parse_opts, payload));
+        tr_variantClear(&var);
+    }
+
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(std::size(payload)));
+}
+
+void build(benchmark::State& state, void (*init)(tr_variant*, size_t))
+{
+    auto const n_torrents = static_cast<size_t>(state.range(0));
+
+    for (auto _ : state)
+    {
+        auto var = tr_variant{};
+        init(&var, 2);
+        buildResponse(&var, n_torrents);
+        benchmark::DoNotOptimize(var);
+        tr_variantClear(&var);
+    }
+}
+
+void serialize(benchmark::State& state, tr_variant_fmt fmt)
+{
+    auto const payload = makePayload(static_cast<size_t>(state.range(0)), TR_VARIANT_FMT_BENC);
+    auto var = tr_variant{};
+    tr_variantFromBuf(&var, TR_VARIANT_PARSE_BENC, payload);
+
+    auto n_bytes = int64_t{};
+    for (auto _ : state)
+    {
+        auto const str = tr_variantToStr(&var, fmt);
+        n_bytes += static_cast<int64_t>(std::size(str));
+        benchmark::DoNotOptimize(str);
+    }
+
+    tr_variantClear(&var);
+    state.SetBytesProcessed(n_bytes);
+}
+
+void BM_VariantFromBenc(benchmark::State& state)
+{
+    parse(state, TR_VARIANT_FMT_BENC, TR_VARIANT_PARSE_BENC);
+}
+
+void BM_VariantFromBencInplace(benchmark::State& state)
+{
+    parse(state, TR_VARIANT_FMT_BENC, TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE);
+}
+
+void BM_VariantFromBencArena(benchmark::State& state)
+{
+    parse(state, TR_VARIANT_FMT_BENC, TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_ARENA);
+}
+
+void BM_VariantFromJson(benchmark::State& state)
+{
+    parse(state, TR_VARIANT_FMT_JSON_LEAN, TR_VARIANT_PARSE_JSON);
+}
+
+void BM_VariantFromJsonInplace(benchmark::State& state)
+{
+    parse(state, TR_VARIANT_FMT_JSON_LEAN, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE);
+}
+
+void BM_VariantFromJsonArena(benchmark::State& state)
+{
+    parse(state, TR_VARIANT_FMT_JSON_LEAN, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_ARENA);
+}
+
+void BM_VariantBuild(benchmark::State& state)
+{
+    build(state, tr_variantInitDict);
+}
+
+void BM_VariantBuildArena(benchmark::State& state)
+{
+    build(state, tr_variantInitArenaDict);
+}
+
+void BM_VariantToBenc(benchmark::State& state)
+{
+    serialize(state, TR_VARIANT_FMT_BENC);
+}
+
+void BM_VariantToJson(benchmark::State& state)
+{
+    serialize(state, TR_VARIANT_FMT_JSON_LEAN);
+}
+
+} // namespace
+
+BENCHMARK(BM_VariantFromBenc)->RangeMultiplier(10)->Range(10, 10000);
+BENCHMARK(BM_VariantFromBencInplace)->RangeMultiplier(10)->Range(10, 10000);
+BENCHMARK(BM_VariantFromBencArena)->RangeMultiplier(10)->Range(10, 10000);
+BENCHMARK(BM_VariantFromJson)->RangeMultiplier(10)->Range(10, 10000);
+BENCHMARK(BM_VariantFromJsonInplace)->RangeMultiplier(10)->Range(10, 10000);
+BENCHMARK(BM_VariantFromJsonArena)->RangeMultiplier(10)->Range(10, 10000);
+BENCHMARK(BM_VariantBuild)->RangeMultiplier(10)->Range(10, 10000);
+BENCHMARK(BM_VariantBuildArena)->RangeMultiplier(10)->Range(10, 10000);
+BENCHMARK(BM_VariantToBenc)->RangeMultiplier(10)->Range(10, 10000);
+BENCHMARK(BM_VariantToJson)->RangeMultiplier(10)->Range(10, 10000);
@@ -0,0 +1,214 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm> // std::fill
+#include <cstddef> // size_t
+#include <cstdint> // uint16_t
+#include <random>
+#include <vector>
+
+#define LIBTRANSMISSION_PEER_MODULE
+
+#include <benchmark/benchmark.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/bitfield.h>
+#include <libtransmission/peer-mgr-wishlist.h>
+
+namespace
+{
+
+// A swarm with `n_pieces` pieces that we don't have yet
+// and `n_peers` peers that each have a random half of them.
+class SwarmMediator final : public Wishlist::Mediator
+{
+public:
+    static auto constexpr BlocksPerPiece = tr_block_index_t{ 16U };
+
+    SwarmMediator(tr_piece_index_t n_pieces, size_t n_peers)
+        : missing_(n_pieces, BlocksPerPiece)
+        , replication_(n_pieces)
+        , have_(size_t{ n_pieces } * BlocksPerPiece)
+    {
+        auto rng = std::mt19937{ 1U }; // fixed seed for repeatable runs
+        auto coin = std::bernoulli_distribution{ 0.5 };
+
+        peers_.reserve(n_peers);
+        for (size_t i = 0; i < n_peers; ++i)
+        {
+            auto& peer = peers_.emplace_back(n_pieces);
+            for (tr_piece_index_t piece = 0; piece < n_pieces; ++piece)
+            {
+                if (coin(rng))
+                {
+                    peer.set(piece);
+                    ++replication_[piece];
+                }
+            }
+        }
+    }
+
+    [[nodiscard]] bool clientCanRequestBlock(tr_block_index_t block) const override
+    {
+        return !have_.test(block);
+    }
+
+    [[nodiscard]] bool clientCanRequestPiece(tr_piece_index_t /*piece*/) const override
+    {
+        return true;
+    }
+
+    [[nodiscard]] bool isEndgame() const override
+    {
+        return false;
+    }
+
+    [[nodiscard]] bool isSequentialDownload() const override
+    {
+        return false;
+    }
+
+    [[nodiscard]] size_t countActiveRequests(tr_block_index_t /*block*/) const override
+    {
+        return 0U;
+    }
+
+    [[nodiscard]] size_t countMissingBlocks(tr_piece_index_t piece) const override
+    {
+        return missing_[piece];
+    }
+
+    [[nodiscard]] tr_block_span_t blockSpan(tr_piece_index_t piece) const override
+    {
+        return { piece * BlocksPerPiece, (piece + 1U) * BlocksPerPiece };
+    }
+
+    [[nodiscard]] tr_piece_index_t countAllPieces() const override
+    {
+        return static_cast<tr_piece_index_t>(std::size(missing_));
+    }
+
+    [[nodiscard]] tr_priority_t priority(tr_piece_index_t /*piece*/) const override
+    {
+        return TR_PRI_NORMAL;
+    }
+
+    [[nodiscard]] size_t pieceReplication(tr_piece_index_t piece) const override
+    {
+        return replication_[piece];
+    }
+
+    [[nodiscard]] auto const& peers() const noexcept
+    {
+        return peers_;
+    }
+
+    void got_block(tr_block_index_t block)
+    {
+        have_.set(block);
+        --missing_[block / BlocksPerPiece];
+    }
+
+    void reset()
+    {
+        have_.set_has_none();
+        std::fill(std::begin(missing_), std::end(missing_), BlocksPerPiece);
+    }
+
+private:
+    std::vector<tr_block_index_t> missing_;
+    std::vector<uint16_t> replication_;
+    std::vector<tr_bitfield> peers_;
+    tr_bitfield have_;
+};
+
+auto constexpr NoRequests = [](tr_block_index_t /*block*/)
+{
+    return false;
+};
+
+// one request round: every peer asks the wishlist for a pipeline's worth of blocks
+void BM_WishlistNextForEachPeer(benchmark::State& state)
+{
+    auto const n_pieces = static_cast<tr_piece_index_t>(state.range(0));
+    auto const n_peers = static_cast<size_t>(state.range(1));
+    auto const mediator = SwarmMediator{ n_pieces, n_peers };
+    auto wishlist = Wishlist{ mediator };
+
+    for (auto _ : state)
+    {
+        for (auto const& peer : mediator.peers())
+        {
+            auto const peer_has_piece = [&peer](tr_piece_index_t piece)
+            {
+                return peer.test(piece);
+            };
+            benchmark::DoNotOptimize(wishlist.next(64U, peer_has_piece, NoRequests));
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+
+// the same, but with the wishlist rebuilt from scratch first, e.g. after a priority change
+void BM_WishlistRebuild(benchmark::State& state)
+{
+    auto const n_pieces = static_cast<tr_piece_index_t>(state.range(0));
+    auto const mediator = SwarmMediator{ n_pieces, 1U };
+    auto wishlist = Wishlist{ mediator };
+
+    for (auto _ : state)
+    {
+        wishlist.invalidate();
+        benchmark::DoNotOptimize(wishlist.next(64U));
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// downloading a few blocks at a time, either rebuilding the wishlist
+// for every request or keeping it up-to-date as the pieces change
+void BM_WishlistNextAfterGotBlocks(benchmark::State& state)
+{
+    auto const n_pieces = static_cast<tr_piece_index_t>(state.range(0));
+    auto const incremental = state.range(1) != 0;
+    auto mediator = SwarmMediator{ n_pieces, 1U };
+    auto wishlist = Wishlist{ mediator };
+
+    for (auto _ : state)
+    {
+        if (!incremental)
+        {
+            wishlist.invalidate();
+        }
+
+        auto const spans = wishlist.next(4U);
+        for (auto const& span : spans)
+        {
+            for (auto block = span.begin; block < span.end; ++block)
+            {
+                mediator.got_block(block);
+                wishlist.on_piece_changed(block / SwarmMediator::BlocksPerPiece);
+            }
+        }
+
+        if (std::empty(spans)) // got everything; start over
+        {
+            state.PauseTiming();
+            mediator.reset();
+            wishlist.invalidate();
+            state.ResumeTiming();
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+} // namespace
+
+BENCHMARK(BM_WishlistNextForEachPeer)->ArgsProduct({ { 1 << 10, 1 << 14 }, { 50, 500 } });
+BENCHMARK(BM_WishlistRebuild)->RangeMultiplier(8)->Range(1 << 10, 1 << 16);
+BENCHMARK(BM_WishlistNextAfterGotBlocks)->ArgsProduct({ { 1 << 10, 1 << 14 }, { 0, 1 } });
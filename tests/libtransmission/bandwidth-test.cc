@@ -0,0 +1,301 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <memory>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/bandwidth.h>
+
+#include "gtest/gtest.h"
+
+namespace
+{
+
+// A peer-io with `backlog` bytes to send or receive.
+// It only moves data when tr_bandwidth::allocate() asks it to.
+class FakePeer final : public tr_bandwidth::Peer
+{
+public:
+    FakePeer(tr_bandwidth* parent, uint64_t const& now)
+        : bandwidth_{ parent }
+        , now_{ now }
+    {
+    }
+
+    [[nodiscard]] static std::shared_ptr<FakePeer> create(tr_bandwidth* parent, uint64_t const& now)
+    {
+        auto peer = std::make_shared<FakePeer>(parent, now);
+        peer->bandwidth_.set_peer(peer);
+        return peer;
+    }
+
+    // queue up `n_bytes` more to transfer and ask for bandwidth
+    void want(tr_direction dir, size_t n_bytes)
+    {
+        backlog_[dir] += n_bytes;
+        bandwidth_.notify_bandwidth_wanted(dir);
+    }
+
+    size_t flush(tr_direction dir, size_t byte_limit) override
+    {
+        auto const n_bytes = bandwidth_.clamp(now_, dir, std::min(byte_limit, backlog_[dir]));
+        backlog_[dir] -= n_bytes;
+        transferred_[dir] += n_bytes;
+        bandwidth_.notify_bandwidth_consumed(dir, n_bytes, true, now_);
+        return n_bytes;
+    }
+
+    size_t flush_outgoing_protocol_msgs() override
+    {
+        return {};
+    }
+
+    void set_enabled(tr_direction dir, bool is_enabled) override
+    {
+        is_enabled_[dir] = is_enabled;
+    }
+
+    [[nodiscard]] bool has_bandwidth_left(tr_direction dir) const noexcept override
+    {
+        return bandwidth_.clamp(now_, dir, 1U) > 0U;
+    }
+
+    [[nodiscard]] constexpr auto& bandwidth() noexcept
+    {
+        return bandwidth_;
+    }
+
+    [[nodiscard]] constexpr auto transferred(tr_direction dir) const noexcept
+    {
+        return transferred_[dir];
+    }
+
+    [[nodiscard]] constexpr auto is_enabled(tr_direction dir) const noexcept
+    {
+        return is_enabled_[dir];
+    }
+
+private:
+    tr_bandwidth bandwidth_;
+    uint64_t const& now_;
+    std::array<size_t, 2> backlog_ = {};
+    std::array<size_t, 2> transferred_ = {};
+    std::array<bool, 2> is_enabled_ = {};
+};
+
+// enough to keep a peer busy for longer than any of these tests
+auto constexpr Endless = size_t{ 1000000000U };
+
+void limit(tr_bandwidth& bandwidth, tr_direction dir, tr_bytes_per_second_t bytes_per_second)
+{
+    bandwidth.set_limited(dir, true);
+    bandwidth.set_desired_speed_bytes_per_second(dir, bytes_per_second);
+}
+
+} // namespace
+
+TEST(Bandwidth, allocateOnlyVisitsWaitingPeers)
+{
+    auto now = uint64_t{ 1000U };
+    auto root = tr_bandwidth{};
+    auto waiting = FakePeer::create(&root, now);
+    auto idle = FakePeer::create(&root, now);
+
+    waiting->want(TR_UP, 100U);
+    waiting->want(TR_UP, 100U); // asking twice doesn't get a peer in line twice
+    root.allocate(now);
+    EXPECT_EQ(200U, waiting->transferred(TR_UP));
+    EXPECT_TRUE(waiting->is_enabled(TR_UP));
+    EXPECT_EQ(0U, waiting->transferred(TR_DOWN));
+    EXPECT_EQ(0U, idle->transferred(TR_UP));
+    EXPECT_FALSE(idle->is_enabled(TR_UP));
+
+    // a peer that got what it wanted leaves the queue
+    waiting->set_enabled(TR_UP, false);
+    root.allocate(now);
+    EXPECT_FALSE(waiting->is_enabled(TR_UP));
+}
+
+TEST(Bandwidth, destroyedPeersLeaveTheQueue)
+{
+    auto now = uint64_t{ 1000U };
+    auto root = tr_bandwidth{};
+    auto tor = std::make_unique<tr_bandwidth>(&root);
+    auto a = FakePeer::create(tor.get(), now);
+    auto b = FakePeer::create(tor.get(), now);
+    auto c = FakePeer::create(tor.get(), now);
+
+    a->want(TR_UP, 100U);
+    b->want(TR_UP, 100U);
+    b->want(TR_DOWN, 100U);
+    c->want(TR_DOWN, 100U);
+
+    // destroying a waiting peer takes it out of the queue, so
+    // allocate() doesn't visit it after it has been freed
+    b.reset();
+    root.allocate(now);
+    EXPECT_EQ(100U, a->transferred(TR_UP));
+    EXPECT_EQ(100U, c->transferred(TR_DOWN));
+
+    // ...and the same goes for a peer that's freed with its torrent
+    a->want(TR_UP, 100U);
+    c->want(TR_UP, 100U);
+    a.reset();
+    c->bandwidth().set_parent(&root);
+    tor.reset();
+    root.allocate(now);
+    EXPECT_EQ(100U, c->transferred(TR_UP));
+}
+
+TEST(Bandwidth, setParentRequeuesWaitingPeers)
+{
+    auto now = uint64_t{ 1000U };
+    auto old_root = tr_bandwidth{};
+    auto new_root = tr_bandwidth{};
+    auto tor = tr_bandwidth{ &old_root };
+
+    // a peer that moves waits in its new tree's queue
+    auto moved = FakePeer::create(&old_root, now);
+    moved->want(TR_UP, 100U);
+    moved->bandwidth().set_parent(&tor);
+    moved->bandwidth().set_parent(&new_root);
+    old_root.allocate(now);
+    EXPECT_EQ(0U, moved->transferred(TR_UP));
+    new_root.allocate(now);
+    EXPECT_EQ(100U, moved->transferred(TR_UP));
+
+    // a peer that got in line before it had a parent moves to its parent's queue
+    auto orphan = FakePeer::create(nullptr, now);
+    orphan->want(TR_DOWN, 100U);
+    orphan->bandwidth().set_parent(&tor);
+    old_root.allocate(now);
+    EXPECT_EQ(100U, orphan->transferred(TR_DOWN));
+
+    // the peers waiting under a torrent move with the torrent
+    auto child = FakePeer::create(&tor, now);
+    child->want(TR_UP, 100U);
+    tor.set_parent(&new_root);
+    old_root.allocate(now);
+    EXPECT_EQ(0U, child->transferred(TR_UP));
+    new_root.allocate(now);
+    EXPECT_EQ(100U, child->transferred(TR_UP));
+
+    tor.set_parent(nullptr);
+}
+
+TEST(Bandwidth, bucketsHoldHalfASecondOfTheirLimit)
+{
+    static auto constexpr BytesPerSecond = tr_bytes_per_second_t{ 10000 };
+    static auto constexpr BucketBytes = size_t{ BytesPerSecond / 2U };
+
+    auto now = uint64_t{ 1000U };
+    auto root = tr_bandwidth{};
+    limit(root, TR_UP, BytesPerSecond);
+    auto tor = tr_bandwidth{ &root };
+    auto peer = FakePeer::create(&tor, now);
+
+    // a new bucket starts out full
+    peer->want(TR_UP, Endless);
+    root.allocate(now);
+    EXPECT_EQ(BucketBytes, peer->transferred(TR_UP));
+    EXPECT_FALSE(peer->is_enabled(TR_UP));
+
+    // a peer that ran out stays in line, but has to wait for the bucket to refill
+    root.allocate(now);
+    EXPECT_EQ(BucketBytes, peer->transferred(TR_UP));
+
+    now += 100U;
+    root.allocate(now);
+    EXPECT_EQ(BucketBytes + BytesPerSecond / 10U, peer->transferred(TR_UP));
+
+    // a second's worth of pulses gets a second's worth of bandwidth
+    auto const before = peer->transferred(TR_UP);
+    for (int i = 0; i < 4; ++i)
+    {
+        now += 250U;
+        root.allocate(now);
+    }
+    EXPECT_EQ(before + BytesPerSecond, peer->transferred(TR_UP));
+
+    // an idle bucket can't save up more than half a second's worth
+    now += 10000U;
+    root.allocate(now);
+    EXPECT_EQ(before + BytesPerSecond + BucketBytes, peer->transferred(TR_UP));
+
+    // a limit anywhere between the peer and the root applies
+    auto const tor_limited = FakePeer::create(&tor, now);
+    limit(tor, TR_DOWN, BytesPerSecond / 5U);
+    tor_limited->want(TR_DOWN, Endless);
+    now += 10000U;
+    root.allocate(now);
+    EXPECT_EQ(BucketBytes / 5U, tor_limited->transferred(TR_DOWN));
+}
+
+TEST(Bandwidth, prioritiesGetQuantaOfTurns)
+{
+    // enough for exactly four rounds of 3 + 2 + 1 turns of 3000 bytes
+    static auto constexpr BucketBytes = size_t{ 4U * 6U * 3000U };
+
+    auto now = uint64_t{ 1000U };
+    auto root = tr_bandwidth{};
+    root.set_priority(TR_PRI_LOW);
+    limit(root, TR_UP, BucketBytes * 2U);
+
+    auto high = FakePeer::create(&root, now);
+    auto normal = FakePeer::create(&root, now);
+    auto low = FakePeer::create(&root, now);
+    high->bandwidth().set_priority(TR_PRI_HIGH);
+    normal->bandwidth().set_priority(TR_PRI_NORMAL);
+    low->bandwidth().set_priority(TR_PRI_LOW);
+
+    for (auto const& peer : { high, normal, low })
+    {
+        peer->want(TR_UP, Endless);
+    }
+
+    root.allocate(now);
+    EXPECT_EQ(BucketBytes / 2U, high->transferred(TR_UP));
+    EXPECT_EQ(BucketBytes / 3U, normal->transferred(TR_UP));
+    EXPECT_EQ(BucketBytes / 6U, low->transferred(TR_UP));
+}
+
+TEST(Bandwidth, peersWithTheSamePrioritySplitEvenly)
+{
+    static auto constexpr NumPeers = size_t{ 5U };
+    static auto constexpr BucketBytes = size_t{ NumPeers * 10U * 3000U };
+
+    auto now = uint64_t{ 1000U };
+    auto root = tr_bandwidth{};
+    limit(root, TR_DOWN, BucketBytes * 2U);
+    auto tor = tr_bandwidth{ &root };
+
+    // a peer that doesn't need its whole turn leaves the rest to the others
+    auto light = FakePeer::create(&tor, now);
+    light->want(TR_DOWN, 1000U);
+
+    auto peers = std::array<std::shared_ptr<FakePeer>, NumPeers>{};
+    for (auto& peer : peers)
+    {
+        peer = FakePeer::create(&tor, now);
+        peer->want(TR_DOWN, Endless);
+    }
+
+    root.allocate(now);
+    EXPECT_EQ(1000U, light->transferred(TR_DOWN));
+
+    auto n_bytes = size_t{};
+    for (auto const& peer : peers)
+    {
+        n_bytes += peer->transferred(TR_DOWN);
+        EXPECT_LE(BucketBytes / NumPeers - 3000U, peer->transferred(TR_DOWN));
+        EXPECT_GE(BucketBytes / NumPeers, peer->transferred(TR_DOWN));
+    }
+    EXPECT_EQ(BucketBytes - 1000U, n_bytes);
+}
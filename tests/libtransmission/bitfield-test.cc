@@ -506,3 +506,150 @@ TEST(Bitfield, intersects)
     EXPECT_TRUE(a.intersects(b));
     EXPECT_TRUE(b.intersects(a));
 }
+
+TEST(Bitfield, andNot)
+{
+    auto a = tr_bitfield{ 100 };
+    auto b = tr_bitfield{ 100 };
+
+    a.set_has_all();
+    b.set_has_none();
+    a.and_not(b);
+    EXPECT_TRUE(a.has_all());
+
+    a.set_has_all();
+    b.set_has_all();
+    a.and_not(b);
+    EXPECT_TRUE(a.has_none());
+
+    a.set_has_all();
+    b.set_has_none();
+    b.set_span(0U, 25U);
+    a.and_not(b);
+    EXPECT_EQ(75U, a.count());
+    EXPECT_EQ(0U, a.count(0U, 25U));
+    EXPECT_EQ(75U, a.count(25U, 100U));
+
+    a.set_has_none();
+    b.set_has_none();
+    for (size_t i = 0; i < std::size(a); ++i)
+    {
+        a.set(i, (i % 2U) == 0U);
+        b.set(i, (i % 3U) == 0U);
+    }
+    a.and_not(b);
+    for (size_t i = 0; i < std::size(a); ++i)
+    {
+        EXPECT_EQ((i % 2U) == 0U && (i % 3U) != 0U, a.test(i));
+    }
+}
+
+TEST(Bitfield, findNext)
+{
+    auto bf = tr_bitfield{ 200 };
+    EXPECT_EQ(200U, bf.find_next_set(0U));
+    EXPECT_EQ(0U, bf.find_next_unset(0U));
+
+    bf.set(3U);
+    bf.set(64U);
+    bf.set(199U);
+    EXPECT_EQ(3U, bf.find_next_set(0U));
+    EXPECT_EQ(3U, bf.find_next_set(3U));
+    EXPECT_EQ(64U, bf.find_next_set(4U));
+    EXPECT_EQ(199U, bf.find_next_set(65U));
+    EXPECT_EQ(200U, bf.find_next_set(200U));
+    EXPECT_EQ(0U, bf.find_next_unset(0U));
+    EXPECT_EQ(4U, bf.find_next_unset(3U));
+
+    bf.set_span(0U, 150U);
+    EXPECT_EQ(150U, bf.find_next_unset(0U));
+    EXPECT_EQ(150U, bf.find_next_unset(64U));
+    EXPECT_EQ(199U, bf.find_next_set(150U));
+
+    // the spare bits past the end of the bitfield are never found
+    bf.set_span(150U, 200U);
+    EXPECT_TRUE(bf.has_all());
+    EXPECT_EQ(200U, bf.find_next_unset(0U));
+    EXPECT_EQ(10U, bf.find_next_set(10U));
+
+    bf.unset(10U);
+    EXPECT_EQ(10U, bf.find_next_unset(0U));
+    EXPECT_EQ(200U, bf.find_next_unset(11U));
+
+    // walking every set bit finds the same bits as test()
+    bf = tr_bitfield{ 1000 };
+    for (size_t i = 0; i < 100; ++i)
+    {
+        bf.set(tr_rand_int(1000U));
+    }
+    auto found = size_t{};
+    for (auto bit = bf.find_next_set(0U); bit < std::size(bf); bit = bf.find_next_set(bit + 1U))
+    {
+        EXPECT_TRUE(bf.test(bit));
+        ++found;
+    }
+    EXPECT_EQ(bf.count(), found);
+}
+
+TEST(Bitfield, bulkOperationsMatchBitByBit)
+{
+    // big enough to use the vectorized code, plus a ragged tail
+    auto constexpr BitCount = size_t{ 64U * 37U + 5U };
+
+    auto make_random = [&]()
+    {
+        auto bf = tr_bitfield{ BitCount };
+        for (size_t i = 0; i < BitCount; ++i)
+        {
+            bf.set(i, tr_rand_int(4U) == 0U);
+        }
+        return bf;
+    };
+
+    for (int run = 0; run < 100; ++run)
+    {
+        auto const a = make_random();
+        auto const b = make_random();
+
+        auto expected_count = size_t{};
+        auto expected_intersects = false;
+        auto ored = a;
+        ored |= b;
+        auto anded = a;
+        anded &= b;
+        auto and_notted = a;
+        and_notted.and_not(b);
+
+        for (size_t i = 0; i < BitCount; ++i)
+        {
+            expected_count += a.test(i) ? 1U : 0U;
+            expected_intersects = expected_intersects || (a.test(i) && b.test(i));
+            EXPECT_EQ(a.test(i) || b.test(i), ored.test(i));
+            EXPECT_EQ(a.test(i) && b.test(i), anded.test(i));
+            EXPECT_EQ(a.test(i) && !b.test(i), and_notted.test(i));
+        }
+
+        EXPECT_EQ(expected_count, a.count());
+        EXPECT_EQ(expected_count, a.count(0U, BitCount));
+        EXPECT_EQ(expected_intersects, a.intersects(b));
+        EXPECT_TRUE(ored.is_valid());
+        EXPECT_TRUE(anded.is_valid());
+        EXPECT_TRUE(and_notted.is_valid());
+    }
+}
+
+TEST(Bitfield, rawRoundTrip)
+{
+    auto raw = std::vector<uint8_t>(37);
+    tr_rand_buffer(std::data(raw), std::size(raw));
+    raw.back() &= 0xF0; // the last 4 bits are spare
+
+    auto bf = tr_bitfield{ std::size(raw) * 8U - 4U };
+    bf.set_raw(std::data(raw), std::size(raw));
+    EXPECT_EQ(raw, bf.raw());
+
+    for (size_t i = 0; i < std::size(bf); ++i)
+    {
+        EXPECT_EQ((raw[i / 8U] & (0x80 >> (i % 8U))) != 0, bf.test(i));
+    }
+}
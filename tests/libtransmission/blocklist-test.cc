@@ -3,11 +3,21 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
 
 #include <libtransmission/transmission.h>
 
+#include <libtransmission/blocklist.h>
+#include <libtransmission/file.h>
 #include <libtransmission/net.h>
 #include <libtransmission/session.h> // tr_session.addressIsBlocked()
 #include <libtransmission/tr-strbuf.h>
@@ -121,4 +131,133 @@ TEST_F(BlocklistTest, updating)
     // cleanup
 }
 
+TEST_F(BlocklistTest, mergesEnabledBlocklists)
+{
+    auto const dir = tr_pathbuf{ session_->configDir(), "/blocklists"sv };
+    createFileWithContents(tr_pathbuf{ dir, "/level1"sv }, Contents1);
+    createFileWithContents(
+        tr_pathbuf{ dir, "/level2"sv },
+        "Evilcorp:216.88.88.0-216.88.88.255\n"
+        "Overlaps level1:216.16.1.150-216.16.1.160\n"
+        "IPv6 example:2001:db9::-2001:db9::ffff\n");
+    tr_sessionReloadBlocklists(session_);
+    EXPECT_EQ(9U, tr_blocklistGetRuleCount(session_));
+
+    // nothing is blocked while the blocklists are disabled
+    EXPECT_FALSE(addressIsBlocked("216.88.88.1"));
+
+    tr_blocklistSetEnabled(session_, true);
+    EXPECT_TRUE(addressIsBlocked("10.1.2.3"));
+    EXPECT_TRUE(addressIsBlocked("216.88.88.1"));
+    EXPECT_TRUE(addressIsBlocked("216.16.1.144"));
+    EXPECT_TRUE(addressIsBlocked("216.16.1.155"));
+    EXPECT_TRUE(addressIsBlocked("216.16.1.160"));
+    EXPECT_FALSE(addressIsBlocked("216.16.1.161"));
+    EXPECT_TRUE(addressIsBlocked("2001:db8::1"));
+    EXPECT_TRUE(addressIsBlocked("2001:db9::1"));
+    EXPECT_FALSE(addressIsBlocked("2001:db9::1:0"));
+
+    tr_blocklistSetEnabled(session_, false);
+    EXPECT_FALSE(addressIsBlocked("216.88.88.1"));
+}
+
+TEST_F(BlocklistTest, rebuildsUnsupportedBinFiles)
+{
+    auto const path = tr_pathbuf{ session_->configDir(), "/blocklists/level1"sv };
+    createFileWithContents(path, Contents1);
+    tr_sessionReloadBlocklists(session_);
+    EXPECT_EQ(6U, tr_blocklistGetRuleCount(session_));
+
+    // replace the .bin file with one in the previous format
+    auto const bin_file = tr_pathbuf{ path, ".bin"sv };
+    createFileWithContents(bin_file, "-tr-blocklist-file-format-v3-"sv);
+    tr_sessionReloadBlocklists(session_);
+    EXPECT_EQ(6U, tr_blocklistGetRuleCount(session_));
+
+    tr_blocklistSetEnabled(session_, true);
+    EXPECT_TRUE(addressIsBlocked("216.16.1.144"));
+    EXPECT_TRUE(addressIsBlocked("2001:db8:dead:beef:dead:beef:dead:beef"));
+
+    // the rebuilt file is usable
+    auto const info = tr_sys_path_get_info(bin_file);
+    ASSERT_TRUE(info);
+    EXPECT_LT(std::size("-tr-blocklist-file-format-v3-"sv), info->size);
+}
+
+TEST_F(BlocklistTest, settingContentReplacesMappedBlocklist)
+{
+    auto const src_file = tr_pathbuf{ sandboxDir(), "/level1"sv };
+    tr_blocklistSetEnabled(session_, true);
+
+    // load the default blocklist from its .bin file, which maps it
+    createFileWithContents(src_file, Contents1);
+    EXPECT_EQ(6U, tr_blocklistSetContent(session_, src_file));
+    tr_sessionReloadBlocklists(session_);
+    EXPECT_TRUE(addressIsBlocked("216.16.1.144"));
+    EXPECT_FALSE(addressIsBlocked("216.88.88.1"));
+
+    // replace it while it's mapped
+    createFileWithContents(src_file, Contents2);
+    EXPECT_EQ(7U, tr_blocklistSetContent(session_, src_file));
+    EXPECT_EQ(7U, tr_blocklistGetRuleCount(session_));
+    EXPECT_TRUE(addressIsBlocked("216.88.88.1"));
+
+    // the new .bin file was saved
+    tr_sessionReloadBlocklists(session_);
+    EXPECT_EQ(7U, tr_blocklistGetRuleCount(session_));
+    EXPECT_TRUE(addressIsBlocked("216.88.88.1"));
+
+    // contents that can't be parsed leave the old blocklist in use
+    createFileWithContents(src_file, "# nothing useful\n");
+    EXPECT_EQ(0U, tr_blocklistSetContent(session_, src_file));
+    EXPECT_EQ(7U, tr_blocklistGetRuleCount(session_));
+    EXPECT_TRUE(addressIsBlocked("216.88.88.1"));
+}
+
+TEST_F(BlocklistTest, matchesLinearSearch)
+{
+    static auto constexpr NumRanges = 2000;
+    static auto constexpr NumLookups = 20000;
+
+    auto rng = std::mt19937{ 1234U };
+
+    // keep the addresses close together so that some of the ranges overlap
+    auto const make_address = [](bool ipv6, uint32_t n)
+    {
+        auto const str = ipv6 ? fmt::format("2001:db8::{:x}:{:x}", n >> 16U, n & 0xFFFFU) :
+                                fmt::format("10.{:d}.{:d}.{:d}", n >> 16U, (n >> 8U) & 0xFFU, n & 0xFFU);
+        return *tr_address::from_string(str);
+    };
+
+    auto contents = std::string{};
+    auto ranges = std::vector<std::pair<tr_address, tr_address>>{};
+    for (int i = 0; i < NumRanges; ++i)
+    {
+        auto const ipv6 = (i % 4) == 0;
+        auto const low = rng() % 0x40000U;
+        auto const high = low + rng() % 64U;
+        auto const& [first, last] = ranges.emplace_back(make_address(ipv6, low), make_address(ipv6, high));
+        contents += fmt::format("range {:d}:{:s}-{:s}\n", i, first.display_name(), last.display_name());
+    }
+
+    auto const src_file = tr_pathbuf{ sandboxDir(), "/external"sv };
+    auto const bin_file = tr_pathbuf{ sandboxDir(), "/level1.bin"sv };
+    createFileWithContents(src_file, contents);
+    auto const in_memory = Blocklist::saveNew(src_file, bin_file, true);
+    ASSERT_TRUE(in_memory);
+    auto const mapped = Blocklist{ bin_file, true };
+    EXPECT_EQ(in_memory->size(), mapped.size());
+
+    for (int i = 0; i < NumLookups; ++i)
+    {
+        auto const addr = make_address((i % 4) == 0, rng() % 0x40000U);
+        auto const expected = std::any_of(
+            std::begin(ranges),
+            std::end(ranges),
+            [&addr](auto const& range) { return !(addr < range.first) && !(range.second < addr); });
+        EXPECT_EQ(expected, in_memory->contains(addr)) << addr.display_name();
+        EXPECT_EQ(expected, mapped.contains(addr)) << addr.display_name();
+    }
+}
+
 } // namespace libtransmission::test
@@ -3,11 +3,17 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <array>
 #include <cstddef> // std::byte
 #include <cstdint> // uint16_t, uint32_t, uint64_t
 #include <memory>
+#include <string>
 #include <string_view>
 
+#ifndef _WIN32
+#include <sys/socket.h> // socketpair()
+#endif
+
 #include <libtransmission/transmission.h>
 
 #include <libtransmission/crypto-utils.h>
@@ -20,6 +26,13 @@ using BufferTest = ::testing::Test;
 using namespace std::literals;
 using Buffer = libtransmission::StackBuffer<1024, std::byte>;
 
+// shaped like POSIX's iovec and libutp's utp_iovec
+struct Iovec
+{
+    void* iov_base;
+    size_t iov_len;
+};
+
 TEST_F(BufferTest, startsWithInSingleSegment)
 {
     auto constexpr Hello = "Hello, "sv;
@@ -102,6 +115,93 @@ TEST_F(BufferTest, Numbers)
     }
 }
 
+TEST_F(BufferTest, chainSharesSegmentsInsteadOfCopying)
+{
+    auto const shared = std::make_shared<std::string const>("World");
+    auto const shared_sv = std::string_view{ *shared };
+
+    auto buf = libtransmission::ChainBuffer{};
+    buf.add("Hello, "sv);
+    buf.add_shared(shared, std::data(*shared), std::size(*shared));
+    buf.add("!"sv);
+    EXPECT_EQ(std::size("Hello, World!"sv), std::size(buf));
+    EXPECT_EQ(2, shared.use_count());
+
+    // the shared segment points at the caller's memory
+    auto iovs = std::array<Iovec, 8>{};
+    ASSERT_EQ(3U, buf.to_iovecs(std::data(iovs), std::size(iovs), std::size(buf)));
+    EXPECT_EQ(std::data(*shared), iovs[1].iov_base);
+    EXPECT_EQ(std::size(*shared), iovs[1].iov_len);
+
+    // n_bytes and n_iovs are both honored
+    EXPECT_EQ(2U, buf.to_iovecs(std::data(iovs), std::size(iovs), 9U));
+    EXPECT_EQ(2U, iovs[1].iov_len);
+    EXPECT_EQ(1U, buf.to_iovecs(std::data(iovs), 1U, std::size(buf)));
+
+    // splicing part of a segment leaves the rest behind
+    auto other = libtransmission::ChainBuffer{};
+    other.splice(buf, 9U);
+    EXPECT_EQ(9U, std::size(other));
+    EXPECT_EQ(4U, std::size(buf));
+    EXPECT_EQ(3, shared.use_count());
+
+    other.splice(buf);
+    EXPECT_TRUE(std::empty(buf));
+
+    auto out = std::string(std::size(other), '\0');
+    other.to_buf(std::data(out), std::size(out));
+    EXPECT_EQ("Hello, World!"sv, out);
+    EXPECT_TRUE(std::empty(other));
+    EXPECT_EQ(1, shared.use_count());
+    EXPECT_EQ("World"sv, shared_sv);
+}
+
+TEST_F(BufferTest, chainMergesAdjacentAdds)
+{
+    auto buf = libtransmission::ChainBuffer{};
+    buf.add_uint32(1U);
+    buf.add_uint8(2U);
+    buf.add_uint32(3U);
+
+    auto iovs = std::array<Iovec, 8>{};
+    EXPECT_EQ(1U, buf.to_iovecs(std::data(iovs), std::size(iovs), std::size(buf)));
+
+    buf.drain(1U);
+    auto const [span_begin, span_len] = buf.front();
+    EXPECT_EQ(8U, span_len);
+    EXPECT_EQ(std::byte{ 0 }, span_begin[0]);
+
+    buf.clear();
+    EXPECT_TRUE(std::empty(buf));
+    EXPECT_EQ(0U, buf.front().second);
+}
+
+#ifndef _WIN32
+TEST_F(BufferTest, chainToSocket)
+{
+    auto sockets = std::array<int, 2>{};
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, std::data(sockets)));
+
+    auto const shared = std::make_shared<std::string const>(4096U, 'x');
+    auto buf = libtransmission::ChainBuffer{};
+    buf.add("head"sv);
+    buf.add_shared(shared, std::data(*shared), std::size(*shared));
+    buf.add("tail"sv);
+    auto const expected = "head"s + *shared + "tail"s;
+
+    auto const n_sent = buf.to_socket(sockets[0], std::size(buf));
+    EXPECT_EQ(std::size(expected), n_sent);
+    EXPECT_TRUE(std::empty(buf));
+
+    auto out = std::string(std::size(expected), '\0');
+    EXPECT_EQ(static_cast<ssize_t>(std::size(out)), recv(sockets[1], std::data(out), std::size(out), MSG_WAITALL));
+    EXPECT_EQ(expected, out);
+
+    tr_net_close_socket(sockets[0]);
+    tr_net_close_socket(sockets[1]);
+}
+#endif
+
 #if 0
 TEST_F(BufferTest, NonBufferWriter)
 {
@@ -0,0 +1,339 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/block-info.h>
+#include <libtransmission/cache.h>
+#include <libtransmission/file.h>
+#include <libtransmission/inout.h>
+#include <libtransmission/torrent.h>
+#include <libtransmission/tr-strbuf.h>
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+namespace libtransmission::test
+{
+
+class CacheTest : public SessionTest
+{
+protected:
+    void runInSessionThread(std::function<void()>&& func)
+    {
+        auto promise = std::promise<void>{};
+        auto future = promise.get_future();
+        session_->runInSessionThread(
+            [&func, &promise]()
+            {
+                func();
+                promise.set_value();
+            });
+        future.wait();
+    }
+
+    static int writeBlock(Cache& cache, tr_torrent const* tor, tr_block_index_t block, uint8_t ch)
+    {
+        auto buf = std::make_unique<Cache::BlockData>(tor->block_size(block));
+        std::fill(std::begin(*buf), std::end(*buf), ch);
+        return cache.write_block(tor->id(), block, std::move(buf));
+    }
+};
+
+TEST_F(CacheTest, readsBlocksFromMemoryAndMergesAdjacentBlocks)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    EXPECT_NE(nullptr, tor);
+
+    runInSessionThread(
+        [this, tor]()
+        {
+            auto& cache = *session_->cache;
+            EXPECT_EQ(0, cache.set_limit(tr_block_info::BlockSize * 16U));
+            auto const before = cache.stats();
+
+            // write three blocks out of order, all of them adjacent
+            EXPECT_EQ(0, writeBlock(cache, tor, 2, 'c'));
+            EXPECT_EQ(0, writeBlock(cache, tor, 0, 'a'));
+            EXPECT_EQ(0, writeBlock(cache, tor, 1, 'b'));
+            auto stats = cache.stats();
+            EXPECT_EQ(3U, stats.cached_blocks);
+            EXPECT_EQ(before.cache_writes + 3U, stats.cache_writes);
+
+            // a read of a cached block should not touch the disk
+            auto buf = std::array<uint8_t, tr_block_info::BlockSize>{};
+            EXPECT_EQ(0, cache.read_block(tor, tor->block_loc(1), std::size(buf), std::data(buf)));
+            EXPECT_TRUE(std::all_of(std::begin(buf), std::end(buf), [](auto ch) { return ch == 'b'; }));
+            stats = cache.stats();
+            EXPECT_EQ(before.read_hits + 1U, stats.read_hits);
+            EXPECT_EQ(before.read_misses, stats.read_misses);
+
+            EXPECT_FALSE(cache.is_on_disk(tor, tor->block_loc(1), tr_block_info::BlockSize));
+            EXPECT_FALSE(cache.is_on_disk(tor, tor->byte_loc(tr_block_info::BlockSize * 3U - 1U), 2U));
+            EXPECT_TRUE(cache.is_on_disk(tor, tor->block_loc(3), tr_block_info::BlockSize));
+
+            // the three blocks should be flushed in a single write
+            EXPECT_EQ(0, cache.flush_torrent(tor));
+            stats = cache.stats();
+            EXPECT_EQ(0U, stats.cached_blocks);
+            EXPECT_TRUE(cache.is_on_disk(tor, tor->block_loc(1), tr_block_info::BlockSize));
+            EXPECT_EQ(before.disk_writes + 1U, stats.disk_writes);
+            EXPECT_EQ(before.disk_write_bytes + tr_block_info::BlockSize * 3U, stats.disk_write_bytes);
+
+            // now the block has to come from disk
+            buf.fill(0);
+            EXPECT_EQ(0, cache.read_block(tor, tor->block_loc(1), std::size(buf), std::data(buf)));
+            EXPECT_TRUE(std::all_of(std::begin(buf), std::end(buf), [](auto ch) { return ch == 'b'; }));
+            EXPECT_EQ(before.read_misses + 1U, cache.stats().read_misses);
+        });
+
+    tr_torrentRemove(tor, true, nullptr, nullptr);
+}
+
+TEST_F(CacheTest, trimFlushesBiggestRun)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    EXPECT_NE(nullptr, tor);
+
+    runInSessionThread(
+        [this, tor]()
+        {
+            auto& cache = *session_->cache;
+            EXPECT_EQ(0, cache.set_limit(tr_block_info::BlockSize * 4U));
+            auto const before = cache.stats();
+
+            EXPECT_EQ(0, writeBlock(cache, tor, 10, 'x'));
+            EXPECT_EQ(0, writeBlock(cache, tor, 0, 'x'));
+            EXPECT_EQ(0, writeBlock(cache, tor, 1, 'x'));
+            EXPECT_EQ(0, writeBlock(cache, tor, 2, 'x'));
+            EXPECT_EQ(before.disk_writes, cache.stats().disk_writes);
+
+            // going over the limit should flush [0..3), the biggest run
+            EXPECT_EQ(0, writeBlock(cache, tor, 20, 'x'));
+            auto const stats = cache.stats();
+            EXPECT_EQ(2U, stats.cached_blocks);
+            EXPECT_EQ(before.disk_writes + 1U, stats.disk_writes);
+            EXPECT_EQ(before.disk_write_bytes + tr_block_info::BlockSize * 3U, stats.disk_write_bytes);
+
+            EXPECT_EQ(0, cache.flush_torrent(tor));
+            EXPECT_EQ(0U, cache.stats().cached_blocks);
+        });
+
+    tr_torrentRemove(tor, true, nullptr, nullptr);
+}
+
+TEST_F(CacheTest, readCacheKeepsPopularBlocks)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    EXPECT_NE(nullptr, tor);
+
+    runInSessionThread(
+        [this, tor]()
+        {
+            auto& cache = *session_->cache;
+            EXPECT_EQ(0, cache.set_limit(tr_block_info::BlockSize * 16U));
+            cache.set_read_cache_limit(tr_block_info::BlockSize * 2U);
+
+            for (tr_block_index_t block = 0; block < 4; ++block)
+            {
+                EXPECT_EQ(0, writeBlock(cache, tor, block, static_cast<uint8_t>('a' + block)));
+            }
+            EXPECT_EQ(0, cache.flush_torrent(tor));
+
+            auto buf = std::array<uint8_t, tr_block_info::BlockSize>{};
+            auto const read = [&cache, &buf, tor](tr_block_index_t block)
+            {
+                EXPECT_EQ(0, cache.read_block(tor, tor->block_loc(block), std::size(buf), std::data(buf)));
+                EXPECT_EQ('a' + block, buf.front());
+                EXPECT_EQ('a' + block, buf.back());
+            };
+
+            // the first read goes to disk, the second one doesn't
+            auto const before = cache.stats();
+            read(0);
+            read(0);
+            auto stats = cache.stats();
+            EXPECT_EQ(before.read_misses + 1U, stats.read_misses);
+            EXPECT_EQ(before.read_hits + 1U, stats.read_hits);
+            EXPECT_EQ(1U, stats.read_cache_blocks);
+
+            // an unaligned read that spans two blocks
+            auto const loc = tor->byte_loc(tr_block_info::BlockSize - 2U);
+            EXPECT_EQ(0, cache.read_block(tor, loc, 4U, std::data(buf)));
+            EXPECT_EQ('a', buf[0]);
+            EXPECT_EQ('a', buf[1]);
+            EXPECT_EQ('b', buf[2]);
+            EXPECT_EQ('b', buf[3]);
+            EXPECT_EQ(2U, cache.stats().read_cache_blocks);
+
+            // block 0 was used again, so block 1 should be the one that's evicted
+            read(0);
+            read(2);
+            stats = cache.stats();
+            read(0);
+            EXPECT_EQ(stats.read_misses, cache.stats().read_misses);
+            read(1);
+            EXPECT_EQ(stats.read_misses + 1U, cache.stats().read_misses);
+            EXPECT_EQ(2U, cache.stats().read_cache_blocks);
+
+            // writing a block invalidates its clean copy
+            EXPECT_EQ(0, writeBlock(cache, tor, 0, 'z'));
+            EXPECT_EQ(0, cache.read_block(tor, tor->block_loc(0), std::size(buf), std::data(buf)));
+            EXPECT_EQ('z', buf.front());
+
+            // closing the torrent's files drops its clean blocks
+            EXPECT_EQ(0, cache.flush_torrent(tor));
+            EXPECT_EQ(0U, cache.stats().read_cache_blocks);
+            cache.set_read_cache_limit(0U);
+        });
+
+    tr_torrentRemove(tor, true, nullptr, nullptr);
+}
+
+TEST_F(CacheTest, writeThroughDropsCleanBlock)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    EXPECT_NE(nullptr, tor);
+
+    runInSessionThread(
+        [this, tor]()
+        {
+            // no write cache, so writes go straight to disk
+            auto& cache = *session_->cache;
+            EXPECT_EQ(0, cache.set_limit(0U));
+            cache.set_read_cache_limit(tr_block_info::BlockSize * 2U);
+
+            auto buf = std::array<uint8_t, tr_block_info::BlockSize>{};
+            EXPECT_EQ(0, writeBlock(cache, tor, 0, 'a'));
+            EXPECT_EQ(0, cache.read_block(tor, tor->block_loc(0), std::size(buf), std::data(buf)));
+            EXPECT_EQ('a', buf.front());
+            EXPECT_EQ(1U, cache.stats().read_cache_blocks);
+
+            // the clean copy of the old data mustn't be served after the new data is written
+            EXPECT_EQ(0, writeBlock(cache, tor, 0, 'z'));
+            EXPECT_EQ(0U, cache.stats().read_cache_blocks);
+            EXPECT_EQ(0, cache.read_block(tor, tor->block_loc(0), std::size(buf), std::data(buf)));
+            EXPECT_EQ('z', buf.front());
+            EXPECT_EQ('z', buf.back());
+
+            cache.set_read_cache_limit(0U);
+        });
+
+    tr_torrentRemove(tor, true, nullptr, nullptr);
+}
+
+TEST_F(CacheTest, ioPoolFlushesAndPrefetchesInBackground)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    EXPECT_NE(nullptr, tor);
+
+    auto buf = std::array<uint8_t, tr_block_info::BlockSize>{};
+    auto stats = Cache::Stats{};
+
+    runInSessionThread(
+        [this, tor, &buf, &stats]()
+        {
+            auto& cache = *session_->cache;
+            cache.set_io_pool(std::make_unique<tr_io_pool>(session_, 2U));
+            EXPECT_EQ(0, cache.set_limit(tr_block_info::BlockSize * 2U));
+            cache.set_read_cache_limit(tr_block_info::BlockSize * 4U);
+
+            // going over the limit hands [0..2) to the pool...
+            EXPECT_EQ(0, writeBlock(cache, tor, 0, 'a'));
+            EXPECT_EQ(0, writeBlock(cache, tor, 1, 'b'));
+            EXPECT_EQ(0, writeBlock(cache, tor, 5, 'c'));
+            EXPECT_EQ(1U, cache.stats().cached_blocks);
+
+            // ...but those blocks are still readable while they're being written
+            stats = cache.stats();
+            EXPECT_EQ(0, cache.read_block(tor, tor->block_loc(0), std::size(buf), std::data(buf)));
+            EXPECT_EQ('a', buf.front());
+            EXPECT_EQ(stats.read_misses, cache.stats().read_misses);
+
+            // closing the torrent's files waits for its writes to finish
+            EXPECT_EQ(0, cache.flush_torrent(tor));
+            EXPECT_EQ(0, cache.read_block(tor, tor->block_loc(0), std::size(buf), std::data(buf)));
+            EXPECT_EQ('a', buf.back());
+            EXPECT_EQ(0, cache.read_block(tor, tor->block_loc(5), std::size(buf), std::data(buf)));
+            EXPECT_EQ('c', buf.back());
+
+            // prefetching reads the block into the read cache in the background
+            stats = cache.stats();
+            EXPECT_EQ(0, cache.prefetch_block(tor, tor->block_loc(1), tr_block_info::BlockSize));
+        });
+
+    auto const prefetched = [this, &stats]()
+    {
+        auto n_blocks = size_t{};
+        runInSessionThread([this, &n_blocks]() { n_blocks = session_->cache->stats().read_cache_blocks; });
+        return n_blocks > stats.read_cache_blocks;
+    };
+    EXPECT_TRUE(waitFor(prefetched, 5000));
+
+    runInSessionThread(
+        [this, tor, &buf, &stats]()
+        {
+            auto& cache = *session_->cache;
+            EXPECT_EQ(0, cache.read_block(tor, tor->block_loc(1), std::size(buf), std::data(buf)));
+            EXPECT_EQ('b', buf.front());
+            EXPECT_EQ(stats.read_misses, cache.stats().read_misses);
+
+            cache.set_io_pool(nullptr);
+            cache.set_read_cache_limit(0U);
+        });
+
+    tr_torrentRemove(tor, true, nullptr, nullptr);
+}
+
+TEST_F(CacheTest, ioPoolFlushKeepsFailedWrites)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    EXPECT_NE(nullptr, tor);
+
+    // a folder where the first file should be, so that writing to it fails
+    auto const filename = tr_pathbuf{ tor->current_dir(), '/', tor->file_subpath(0) };
+    EXPECT_TRUE(tr_sys_dir_create(filename, TR_SYS_DIR_CREATE_PARENTS, 0700));
+
+    runInSessionThread(
+        [this, tor, &filename]()
+        {
+            auto& cache = *session_->cache;
+            cache.set_io_pool(std::make_unique<tr_io_pool>(session_, 2U));
+            EXPECT_EQ(0, cache.set_limit(tr_block_info::BlockSize * 2U));
+
+            // going over the limit hands [0..2) to the pool, where it fails
+            EXPECT_EQ(0, writeBlock(cache, tor, 0, 'a'));
+            EXPECT_EQ(0, writeBlock(cache, tor, 1, 'b'));
+            EXPECT_EQ(0, writeBlock(cache, tor, 5, 'c'));
+            EXPECT_EQ(1U, cache.stats().cached_blocks);
+
+            // flushing waits for the failed write, puts its blocks
+            // back in the cache, and reports that they can't be written
+            EXPECT_NE(0, cache.flush_torrent(tor));
+            EXPECT_EQ(3U, cache.stats().cached_blocks);
+
+            // so nothing is lost once the file can be written
+            EXPECT_TRUE(tr_sys_path_remove(filename));
+            EXPECT_EQ(0, cache.flush_torrent(tor));
+            EXPECT_EQ(0U, cache.stats().cached_blocks);
+
+            auto buf = std::array<uint8_t, tr_block_info::BlockSize>{};
+            EXPECT_EQ(0, cache.read_block(tor, tor->block_loc(1), std::size(buf), std::data(buf)));
+            EXPECT_EQ('b', buf.front());
+
+            cache.set_io_pool(nullptr);
+        });
+
+    tr_torrentRemove(tor, true, nullptr, nullptr);
+}
+
+} // namespace libtransmission::test
@@ -3,6 +3,7 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cstddef> // std::byte, size_t
@@ -15,6 +16,7 @@
 
 #include <libtransmission/peer-mse.h>
 #include <libtransmission/crypto-utils.h>
+#include <libtransmission/tr-arc4.h>
 #include <libtransmission/tr-macros.h>
 #include <libtransmission/utils.h>
 
@@ -96,6 +98,81 @@ TEST(Crypto, encryptDecrypt)
     EXPECT_EQ(Input2, std::data(decrypted2)) << "Input2 " << Input2 << " decrypted2 " << std::data(decrypted2);
 }
 
+TEST(Crypto, decryptInPlace)
+{
+    auto a_dh = tr_message_stream_encryption::DH{};
+    auto b_dh = tr_message_stream_encryption::DH{};
+
+    a_dh.setPeerPublicKey(b_dh.publicKey());
+    b_dh.setPeerPublicKey(a_dh.publicKey());
+
+    auto constexpr Input = "@#)C$@)#(*%bvkdjfhwbc039bc4603756VB3)"sv;
+    auto buf = std::array<char, std::size(Input)>{};
+
+    // a no-op until decrypt_init()
+    auto b = tr_message_stream_encryption::Filter{};
+    std::copy_n(std::data(Input), std::size(Input), std::data(buf));
+    b.decrypt(std::data(buf), std::size(buf));
+    EXPECT_EQ(Input, std::string_view(std::data(buf), std::size(buf)));
+
+    auto a = tr_message_stream_encryption::Filter{};
+    a.encrypt_init(false, a_dh, SomeHash);
+    a.encrypt(std::data(Input), std::size(Input), std::data(buf));
+    EXPECT_NE(Input, std::string_view(std::data(buf), std::size(buf)));
+
+    // decrypting a piece at a time is the same as decrypting it all at once
+    b.decrypt_init(true, b_dh, SomeHash);
+    b.decrypt(std::data(buf), 5U);
+    b.decrypt(std::data(buf) + 5U, std::size(buf) - 5U);
+    EXPECT_EQ(Input, std::string_view(std::data(buf), std::size(buf)));
+}
+
+TEST(Crypto, arc4)
+{
+    // test vectors from https://en.wikipedia.org/wiki/RC4#Test_vectors
+    struct Vector
+    {
+        std::string_view key;
+        std::string_view plaintext;
+        std::string_view ciphertext;
+    };
+
+    auto constexpr Vectors = std::array<Vector, 3>{ {
+        { "Key"sv, "Plaintext"sv, "\xBB\xF3\x16\xE8\xD9\x40\xAF\x0A\xD3"sv },
+        { "Wiki"sv, "pedia"sv, "\x10\x21\xBF\x04\x20"sv },
+        { "Secret"sv, "Attack at dawn"sv, "\x45\xA0\x1F\x64\x5F\xC3\x5B\x38\x35\x52\x54\x4B\x9B\xF5"sv },
+    } };
+
+    for (auto const& [key, plaintext, ciphertext] : Vectors)
+    {
+        auto const* const src = reinterpret_cast<uint8_t const*>(std::data(plaintext));
+        auto buf = std::array<uint8_t, 32>{};
+        auto const buf_sv = [&buf](size_t len)
+        {
+            return std::string_view{ reinterpret_cast<char const*>(std::data(buf)), len };
+        };
+
+        auto arc4 = tr_arc4{ std::data(key), std::size(key) };
+        arc4.process(src, std::size(plaintext), std::data(buf));
+        EXPECT_EQ(ciphertext, buf_sv(std::size(ciphertext)));
+
+        // in place, and a byte at a time
+        arc4 = tr_arc4{ std::data(key), std::size(key) };
+        std::copy_n(src, std::size(plaintext), std::data(buf));
+        for (size_t i = 0; i < std::size(plaintext); ++i)
+        {
+            arc4.process(&buf[i], 1U, &buf[i]);
+        }
+        EXPECT_EQ(ciphertext, buf_sv(std::size(ciphertext)));
+
+        // discard() skips the same keystream that process() would use
+        arc4 = tr_arc4{ std::data(key), std::size(key) };
+        arc4.discard(1U);
+        arc4.process(src + 1, std::size(plaintext) - 1U, std::data(buf));
+        EXPECT_EQ(ciphertext.substr(1), buf_sv(std::size(ciphertext) - 1U));
+    }
+}
+
 TEST(Crypto, sha1)
 {
     auto hash1 = tr_sha1::digest("test"sv);
@@ -1222,6 +1222,47 @@ TEST_F(FileTest, fileTruncate)
     tr_sys_path_remove(path);
 }
 
+TEST_F(FileTest, fileWritevAt)
+{
+    auto const test_dir = createTestDir(currentTestName());
+
+    auto const path = tr_pathbuf{ test_dir, "/a"sv };
+    createFileWithContents(path, "0123456789"sv);
+    auto fd = tr_sys_file_open(path, TR_SYS_FILE_READ | TR_SYS_FILE_WRITE, 0600);
+    EXPECT_NE(TR_BAD_SYS_FILE, fd);
+
+    // write several buffers, including an empty one, as a single span
+    auto constexpr Hello = "hello"sv;
+    auto constexpr Empty = ""sv;
+    auto constexpr World = "world"sv;
+    auto const bufs = std::array<tr_sys_iovec, 3>{ {
+        { std::data(Hello), std::size(Hello) },
+        { std::data(Empty), std::size(Empty) },
+        { std::data(World), std::size(World) },
+    } };
+
+    auto n_written = uint64_t{};
+    tr_error* err = nullptr;
+    EXPECT_TRUE(tr_sys_file_writev_at(fd, std::data(bufs), std::size(bufs), 2U, &n_written, &err));
+    EXPECT_EQ(nullptr, err) << *err;
+    EXPECT_EQ(std::size(Hello) + std::size(World), n_written);
+
+    auto buf = std::array<char, 64>{};
+    auto n_read = uint64_t{};
+    EXPECT_TRUE(tr_sys_file_read_at(fd, std::data(buf), std::size(buf), 0U, &n_read, &err));
+    EXPECT_EQ(nullptr, err) << *err;
+    EXPECT_EQ("01helloworld"sv, std::string_view(std::data(buf), n_read));
+
+    tr_sys_file_close(fd);
+
+    // try to write to a closed file
+    EXPECT_FALSE(tr_sys_file_writev_at(fd, std::data(bufs), std::size(bufs), 0U, &n_written, &err)); // coverity[USE_AFTER_FREE]
+    EXPECT_NE(nullptr, err);
+    tr_error_clear(&err);
+
+    tr_sys_path_remove(path);
+}
+
 TEST_F(FileTest, filePreallocate)
 {
     auto const test_dir = createTestDir(currentTestName());
@@ -1283,6 +1324,33 @@ TEST_F(FileTest, filePreallocate)
     tr_sys_path_remove(path1);
 }
 
+TEST_F(FileTest, fileMap)
+{
+    auto const test_dir = createTestDir(currentTestName());
+
+    auto const path1 = tr_pathbuf{ test_dir, "/a"sv };
+    auto const contents = std::string{ "test" };
+    createFileWithContents(path1, contents);
+
+    auto const fd = tr_sys_file_open(path1, TR_SYS_FILE_READ, 0600);
+    EXPECT_NE(TR_BAD_SYS_FILE, fd);
+
+    tr_error* err = nullptr;
+    auto const* const view = tr_sys_file_map_for_reading(fd, 0, std::size(contents), &err);
+    EXPECT_NE(nullptr, view);
+    EXPECT_EQ(nullptr, err) << *err;
+    EXPECT_EQ(contents, (std::string_view{ static_cast<char const*>(view), std::size(contents) }));
+
+    // the view outlives the descriptor
+    tr_sys_file_close(fd);
+    EXPECT_EQ(contents, (std::string_view{ static_cast<char const*>(view), std::size(contents) }));
+
+    EXPECT_TRUE(tr_sys_file_unmap(view, std::size(contents), &err));
+    EXPECT_EQ(nullptr, err) << *err;
+
+    tr_sys_path_remove(path1);
+}
+
 TEST_F(FileTest, dirCreate)
 {
     auto const test_dir = createTestDir(currentTestName());
@@ -5,14 +5,20 @@
 
 #define LIBTRANSMISSION_VARIANT_MODULE
 
+#include <array>
+#include <cstddef> // std::byte
 #include <cstdint> // int64_t
+#include <limits>
 #include <locale>
 #include <optional>
 #include <stdexcept> // std::runtime_error
 #include <string>
 #include <string_view>
 
+#include <libtransmission/error.h>
+#include <libtransmission/json-writer.h>
 #include <libtransmission/quark.h>
+#include <libtransmission/tr-buffer.h>
 #include <libtransmission/variant.h>
 
 #include "gtest/gtest.h"
@@ -250,6 +256,186 @@ TEST_P(JSONTest, unescape)
     tr_variantClear(&top);
 }
 
+TEST_P(JSONTest, inplace)
+{
+    auto const in = R"({ "plain": "hello world", "escaped": "hello\tworld" })"sv;
+
+    auto top = tr_variant{};
+    EXPECT_TRUE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE, in));
+
+    // strings without escapes are views into the input...
+    auto sv = std::string_view{};
+    EXPECT_TRUE(tr_variantDictFindStrView(&top, tr_quark_new("plain"sv), &sv));
+    EXPECT_EQ("hello world"sv, sv);
+    EXPECT_EQ(std::data(in) + in.find("hello world"), std::data(sv));
+
+    // ...but strings with escapes have to be unescaped somewhere else
+    EXPECT_TRUE(tr_variantDictFindStrView(&top, tr_quark_new("escaped"sv), &sv));
+    EXPECT_EQ("hello\tworld"sv, sv);
+    EXPECT_EQ(std::string_view::npos, in.find(sv));
+
+    tr_variantClear(&top);
+}
+
+TEST_P(JSONTest, escapesAcrossBlocks)
+{
+    // the parser reads its input in 64-byte blocks, so try backslashes and
+    // quotes at every offset to be sure that escapes are tracked across them
+    auto const key = tr_quark_new("key"sv);
+    for (size_t padding = 0; padding < 70U; ++padding)
+    {
+        for (size_t n_backslashes = 0; n_backslashes < 6U; ++n_backslashes)
+        {
+            auto const expected = std::string(padding, 'x') + std::string(n_backslashes, '\\') + "\"y\\";
+
+            auto top = tr_variant{};
+            tr_variantInitDict(&top, 1);
+            tr_variantDictAddStr(&top, key, expected);
+            auto const json = tr_variantToStr(&top, TR_VARIANT_FMT_JSON_LEAN);
+            tr_variantClear(&top);
+
+            EXPECT_TRUE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE, json)) << json;
+            auto sv = std::string_view{};
+            EXPECT_TRUE(tr_variantDictFindStrView(&top, key, &sv));
+            EXPECT_EQ(expected, sv);
+            tr_variantClear(&top);
+        }
+    }
+}
+
+TEST_P(JSONTest, roundTrip)
+{
+    auto top = tr_variant{};
+    tr_variantInitDict(&top, 3);
+    auto* const list = tr_variantDictAddList(&top, TR_KEY_torrents, 200);
+    for (int64_t i = 0; i < 200; ++i)
+    {
+        auto* const dict = tr_variantListAddDict(list, 6);
+        tr_variantDictAddInt(dict, TR_KEY_id, i * 7919 - 500000);
+        tr_variantDictAddStr(dict, TR_KEY_name, std::string(static_cast<size_t>(i % 80), static_cast<char>('a' + i % 26)));
+        tr_variantDictAddStr(dict, TR_KEY_comment, "quote \" backslash \\ tab \t newline \n Letöltések"sv);
+        tr_variantDictAddReal(dict, TR_KEY_percentDone, static_cast<double>(i) / 8);
+        tr_variantDictAddBool(dict, TR_KEY_isPrivate, i % 2 == 0);
+        tr_variantDictAddList(dict, TR_KEY_labels, 0);
+    }
+    tr_variantDictAddDict(&top, TR_KEY_arguments, 0);
+    tr_variantDictAddInt(&top, TR_KEY_tag, std::numeric_limits<int64_t>::min());
+    auto const lean = tr_variantToStr(&top, TR_VARIANT_FMT_JSON_LEAN);
+    auto const pretty = tr_variantToStr(&top, TR_VARIANT_FMT_JSON);
+    tr_variantClear(&top);
+
+    for (auto const& json : { lean, pretty })
+    {
+        for (auto const opts : { int{ TR_VARIANT_PARSE_JSON }, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE })
+        {
+            EXPECT_TRUE(tr_variantFromBuf(&top, opts, json));
+            EXPECT_EQ(lean, tr_variantToStr(&top, TR_VARIANT_FMT_JSON_LEAN));
+            tr_variantClear(&top);
+        }
+    }
+}
+
+TEST_P(JSONTest, scalars)
+{
+    auto top = tr_variant{};
+
+    auto i = int64_t{};
+    EXPECT_TRUE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON, " -42 "sv));
+    EXPECT_TRUE(tr_variantGetInt(&top, &i));
+    EXPECT_EQ(-42, i);
+
+    // out-of-range ints saturate
+    EXPECT_TRUE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON, "99999999999999999999"sv));
+    EXPECT_TRUE(tr_variantGetInt(&top, &i));
+    EXPECT_EQ(std::numeric_limits<int64_t>::max(), i);
+
+    auto d = double{};
+    EXPECT_TRUE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON, "[2.5e3]"sv));
+    EXPECT_TRUE(tr_variantGetReal(tr_variantListChild(&top, 0), &d));
+    EXPECT_EQ(2500, static_cast<int>(d));
+    tr_variantClear(&top);
+
+    auto sv = std::string_view{};
+    EXPECT_TRUE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON, R"("é")"sv));
+    EXPECT_TRUE(tr_variantGetStrView(&top, &sv));
+    EXPECT_EQ("é"sv, sv);
+    tr_variantClear(&top);
+}
+
+TEST_P(JSONTest, malformed)
+{
+    static auto constexpr Malformed = std::array<std::string_view, 19>{
+        "{"sv,
+        "[1, 2"sv,
+        R"({ "key": "value)"sv,
+        R"({ "key" "value" })"sv,
+        R"({ "key": })"sv,
+        R"({ "key": 1, })"sv,
+        R"({ 1: 2 })"sv,
+        "[1, 2,]"sv,
+        "[1 2]"sv,
+        "[1, 2}"sv,
+        "[1, 2]]"sv,
+        "[1, 2] [3]"sv,
+        "[tru]"sv,
+        "[nulll]"sv,
+        "[-]"sv,
+        "[1.]"sv,
+        "[1e]"sv,
+        R"(["bad \q escape"])"sv,
+        "}"sv,
+    };
+
+    for (auto const& json : Malformed)
+    {
+        auto top = tr_variant{};
+        tr_error* error = nullptr;
+        EXPECT_FALSE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE, json, nullptr, &error)) << json;
+        EXPECT_NE(nullptr, error) << json;
+        EXPECT_TRUE(tr_variantIsEmpty(&top));
+        tr_error_clear(&error);
+    }
+
+    // too deep
+    auto const deep = std::string(100U, '[') + std::string(100U, ']');
+    auto top = tr_variant{};
+    EXPECT_FALSE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON, deep));
+    EXPECT_TRUE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON, std::string_view{ deep }.substr(36U, 128U)));
+    tr_variantClear(&top);
+}
+
+TEST_P(JSONTest, writer)
+{
+    auto buf = libtransmission::StackBuffer<256U, std::byte>{};
+    auto writer = libtransmission::JsonWriter{ buf };
+
+    writer.start_object();
+    writer.add_int(TR_KEY_id, 5);
+    writer.add_str(TR_KEY_name, "tab\t quote\" \u00e9"sv);
+    writer.key(TR_KEY_files);
+    writer.start_array();
+    writer.add_real(6.5);
+    writer.add_bool(true);
+    writer.start_object();
+    writer.end_object();
+    writer.start_array();
+    writer.end_array();
+    writer.end_array();
+    writer.add_bool(TR_KEY_wanted, false);
+    writer.end_object();
+
+    EXPECT_EQ(R"({"id":5,"name":"tab\t quote\" \u00e9","files":[6.5000,true,{},[]],"wanted":false})"sv, buf.to_string());
+
+    // the writer and the tr_variant serializer should agree
+    auto top = tr_variant{};
+    EXPECT_TRUE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON, buf.to_string_view()));
+    EXPECT_EQ(
+        R"({"files":[6.5000,true,{},[]],"id":5,"name":"tab\t quote\" \u00e9","wanted":false})"
+        "\n"sv,
+        tr_variantToStr(&top, TR_VARIANT_FMT_JSON_LEAN));
+    tr_variantClear(&top);
+}
+
 INSTANTIATE_TEST_SUITE_P( //
     JSON,
     JSONTest,
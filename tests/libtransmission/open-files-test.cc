@@ -204,3 +204,39 @@ TEST_F(OpenFilesTest, closesLeastRecentlyUsedFile)
     EXPECT_EQ(sorted, results);
     EXPECT_GT(std::count(std::begin(results), std::end(results), true), 0);
 }
+
+TEST_F(OpenFilesTest, lentFilesCountAgainstTheLimit)
+{
+    static auto constexpr Contents = "Hello, World!\n"sv;
+    static auto constexpr TorId = tr_torrent_id_t{ 0 };
+    static auto constexpr NumFiles = tr_file_index_t{ 3 };
+
+    auto open_files = tr_open_files{ NumFiles };
+    auto const open_all = [this, &open_files]()
+    {
+        for (tr_file_index_t i = 0; i < NumFiles; ++i)
+        {
+            auto filename = tr_pathbuf{ sandboxDir(), fmt::format("/file-{:d}.txt"sv, i) };
+            EXPECT_TRUE(open_files.get(TorId, i, true, filename, TR_PREALLOCATE_FULL, std::size(Contents)));
+        }
+    };
+
+    // with one file lent out, only the two newest files stay open
+    open_files.lend(1U);
+    open_all();
+    EXPECT_FALSE(open_files.get(TorId, 0, false));
+    EXPECT_TRUE(open_files.get(TorId, 1, false));
+    EXPECT_TRUE(open_files.get(TorId, 2, false));
+
+    // lending more closes files to make room
+    open_files.lend(1U);
+    EXPECT_EQ(1, !!open_files.get(TorId, 1, false) + !!open_files.get(TorId, 2, false));
+
+    // once the files are given back, all of them fit again
+    open_files.take_back(2U);
+    open_all();
+    for (tr_file_index_t i = 0; i < NumFiles; ++i)
+    {
+        EXPECT_TRUE(open_files.get(TorId, i, false));
+    }
+}
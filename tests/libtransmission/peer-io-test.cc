@@ -0,0 +1,230 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <array>
+#include <cerrno>
+#include <cstddef> // size_t, std::byte
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#endif
+
+#include <event2/util.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/crypto-utils.h>
+#include <libtransmission/net.h>
+#include <libtransmission/peer-io.h>
+#include <libtransmission/peer-mse.h>
+#include <libtransmission/peer-socket.h>
+#include <libtransmission/session.h>
+#include <libtransmission/utils.h>
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+#ifdef _WIN32
+#define LOCAL_SOCKETPAIR_AF AF_INET
+#else
+#define LOCAL_SOCKETPAIR_AF AF_UNIX
+#endif
+
+namespace libtransmission::test
+{
+
+auto constexpr MaxWaitMsec = int{ 5000 };
+
+class PeerIoTest : public SessionTest
+{
+protected:
+    using DH = tr_message_stream_encryption::DH;
+
+    // everything a tr_peerIo has received, as seen by its CanRead callback
+    struct Received
+    {
+        [[nodiscard]] std::string str() const
+        {
+            auto const lock = std::lock_guard{ mutex };
+            return data;
+        }
+
+        mutable std::mutex mutex;
+        std::string data;
+    };
+
+    static ReadState canRead(tr_peerIo* io, void* vreceived, size_t* /*piece*/)
+    {
+        auto* const received = static_cast<Received*>(vreceived);
+        auto buf = std::string(io->read_buffer_size(), '\0');
+        io->read_bytes(std::data(buf), std::size(buf));
+
+        auto const lock = std::lock_guard{ received->mutex };
+        received->data += buf;
+        return READ_LATER;
+    }
+
+    // A pair of connected peers whose connection is encrypted,
+    // like it would be after an MSE handshake.
+    auto createEncryptedPair()
+    {
+        auto sockpair = std::array<evutil_socket_t, 2>{ -1, -1 };
+        EXPECT_EQ(0, evutil_socketpair(LOCAL_SOCKETPAIR_AF, SOCK_STREAM, 0, std::data(sockpair))) << tr_strerror(errno);
+
+        auto const sock_addr = tr_socket_address{ *tr_address::from_string("127.0.0.1"sv), tr_port::fromHost(8080) };
+        auto ios = std::array<std::shared_ptr<tr_peerIo>, 2>{};
+        for (size_t i = 0; i < 2U; ++i)
+        {
+            ios[i] = tr_peerIo::new_incoming(session_, nullptr, tr_peer_socket(session_, sock_addr, sockpair[i]));
+        }
+
+        auto const info_hash = tr_sha1::digest("abcde"sv);
+        auto dh = std::array<DH, 2>{};
+        dh[0].setPeerPublicKey(dh[1].publicKey());
+        dh[1].setPeerPublicKey(dh[0].publicKey());
+        for (size_t i = 0; i < 2U; ++i)
+        {
+            auto const is_incoming = i == 1U;
+            ios[i]->encrypt_init(is_incoming, dh[i], info_hash);
+            ios[i]->decrypt_init(is_incoming, dh[i], info_hash);
+        }
+
+        return ios;
+    }
+
+    template<typename Func>
+    void runInSessionThread(Func&& func)
+    {
+        auto promise = std::promise<void>{};
+        auto future = promise.get_future();
+        session_->runInSessionThread(
+            [&func, &promise]()
+            {
+                func();
+                promise.set_value();
+            });
+        future.wait();
+    }
+
+    [[nodiscard]] static std::string makePayload(size_t len, char seed)
+    {
+        auto ret = std::string(len, '\0');
+        for (size_t i = 0; i < len; ++i)
+        {
+            ret[i] = static_cast<char>(seed + i * 7U % 251U);
+        }
+        return ret;
+    }
+};
+
+TEST_F(PeerIoTest, moveToThreadKeepsEncryptedStream)
+{
+    auto threads = tr_peer_io_threads{ 2U };
+    auto ios = createEncryptedPair();
+    auto& local = ios[0];
+    auto& remote = ios[1];
+    auto local_received = Received{};
+    auto remote_received = Received{};
+
+    auto const before_move = makePayload(4000U, 'a');
+    auto const reply_before_move = makePayload(3000U, 'b');
+    auto const after_move = makePayload(1024U * 1024U, 'c');
+    auto const reply_after_move = makePayload(512U * 1024U, 'd');
+
+    // `remote` reads some data before it's moved, but has nobody to hand it to yet,
+    // so it sits still encrypted in its read buffer
+    runInSessionThread(
+        [&]()
+        {
+            local->set_callbacks(&canRead, nullptr, nullptr, &local_received);
+            local->write_bytes(std::data(before_move), std::size(before_move), false);
+            local->set_enabled(TR_UP, true);
+            local->set_enabled(TR_DOWN, true);
+            remote->set_enabled(TR_DOWN, true);
+        });
+    auto const read_before_move = [&]()
+    {
+        auto n_bytes = size_t{};
+        runInSessionThread([&]() { n_bytes = remote->read_buffer_size(); });
+        return n_bytes == std::size(before_move);
+    };
+    EXPECT_TRUE(waitFor(read_before_move, MaxWaitMsec));
+
+    // `remote` also has data queued to send when it's moved
+    runInSessionThread(
+        [&]()
+        {
+            remote->write_bytes(std::data(reply_before_move), std::size(reply_before_move), false);
+            remote->set_callbacks(&canRead, nullptr, nullptr, &remote_received);
+            remote->move_to_thread(threads.next());
+            EXPECT_TRUE(remote->is_offloaded());
+            EXPECT_TRUE(remote->is_encrypted());
+            EXPECT_FALSE(remote->can_write_file());
+
+            remote->write_bytes(std::data(reply_after_move), std::size(reply_after_move), false);
+            remote->set_enabled(TR_UP, true);
+            local->write_bytes(std::data(after_move), std::size(after_move), false);
+            local->set_enabled(TR_UP, true);
+        });
+
+    auto const expected_remote = before_move + after_move;
+    auto const expected_local = reply_before_move + reply_after_move;
+    EXPECT_TRUE(waitFor(
+        [&]()
+        {
+            return std::size(remote_received.str()) >= std::size(expected_remote) &&
+                std::size(local_received.str()) >= std::size(expected_local);
+        },
+        MaxWaitMsec));
+    EXPECT_EQ(expected_remote, remote_received.str());
+    EXPECT_EQ(expected_local, local_received.str());
+
+    runInSessionThread(
+        [&]()
+        {
+            local.reset();
+            remote.reset();
+        });
+}
+
+TEST_F(PeerIoTest, moveToThreadReportsDisconnect)
+{
+    auto threads = tr_peer_io_threads{ 1U };
+    auto ios = createEncryptedPair();
+    auto& local = ios[0];
+    auto& remote = ios[1];
+
+    auto got_error = std::promise<void>{};
+    auto const on_error = [](tr_peerIo* io, tr_error const& /*error*/, void* vpromise)
+    {
+        io->clear_callbacks();
+        static_cast<std::promise<void>*>(vpromise)->set_value();
+    };
+
+    runInSessionThread(
+        [&]()
+        {
+            remote->set_callbacks(nullptr, nullptr, on_error, &got_error);
+            remote->move_to_thread(threads.next());
+            remote->set_enabled(TR_DOWN, true);
+            local.reset();
+        });
+
+    EXPECT_EQ(std::future_status::ready, got_error.get_future().wait_for(std::chrono::milliseconds{ MaxWaitMsec }));
+
+    runInSessionThread([&]() { remote.reset(); });
+}
+
+} // namespace libtransmission::test
@@ -189,3 +189,57 @@ TEST_F(PeerMgrActiveRequestsTest, sentBefore)
     EXPECT_EQ(block_a1, items[0].first);
     EXPECT_EQ(peer_a_, items[0].second);
 }
+
+TEST_F(PeerMgrActiveRequestsTest, indicesStayConsistent)
+{
+    auto requests = ActiveRequests{};
+
+    // peer_a_ and peer_b_ both have requests for blocks [0..100),
+    // peer_c_ has requests for the odd ones
+    for (tr_block_index_t block = 0; block < 100; ++block)
+    {
+        EXPECT_TRUE(requests.add(block, peer_a_, block));
+        EXPECT_TRUE(requests.add(block, peer_b_, block + 1000));
+        if (block % 2 != 0)
+        {
+            EXPECT_TRUE(requests.add(block, peer_c_, block + 2000));
+        }
+    }
+    EXPECT_EQ(250U, requests.size());
+
+    // removing one peer's requests leaves the others' alone
+    auto blocks = requests.remove(peer_a_);
+    std::sort(std::begin(blocks), std::end(blocks));
+    ASSERT_EQ(100U, std::size(blocks));
+    EXPECT_EQ(tr_block_index_t{ 0 }, blocks.front());
+    EXPECT_EQ(tr_block_index_t{ 99 }, blocks.back());
+    EXPECT_EQ(0U, requests.count(peer_a_));
+    EXPECT_EQ(100U, requests.count(peer_b_));
+    EXPECT_EQ(50U, requests.count(peer_c_));
+    EXPECT_EQ(150U, requests.size());
+
+    // removing one block's requests updates the per-peer counts
+    auto peers = requests.remove(tr_block_index_t{ 1 });
+    std::sort(std::begin(peers), std::end(peers));
+    auto expected = std::vector<tr_peer*>{ peer_b_, peer_c_ };
+    std::sort(std::begin(expected), std::end(expected));
+    EXPECT_EQ(expected, peers);
+    EXPECT_EQ(99U, requests.count(peer_b_));
+    EXPECT_EQ(49U, requests.count(peer_c_));
+
+    // sentBefore() sees neither of those removals and is oldest-first
+    auto const items = requests.sentBefore(1010);
+    ASSERT_EQ(9U, std::size(items)); // peer_b_'s blocks [0..10), except 1
+    EXPECT_EQ(tr_block_index_t{ 0 }, items.front().first);
+    EXPECT_EQ(tr_block_index_t{ 9 }, items.back().first);
+    for (auto const& [block, peer] : items)
+    {
+        EXPECT_EQ(peer_b_, peer);
+    }
+
+    // removing everything leaves nothing behind
+    requests.remove(peer_b_);
+    requests.remove(peer_c_);
+    EXPECT_EQ(0U, requests.size());
+    EXPECT_TRUE(std::empty(requests.sentBefore(3000)));
+}
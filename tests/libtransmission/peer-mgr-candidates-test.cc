@@ -0,0 +1,126 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#define LIBTRANSMISSION_PEER_MODULE
+
+#include <cstdint> // uint64_t
+#include <ctime> // time_t
+#include <optional>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/net.h>
+#include <libtransmission/peer-mgr-candidates.h>
+
+#include "gtest/gtest.h"
+
+class PeerMgrCandidatesTest : public ::testing::Test
+{
+protected:
+    [[nodiscard]] static tr_peer_candidates::Candidate make_candidate(uint64_t score, tr_torrent_id_t tor_id = 1)
+    {
+        auto const addr = tr_address::from_string("10.0.0.1");
+        EXPECT_TRUE(addr);
+        return { score, tor_id, tr_socket_address{ *addr, tr_port::fromHost(static_cast<uint16_t>(1000U + score)) } };
+    }
+
+    [[nodiscard]] static std::vector<uint64_t> pop_all(tr_peer_candidates& candidates)
+    {
+        auto scores = std::vector<uint64_t>{};
+        while (auto const candidate = candidates.pop())
+        {
+            scores.push_back(candidate->score);
+        }
+        return scores;
+    }
+};
+
+TEST_F(PeerMgrCandidatesTest, popsBestScoreFirst)
+{
+    auto candidates = tr_peer_candidates{};
+    EXPECT_FALSE(candidates.pop());
+
+    for (auto const score : { 50U, 10U, 40U, 20U, 30U })
+    {
+        candidates.push(make_candidate(score));
+    }
+
+    EXPECT_EQ(5U, candidates.size());
+
+    auto const popped = candidates.pop();
+    ASSERT_TRUE(popped);
+    EXPECT_EQ(10U, popped->score);
+    EXPECT_EQ(make_candidate(10U).socket_address, popped->socket_address);
+    EXPECT_EQ(4U, candidates.size());
+
+    auto const expected = std::vector<uint64_t>{ 20U, 30U, 40U, 50U };
+    EXPECT_EQ(expected, pop_all(candidates));
+    EXPECT_EQ(0U, candidates.size());
+}
+
+TEST_F(PeerMgrCandidatesTest, sleepersWaitUntilTheirTime)
+{
+    auto candidates = tr_peer_candidates{};
+    auto const now = time_t{ 1000 };
+
+    candidates.push(make_candidate(30U));
+    candidates.push_later(make_candidate(10U), now + 10);
+    candidates.push_later(make_candidate(20U), now + 20);
+    EXPECT_EQ(1U, candidates.size());
+    EXPECT_EQ(2U, candidates.size_asleep());
+
+    candidates.wake(now);
+    EXPECT_EQ(1U, candidates.size());
+    EXPECT_EQ(2U, candidates.size_asleep());
+
+    candidates.wake(now + 10);
+    EXPECT_EQ(2U, candidates.size());
+    EXPECT_EQ(1U, candidates.size_asleep());
+
+    // once awake, the sleeper is sorted by score alongside everyone else
+    auto expected = std::vector<uint64_t>{ 10U, 30U };
+    EXPECT_EQ(expected, pop_all(candidates));
+
+    candidates.wake(now + 100);
+    EXPECT_EQ(0U, candidates.size_asleep());
+    expected = std::vector<uint64_t>{ 20U };
+    EXPECT_EQ(expected, pop_all(candidates));
+}
+
+TEST_F(PeerMgrCandidatesTest, removeIfRemovesQueuedAndSleeping)
+{
+    auto candidates = tr_peer_candidates{};
+    auto const now = time_t{ 1000 };
+
+    for (auto const score : { 60U, 10U, 50U, 20U })
+    {
+        candidates.push(make_candidate(score, score % 20U == 0U ? 2 : 1));
+    }
+    candidates.push_later(make_candidate(40U, 2), now + 10);
+    candidates.push_later(make_candidate(30U, 1), now + 10);
+
+    candidates.remove_if([](auto const& candidate) { return candidate.tor_id == 2; });
+    EXPECT_EQ(2U, candidates.size());
+    EXPECT_EQ(1U, candidates.size_asleep());
+
+    candidates.wake(now + 10);
+    auto const expected = std::vector<uint64_t>{ 10U, 30U, 50U };
+    EXPECT_EQ(expected, pop_all(candidates));
+}
+
+TEST_F(PeerMgrCandidatesTest, clearRemovesEverything)
+{
+    auto candidates = tr_peer_candidates{};
+
+    candidates.push(make_candidate(10U));
+    candidates.push_later(make_candidate(20U), 1000);
+    candidates.clear();
+
+    EXPECT_EQ(0U, candidates.size());
+    EXPECT_EQ(0U, candidates.size_asleep());
+    candidates.wake(2000);
+    EXPECT_FALSE(candidates.pop());
+}
@@ -6,6 +6,7 @@
 #include <cstddef> // size_t
 #include <map>
 #include <set>
+#include <vector>
 
 #define LIBTRANSMISSION_PEER_MODULE
 
@@ -25,6 +26,7 @@ protected:
         mutable std::map<tr_piece_index_t, size_t> missing_block_count_;
         mutable std::map<tr_piece_index_t, tr_block_span_t> block_span_;
         mutable std::map<tr_piece_index_t, tr_priority_t> piece_priority_;
+        mutable std::map<tr_piece_index_t, size_t> piece_replication_;
         mutable std::set<tr_block_index_t> can_request_block_;
         mutable std::set<tr_piece_index_t> can_request_piece_;
         tr_piece_index_t piece_count_ = 0;
@@ -75,6 +77,95 @@ protected:
         {
             return piece_priority_[piece];
         }
+
+        [[nodiscard]] size_t pieceReplication(tr_piece_index_t piece) const final
+        {
+            return piece_replication_[piece];
+        }
+    };
+
+    // a mediator that downloads pieces sequentially and keeps track of what we have
+    class SequentialMediator final : public Wishlist::Mediator
+    {
+    public:
+        static auto constexpr BlocksPerPiece = tr_block_index_t{ 16U };
+
+        explicit SequentialMediator(tr_piece_index_t n_pieces)
+            : missing_(n_pieces, BlocksPerPiece)
+            , have_(size_t{ n_pieces } * BlocksPerPiece)
+        {
+        }
+
+        [[nodiscard]] bool clientCanRequestBlock(tr_block_index_t block) const override
+        {
+            return !have_.test(block);
+        }
+
+        [[nodiscard]] bool clientCanRequestPiece(tr_piece_index_t /*piece*/) const override
+        {
+            return true;
+        }
+
+        [[nodiscard]] bool isEndgame() const override
+        {
+            return false;
+        }
+
+        [[nodiscard]] bool isSequentialDownload() const override
+        {
+            return true;
+        }
+
+        [[nodiscard]] size_t countActiveRequests(tr_block_index_t /*block*/) const override
+        {
+            return 0U;
+        }
+
+        [[nodiscard]] size_t countMissingBlocks(tr_piece_index_t piece) const override
+        {
+            return missing_[piece];
+        }
+
+        [[nodiscard]] tr_block_span_t blockSpan(tr_piece_index_t piece) const override
+        {
+            return { piece * BlocksPerPiece, (piece + 1U) * BlocksPerPiece };
+        }
+
+        [[nodiscard]] tr_piece_index_t countAllPieces() const override
+        {
+            return static_cast<tr_piece_index_t>(std::size(missing_));
+        }
+
+        [[nodiscard]] tr_priority_t priority(tr_piece_index_t /*piece*/) const override
+        {
+            return TR_PRI_NORMAL;
+        }
+
+        [[nodiscard]] size_t pieceReplication(tr_piece_index_t /*piece*/) const override
+        {
+            return 1U;
+        }
+
+        void got_block(tr_block_index_t block)
+        {
+            have_.set(block);
+            --missing_[block / BlocksPerPiece];
+        }
+
+        [[nodiscard]] bool is_complete(tr_piece_index_t piece) const
+        {
+            return missing_[piece] == 0U;
+        }
+
+        void fail_piece(tr_piece_index_t piece)
+        {
+            have_.unset_span(piece * BlocksPerPiece, (piece + 1U) * BlocksPerPiece);
+            missing_[piece] = BlocksPerPiece;
+        }
+
+    private:
+        std::vector<size_t> missing_;
+        tr_bitfield have_;
     };
 };
 
@@ -350,3 +441,273 @@ TEST_F(PeerMgrWishlistTest, prefersNearlyCompletePieces)
         EXPECT_EQ(0U, requested.count(200, 300));
     }
 }
+
+TEST_F(PeerMgrWishlistTest, prefersRarePieces)
+{
+    auto mediator = MockMediator{};
+
+    // setup: three pieces, all missing, and we want everything
+    mediator.piece_count_ = 3;
+    for (tr_piece_index_t piece = 0; piece < 3; ++piece)
+    {
+        mediator.missing_block_count_[piece] = 100;
+        mediator.block_span_[piece] = { piece * 100, (piece + 1) * 100 };
+        mediator.can_request_piece_.insert(piece);
+    }
+    for (tr_block_index_t i = 0; i < 300; ++i)
+    {
+        mediator.can_request_block_.insert(i);
+    }
+
+    // but the third piece is the rarest, then the first piece
+    mediator.piece_replication_[0] = 5;
+    mediator.piece_replication_[1] = 10;
+    mediator.piece_replication_[2] = 2;
+
+    // NB: when all other things are equal in the wishlist, pieces are
+    // picked at random so this test -could- pass even if there's a bug.
+    // So test several times to shake out any randomness
+    auto const num_runs = 1000;
+    for (int run = 0; run < num_runs; ++run)
+    {
+        auto const spans = Wishlist{ mediator }.next(150);
+        auto requested = tr_bitfield(300);
+        for (auto const& span : spans)
+        {
+            requested.set_span(span.begin, span.end);
+        }
+        EXPECT_EQ(150U, requested.count());
+        EXPECT_EQ(50U, requested.count(0, 100));
+        EXPECT_EQ(0U, requested.count(100, 200));
+        EXPECT_EQ(100U, requested.count(200, 300));
+    }
+
+    // when a peer announces it has the rare piece, the wishlist moves it
+    auto wishlist = Wishlist{ mediator };
+    EXPECT_EQ(200U, wishlist.next(1).front().begin);
+    mediator.piece_replication_[2] = 20;
+    wishlist.on_piece_changed(2);
+    EXPECT_EQ(0U, wishlist.next(1).front().begin);
+
+    // but sequential downloads ignore rarity
+    mediator.is_sequential_download_ = true;
+    mediator.piece_replication_[0] = 20;
+    mediator.piece_replication_[1] = 1;
+    EXPECT_EQ(0U, Wishlist{ mediator }.next(1).front().begin);
+}
+
+TEST_F(PeerMgrWishlistTest, onlyRequestsPiecesThePeerHas)
+{
+    auto mediator = MockMediator{};
+
+    // setup: three pieces, all missing, and we want everything
+    mediator.piece_count_ = 3;
+    for (tr_piece_index_t piece = 0; piece < 3; ++piece)
+    {
+        mediator.missing_block_count_[piece] = 100;
+        mediator.block_span_[piece] = { piece * 100, (piece + 1) * 100 };
+        mediator.can_request_piece_.insert(piece);
+    }
+    for (tr_block_index_t i = 0; i < 300; ++i)
+    {
+        mediator.can_request_block_.insert(i);
+    }
+
+    // but the peer only has the middle piece,
+    // and we've already asked this peer for its first 10 blocks
+    auto wishlist = Wishlist{ mediator };
+    auto const spans = wishlist.next(
+        1000,
+        [](tr_piece_index_t piece) { return piece == 1; },
+        [](tr_block_index_t block) { return block < 110; });
+    ASSERT_EQ(1U, std::size(spans));
+    EXPECT_EQ(110U, spans[0].begin);
+    EXPECT_EQ(200U, spans[0].end);
+}
+
+TEST_F(PeerMgrWishlistTest, updatesIncrementallyWhenPiecesChange)
+{
+    auto mediator = MockMediator{};
+
+    // setup: three pieces, same size, and we want everything
+    mediator.piece_count_ = 3;
+    for (tr_piece_index_t piece = 0; piece < 3; ++piece)
+    {
+        mediator.block_span_[piece] = { piece * 100, (piece + 1) * 100 };
+        mediator.can_request_piece_.insert(piece);
+    }
+    for (tr_block_index_t i = 0; i < 300; ++i)
+    {
+        mediator.can_request_block_.insert(i);
+    }
+    mediator.missing_block_count_[0] = 100;
+    mediator.missing_block_count_[1] = 50;
+    mediator.missing_block_count_[2] = 100;
+
+    // the second piece is closest to completion
+    auto wishlist = Wishlist{ mediator };
+    auto spans = wishlist.next(10);
+    ASSERT_EQ(1U, std::size(spans));
+    EXPECT_EQ(100U, spans[0].begin);
+
+    // now the third piece is closer to completion,
+    // but the wishlist doesn't know that until it's told
+    mediator.missing_block_count_[2] = 10;
+    spans = wishlist.next(10);
+    ASSERT_EQ(1U, std::size(spans));
+    EXPECT_EQ(100U, spans[0].begin);
+
+    wishlist.on_piece_changed(2);
+    spans = wishlist.next(10);
+    ASSERT_EQ(1U, std::size(spans));
+    EXPECT_EQ(200U, spans[0].begin);
+
+    // completed pieces drop out of the wishlist
+    mediator.missing_block_count_[2] = 0;
+    wishlist.on_piece_changed(2);
+    spans = wishlist.next(10);
+    ASSERT_EQ(1U, std::size(spans));
+    EXPECT_EQ(100U, spans[0].begin);
+
+    // and changing the priorities rebuilds the wishlist
+    mediator.piece_priority_[0] = TR_PRI_HIGH;
+    mediator.missing_block_count_[1] = 100;
+    wishlist.invalidate();
+    spans = wishlist.next(10);
+    ASSERT_EQ(1U, std::size(spans));
+    EXPECT_EQ(0U, spans[0].begin);
+}
+
+TEST_F(PeerMgrWishlistTest, dropsFullyRequestedPiecesUntilTold)
+{
+    auto mediator = MockMediator{};
+
+    // setup: three pieces, all missing, and we want everything
+    mediator.piece_count_ = 3;
+    for (tr_piece_index_t piece = 0; piece < 3; ++piece)
+    {
+        mediator.missing_block_count_[piece] = 100;
+        mediator.block_span_[piece] = { piece * 100, (piece + 1) * 100 };
+        mediator.can_request_piece_.insert(piece);
+    }
+    for (tr_block_index_t i = 0; i < 300; ++i)
+    {
+        mediator.can_request_block_.insert(i);
+    }
+
+    // and we've already requested the first piece
+    for (tr_block_index_t i = 0; i < 100; ++i)
+    {
+        mediator.active_request_count_[i] = 1;
+    }
+
+    auto wishlist = Wishlist{ mediator };
+    auto spans = wishlist.next(1000);
+    ASSERT_EQ(1U, std::size(spans));
+    EXPECT_EQ(100U, spans[0].begin);
+    EXPECT_EQ(300U, spans[0].end);
+
+    // once everything has been requested, the pieces are dropped,
+    // so the wishlist doesn't notice requests that go away...
+    for (tr_block_index_t i = 100; i < 300; ++i)
+    {
+        mediator.active_request_count_[i] = 1;
+    }
+    EXPECT_TRUE(std::empty(wishlist.next(1000)));
+    mediator.active_request_count_[50] = 0;
+    mediator.active_request_count_[150] = 0;
+    EXPECT_TRUE(std::empty(wishlist.next(1000)));
+
+    // ...until it's told about them
+    wishlist.on_piece_changed(1);
+    spans = wishlist.next(1000);
+    ASSERT_EQ(1U, std::size(spans));
+    EXPECT_EQ(150U, spans[0].begin);
+    EXPECT_EQ(151U, spans[0].end);
+
+    // and a rebuild brings them all back
+    wishlist.invalidate();
+    spans = wishlist.next(1000);
+    ASSERT_EQ(2U, std::size(spans));
+    EXPECT_EQ(50U, spans[0].begin);
+    EXPECT_EQ(150U, spans[1].begin);
+}
+
+TEST_F(PeerMgrWishlistTest, requestsFailedPieceCompletedByStraddlingBlock)
+{
+    auto mediator = MockMediator{};
+
+    // setup: two pieces that share block 1
+    mediator.piece_count_ = 2;
+    mediator.block_span_[0] = { 0, 2 };
+    mediator.block_span_[1] = { 1, 3 };
+    for (tr_piece_index_t piece = 0; piece < 2; ++piece)
+    {
+        mediator.can_request_piece_.insert(piece);
+    }
+    mediator.can_request_block_.insert(1);
+    mediator.missing_block_count_[0] = 1;
+    mediator.missing_block_count_[1] = 1;
+
+    auto wishlist = Wishlist{ mediator };
+    auto spans = wishlist.next(10);
+    ASSERT_FALSE(std::empty(spans));
+    EXPECT_EQ(1U, spans[0].begin);
+    EXPECT_EQ(2U, spans[0].end);
+
+    // getting block 1 completes both pieces
+    mediator.can_request_block_.erase(1);
+    mediator.missing_block_count_[0] = 0;
+    mediator.missing_block_count_[1] = 0;
+    wishlist.on_piece_changed(0);
+    wishlist.on_piece_changed(1);
+    EXPECT_TRUE(std::empty(wishlist.next(10)));
+
+    // the second piece fails its checksum, so all its blocks are missing again
+    mediator.can_request_block_.insert({ 1, 2 });
+    mediator.missing_block_count_[1] = 2;
+    wishlist.on_piece_changed(1);
+    spans = wishlist.next(10);
+    ASSERT_EQ(1U, std::size(spans));
+    EXPECT_EQ(1U, spans[0].begin);
+    EXPECT_EQ(3U, spans[0].end);
+}
+
+TEST_F(PeerMgrWishlistTest, incrementalUpdatesMatchRebuild)
+{
+    static auto constexpr NumPieces = tr_piece_index_t{ 200U };
+    static auto constexpr NumRequests = 400U;
+    static auto constexpr BlocksPerRequest = size_t{ 3U };
+
+    // a wishlist that is kept up-to-date incrementally should
+    // pick the same blocks as one that is rebuilt from scratch
+    auto mediator = SequentialMediator{ NumPieces };
+    auto wishlist = Wishlist{ mediator };
+    for (size_t i = 0; i < NumRequests; ++i)
+    {
+        auto const expected = Wishlist{ mediator }.next(BlocksPerRequest);
+        auto const spans = wishlist.next(BlocksPerRequest);
+        ASSERT_EQ(std::size(expected), std::size(spans));
+        for (size_t j = 0; j < std::size(spans); ++j)
+        {
+            EXPECT_EQ(expected[j].begin, spans[j].begin);
+            EXPECT_EQ(expected[j].end, spans[j].end);
+        }
+
+        for (auto const& span : spans)
+        {
+            for (auto block = span.begin; block < span.end; ++block)
+            {
+                mediator.got_block(block);
+                wishlist.on_piece_changed(block / SequentialMediator::BlocksPerPiece);
+            }
+        }
+
+        // now and then, a piece fails its checksum test
+        if (auto const piece = static_cast<tr_piece_index_t>(i / 10U); i % 10U == 9U && mediator.is_complete(piece))
+        {
+            mediator.fail_piece(piece);
+            wishlist.on_piece_changed(piece);
+        }
+    }
+}
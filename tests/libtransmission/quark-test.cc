@@ -7,6 +7,8 @@
 #include <cstddef> // size_t
 #include <string>
 #include <string_view>
+#include <thread>
+#include <vector>
 
 #include <libtransmission/quark.h>
 
@@ -40,3 +42,39 @@ TEST_F(QuarkTest, newQuarkByStringView)
     auto const q = tr_quark_new(UniqueString);
     EXPECT_EQ(UniqueString, tr_quark_get_string_view(q));
 }
+
+TEST_F(QuarkTest, newQuarkFromManyThreads)
+{
+    static auto constexpr NumThreads = 8U;
+    static auto constexpr NumQuarks = 500U;
+
+    // every thread creates the same quarks, so they should agree on the values
+    auto results = std::vector<std::vector<tr_quark>>(NumThreads);
+    auto threads = std::vector<std::thread>{};
+    for (auto& result : results)
+    {
+        threads.emplace_back(
+            [&result]()
+            {
+                for (size_t i = 0; i < NumQuarks; ++i)
+                {
+                    result.emplace_back(tr_quark_new("runtime-quark-" + std::to_string(i)));
+                }
+            });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (auto const& result : results)
+    {
+        EXPECT_EQ(results.front(), result);
+    }
+
+    for (size_t i = 0; i < NumQuarks; ++i)
+    {
+        EXPECT_EQ("runtime-quark-" + std::to_string(i), quarkGetString(results.front()[i]));
+    }
+}
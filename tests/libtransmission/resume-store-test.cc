@@ -0,0 +1,237 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // std::byte, size_t
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/file.h>
+#include <libtransmission/resume-store.h>
+#include <libtransmission/tr-strbuf.h>
+#include <libtransmission/utils.h>
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission::test
+{
+
+class ResumeStoreTest : public SandboxedTest
+{
+protected:
+    [[nodiscard]] std::string filename() const
+    {
+        return std::string{ tr_pathbuf{ sandboxDir(), "/resume.db"sv }.sv() };
+    }
+
+    [[nodiscard]] static tr_sha1_digest_t makeHash(size_t i)
+    {
+        auto hash = tr_sha1_digest_t{};
+        hash[0] = static_cast<std::byte>(i & 0xFFU);
+        hash[1] = static_cast<std::byte>((i >> 8U) & 0xFFU);
+        return hash;
+    }
+
+    [[nodiscard]] static std::string get(tr_resume_store const& store, tr_sha1_digest_t const& hash)
+    {
+        auto buf = std::vector<char>{};
+        return store.get(hash, buf) ? std::string{ std::data(buf), std::size(buf) } : "(none)";
+    }
+};
+
+TEST_F(ResumeStoreTest, putGetErase)
+{
+    auto store = tr_resume_store{ filename() };
+    EXPECT_TRUE(store.empty());
+
+    // pending changes are visible before they're flushed
+    store.put(makeHash(1), "one"sv);
+    store.put(makeHash(2), "two"sv);
+    EXPECT_FALSE(store.empty());
+    EXPECT_EQ("one"sv, get(store, makeHash(1)));
+    EXPECT_EQ("two"sv, get(store, makeHash(2)));
+    EXPECT_EQ("(none)"sv, get(store, makeHash(3)));
+
+    // ...and after
+    EXPECT_TRUE(store.flush());
+    EXPECT_EQ("one"sv, get(store, makeHash(1)));
+    EXPECT_EQ("two"sv, get(store, makeHash(2)));
+    EXPECT_EQ(2U, store.stats().n_records);
+
+    store.put(makeHash(1), "uno"sv);
+    store.erase(makeHash(2));
+    EXPECT_EQ("uno"sv, get(store, makeHash(1)));
+    EXPECT_FALSE(store.contains(makeHash(2)));
+    EXPECT_TRUE(store.flush());
+    EXPECT_EQ("uno"sv, get(store, makeHash(1)));
+    EXPECT_FALSE(store.contains(makeHash(2)));
+
+    store.erase(makeHash(1));
+    EXPECT_TRUE(store.empty());
+}
+
+TEST_F(ResumeStoreTest, persistsAcrossReopen)
+{
+    {
+        auto store = tr_resume_store{ filename() };
+        store.put(makeHash(1), "one"sv);
+        store.put(makeHash(2), "two"sv);
+        EXPECT_TRUE(store.flush());
+        store.put(makeHash(2), "dos"sv);
+        store.erase(makeHash(1));
+        store.put(makeHash(3), "tres"sv);
+        // the destructor flushes the rest
+    }
+
+    auto const store = tr_resume_store{ filename() };
+    EXPECT_FALSE(store.contains(makeHash(1)));
+    EXPECT_EQ("dos"sv, get(store, makeHash(2)));
+    EXPECT_EQ("tres"sv, get(store, makeHash(3)));
+    EXPECT_EQ(2U, store.stats().n_records);
+}
+
+TEST_F(ResumeStoreTest, discardsTornRecord)
+{
+    {
+        auto store = tr_resume_store{ filename() };
+        store.put(makeHash(1), "one"sv);
+        EXPECT_TRUE(store.flush());
+        store.put(makeHash(2), "two"sv);
+    }
+
+    // simulate a crash partway through writing the last record
+    auto contents = std::vector<char>{};
+    EXPECT_TRUE(tr_file_read(filename(), contents));
+    contents.resize(std::size(contents) - 2U);
+    EXPECT_TRUE(tr_file_save(filename(), contents));
+
+    {
+        auto store = tr_resume_store{ filename() };
+        EXPECT_EQ("one"sv, get(store, makeHash(1)));
+        EXPECT_FALSE(store.contains(makeHash(2)));
+
+        // new records go where the torn one was
+        store.put(makeHash(3), "three"sv);
+    }
+
+    auto const store = tr_resume_store{ filename() };
+    EXPECT_EQ("one"sv, get(store, makeHash(1)));
+    EXPECT_EQ("three"sv, get(store, makeHash(3)));
+}
+
+TEST_F(ResumeStoreTest, ignoresInvalidFile)
+{
+    EXPECT_TRUE(tr_file_save(filename(), "this is not a resume database"sv));
+
+    auto store = tr_resume_store{ filename() };
+    EXPECT_TRUE(store.empty());
+    store.put(makeHash(1), "one"sv);
+    EXPECT_TRUE(store.flush());
+    EXPECT_EQ("one"sv, get(store, makeHash(1)));
+}
+
+TEST_F(ResumeStoreTest, compacts)
+{
+    static auto constexpr NumTorrents = size_t{ 100U };
+    auto const payload = std::string(4096U, 'x');
+
+    auto store = tr_resume_store{ filename() };
+
+    // keep saving the same torrents until the file is mostly stale records
+    for (size_t pass = 0; store.stats().n_compactions == 0U; ++pass)
+    {
+        ASSERT_LT(pass, 100U);
+
+        for (size_t i = 0; i < NumTorrents; ++i)
+        {
+            store.put(makeHash(i), payload + std::to_string(pass));
+        }
+        EXPECT_TRUE(store.flush());
+    }
+
+    auto const stats = store.stats();
+    EXPECT_EQ(NumTorrents, stats.n_records);
+    EXPECT_EQ(stats.live_bytes, stats.file_bytes);
+    EXPECT_EQ(stats.file_bytes, tr_sys_path_get_info(filename())->size);
+
+    // the compacted file still has the latest data
+    auto const latest = get(store, makeHash(0));
+    auto const reopened = tr_resume_store{ filename() };
+    for (size_t i = 0; i < NumTorrents; ++i)
+    {
+        EXPECT_EQ(latest, get(reopened, makeHash(i)));
+    }
+}
+
+TEST_F(ResumeStoreTest, keepsFileIfCompactionCantReadIt)
+{
+    static auto constexpr NumTorrents = size_t{ 100U };
+    auto const payload = std::string(4096U, 'x');
+    auto const tmpfile = tr_pathbuf{ filename(), ".tmp"sv };
+
+    auto store = tr_resume_store{ filename() };
+
+    // put a directory where compaction writes its new file, so that
+    // the file can fill up with stale records without being compacted
+    EXPECT_TRUE(tr_sys_dir_create(tmpfile, 0, 0700));
+    auto latest = std::string{};
+    for (size_t pass = 0; store.stats().live_bytes * 4U > store.stats().file_bytes; ++pass)
+    {
+        ASSERT_LT(pass, 100U);
+
+        latest = payload + std::to_string(pass);
+        for (size_t i = 0; i < NumTorrents; ++i)
+        {
+            store.put(makeHash(i), latest);
+        }
+        EXPECT_TRUE(store.flush());
+    }
+    EXPECT_EQ(0U, store.stats().n_compactions);
+    EXPECT_TRUE(tr_sys_path_remove(tmpfile));
+
+    // cut off the end of the last record
+    auto const file_size = tr_sys_path_get_info(filename())->size - 100U;
+    auto const fd = tr_sys_file_open(filename().c_str(), TR_SYS_FILE_WRITE, 0);
+    ASSERT_NE(TR_BAD_SYS_FILE, fd);
+    EXPECT_TRUE(tr_sys_file_truncate(fd, file_size));
+    tr_sys_file_close(fd);
+
+    // the next compaction can't read that record, so it leaves the file alone
+    EXPECT_TRUE(store.flush());
+    EXPECT_EQ(0U, store.stats().n_compactions);
+    EXPECT_EQ(file_size, tr_sys_path_get_info(filename())->size);
+    EXPECT_FALSE(tr_sys_path_exists(tmpfile));
+
+    // the other records are still there when it's reopened
+    auto const reopened = tr_resume_store{ filename() };
+    auto n_latest = size_t{};
+    for (size_t i = 0; i < NumTorrents; ++i)
+    {
+        EXPECT_TRUE(reopened.contains(makeHash(i)));
+        n_latest += get(reopened, makeHash(i)) == latest ? 1U : 0U;
+    }
+    EXPECT_EQ(NumTorrents - 1U, n_latest);
+}
+
+TEST_F(ResumeStoreTest, removesFilesAfterFlush)
+{
+    auto const resume_file = tr_pathbuf{ sandboxDir(), "/some.resume"sv };
+    EXPECT_TRUE(tr_file_save(resume_file, "d3:foo3:bare"sv));
+
+    auto store = tr_resume_store{ filename() };
+    store.put(makeHash(1), "d3:foo3:bare"sv);
+    store.remove_after_flush(resume_file);
+    EXPECT_TRUE(tr_sys_path_exists(resume_file));
+    EXPECT_TRUE(store.flush());
+    EXPECT_FALSE(tr_sys_path_exists(resume_file));
+}
+
+} // namespace libtransmission::test
@@ -0,0 +1,175 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // size_t
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/error.h>
+#include <libtransmission/file.h>
+#include <libtransmission/quark.h>
+#include <libtransmission/resume-store.h>
+#include <libtransmission/resume-writer.h>
+#include <libtransmission/tr-strbuf.h>
+#include <libtransmission/utils.h>
+#include <libtransmission/variant.h>
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission::test
+{
+
+class ResumeWriterTest : public SandboxedTest
+{
+protected:
+    [[nodiscard]] std::string resumeFile(char const* name) const
+    {
+        return std::string{ tr_pathbuf{ sandboxDir(), '/', name, ".resume"sv }.sv() };
+    }
+
+    [[nodiscard]] static tr_sha1_digest_t makeHash(uint8_t i)
+    {
+        auto hash = tr_sha1_digest_t{};
+        hash[0] = static_cast<std::byte>(i);
+        return hash;
+    }
+
+    [[nodiscard]] static tr_variant makeSnapshot(int64_t value)
+    {
+        auto snapshot = tr_variant{};
+        tr_variantInitDict(&snapshot, 1);
+        tr_variantDictAddInt(&snapshot, TR_KEY_uploaded, value);
+        return snapshot;
+    }
+
+    [[nodiscard]] static std::string encode(int64_t value)
+    {
+        auto snapshot = makeSnapshot(value);
+        auto str = tr_variantToStr(&snapshot, TR_VARIANT_FMT_BENC);
+        tr_variantClear(&snapshot);
+        return str;
+    }
+
+    [[nodiscard]] static std::string read(std::string const& filename)
+    {
+        auto contents = std::vector<char>{};
+        return tr_file_read(filename, contents) ? std::string{ std::data(contents), std::size(contents) } : "(none)";
+    }
+};
+
+TEST_F(ResumeWriterTest, savesToFile)
+{
+    auto writer = tr_resume_writer{};
+    auto const filename = resumeFile("one");
+
+    auto snapshot = makeSnapshot(100);
+    writer.save(makeHash(1), filename, nullptr, false, std::move(snapshot));
+    writer.wait();
+    EXPECT_EQ(encode(100), read(filename));
+
+    snapshot = makeSnapshot(200);
+    writer.save(makeHash(1), filename, nullptr, false, std::move(snapshot));
+    writer.wait();
+    EXPECT_EQ(encode(200), read(filename));
+
+    auto const stats = writer.stats();
+    EXPECT_EQ(2U, stats.n_queued);
+    EXPECT_EQ(stats.n_queued, stats.n_written + stats.n_coalesced);
+}
+
+TEST_F(ResumeWriterTest, coalescesSaves)
+{
+    static auto constexpr NumSaves = 1000;
+
+    auto writer = tr_resume_writer{};
+    auto const filename = resumeFile("one");
+
+    for (int i = 1; i <= NumSaves; ++i)
+    {
+        auto snapshot = makeSnapshot(i);
+        writer.save(makeHash(1), filename, nullptr, false, std::move(snapshot));
+    }
+    writer.wait();
+
+    // the last snapshot wins, even if earlier ones were skipped
+    EXPECT_EQ(encode(NumSaves), read(filename));
+
+    auto const stats = writer.stats();
+    EXPECT_EQ(size_t{ NumSaves }, stats.n_queued);
+    EXPECT_EQ(stats.n_queued, stats.n_written + stats.n_coalesced);
+    EXPECT_LE(stats.last_batch_time, stats.max_batch_time);
+}
+
+TEST_F(ResumeWriterTest, removeDiscardsPendingSave)
+{
+    auto const filename = resumeFile("one");
+
+    {
+        auto writer = tr_resume_writer{};
+        auto snapshot = makeSnapshot(100);
+        writer.save(makeHash(1), filename, nullptr, false, std::move(snapshot));
+        writer.remove(makeHash(1), filename, nullptr);
+        // the destructor finishes the queue
+    }
+
+    EXPECT_FALSE(tr_sys_path_exists(filename));
+}
+
+TEST_F(ResumeWriterTest, savesToStore)
+{
+    auto store = tr_resume_store{ tr_pathbuf{ sandboxDir(), "/resume.db"sv } };
+    auto writer = tr_resume_writer{};
+    auto const filename = resumeFile("one");
+
+    // saving into the store moves the data out of the .resume file...
+    EXPECT_TRUE(tr_file_save(filename, encode(100)));
+    auto snapshot = makeSnapshot(200);
+    writer.save(makeHash(1), filename, &store, true, std::move(snapshot));
+    writer.wait();
+    auto buf = std::vector<char>{};
+    EXPECT_TRUE(store.get(makeHash(1), buf));
+    EXPECT_EQ(encode(200), (std::string{ std::data(buf), std::size(buf) }));
+    EXPECT_FALSE(tr_sys_path_exists(filename));
+    EXPECT_EQ(1U, store.stats().n_flushes);
+
+    // ...and saving into the .resume file moves it out of the store
+    snapshot = makeSnapshot(300);
+    writer.save(makeHash(1), filename, &store, false, std::move(snapshot));
+    writer.wait();
+    EXPECT_EQ(encode(300), read(filename));
+    EXPECT_FALSE(store.contains(makeHash(1)));
+
+    writer.remove(makeHash(1), filename, &store);
+    writer.wait();
+    EXPECT_FALSE(tr_sys_path_exists(filename));
+}
+
+TEST_F(ResumeWriterTest, reportsErrors)
+{
+    auto n_errors = size_t{};
+    auto error_hash = tr_sha1_digest_t{};
+    auto writer = tr_resume_writer{ [&](tr_sha1_digest_t const& info_hash, tr_error const& /*error*/)
+                                    {
+                                        error_hash = info_hash;
+                                        ++n_errors;
+                                    } };
+
+    auto const filename = std::string{ tr_pathbuf{ sandboxDir(), "/no/such/dir/one.resume"sv }.sv() };
+    auto snapshot = makeSnapshot(100);
+    writer.save(makeHash(7), filename, nullptr, false, std::move(snapshot));
+    writer.wait();
+
+    EXPECT_EQ(1U, n_errors);
+    EXPECT_EQ(makeHash(7), error_hash);
+}
+
+} // namespace libtransmission::test
@@ -9,9 +9,12 @@
 #include <cstdint> // int64_t
 #include <iterator> // std::inserter
 #include <set>
+#include <string>
 #include <string_view>
 #include <vector>
 
+#include <event2/buffer.h>
+
 #include <libtransmission/transmission.h>
 #include <libtransmission/rpcimpl.h>
 #include <libtransmission/variant.h>
@@ -191,4 +194,266 @@ TEST_F(RpcTest, sessionGet)
     tr_torrentRemove(tor, false, nullptr, nullptr);
 }
 
+TEST_F(RpcTest, torrentGetSince)
+{
+    auto const rpc_response_func = [](tr_session* /*session*/, tr_variant* response, void* setme) noexcept
+    {
+        *static_cast<tr_variant*>(setme) = *response;
+        tr_variantInitBool(response, false);
+    };
+
+    // returns the response's `version` and `torrents`, then `removed`
+    auto const torrent_get = [this, &rpc_response_func](int64_t since, std::string_view format)
+    {
+        tr_variant request;
+        tr_variantInitDict(&request, 2);
+        tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-get");
+        auto* args = tr_variantDictAddDict(&request, TR_KEY_arguments, 3);
+        tr_variantDictAddInt(args, TR_KEY_since, since);
+        tr_variantDictAddStrView(args, TR_KEY_format, format);
+        auto* fields = tr_variantDictAddList(args, TR_KEY_fields, 3);
+        tr_variantListAddStrView(fields, "id"sv);
+        tr_variantListAddStrView(fields, "name"sv);
+        tr_variantListAddStrView(fields, "uploadLimit"sv);
+        tr_variant response;
+        tr_rpc_request_exec_json(session_, &request, rpc_response_func, &response);
+        tr_variantClear(&request);
+        return response;
+    };
+
+    auto const get_version = [](tr_variant* response)
+    {
+        auto version = int64_t{};
+        tr_variant* args = nullptr;
+        EXPECT_TRUE(tr_variantDictFindDict(response, TR_KEY_arguments, &args));
+        EXPECT_TRUE(tr_variantDictFindInt(args, TR_KEY_version, &version));
+        return version;
+    };
+
+    auto const get_list = [](tr_variant* response, tr_quark key)
+    {
+        tr_variant* args = nullptr;
+        tr_variant* list = nullptr;
+        EXPECT_TRUE(tr_variantDictFindDict(response, TR_KEY_arguments, &args));
+        EXPECT_TRUE(tr_variantDictFindList(args, key, &list));
+        return list;
+    };
+
+    auto* tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    EXPECT_NE(nullptr, tor);
+    auto const id = static_cast<int64_t>(tr_torrentId(tor));
+
+    // the first request gets everything
+    auto response = torrent_get(0, "objects"sv);
+    auto version = get_version(&response);
+    EXPECT_LT(0, version);
+    auto* torrents = get_list(&response, TR_KEY_torrents);
+    EXPECT_EQ(1U, tr_variantListSize(torrents));
+    auto* tor_dict = tr_variantListChild(torrents, 0);
+    EXPECT_NE(nullptr, tr_variantDictFind(tor_dict, TR_KEY_name));
+    EXPECT_NE(nullptr, tr_variantDictFind(tor_dict, TR_KEY_uploadLimit));
+    tr_variantClear(&response);
+
+    // wait for the new torrent to settle down, e.g. finish verifying
+    EXPECT_TRUE(waitFor(
+        [&]()
+        {
+            response = torrent_get(version, "objects"sv);
+            version = get_version(&response);
+            auto const n_torrents = tr_variantListSize(get_list(&response, TR_KEY_torrents));
+            tr_variantClear(&response);
+            return n_torrents == 0U;
+        },
+        5000));
+
+    // changing a setting only sends the settings fields
+    tr_torrentSetSpeedLimit_KBps(tor, TR_UP, 100);
+    response = torrent_get(version, "objects"sv);
+    EXPECT_LT(version, get_version(&response));
+    torrents = get_list(&response, TR_KEY_torrents);
+    EXPECT_EQ(1U, tr_variantListSize(torrents));
+    tor_dict = tr_variantListChild(torrents, 0);
+    auto i = int64_t{};
+    EXPECT_TRUE(tr_variantDictFindInt(tor_dict, TR_KEY_id, &i));
+    EXPECT_EQ(id, i);
+    EXPECT_TRUE(tr_variantDictFindInt(tor_dict, TR_KEY_uploadLimit, &i));
+    EXPECT_EQ(100, i);
+    EXPECT_EQ(nullptr, tr_variantDictFind(tor_dict, TR_KEY_name));
+    tr_variantClear(&response);
+
+    // ...but tables always have every field
+    response = torrent_get(version, "table"sv);
+    torrents = get_list(&response, TR_KEY_torrents);
+    EXPECT_EQ(2U, tr_variantListSize(torrents));
+    EXPECT_EQ(3U, tr_variantListSize(tr_variantListChild(torrents, 1)));
+    version = get_version(&response);
+    tr_variantClear(&response);
+
+    // a `since` from a later session, e.g. after the clock was set back, gets everything
+    response = torrent_get(version + 1000, "objects"sv);
+    EXPECT_EQ(version, get_version(&response));
+    torrents = get_list(&response, TR_KEY_torrents);
+    EXPECT_EQ(1U, tr_variantListSize(torrents));
+    tor_dict = tr_variantListChild(torrents, 0);
+    EXPECT_NE(nullptr, tr_variantDictFind(tor_dict, TR_KEY_name));
+    EXPECT_NE(nullptr, tr_variantDictFind(tor_dict, TR_KEY_uploadLimit));
+    tr_variantClear(&response);
+
+    // removed torrents are listed once
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+    EXPECT_TRUE(waitFor(
+        [&]()
+        {
+            response = torrent_get(version, "objects"sv);
+            auto* const removed = get_list(&response, TR_KEY_removed);
+            auto removed_id = int64_t{};
+            auto const ok = tr_variantListSize(removed) == 1U &&
+                tr_variantGetInt(tr_variantListChild(removed, 0), &removed_id) && removed_id == id;
+            tr_variantClear(&response);
+            return ok;
+        },
+        5000));
+}
+
+TEST_F(RpcTest, torrentGetSinceSendsFilePriorities)
+{
+    auto const rpc_response_func = [](tr_session* /*session*/, tr_variant* response, void* setme) noexcept
+    {
+        *static_cast<tr_variant*>(setme) = *response;
+        tr_variantInitBool(response, false);
+    };
+
+    // returns the response's `version`, and its `torrents` in `setme_torrents`
+    auto const torrent_get = [this, &rpc_response_func](int64_t since, tr_variant* setme_torrents)
+    {
+        tr_variant request;
+        tr_variantInitDict(&request, 2);
+        tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-get");
+        auto* args = tr_variantDictAddDict(&request, TR_KEY_arguments, 2);
+        tr_variantDictAddInt(args, TR_KEY_since, since);
+        auto* fields = tr_variantDictAddList(args, TR_KEY_fields, 2);
+        tr_variantListAddStrView(fields, "id"sv);
+        tr_variantListAddStrView(fields, "fileStats"sv);
+        tr_variant response;
+        tr_rpc_request_exec_json(session_, &request, rpc_response_func, &response);
+        tr_variantClear(&request);
+
+        auto version = int64_t{};
+        tr_variant* response_args = nullptr;
+        tr_variant* torrents = nullptr;
+        EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &response_args));
+        EXPECT_TRUE(tr_variantDictFindInt(response_args, TR_KEY_version, &version));
+        EXPECT_TRUE(tr_variantDictFindList(response_args, TR_KEY_torrents, &torrents));
+        *setme_torrents = *torrents;
+        tr_variantInitBool(torrents, false);
+        tr_variantClear(&response);
+        return version;
+    };
+
+    auto* tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    EXPECT_NE(nullptr, tor);
+    EXPECT_FALSE(tor->is_running());
+
+    // wait for the new torrent to settle down, e.g. finish verifying
+    auto version = int64_t{};
+    auto torrents = tr_variant{};
+    EXPECT_TRUE(waitFor(
+        [&]()
+        {
+            version = torrent_get(version, &torrents);
+            auto const n_torrents = tr_variantListSize(&torrents);
+            tr_variantClear(&torrents);
+            return n_torrents == 0U;
+        },
+        5000));
+
+    // a paused torrent has no activity, but a file's priority still gets sent
+    auto const file = tr_file_index_t{ 1 };
+    tr_torrentSetFilePriorities(tor, &file, 1, TR_PRI_HIGH);
+    EXPECT_LT(version, torrent_get(version, &torrents));
+    ASSERT_EQ(1U, tr_variantListSize(&torrents));
+    tr_variant* file_stats = nullptr;
+    EXPECT_TRUE(tr_variantDictFindList(tr_variantListChild(&torrents, 0), TR_KEY_fileStats, &file_stats));
+    ASSERT_EQ(tor->file_count(), tr_variantListSize(file_stats));
+    for (tr_file_index_t i = 0, n = tor->file_count(); i < n; ++i)
+    {
+        auto priority = int64_t{};
+        EXPECT_TRUE(tr_variantDictFindInt(tr_variantListChild(file_stats, i), TR_KEY_priority, &priority));
+        EXPECT_EQ(i == file ? TR_PRI_HIGH : TR_PRI_NORMAL, priority);
+    }
+    tr_variantClear(&torrents);
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
+TEST_F(RpcTest, serializedMatchesVariant)
+{
+    // serialize a response the old way, via a tr_variant tree
+    auto const exec_variant = [this](tr_variant* request)
+    {
+        auto str = std::string{};
+        tr_rpc_request_exec_json(
+            session_,
+            request,
+            [](tr_session* /*session*/, tr_variant* response, void* vstr)
+            { *static_cast<std::string*>(vstr) = tr_variantToStr(response, TR_VARIANT_FMT_JSON_LEAN); },
+            &str);
+        return str;
+    };
+
+    // serialize a response the new way, then normalize its key order
+    auto const exec_serialized = [this](tr_variant* request)
+    {
+        auto str = std::string{};
+        tr_rpc_request_exec_serialized(
+            session_,
+            request,
+            [](tr_session* /*session*/, evbuffer* response, void* vstr)
+            {
+                auto const n_bytes = evbuffer_get_length(response);
+                auto const* const data = reinterpret_cast<char const*>(evbuffer_pullup(response, -1));
+                auto parsed = tr_variant{};
+                EXPECT_TRUE(tr_variantFromBuf(&parsed, TR_VARIANT_PARSE_JSON, std::string_view{ data, n_bytes }));
+                *static_cast<std::string*>(vstr) = tr_variantToStr(&parsed, TR_VARIANT_FMT_JSON_LEAN);
+                tr_variantClear(&parsed);
+            },
+            &str);
+        return str;
+    };
+
+    auto* tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    EXPECT_NE(nullptr, tor);
+    tr_torrentStop(tor);
+
+    for (auto const format : { "objects"sv, "table"sv })
+    {
+        tr_variant request;
+        tr_variantInitDict(&request, 3);
+        tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-get");
+        tr_variantDictAddInt(&request, TR_KEY_tag, 7);
+        auto* args = tr_variantDictAddDict(&request, TR_KEY_arguments, 2);
+        tr_variantDictAddStrView(args, TR_KEY_format, format);
+        auto* fields = tr_variantDictAddList(args, TR_KEY_fields, 8);
+        tr_variantListAddStrView(fields, "id"sv);
+        tr_variantListAddStrView(fields, "name"sv);
+        tr_variantListAddStrView(fields, "files"sv);
+        tr_variantListAddStrView(fields, "fileStats"sv);
+        tr_variantListAddStrView(fields, "labels"sv);
+        tr_variantListAddStrView(fields, "percentDone"sv);
+        tr_variantListAddStrView(fields, "trackers"sv);
+        tr_variantListAddStrView(fields, "wanted"sv);
+        EXPECT_EQ(exec_variant(&request), exec_serialized(&request));
+        tr_variantClear(&request);
+    }
+
+    // methods without a streaming serializer fall back to the tr_variant one
+    tr_variant request;
+    tr_variantInitDict(&request, 1);
+    tr_variantDictAddStrView(&request, TR_KEY_method, "session-get");
+    EXPECT_EQ(exec_variant(&request), exec_serialized(&request));
+    tr_variantClear(&request);
+
+    tr_torrentRemove(tor, false, nullptr, nullptr);
+}
+
 } // namespace libtransmission::test
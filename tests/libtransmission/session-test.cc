@@ -11,6 +11,7 @@
 #include <memory>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include <libtransmission/transmission.h>
 
@@ -18,6 +19,10 @@
 #include <libtransmission/quark.h>
 #include <libtransmission/session-id.h>
 #include <libtransmission/session.h>
+#include <libtransmission/torrent-metainfo.h>
+#include <libtransmission/torrent.h>
+#include <libtransmission/tr-strbuf.h>
+#include <libtransmission/utils.h>
 #include <libtransmission/variant.h>
 #include <libtransmission/version.h>
 
@@ -350,4 +355,59 @@ TEST_F(SessionTest, savesSettings)
     tr_variantClear(&settings);
 }
 
+TEST_F(SessionTest, loadsTorrentsFromTorrentDir)
+{
+    static auto constexpr AddedDate = int64_t{ 1234567890 };
+    static auto constexpr Basenames = std::array<std::string_view, 4>{
+        "Android-x86 8.1 r6 iso.torrent"sv,
+        "debian-11.2.0-amd64-DVD-1.iso.torrent"sv,
+        "gimp-2.10.32-1-arm64.dmg.torrent"sv,
+        "ubuntu-20.04.4-desktop-amd64.iso.torrent"sv,
+    };
+
+    // put the torrents in the torrent dir, and give each one a resume file
+    auto metainfos = std::vector<tr_torrent_metainfo>{};
+    for (auto const& basename : Basenames)
+    {
+        auto benc = std::vector<char>{};
+        auto const src = tr_pathbuf{ LIBTRANSMISSION_TEST_ASSETS_DIR, '/', basename };
+        EXPECT_TRUE(tr_file_read(src, benc));
+        auto& metainfo = metainfos.emplace_back();
+        EXPECT_TRUE(metainfo.parse_benc(std::string_view{ std::data(benc), std::size(benc) }));
+        EXPECT_TRUE(tr_file_save(metainfo.torrent_file(session_->torrentDir()), benc));
+
+        auto resume = tr_variant{};
+        tr_variantInitDict(&resume, 1);
+        tr_variantDictAddInt(&resume, TR_KEY_added_date, AddedDate + static_cast<int64_t>(std::size(metainfos)));
+        EXPECT_TRUE(tr_file_save(metainfo.resume_file(session_->resumeDir()), tr_variantToStr(&resume, TR_VARIANT_FMT_BENC)));
+        tr_variantClear(&resume);
+    }
+
+    // and a magnet link
+    auto constexpr MagnetLink =
+        "magnet:?xt=urn:btih:f4af9a0a2e1b8b7e6e4b1f6b4f2b3c5d6e7f8a9b&dn=Magnet+Test&tr=http%3A%2F%2Fexample.org%2Fannounce"sv;
+    auto magnet = tr_torrent_metainfo{};
+    EXPECT_TRUE(magnet.parseMagnet(MagnetLink));
+    EXPECT_TRUE(tr_file_save(magnet.magnet_file(session_->torrentDir()), MagnetLink));
+
+    auto* const ctor = tr_ctorNew(session_);
+    tr_ctorSetPaused(ctor, TR_FORCE, true);
+    EXPECT_EQ(std::size(Basenames) + 1U, tr_sessionLoadTorrents(session_, ctor));
+    tr_ctorFree(ctor);
+
+    EXPECT_EQ(0U, session_->n_torrents_loading());
+    EXPECT_EQ(std::size(Basenames) + 1U, std::size(session_->torrents()));
+    for (size_t i = 0; i < std::size(metainfos); ++i)
+    {
+        auto const* const tor = session_->torrents().get(metainfos[i].info_hash());
+        ASSERT_NE(nullptr, tor);
+        EXPECT_TRUE(tor->has_metainfo());
+        EXPECT_EQ(AddedDate + static_cast<int64_t>(i) + 1, tor->addedDate);
+    }
+
+    auto const* const tor = session_->torrents().get(magnet.info_hash());
+    ASSERT_NE(nullptr, tor);
+    EXPECT_FALSE(tor->has_metainfo());
+}
+
 } // namespace libtransmission::test
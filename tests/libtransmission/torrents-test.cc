@@ -4,6 +4,7 @@
 // License text can be found in the licenses/ folder.
 
 #include <array>
+#include <cstdint> // uint64_t
 #include <ctime> // time, size_t, time_t
 #include <memory>
 #include <set>
@@ -136,6 +137,17 @@ TEST_F(TorrentsTest, removedSince)
     EXPECT_EQ(remove, torrents.removedSince(50));
 }
 
+TEST_F(TorrentsTest, versionIsAheadOfEarlierSessions)
+{
+    auto const earlier = tr_torrents{};
+    auto const later = tr_torrents{};
+    EXPECT_LE(earlier.version(), later.version());
+
+    // versions are microseconds since the epoch, which JSON clients can represent exactly
+    EXPECT_LT(uint64_t{ 1 } << 50U, later.version());
+    EXPECT_GT(uint64_t{ 1 } << 53U, later.version());
+}
+
 using TorrentsPieceSpanTest = libtransmission::test::SessionTest;
 
 TEST_F(TorrentsPieceSpanTest, exposesFilePieceSpan)
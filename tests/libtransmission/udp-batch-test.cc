@@ -0,0 +1,226 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <array>
+#include <chrono>
+#include <cstddef> // size_t
+#include <cstdint> // uint16_t
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+#include <fmt/core.h>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/net.h>
+#include <libtransmission/tr-udp-batch.h>
+#include <libtransmission/utils.h>
+
+#include "gtest/gtest.h"
+
+class UdpBatchTest : public ::testing::Test
+{
+protected:
+    struct Received
+    {
+        uint16_t from_port;
+        std::string payload;
+    };
+
+    void SetUp() override
+    {
+        ::testing::Test::SetUp();
+        init_mgr_ = tr_lib_init();
+    }
+
+    void TearDown() override
+    {
+        for (auto const sock : socks_)
+        {
+            tr_net_close_socket(sock);
+        }
+
+        ::testing::Test::TearDown();
+    }
+
+    // a UDP socket bound to a free port on 127.0.0.1
+    [[nodiscard]] std::pair<tr_socket_t, sockaddr_in> makeSocket()
+    {
+        auto const sock = socket(AF_INET, SOCK_DGRAM, 0);
+        EXPECT_NE(TR_BAD_SOCKET, sock);
+        socks_.push_back(sock);
+
+        auto addr = sockaddr_in{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        EXPECT_EQ(0, bind(sock, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)));
+
+        auto addrlen = socklen_t{ sizeof(addr) };
+        EXPECT_EQ(0, getsockname(sock, reinterpret_cast<sockaddr*>(&addr), &addrlen));
+        return { sock, addr };
+    }
+
+    static void push(tr_udp_send_queue& queue, tr_socket_t sock, std::string const& payload, sockaddr_in const& to)
+    {
+        queue.push(sock, std::data(payload), std::size(payload), reinterpret_cast<sockaddr const*>(&to), sizeof(to));
+    }
+
+    // read datagrams from `sock` until `n` have arrived
+    [[nodiscard]] static std::vector<Received> receive(tr_socket_t sock, size_t n)
+    {
+        auto received = std::vector<Received>{};
+        auto batch = tr_udp_recv_batch{};
+
+        auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds{ 5 };
+        while (std::size(received) < n && std::chrono::steady_clock::now() < deadline)
+        {
+            for (size_t i = 0, n_read = batch.read(sock); i < n_read; ++i)
+            {
+                auto const datagram = batch[i];
+                EXPECT_EQ(static_cast<socklen_t>(sizeof(sockaddr_in)), datagram.fromlen);
+                EXPECT_EQ(AF_INET, datagram.from->sa_family);
+
+                auto const* const from = reinterpret_cast<sockaddr_in const*>(datagram.from);
+                EXPECT_EQ(htonl(INADDR_LOOPBACK), from->sin_addr.s_addr);
+                received.push_back({ ntohs(from->sin_port),
+                                     std::string{ reinterpret_cast<char const*>(datagram.buf), datagram.len } });
+            }
+        }
+
+        return received;
+    }
+
+private:
+    std::unique_ptr<tr_net_init_mgr> init_mgr_;
+    std::vector<tr_socket_t> socks_;
+};
+
+TEST_F(UdpBatchTest, sendsDatagramsInOrder)
+{
+    // more than fit in one batch
+    static auto constexpr NumDatagrams = size_t{ tr_udp_send_queue::MaxSize * 2U + 5U };
+
+    auto const [sender, sender_addr] = makeSocket();
+    auto const [receiver, receiver_addr] = makeSocket();
+
+    auto payloads = std::vector<std::string>{};
+    auto queue = tr_udp_send_queue{};
+    for (size_t i = 0; i < NumDatagrams; ++i)
+    {
+        auto const& payload = payloads.emplace_back(fmt::format("datagram #{:d}{:s}", i, std::string(i, 'x')));
+        push(queue, sender, payload, receiver_addr);
+    }
+    EXPECT_EQ(NumDatagrams, std::size(queue));
+
+    auto n_errors = size_t{};
+    queue.flush([&n_errors](sockaddr const* /*to*/, socklen_t /*tolen*/, int /*error_code*/) { ++n_errors; });
+    EXPECT_EQ(0U, n_errors);
+    EXPECT_TRUE(std::empty(queue));
+
+    auto const received = receive(receiver, NumDatagrams);
+    ASSERT_EQ(NumDatagrams, std::size(received));
+    for (size_t i = 0; i < NumDatagrams; ++i)
+    {
+        EXPECT_EQ(ntohs(sender_addr.sin_port), received[i].from_port);
+        EXPECT_EQ(payloads[i], received[i].payload);
+    }
+}
+
+TEST_F(UdpBatchTest, flushesMixedSockets)
+{
+    static auto constexpr NumDatagrams = size_t{ 20U };
+    static auto constexpr NumToB = (NumDatagrams + 2U) / 3U; // every third one
+
+    auto const [sender_a, sender_a_addr] = makeSocket();
+    auto const [sender_b, sender_b_addr] = makeSocket();
+    auto const [receiver_a, receiver_a_addr] = makeSocket();
+    auto const [receiver_b, receiver_b_addr] = makeSocket();
+
+    // interleave the sockets, and have each one send to both receivers
+    auto queue = tr_udp_send_queue{};
+    for (size_t i = 0; i < NumDatagrams; ++i)
+    {
+        auto const& to = i % 3U == 0U ? receiver_b_addr : receiver_a_addr;
+        push(queue, i % 2U == 0U ? sender_a : sender_b, std::to_string(i), to);
+    }
+    queue.flush({});
+    EXPECT_TRUE(std::empty(queue));
+
+    // every datagram arrives, from the socket that it was queued on,
+    // and each sender's datagrams to a receiver are still in order
+    auto const port_a = ntohs(sender_a_addr.sin_port);
+    auto const port_b = ntohs(sender_b_addr.sin_port);
+    auto n_received = size_t{};
+    auto const expected = std::array<std::pair<tr_socket_t, size_t>, 2>{ {
+        { receiver_a, NumDatagrams - NumToB },
+        { receiver_b, NumToB },
+    } };
+    for (auto const& [receiver, n_expected] : expected)
+    {
+        auto last = std::vector<int>{ -1, -1 };
+        for (auto const& [from_port, payload] : receive(receiver, n_expected))
+        {
+            auto const i = std::stoi(payload);
+            EXPECT_EQ(i % 2 == 0 ? port_a : port_b, from_port) << payload;
+            EXPECT_EQ(receiver == receiver_a, i % 3 != 0) << payload;
+            EXPECT_LT(last[i % 2], i);
+            last[i % 2] = i;
+            ++n_received;
+        }
+    }
+    EXPECT_EQ(NumDatagrams, n_received);
+}
+
+TEST_F(UdpBatchTest, reportsFailedDatagramsAndSendsTheRest)
+{
+    auto const [sender, sender_addr] = makeSocket();
+    auto const [receiver, receiver_addr] = makeSocket();
+
+    // too big to be a UDP datagram, so it fails in the middle of a batch
+    auto const too_big = std::string(70000U, 'x');
+
+    auto queue = tr_udp_send_queue{};
+    push(queue, sender, "first", receiver_addr);
+    push(queue, sender, too_big, receiver_addr);
+    push(queue, sender, "second", receiver_addr);
+    push(queue, sender, too_big, receiver_addr);
+    push(queue, sender, "third", receiver_addr);
+
+    auto errors = std::vector<std::pair<uint16_t, int>>{};
+    queue.flush(
+        [&errors](sockaddr const* to, socklen_t tolen, int error_code)
+        {
+            EXPECT_EQ(static_cast<socklen_t>(sizeof(sockaddr_in)), tolen);
+            errors.emplace_back(ntohs(reinterpret_cast<sockaddr_in const*>(to)->sin_port), error_code);
+        });
+    EXPECT_TRUE(std::empty(queue));
+
+    ASSERT_EQ(2U, std::size(errors));
+    for (auto const& [port, error_code] : errors)
+    {
+        EXPECT_EQ(ntohs(receiver_addr.sin_port), port);
+        EXPECT_NE(0, error_code);
+    }
+
+    auto const received = receive(receiver, 3U);
+    ASSERT_EQ(3U, std::size(received));
+    EXPECT_EQ("first", received[0].payload);
+    EXPECT_EQ("second", received[1].payload);
+    EXPECT_EQ("third", received[2].payload);
+    for (auto const& datagram : received)
+    {
+        EXPECT_EQ(ntohs(sender_addr.sin_port), datagram.from_port);
+    }
+}
@@ -13,6 +13,7 @@
 #include <cstdint> // int64_t
 #include <string>
 #include <string_view>
+#include <utility>
 
 #define LIBTRANSMISSION_VARIANT_MODULE
 
@@ -568,3 +569,124 @@ TEST_F(VariantTest, variantFromBufFuzz)
         }
     }
 }
+
+TEST_F(VariantTest, arenaMatchesHeap)
+{
+    auto const long_str = std::string(100, 'x');
+
+    auto const build = [&long_str](tr_variant* top)
+    {
+        tr_variantDictAddStr(top, TR_KEY_name, long_str);
+        tr_variantDictAddStr(top, TR_KEY_comment, "short"sv);
+        auto* const files = tr_variantDictAddList(top, TR_KEY_files, 0);
+        for (int64_t i = 0; i < 100; ++i)
+        {
+            auto* const file = tr_variantListAddDict(files, 2);
+            tr_variantDictAddInt(file, TR_KEY_length, i);
+            tr_variantListAddStr(tr_variantDictAddList(file, TR_KEY_path, 1), long_str);
+        }
+
+        // overwrite and remove some values, then reuse the freed slots
+        tr_variantDictAddStr(top, TR_KEY_name, long_str + long_str);
+        tr_variantDictRemove(top, TR_KEY_comment);
+        tr_variantListRemove(files, 0);
+        tr_variantListAddStr(files, long_str);
+        tr_variantDictAddReal(top, TR_KEY_comment, 0.5);
+    };
+
+    auto heap = tr_variant{};
+    tr_variantInitDict(&heap, 0);
+    build(&heap);
+
+    auto arena = tr_variant{};
+    tr_variantInitArenaDict(&arena, 0);
+    build(&arena);
+
+    EXPECT_EQ(tr_variantToStr(&heap, TR_VARIANT_FMT_BENC), tr_variantToStr(&arena, TR_VARIANT_FMT_BENC));
+
+    tr_variantClear(&arena);
+    EXPECT_TRUE(tr_variantIsEmpty(&arena));
+    tr_variantClear(&heap);
+}
+
+TEST_F(VariantTest, arenaParse)
+{
+    static auto constexpr Inputs = std::array<std::pair<std::string_view, int>, 4>{ {
+        { "d4:name30:this string is long enough to..4:listli1ei2e3:abcee"sv, TR_VARIANT_PARSE_BENC },
+        { "i42e"sv, TR_VARIANT_PARSE_BENC },
+        { R"({"name":"this string is long enough to..","list":[1,2,"abc",{"a\nb":[]}]})"sv, TR_VARIANT_PARSE_JSON },
+        { R"("a string that's long enough to need storage")"sv, TR_VARIANT_PARSE_JSON },
+    } };
+
+    for (auto const& [input, fmt] : Inputs)
+    {
+        for (auto const opts : { fmt, fmt | TR_VARIANT_PARSE_INPLACE })
+        {
+            auto heap = tr_variant{};
+            EXPECT_TRUE(tr_variantFromBuf(&heap, opts, input));
+
+            auto arena = tr_variant{};
+            EXPECT_TRUE(tr_variantFromBuf(&arena, opts | TR_VARIANT_PARSE_ARENA, input));
+            EXPECT_EQ(tr_variantToStr(&heap, TR_VARIANT_FMT_BENC), tr_variantToStr(&arena, TR_VARIANT_FMT_BENC));
+
+            tr_variantClear(&arena);
+            tr_variantClear(&heap);
+        }
+    }
+
+    // a failed parse frees whatever it built
+    auto top = tr_variant{};
+    EXPECT_FALSE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_ARENA, R"({"a":["b",)"sv));
+    EXPECT_TRUE(tr_variantIsEmpty(&top));
+    EXPECT_FALSE(tr_variantFromBuf(&top, TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_ARENA, "d1:ali1e"sv));
+    EXPECT_TRUE(tr_variantIsEmpty(&top));
+}
+
+TEST_F(VariantTest, arenaHandoff)
+{
+    auto const long_str = std::string(100, 'x');
+
+    auto original = tr_variant{};
+    tr_variantInitArenaDict(&original, 1);
+    tr_variantDictAddStr(&original, TR_KEY_name, long_str);
+
+    // copying the root and then re-initializing it hands off the tree
+    auto copy = original;
+    tr_variantInitBool(&original, false);
+    tr_variantClear(&original);
+
+    auto sv = std::string_view{};
+    EXPECT_TRUE(tr_variantDictFindStrView(&copy, TR_KEY_name, &sv));
+    EXPECT_EQ(long_str, sv);
+    tr_variantClear(&copy);
+}
+
+TEST_F(VariantTest, arenaSteal)
+{
+    auto const long_str = std::string(100, 'x');
+
+    // steal a heap value into an arena tree
+    auto heap_value = tr_variant{};
+    tr_variantInitList(&heap_value, 1);
+    tr_variantListAddStr(&heap_value, long_str);
+
+    auto arena = tr_variant{};
+    tr_variantInitArenaDict(&arena, 1);
+    tr_variantDictSteal(&arena, TR_KEY_files, &heap_value);
+    tr_variantClear(&heap_value);
+
+    // steal an arena tree into a heap tree
+    auto heap = tr_variant{};
+    tr_variantInitDict(&heap, 1);
+    tr_variantDictSteal(&heap, TR_KEY_info, &arena);
+    tr_variantClear(&arena);
+
+    auto* info = static_cast<tr_variant*>(nullptr);
+    EXPECT_TRUE(tr_variantDictFindDict(&heap, TR_KEY_info, &info));
+    auto* files = static_cast<tr_variant*>(nullptr);
+    EXPECT_TRUE(tr_variantDictFindList(info, TR_KEY_files, &files));
+    auto sv = std::string_view{};
+    EXPECT_TRUE(tr_variantGetStrView(tr_variantListChild(files, 0), &sv));
+    EXPECT_EQ(long_str, sv);
+    tr_variantClear(&heap);
+}
@@ -0,0 +1,107 @@
+// This file Copyright (C) 2023 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <array>
+#include <cstddef> // size_t
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <libtransmission/transmission.h>
+
+#include <libtransmission/file.h>
+#include <libtransmission/quark.h>
+#include <libtransmission/torrent.h>
+#include <libtransmission/variant.h>
+
+#include "gtest/gtest.h"
+#include "test-fixtures.h"
+
+namespace libtransmission::test
+{
+
+class VerifyTest : public SessionTest
+{
+protected:
+    void setVerifyThreads(size_t n_threads)
+    {
+        auto settings = tr_variant{};
+        tr_variantInitDict(&settings, 0);
+        tr_sessionGetSettings(session_, &settings);
+        tr_variantDictAddInt(&settings, TR_KEY_verify_threads, n_threads);
+        tr_sessionSet(session_, &settings);
+        tr_variantClear(&settings);
+    }
+
+    // corrupt the byte at `offset` in the torrent and return its piece
+    static tr_piece_index_t corruptByte(tr_torrent const* tor, uint64_t offset)
+    {
+        auto const loc = tor->byte_loc(offset);
+        auto const [file, file_offset] = tor->file_offset(loc);
+        auto const filename = tr_torrentFindFile(tor, file);
+        auto const fd = tr_sys_file_open(filename.c_str(), TR_SYS_FILE_WRITE, 0);
+        EXPECT_NE(TR_BAD_SYS_FILE, fd);
+        auto constexpr Ch = '\1';
+        EXPECT_TRUE(tr_sys_file_write_at(fd, &Ch, 1, file_offset, nullptr));
+        tr_sys_file_close(fd);
+        return loc.piece;
+    }
+
+    [[nodiscard]] static std::vector<bool> havePieces(tr_torrent const* tor)
+    {
+        auto ret = std::vector<bool>{};
+        ret.reserve(tor->piece_count());
+        for (tr_piece_index_t piece = 0, n = tor->piece_count(); piece < n; ++piece)
+        {
+            ret.push_back(tor->has_piece(piece));
+        }
+        return ret;
+    }
+};
+
+TEST_F(VerifyTest, findsCorruptedPieces)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    blockingTorrentVerify(tor);
+    EXPECT_EQ(0, tr_torrentStat(tor)->leftUntilDone);
+
+    // corrupt a piece in the middle of a file, the pieces on either
+    // side of the first file boundary, and the last piece, which spans
+    // the last two files
+    auto const file_size = uint64_t{ tor->file_size(0) };
+    auto const offsets = std::array<uint64_t, 4>{
+        tor->piece_size() * 3U + 7U,
+        file_size - 1U,
+        file_size,
+        tor->total_size() - 1U,
+    };
+    auto const n_pieces = tor->piece_count();
+    auto expected = std::vector<bool>(n_pieces, true);
+    for (auto const offset : offsets)
+    {
+        expected[corruptByte(tor, offset)] = false;
+    }
+    ASSERT_FALSE(expected[3]);
+    ASSERT_FALSE(expected[n_pieces - 1U]);
+    ASSERT_TRUE(expected[0]);
+    ASSERT_TRUE(expected[4]);
+
+    // every number of threads finds exactly the corrupted pieces
+    for (auto const n_threads : { 1U, 2U, 4U })
+    {
+        setVerifyThreads(n_threads);
+        blockingTorrentVerify(tor);
+        EXPECT_EQ(expected, havePieces(tor)) << n_threads << " threads";
+        for (tr_piece_index_t piece = 0; piece < n_pieces; ++piece)
+        {
+            EXPECT_TRUE(tor->is_piece_checked(piece)) << n_threads << " threads, piece " << piece;
+        }
+    }
+
+    // cleanup
+    tr_torrentRemove(tor, true, nullptr, nullptr);
+}
+
+} // namespace libtransmission::test